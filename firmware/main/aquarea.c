@@ -13,14 +13,117 @@
  * for more details.
  * This program is distributed WITHOUT ANY WARRANTY.
  */
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include "aquarea.h"
 #include "aquarea_ll.h"
+#include "aquarea_state.h"
+#include "bridge.h"
+#include "control.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "history.h"
+#include "live.h"
+#include "mem.h"
+#include "metrics.h"
+#include "os.h"
+#include "publish.h"
+#include "rules.h"
+#include "snapshot.h"
+#include "stream.h"
+#include "tasks.h"
 
+static void aquarea_send_command(void);
 static void aquarea_send_query(void);
+static void aquarea_alarm(struct rules *r, const struct rule *rule,
+                          int32_t value, uint32_t time);
+static void aquarea_regulate(uint32_t uptime);
+static void aquarea_task(void *arg);
+static uint32_t warm_check(void);
+static void warm_restore(void);
+static void warm_save(void);
 
-static time_t tm_ref;
+static uint32_t   tm_poll;     /* Time of the next request             */
+static uint32_t   poll_period; /* Current period of requests           */
+static int        answered;    /* A frame has been received since the  */
+                               /* last request                         */
+static uint32_t   tm_req;      /* Time of the last request             */
+static int        pm_held;     /* Power lock is held (response pending)*/
+static os_pm_lock_t pm_lock;
+static os_queue_t cmd_queue;
+static os_mutex_t cmd_lock;    /* Commands of a list are queued together */
+static os_queue_t param_queue;
+static struct aquarea_state state;
+static struct metrics metrics;
+static struct rules   rules;
+static struct control control;
+/* Copy of the last state, for other tasks (protected by a sequence lock) */
+static struct aquarea_state state_pub;
+static volatile uint32_t    state_lock;
+/* Storage of queues and request frame, no heap is used after init */
+static struct os_queue_static ready_qs, cmd_qs, param_qs;
+static uint8_t ready_buf[sizeof(int)];
+static uint8_t cmd_buf[AQUAREA_CMD_COUNT * sizeof(struct aquarea_cmd)];
+static uint8_t param_buf[sizeof(struct control_param)];
+static uint8_t tx_buf[260];
+
+#define LINK_STATIC (sizeof(ready_qs) + sizeof(cmd_qs) + sizeof(param_qs) + \
+                     sizeof(ready_buf) + sizeof(cmd_buf) + sizeof(param_buf) + \
+                     sizeof(tx_buf))
+#define STATE_STATIC (sizeof(state) + sizeof(state_pub) + sizeof(metrics) + \
+                      sizeof(rules) + sizeof(control))
+_Static_assert(LINK_STATIC <= MEM_BUDGET_LINK, "aquarea link over memory budget");
+_Static_assert(STATE_STATIC <= MEM_BUDGET_STATE, "aquarea state over memory budget");
+
+#define AQUAREA_WARM_MAGIC 0x41515731 /* "AQW1" */
+
+/**
+ * @brief Last state and energy counters, kept across a reset
+ *
+ * This structure is stored into RTC slow memory, not initialized on boot :
+ * content is preserved on software reset, watchdog or brownout, but random
+ * after power on (detected using magic and check values).
+ */
+struct aquarea_warm
+{
+	uint32_t magic;
+	struct aquarea_state state;
+	uint64_t joule_prod;
+	uint64_t joule_cons;
+	struct control_param control;
+	uint32_t check;
+};
+static RTC_NOINIT_ATTR struct aquarea_warm warm;
+
+/**
+ * @brief Start the task that handles Aquarea
+ *
+ * The task is pinned to the link core and the module is initialized from
+ * this task, so the UART interrupt is allocated on the same core. This
+ * function returns when init is done.
+ *
+ * @return integer Zero is returned on success, -1 on error
+ */
+int aquarea_start(void)
+{
+	os_queue_t ready;
+	int dummy;
+
+	ready = os_queue_create_static(1, sizeof(int), &ready_qs, ready_buf);
+	if (ready == NULL)
+		return(-1);
+	if (os_task_create(aquarea_task, "aquarea", AQUAREA_TASK_STACK, ready,
+	                   TASK_PRIO_AQUAREA, TASK_CORE_LINK))
+	{
+		printf("AQUAREA: Failed to start task\n");
+		return(-1);
+	}
+	/* Wait the end of init */
+	os_queue_recv(ready, &dummy, OS_FOREVER);
+	return(0);
+}
 
 /**
  * @brief Initialize the Aquarea module
@@ -33,33 +136,118 @@ void aquarea_init(void)
 	/* Call sublayer for low-level inits */
 	aquarea_ll_init();
 
-	/* Get the current time (will be used to compute delay) */
-	time(&tm_ref);
+	memset(&state, 0, sizeof(struct aquarea_state));
+	memset(&state_pub, 0, sizeof(struct aquarea_state));
+	state_lock = 0;
+	cmd_queue = os_queue_create_static(AQUAREA_CMD_COUNT,
+	                                   sizeof(struct aquarea_cmd),
+	                                   &cmd_qs, cmd_buf);
+	if (cmd_lock == NULL)
+		cmd_lock = os_mutex_create();
+	metrics_init(&metrics);
+	rules_init(&rules, aquarea_alarm);
+	rules_load(&rules, RULES_DEFAULT);
+	control_init(&control);
+	control_load(&control.param, CONTROL_DEFAULT);
+	param_queue = os_queue_create_static(1, sizeof(struct control_param),
+	                                     &param_qs, param_buf);
+	snapshot_init();
+	live_init();
+
+	/* Last known state available before first frame, for other modules */
+	warm_restore();
+
+	/* First request immediately, the link does not depend on network */
+	poll_period = AQUAREA_POLL_PERIOD;
+	tm_poll = os_time_ms();
+	answered = 1;
+
+	/* NULL if power management is not available, lock does nothing */
+	pm_lock = os_pm_lock_create("aquarea");
+	pm_held = 0;
+
+	mem_account("ll",    aquarea_ll_mem(), MEM_BUDGET_LL);
+	mem_account("link",  LINK_STATIC,      MEM_BUDGET_LINK);
+	mem_account("state", STATE_STATIC,     MEM_BUDGET_STATE);
 }
 
 /**
  * @brief Do priodic tasks to cntrol and handle Aquarea
  *
  * This function must be called periodically to process Aquarea events.
+ * Between two exchanges, nothing happens on the link (the heatpump only
+ * speaks when asked) : the returned delay allows the caller to sleep until
+ * the next request.
+ *
+ * @return uint32 Delay before the next call (ms), zero to be called again
+ *                on next tick (exchange in progress)
  */
-void aquarea_process(void)
+uint32_t aquarea_process(void)
 {
-	time_t  tm_now;
+	struct control_param param;
+	uint32_t now;
+
+	/* New control parameters, used from next state */
+	if (os_queue_recv(param_queue, &param, 0) == 0)
+		control_set(&control, &param);
 
 	aquarea_ll_process();
 
-	/* If 5 sec elapsed since last query, query again */
-	time(&tm_now);
-	if ((tm_now - tm_ref) > 5)
+	/* Monotonic clock, not affected by NTP updates */
+	now = os_time_ms();
+
+	/* Response received, or no response : light sleep allowed again */
+	if (pm_held && (answered || ((now - tm_req) >= AQUAREA_RSP_TIMEOUT)))
 	{
-		aquarea_send_query();
-		/* Save a new time ref */
-		tm_ref = tm_now;
+		os_pm_release(pm_lock);
+		pm_held = 0;
+	}
+
+	if ((int32_t)(now - tm_poll) < 0)
+		goto wait;
+
+	/* No response to the previous request (heatpump off or disconnected)
+	 * slow down, up to AQUAREA_POLL_MAX */
+	if (answered)
+		poll_period = AQUAREA_POLL_PERIOD;
+	else if (poll_period < (AQUAREA_POLL_MAX / 2))
+		poll_period *= 2;
+	else
+		poll_period = AQUAREA_POLL_MAX;
+	answered = 0;
+
+	/* UART bytes are lost during light sleep, stay awake until response */
+	if ( ! pm_held)
+	{
+		os_pm_acquire(pm_lock);
+		pm_held = 1;
 	}
+	tm_req = now;
+
+	/* A frame injected by a remote tool, or a set command, replaces the
+	 * query : only one request is pending on the link */
+	if (bridge_inject(tx_buf))
+		aquarea_ll_send(tx_buf);
+	else if (os_queue_count(cmd_queue))
+		aquarea_send_command();
+	else
+		aquarea_send_query();
+
+	/* Next request is scheduled from this one, so a late call does not
+	 * shift the cadence. After a long stall, restart from now (no burst) */
+	tm_poll += poll_period;
+	if ((int32_t)(now - tm_poll) >= 0)
+		tm_poll = now + poll_period;
+
+wait:
+	if (pm_held)
+		return(0);
+	return(tm_poll - now);
 }
 
 void aquarea_rx(uint8_t *packet, size_t len)
 {
+	uint32_t uptime;
 	int i;
 	printf("AQUAREA: Received packet :\n");
 	for (i = 0; i < len; i++)
@@ -69,29 +257,327 @@ void aquarea_rx(uint8_t *packet, size_t len)
 			printf("\n");
 	}
 	printf("\n");
+	answered = 1;
+
+	/* Decode status packets, compute metrics, save into history and publish */
+	if (aquarea_state_decode(&state, packet, len) == 0)
+	{
+		state.time = time(NULL);
+		/* Wall clock jumps when set (SNTP), delays use time since boot */
+		uptime = (uint32_t)(esp_timer_get_time() / 1000000);
+		metrics_update(&metrics, &state);
+		rules_update(&rules, &state, uptime);
+		aquarea_regulate(uptime);
+		warm_save();
+		snapshot_update(&state);
+		history_push(&state);
+		publish_push(&state);
+		live_push(&state);
+		stream_push(&state);
+
+		/* Odd sequence while the copy is updated */
+		state_lock++;
+		__sync_synchronize();
+		memcpy(&state_pub, &state, sizeof(struct aquarea_state));
+		__sync_synchronize();
+		state_lock++;
+	}
+}
+
+/**
+ * @brief Get a copy of the last decoded state
+ *
+ * This function can be called from any task. It never blocks the task that
+ * receive packets : if the state is modified during the copy, the copy is
+ * made again.
+ *
+ * @param copy Pointer to a structure where the state is copied
+ */
+void aquarea_get_state(struct aquarea_state *copy)
+{
+	uint32_t seq;
+
+	while(1)
+	{
+		seq = state_lock;
+		__sync_synchronize();
+		if ((seq & 1) == 0)
+		{
+			memcpy(copy, &state_pub, sizeof(struct aquarea_state));
+			__sync_synchronize();
+			if (seq == state_lock)
+				break;
+		}
+	}
+}
+
+/**
+ * @brief Request a modification of a setting
+ *
+ * This function can be called from any task, it never waits. The command is
+ * sent in place of the next status query, so writes never add transactions
+ * on the serial link. Commands pending at the same time are sent into the
+ * same packet.
+ *
+ * @param field Identifier of the field (see aquarea_field)
+ * @param value New value of the field
+ * @return integer Zero on success, -1 if field is not writable or value out
+ *                 of range, -2 if too many commands are pending
+ */
+int aquarea_set(int field, int32_t value)
+{
+	struct aquarea_cmd cmd;
+
+	cmd.field = field;
+	cmd.value = value;
+	return(aquarea_set_list(&cmd, 1));
+}
+
+/**
+ * @brief Request the modification of many settings at once
+ *
+ * Like aquarea_set(), this function never waits. Commands are queued all
+ * together or not at all, so the heatpump never receives only a part of
+ * the list.
+ *
+ * @param list  Pointer to an array of commands
+ * @param count Number of commands into the array
+ * @return integer Zero on success, -1 if a field is not writable or a value
+ *                 out of range, -2 if there is no room for all commands
+ */
+int aquarea_set_list(const struct aquarea_cmd *list, int count)
+{
+	int i, result = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		if (aquarea_state_encode(NULL, list[i].field, list[i].value) != 0)
+			return(-1);
+	}
+
+	/* Aquarea task only removes commands, room can't shrink once checked */
+	os_mutex_lock(cmd_lock);
+	if ((AQUAREA_CMD_COUNT - (int)os_queue_count(cmd_queue)) < count)
+		result = -2;
+	for (i = 0; (i < count) && (result == 0); i++)
+		os_queue_send(cmd_queue, &list[i], 0);
+	os_mutex_unlock(cmd_lock);
+
+	return(result);
+}
+
+/**
+ * @brief Load new parameters of the heating control
+ *
+ * This function can be called from any task (parameters are pushed by the
+ * cloud) and never waits. Parameters are parsed by the caller, then used by
+ * the Aquarea task for the next state : when new parameters arrive before,
+ * the pending ones are replaced (only the last message is used).
+ *
+ * @param text Parameters (see control.c for syntax)
+ * @return integer Zero on success, -1 if parameters are invalid
+ */
+int aquarea_control(const char *text)
+{
+	struct control_param param;
+
+	if (control_load(&param, text) != 0)
+		return(-1);
+	os_queue_overwrite(param_queue, &param);
+	return(0);
+}
+
+/**
+ * @brief Get the alarm rules, for export
+ *
+ * Rules are not modified after init, only the bitmap of active alarms
+ * changes (one word, can be read from any task).
+ *
+ * @return struct Pointer to the rules context
+ */
+const struct rules *aquarea_rules(void)
+{
+	return(&rules);
 }
 
 /* -------------------------------------------------------------------------- */
 /* --                          Internal functions                          -- */
 /* -------------------------------------------------------------------------- */
 
+/**
+ * @brief Called by rules engine when an alarm is raised or cleared
+ *
+ * @param r     Pointer to the rules context
+ * @param rule  Pointer to the rule that changed
+ * @param value Value of the field
+ * @param time  Timestamp of the state
+ */
+static void aquarea_alarm(struct rules *r, const struct rule *rule,
+                          int32_t value, uint32_t time)
+{
+	printf("AQUAREA: Alarm %s %s (%s = %d)\n", rule->name,
+	       rule->active ? "raised" : "cleared",
+	       aquarea_state_name(rule->field), (int)value);
+	publish_alarm(rule->name, rule->active, value, time);
+}
+
+/**
+ * @brief Compute the heating setpoint, and send it if needed
+ *
+ * The command is sent in place of the next query : the setpoint follows the
+ * state after one poll period, without network.
+ *
+ * @param uptime Time since boot (sec.)
+ */
+static void aquarea_regulate(uint32_t uptime)
+{
+	struct metrics_agg agg;
+	struct tm tm;
+	time_t  t;
+	int32_t outside, sp;
+	int     minute = -1;
+
+	/* Outside temperature averaged over 15 minutes, less sensitive to
+	 * sun and wind */
+	outside = state.value[AQ_OUTSIDE_TEMP];
+	if ((metrics_window(&metrics, AQ_OUTSIDE_TEMP, METRICS_15M, &agg) == 0) &&
+	    agg.count)
+		outside = agg.avg;
+	/* Schedule is used only when the clock is set */
+	if (state.time >= CONTROL_CLOCK_VALID)
+	{
+		t = state.time;
+		localtime_r(&t, &tm);
+		minute = (tm.tm_hour * 60) + tm.tm_min;
+	}
+
+	sp = control_update(&control, outside, state.value[AQ_Z1_HEAT_REQUEST],
+	                    uptime, minute);
+	if (sp == CONTROL_NONE)
+		return;
+	printf("AQUAREA: Control, zone 1 request %d (outside %d)\n",
+	       (int)sp, (int)outside);
+	if (aquarea_set(AQ_Z1_HEAT_REQUEST, sp) != 0)
+		printf("AQUAREA: Failed to send setpoint\n");
+}
+
+/**
+ * @brief Send a packet with all pending set commands
+ *
+ */
+static void aquarea_send_command(void)
+{
+	uint8_t *req = tx_buf;
+	struct aquarea_cmd cmd;
+
+	/* Insert request header */
+	aquarea_state_request(req, AQUAREA_COMMAND);
+
+	while (os_queue_recv(cmd_queue, &cmd, 0) == 0)
+	{
+		printf("Send a set command (%s = %d)\r\n",
+		       aquarea_state_name(cmd.field), (int)cmd.value);
+		aquarea_state_encode(req, cmd.field, cmd.value);
+	}
+
+	aquarea_ll_send(req);
+}
+
 /**
  * @brief Send a packet to ask Aquarea for his status
  *
  */
 static void aquarea_send_query(void)
 {
-	uint8_t req[260];
+	uint8_t *req = tx_buf;
 
 	printf("Send a query packet ...\r\n");
 
-	memset(req, 0, 260);
 	/* Insert request header */
-	req[0] = 0x71;
-	req[1] = 108;  // Payload length
-	req[2] = 0x01;
-	req[3] = 0x10;
+	aquarea_state_request(req, AQUAREA_QUERY);
 
 	aquarea_ll_send(req);
 }
+
+/**
+ * @brief Compute the check value of the warm state (FNV-1a)
+ *
+ * @return uint32 Hash of the warm state, magic included
+ */
+static uint32_t warm_check(void)
+{
+	const uint8_t *p = (const uint8_t *)&warm;
+	uint32_t hash = 0x811C9DC5;
+	size_t i;
+
+	for (i = 0; i < offsetof(struct aquarea_warm, check); i++)
+		hash = (hash ^ p[i]) * 0x01000193;
+	return(hash);
+}
+
+/**
+ * @brief Restore the last state saved before a reset, if any
+ *
+ */
+static void warm_restore(void)
+{
+	if ((warm.magic != AQUAREA_WARM_MAGIC) || (warm.check != warm_check()))
+	{
+		printf("AQUAREA: Cold boot, no previous state\n");
+		return;
+	}
+	printf("AQUAREA: Warm boot, restore state %u (time %u)\n",
+	       (unsigned int)warm.state.seq, (unsigned int)warm.state.time);
+
+	memcpy(&state, &warm.state, sizeof(struct aquarea_state));
+	memcpy(&state_pub, &warm.state, sizeof(struct aquarea_state));
+	/* Counters continue, but the reset period is not integrated */
+	metrics.joule_prod = warm.joule_prod;
+	metrics.joule_cons = warm.joule_cons;
+	/* Last parameters pushed, control continues without network */
+	control_set(&control, &warm.control);
+	snapshot_update(&state);
+}
+
+/**
+ * @brief Save the current state and counters into RTC memory
+ *
+ */
+static void warm_save(void)
+{
+	warm.magic = AQUAREA_WARM_MAGIC;
+	memcpy(&warm.state, &state, sizeof(struct aquarea_state));
+	warm.joule_prod = metrics.joule_prod;
+	warm.joule_cons = metrics.joule_cons;
+	memcpy(&warm.control, &control.param, sizeof(struct control_param));
+	warm.check = warm_check();
+}
+
+/**
+ * @brief Main function of the Aquarea task
+ *
+ * @param arg Queue used to signal the end of init
+ */
+static void aquarea_task(void *arg)
+{
+	uint32_t delay;
+	int dummy = 0;
+
+	aquarea_init();
+	/* From here, the link runs without heap */
+	mem_seal();
+	os_queue_send((os_queue_t)arg, &dummy, 0);
+
+	while(1)
+	{
+		delay = aquarea_process();
+
+		/* Wait for the next tick during an exchange, else sleep until
+		 * the next request (commands are sent in place of a request) */
+		if (delay)
+			os_delay(delay);
+		else
+			os_yield();
+	}
+}
 /* EOF */
@@ -16,7 +16,31 @@
 #ifndef AQUAREA_H
 #define AQUAREA_H
 
+#include "aquarea_state.h"
+#include "rules.h"
+
+#define AQUAREA_CMD_COUNT      8 /* Max number of pending set commands  */
+#define AQUAREA_POLL_PERIOD 5000 /* Period of status queries (ms)       */
+#define AQUAREA_POLL_MAX   60000 /* Max period without response (ms)    */
+#define AQUAREA_RSP_TIMEOUT 2000 /* Max delay for a response (ms)       */
+#define AQUAREA_TASK_STACK  4096 /* Stack of the link task (bytes)      */
+
+/**
+ * @brief A pending set command
+ */
+struct aquarea_cmd
+{
+	int     field;
+	int32_t value;
+};
+
+int  aquarea_start(void);
 void aquarea_init(void);
-void aquarea_process(void);
+uint32_t aquarea_process(void);
+void aquarea_get_state(struct aquarea_state *copy);
+int  aquarea_set(int field, int32_t value);
+int  aquarea_set_list(const struct aquarea_cmd *list, int count);
+int  aquarea_control(const char *text);
+const struct rules *aquarea_rules(void);
 
 #endif
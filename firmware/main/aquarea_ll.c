@@ -18,7 +18,9 @@
 #include <string.h>
 #include "driver/uart.h"
 #include "esp_err.h"
+#include "esp_timer.h"
 #include "aquarea_ll.h"
+#include "mem.h"
 
 /* UART connected to Aquarea */
 #if (AQUAREA_UART == 2)
@@ -31,9 +33,35 @@
 #define UART_BUF  1024
 
 #define BUFFER_SIZE 258 /* Larger packet is 255 + 3 bytes */
+_Static_assert(BUFFER_SIZE >= (0xFF + 3), "rx buffer shorter than max packet");
 uint16_t buffer_w;
 uint8_t  buffer_rx[BUFFER_SIZE];
 
+/* Max delay (us) between two bytes of a packet, else packet is dropped */
+#define RESYNC_DELAY 100000
+/* Period (us) used to compute rates and load of the line */
+#define RATE_WINDOW 10000000
+
+const uint16_t aquarea_ll_lat_bounds[AQUAREA_LL_LAT_BUCKETS - 1] =
+	{ 250, 300, 400, 500, 750, 1000, 2000 };
+const uint16_t aquarea_ll_gap_bounds[AQUAREA_LL_GAP_BUCKETS - 1] =
+	{ 20, 50, 100, 200, 500, 1000, 5000 };
+
+static struct aquarea_ll_stats stats;
+static int64_t  tm_rx;   /* Time of the last received byte                */
+static int64_t  tm_tx;   /* Time of the last packet sent, 0 if no pending */
+static int64_t  tm_init; /* Time of init                                  */
+static int64_t  tm_end;  /* End of the last frame on the line, 0 if none  */
+static int64_t  tm_win;  /* Start of the current rate window              */
+static uint32_t win_rx;  /* Bytes received at start of the window         */
+static uint32_t win_tx;  /* Bytes sent at start of the window             */
+static aquarea_ll_tap_t tap;
+static aquarea_ll_raw_t raw;
+
+/* Static memory of the link layer, no heap is used after init */
+#define LL_STATIC (sizeof(buffer_rx) + sizeof(buffer_w) + sizeof(stats))
+_Static_assert(LL_STATIC <= MEM_BUDGET_LL, "aquarea_ll over memory budget");
+
 #ifdef AQUAREA_LOG
 unsigned int aquarea_ll_log = 0;
 #endif
@@ -44,6 +72,9 @@ void aquarea_rx(uint8_t *packet, size_t len);
 /* Internal functions */
 static uint8_t checksum(uint8_t *buffer, int len);
 static int checksum_verify(uint8_t *packet);
+static void latency(int64_t now);
+static void frame(int64_t start, int64_t end);
+static void window(int64_t now);
 
 /**
  * @brief Initialize the Aquarea low-level module
@@ -59,6 +90,16 @@ int aquarea_ll_init(void)
 #endif
 	buffer_w = 0;
 	memset(buffer_rx, 0, BUFFER_SIZE);
+	memset(&stats, 0, sizeof(struct aquarea_ll_stats));
+	tm_rx = 0;
+	tm_tx = 0;
+	tm_init = esp_timer_get_time();
+	tm_end = 0;
+	tm_win = tm_init;
+	win_rx = 0;
+	win_tx = 0;
+	tap = NULL;
+	raw = NULL;
 
 	uart_config_t uart_config = {
 		.baud_rate  = 9600,
@@ -66,7 +107,12 @@ int aquarea_ll_init(void)
 		.parity     = UART_PARITY_EVEN,
 		.stop_bits  = UART_STOP_BITS_1,
 		.flow_ctrl  = UART_HW_FLOWCTRL_DISABLE,
+#ifdef CONFIG_PM_ENABLE
+		/* APB clock changes with CPU frequency, REF_TICK does not */
+		.source_clk = UART_SCLK_REF_TICK,
+#else
 		.source_clk = UART_SCLK_APB,
+#endif
 	};
 
 	/* Initialize UART connected to Aquarea */
@@ -96,16 +142,33 @@ void aquarea_ll_process(void)
 {
 	uint8_t *pbuf;
 	size_t   avail_sz, pkt_sz, rem_sz, len;
+	int64_t  now;
 #ifdef AQUAREA_LOG
 	int i;
 #endif
 
+	now = esp_timer_get_time();
+	window(now);
+
 	/* Test is some data has been received from remote */
 	if (uart_get_buffered_data_len(AQUAREA_UART, &avail_sz) != ESP_OK)
 		goto err_uart;
 	/* No data received ? nothing more to do here ;) */
 	if (avail_sz <= 0)
+	{
+		/* Incomplete packet and no more data, drop it to resync */
+		if (buffer_w && ((now - tm_rx) > RESYNC_DELAY))
+		{
+			printf("AQUAREA: Drop incomplete packet (%d bytes)\n", buffer_w);
+			stats.rx_resync++;
+			if (tap)
+				tap(AQUAREA_LL_RX, AQUAREA_LL_PARTIAL, buffer_rx,
+				    buffer_w, tm_rx);
+			buffer_w = 0;
+		}
 		return;
+	}
+	tm_rx = now;
 
 #ifdef AQUAREA_LOG
 	if (aquarea_ll_log & (1 << 8))
@@ -125,6 +188,19 @@ void aquarea_ll_process(void)
 		{
 			/* Compute length of the full packet */
 			pkt_sz = ((uint8_t)buffer_rx[1] + 3);
+			/* Shorter than the header already read : not a packet,
+			 * drop it and resync on next bytes */
+			if (pkt_sz < buffer_w)
+			{
+				printf("AQUAREA: Drop packet with invalid length %d\n",
+				       buffer_rx[1]);
+				stats.rx_resync++;
+				if (tap)
+					tap(AQUAREA_LL_RX, AQUAREA_LL_PARTIAL, buffer_rx,
+					    buffer_w, now);
+				buffer_w = 0;
+				continue;
+			}
 			/* Number of remaining bytes to have the full packet */
 			rem_sz = pkt_sz - buffer_w;
 			/* If there is more than one packet into rx */
@@ -132,21 +208,13 @@ void aquarea_ll_process(void)
 				len = rem_sz;
 			else
 				len = avail_sz;
-
-			if (pkt_sz <= BUFFER_SIZE)
-				pbuf = (buffer_rx + buffer_w);
-			else
-			{
-				printf("AQUAREA: Error, packet larger than buffer (%d > %d)\n",
-				       (unsigned int)pkt_sz, BUFFER_SIZE);
-				pbuf = buffer_rx + 4;
-				if (len > (BUFFER_SIZE - 4))
-					len = (BUFFER_SIZE - 4);
-			}
+			pbuf = (buffer_rx + buffer_w);
 		}
 
 		/* Read received data ! */
 		len = uart_read_bytes(AQUAREA_UART, pbuf, len, 100);
+		if (raw && len)
+			raw(AQUAREA_LL_RX, pbuf, len, now);
 #ifdef AQUAREA_LOG
 		if (aquarea_ll_log & (2 << 8))
 		{
@@ -159,17 +227,33 @@ void aquarea_ll_process(void)
 		/* Update counters */
 		buffer_w += len;
 		avail_sz -= len;
+		stats.rx_bytes += len;
 
 		/* If all byets of the packet have been received :) */
 		if (buffer_w == pkt_sz)
 		{
+			/* Bytes of a packet are sent back to back, its start is
+			 * deduced from its end (more accurate than the first read) */
+			frame(now - ((int64_t)pkt_sz * AQUAREA_LL_BYTE_US), now);
 			if (checksum_verify(buffer_rx))
 			{
 				printf("Packet fully received\n");
+				stats.rx_ok++;
+				/* Boot to first frame, since start of the timer */
+				if (stats.rx_ok == 1)
+					stats.first_rx = (uint32_t)(now / 1000);
+				latency(now);
+				if (tap)
+					tap(AQUAREA_LL_RX, AQUAREA_LL_OK, buffer_rx, pkt_sz, now);
 				aquarea_rx(buffer_rx, pkt_sz);
 			}
 			else
+			{
 				printf("AQUAREA: Ignore invalid packet\n");
+				stats.rx_cksum++;
+				if (tap)
+					tap(AQUAREA_LL_RX, AQUAREA_LL_CKSUM, buffer_rx, pkt_sz, now);
+			}
 			buffer_w = 0;
 		}
 	}
@@ -189,7 +273,8 @@ err_uart:
  */
 int aquarea_ll_send(unsigned char *packet)
 {
-	size_t pkt_len;
+	size_t  pkt_len;
+	int64_t now;
 #ifdef AQUAREA_LOG
 	int i;
 #endif
@@ -202,6 +287,16 @@ int aquarea_ll_send(unsigned char *packet)
 
 	/* Send request to Aquarea */
 	uart_write_bytes(AQUAREA_UART, (const char *)packet, pkt_len);
+	stats.tx++;
+	stats.tx_bytes += pkt_len;
+	/* Save time, used to measure response latency (zero means none) */
+	now = esp_timer_get_time();
+	tm_tx = now ? now : 1;
+	frame(now, now + ((int64_t)pkt_len * AQUAREA_LL_BYTE_US));
+	if (raw)
+		raw(AQUAREA_LL_TX, packet, pkt_len, now);
+	if (tap)
+		tap(AQUAREA_LL_TX, AQUAREA_LL_OK, packet, pkt_len, now);
 
 #ifdef AQUAREA_LOG
 	printf("Send packet :\n");
@@ -218,10 +313,151 @@ int aquarea_ll_send(unsigned char *packet)
 	return(pkt_len);
 }
 
+/**
+ * @brief Get a copy of link counters
+ *
+ * Counters are updated by the task that process the link, this function can
+ * be called from any other task (each counter is read atomically). Busy
+ * time is computed from the number of bytes and the speed of the line.
+ *
+ * @param dst Pointer to a structure where counters are copied
+ */
+void aquarea_ll_stats(struct aquarea_ll_stats *dst)
+{
+	memcpy(dst, &stats, sizeof(struct aquarea_ll_stats));
+	dst->rx_busy = (uint32_t)(((uint64_t)dst->rx_bytes * AQUAREA_LL_BYTE_US) / 1000);
+	dst->tx_busy = (uint32_t)(((uint64_t)dst->tx_bytes * AQUAREA_LL_BYTE_US) / 1000);
+	dst->elapsed = (uint32_t)((esp_timer_get_time() - tm_init) / 1000);
+}
+
+/**
+ * @brief Get the size of static buffers of the link layer
+ *
+ * @return size Number of bytes
+ */
+size_t aquarea_ll_mem(void)
+{
+	return(LL_STATIC);
+}
+
+/**
+ * @brief Set a function called for each frame sent or received
+ *
+ * The tap is called into the context of the task that process the link, it
+ * must never wait. Only one tap can be set, NULL to remove it.
+ *
+ * @param fn Pointer to the tap function
+ */
+void aquarea_ll_set_tap(aquarea_ll_tap_t fn)
+{
+	tap = fn;
+}
+
+/**
+ * @brief Set a function called for each chunk of bytes read or written
+ *
+ * Unlike the tap, this function receives bytes as they are read from UART
+ * (used to capture the link). It must never wait. NULL to remove it.
+ *
+ * @param fn Pointer to the function
+ */
+void aquarea_ll_set_raw(aquarea_ll_raw_t fn)
+{
+	raw = fn;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --                          Internal functions                          -- */
 /* -------------------------------------------------------------------------- */
 
+/**
+ * @brief Insert response latency into histogram
+ *
+ * @param now Time of the response (us)
+ */
+static void latency(int64_t now)
+{
+	uint32_t ms;
+	int i;
+
+	/* No query pending (packet not solicited) */
+	if (tm_tx == 0)
+		return;
+
+	ms = (uint32_t)((now - tm_tx) / 1000);
+	tm_tx = 0;
+
+	for (i = 0; i < (AQUAREA_LL_LAT_BUCKETS - 1); i++)
+	{
+		if (ms <= aquarea_ll_lat_bounds[i])
+			break;
+	}
+	stats.lat_bucket[i]++;
+	stats.lat_sum += ms;
+	stats.lat_count++;
+}
+
+/**
+ * @brief Insert the idle time before a frame into histogram
+ *
+ * Times come from the monotonic timer. The end of a received frame is the
+ * time it has been read, so gaps before a response can be longer than on
+ * the line by up to one period of the link task.
+ *
+ * @param start Time of the first byte of the frame (us)
+ * @param end   Time of the end of the frame (us)
+ */
+static void frame(int64_t start, int64_t end)
+{
+	uint32_t ms;
+	int i;
+
+	/* First frame, or frames overlapping (both directions at once) */
+	if ((tm_end == 0) || (start < tm_end))
+	{
+		if (end > tm_end)
+			tm_end = end;
+		return;
+	}
+	ms = (uint32_t)((start - tm_end) / 1000);
+	tm_end = end;
+
+	for (i = 0; i < (AQUAREA_LL_GAP_BUCKETS - 1); i++)
+	{
+		if (ms <= aquarea_ll_gap_bounds[i])
+			break;
+	}
+	stats.gap_bucket[i]++;
+	stats.gap_sum += ms;
+	if ((stats.gap_count == 0) || (ms < stats.gap_min))
+		stats.gap_min = ms;
+	stats.gap_count++;
+}
+
+/**
+ * @brief Update rates and load of the line at the end of each window
+ *
+ * @param now Current time (us)
+ */
+static void window(int64_t now)
+{
+	uint64_t rx, tx, elapsed;
+
+	elapsed = (uint64_t)(now - tm_win);
+	if (elapsed < RATE_WINDOW)
+		return;
+
+	rx = stats.rx_bytes - win_rx;
+	tx = stats.tx_bytes - win_tx;
+	stats.rx_rate = (uint32_t)((rx * 1000000) / elapsed);
+	stats.tx_rate = (uint32_t)((tx * 1000000) / elapsed);
+	stats.load    = (uint32_t)(((rx + tx) * AQUAREA_LL_BYTE_US * 1000) / elapsed);
+
+	tm_win = now;
+	win_rx = stats.rx_bytes;
+	win_tx = stats.tx_bytes;
+}
+
 /**
  * @brief Compute the checksum of a buffer
  *
@@ -16,11 +16,91 @@
 #ifndef AQUAREA_LL_H
 #define AQUAREA_LL_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define AQUAREA_UART 2
 #define AQUAREA_LOG
 
+/* Number of buckets of the response latency histogram (last is +Inf) */
+#define AQUAREA_LL_LAT_BUCKETS 8
+/* Number of buckets of the idle gap histogram (last is +Inf) */
+#define AQUAREA_LL_GAP_BUCKETS 8
+/* Time of one byte on the line (us) : 11 bits at 9600 bauds (8E1) */
+#define AQUAREA_LL_BYTE_US  1146
+
+/**
+ * @brief Counters of the serial link
+ */
+struct aquarea_ll_stats
+{
+	uint32_t rx_ok;        /* Packets received with a valid checksum  */
+	uint32_t rx_cksum;     /* Packets dropped, invalid checksum       */
+	uint32_t rx_resync;    /* Partial packets dropped after a timeout */
+	uint32_t tx;           /* Packets sent                            */
+	uint32_t lat_count;    /* Number of latency measures              */
+	uint32_t lat_sum;      /* Sum of latencies (ms)                   */
+	uint32_t lat_bucket[AQUAREA_LL_LAT_BUCKETS];
+	uint32_t first_rx;     /* Time of the first valid packet (ms)     */
+	/* Usage of the line */
+	uint32_t rx_bytes;     /* Bytes received                          */
+	uint32_t tx_bytes;     /* Bytes sent                              */
+	uint32_t rx_busy;      /* Time the line was busy, RX (ms)         */
+	uint32_t tx_busy;      /* Time the line was busy, TX (ms)         */
+	uint32_t rx_rate;      /* Bytes/s received, last window           */
+	uint32_t tx_rate;      /* Bytes/s sent, last window               */
+	uint32_t load;         /* Busy time of last window (per mille)    */
+	uint32_t elapsed;      /* Time since init (ms)                    */
+	/* Idle time between the end of a frame and the start of the next */
+	uint32_t gap_count;    /* Number of gaps measured                 */
+	uint32_t gap_sum;      /* Sum of gaps (ms)                        */
+	uint32_t gap_min;      /* Shortest gap (ms)                       */
+	uint32_t gap_bucket[AQUAREA_LL_GAP_BUCKETS];
+};
+
+/* Upper bounds (ms) of the latency histogram buckets */
+extern const uint16_t aquarea_ll_lat_bounds[AQUAREA_LL_LAT_BUCKETS - 1];
+/* Upper bounds (ms) of the idle gap histogram buckets */
+extern const uint16_t aquarea_ll_gap_bounds[AQUAREA_LL_GAP_BUCKETS - 1];
+
+/* Direction of frames given to the tap */
+#define AQUAREA_LL_RX 0
+#define AQUAREA_LL_TX 1
+/* Status of frames given to the tap */
+#define AQUAREA_LL_OK       0 /* Valid frame                          */
+#define AQUAREA_LL_CKSUM    1 /* Invalid checksum                     */
+#define AQUAREA_LL_PARTIAL  3 /* Incomplete, dropped after a timeout  */
+/* Status 2 is unused : length is one byte, a packet always fits buffer */
+
+/**
+ * @brief Function called for each frame sent or received (see set_tap)
+ *
+ * @param dir    Direction of the frame (AQUAREA_LL_RX or AQUAREA_LL_TX)
+ * @param status Status of the frame (AQUAREA_LL_OK, ...)
+ * @param data   Pointer to the frame bytes
+ * @param len    Number of bytes
+ * @param time   Time of the frame (us since boot)
+ */
+typedef void (*aquarea_ll_tap_t)(int dir, int status, const uint8_t *data,
+                                 size_t len, int64_t time);
+
+/**
+ * @brief Function called for each chunk of bytes read or written on UART
+ *
+ * @param dir  Direction (AQUAREA_LL_RX or AQUAREA_LL_TX)
+ * @param data Pointer to the bytes
+ * @param len  Number of bytes
+ * @param time Time of the chunk (us since boot)
+ */
+typedef void (*aquarea_ll_raw_t)(int dir, const uint8_t *data, size_t len,
+                                 int64_t time);
+
 int  aquarea_ll_init(void);
 void aquarea_ll_process(void);
 int  aquarea_ll_send(unsigned char *packet);
+void aquarea_ll_stats(struct aquarea_ll_stats *stats);
+size_t aquarea_ll_mem(void);
+void aquarea_ll_set_tap(aquarea_ll_tap_t tap);
+void aquarea_ll_set_raw(aquarea_ll_raw_t raw);
 
 #endif
@@ -0,0 +1,103 @@
+/**
+ * @file  main/aquarea_proto.h
+ * @brief Description of the Aquarea protocol (frames and fields)
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Fields
+ * This file is the only description of the fields : the enum of
+ * identifiers, the decoder, the names (JSON, CSV, metrics), the Modbus
+ * registers (index of the field) and the publish policy are all made from
+ * the AQUAREA_FIELDS list at compile time. Each line is :
+ *   X(id, name, offset, type, deadband, interval)
+ *     - id       : suffix of the identifier (AQ_<id>)
+ *     - name     : name used into outputs
+ *     - offset   : position of the first byte into a status packet
+ *     - type     : encoding of the value (see aquarea_state.c)
+ *     - deadband : minimum change published (see fwdq.c)
+ *     - interval : minimum delay between two publish (sec.)
+ * The order of the lines is the order of the Modbus registers, new fields
+ * must be added at the end.
+ */
+#ifndef AQUAREA_PROTO_H
+#define AQUAREA_PROTO_H
+
+/* Header of the packets */
+#define AQUAREA_QUERY       0x71 /* Status query, and status answer       */
+#define AQUAREA_COMMAND     0xF1 /* Set command                           */
+#define AQUAREA_PAYLOAD_LEN  108 /* Length of query and command payload   */
+#define AQUAREA_REQUEST_LEN (AQUAREA_PAYLOAD_LEN + 3)
+
+/* Length of a status packet sent by Aquarea (answer to a 0x71 query) */
+#define AQUAREA_STATUS_LEN 203
+
+#define AQUAREA_FIELDS(X) \
+	/* Heatpump on (1) or off (0)         */ \
+	X(HP_STATE,        heatpump_state,    4, BIT78,      0,   0) \
+	/* Water flow (1/100 l/min)           */ \
+	X(PUMP_FLOW,       pump_flow,       169, FLOW,      50,  30) \
+	/* Force DHW state                    */ \
+	X(FORCE_DHW,       force_dhw,         4, BIT12,      0,   0) \
+	/* Operating mode (raw value)         */ \
+	X(OPERATING_MODE,  operating_mode,    6, RAW,        0,   0) \
+	/* Main inlet water temperature (°C)  */ \
+	X(INLET_TEMP,      inlet_temp,      143, MINUS128,   1,  30) \
+	/* Main outlet water temperature (°C) */ \
+	X(OUTLET_TEMP,     outlet_temp,     144, MINUS128,   1,  30) \
+	/* Main target temperature (°C)       */ \
+	X(TARGET_TEMP,     target_temp,     153, MINUS128,   0,   0) \
+	/* Compressor frequency (Hz)          */ \
+	X(COMPRESSOR_FREQ, compressor_freq, 166, MINUS1,     2,  30) \
+	/* DHW target temperature (°C)        */ \
+	X(DHW_TARGET_TEMP, dhw_target_temp,  42, MINUS128,   0,   0) \
+	/* DHW temperature (°C)               */ \
+	X(DHW_TEMP,        dhw_temp,        141, MINUS128,   1,  60) \
+	/* Outside temperature (°C)           */ \
+	X(OUTSIDE_TEMP,    outside_temp,    142, MINUS128,   1, 300) \
+	/* Zone 1 water temperature (°C)      */ \
+	X(Z1_WATER_TEMP,   z1_water_temp,   145, MINUS128,   1,  30) \
+	/* Heat power produced (W)            */ \
+	X(HEAT_POWER_PROD, heat_power_prod, 194, POWER,    200,  30) \
+	/* Heat power consumed (W)            */ \
+	X(HEAT_POWER_CONS, heat_power_cons, 193, POWER,    200,  30) \
+	/* DHW power produced (W)             */ \
+	X(DHW_POWER_PROD,  dhw_power_prod,  198, POWER,    200,  30) \
+	/* DHW power consumed (W)             */ \
+	X(DHW_POWER_CONS,  dhw_power_cons,  197, POWER,    200,  30) \
+	/* Defrosting state                   */ \
+	X(DEFROST,         defrost,         111, BIT56,      0,   0) \
+	/* Quiet mode level                   */ \
+	X(QUIET_MODE,      quiet_mode,        7, QUIET,      0,   0) \
+	/* Error code (type << 8 | number)    */ \
+	X(ERROR,           error,           113, ERROR,      0,   0) \
+	/* Derived values, computed by metrics module */ \
+	/* Power produced, heat + DHW (W)     */ \
+	X(POWER_PROD,      power_prod,        0, DERIVED,  200,  30) \
+	/* Power consumed, heat + DHW (W)     */ \
+	X(POWER_CONS,      power_cons,        0, DERIVED,  200,  30) \
+	/* Coefficient of performance (x100)  */ \
+	X(COP,             cop,               0, DERIVED,   20,  60) \
+	/* Energy produced since power-up (Wh)*/ \
+	X(ENERGY_PROD,     energy_prod,       0, DERIVED,  100,  60) \
+	/* Energy consumed since power-up (Wh)*/ \
+	X(ENERGY_CONS,     energy_cons,       0, DERIVED,  100,  60) \
+	/* COP of the last minute (x100)      */ \
+	X(COP_1M,          cop_1m,            0, DERIVED,   20,  60) \
+	/* COP of the last 15 minutes (x100)  */ \
+	X(COP_15M,         cop_15m,           0, DERIVED,   10, 300) \
+	/* COP of the last hour (x100)        */ \
+	X(COP_1H,          cop_1h,            0, DERIVED,   10, 300) \
+	/* Fields added later, at end to keep Modbus addresses */ \
+	/* Zone 1 water temperature request   */ \
+	X(Z1_HEAT_REQUEST, z1_heat_request,  38, MINUS128,   0,   0)
+
+#endif
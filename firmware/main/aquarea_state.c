@@ -0,0 +1,353 @@
+/**
+ * @file  main/aquarea_state.c
+ * @brief Decode status packets received from Aquarea
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdint.h>
+#include <string.h>
+#include "aquarea_state.h"
+
+/* Types of encoding used into status packet */
+#define T_RAW      0 /* Raw byte value                        */
+#define T_MINUS1   1 /* Byte value minus one                  */
+#define T_MINUS128 2 /* Byte value minus 128 (temperatures)   */
+#define T_BIT12    3 /* Bits 7-6 minus one                    */
+#define T_BIT56    4 /* Bits 3-2 minus one                    */
+#define T_BIT78    5 /* Bits 1-0 minus one                    */
+#define T_QUIET    6 /* Bits 5-3 minus one                    */
+#define T_POWER    7 /* Byte value minus one, unit of 200W    */
+#define T_FLOW     8 /* Two bytes flow encoding               */
+#define T_ERROR    9 /* Two bytes error encoding              */
+#define T_DERIVED 10 /* Not into packet, see metrics.c       */
+
+/* Extract a value from the bytes of a field, for each type */
+#define GET_RAW(p)      ((int32_t)(p)[0])
+#define GET_MINUS1(p)   ((int32_t)(p)[0] - 1)
+#define GET_MINUS128(p) ((int32_t)(p)[0] - 128)
+#define GET_BIT12(p)    ((((p)[0] >> 6) & 3) - 1)
+#define GET_BIT56(p)    ((((p)[0] >> 2) & 3) - 1)
+#define GET_BIT78(p)    (((p)[0] & 3) - 1)
+#define GET_QUIET(p)    ((((p)[0] >> 3) & 7) - 1)
+#define GET_POWER(p)    (((int32_t)(p)[0] - 1) * 200)
+#define GET_FLOW(p)     (((int32_t)(p)[1] * 100) + ((((int32_t)(p)[0] - 1) / 5) * 2))
+#define GET_ERROR(p)    (((int32_t)(p)[0] << 8) | (p)[1])
+#define GET_DERIVED(p)  0
+
+/* Settings area : fields stored before this offset are also used, with the
+ * same encoding, into set commands (0xF1 packets) */
+#define SETTINGS_END 110
+
+struct field_desc
+{
+	uint8_t offset;
+	uint8_t type;
+};
+
+static int32_t clamp(int32_t value, int32_t min, int32_t max);
+static uint8_t mask(uint8_t type);
+static int32_t unpack(const struct field_desc *desc, const uint8_t *packet);
+
+/* Two bytes fields must end before the checksum */
+#define FIELD_CHECK(id, name, offset, type, deadband, interval) \
+	_Static_assert((offset) + 1 < (AQUAREA_STATUS_LEN - 1), #name " out of packet");
+AQUAREA_FIELDS(FIELD_CHECK)
+#undef FIELD_CHECK
+
+#define FIELD_DESC(id, name, offset, type, deadband, interval) \
+	[AQ_##id] = { offset, T_##type },
+static const struct field_desc fields[AQ_FIELD_COUNT] =
+{
+	AQUAREA_FIELDS(FIELD_DESC)
+};
+#undef FIELD_DESC
+
+#define FIELD_NAME(id, name, offset, type, deadband, interval) \
+	[AQ_##id] = #name,
+static const char *const names[AQ_FIELD_COUNT] =
+{
+	AQUAREA_FIELDS(FIELD_NAME)
+};
+#undef FIELD_NAME
+
+/* Header of queries and commands, the first byte is the type */
+static const uint8_t request_header[4] =
+{
+	0x00, AQUAREA_PAYLOAD_LEN, 0x01, 0x10
+};
+
+/**
+ * @brief Decode a status packet
+ *
+ * This function extract all known fields from a status packet and update
+ * the specified state. The state is not modified if the packet is not a
+ * valid status packet. Derived fields are not modified (see metrics). The
+ * code of this function is made from the list of fields (aquarea_proto.h).
+ *
+ * @param state  Pointer to the state structure to update
+ * @param packet Pointer to a byte array with received packet
+ * @param len    Number of bytes into the packet
+ * @return integer Zero is returned on success, -1 if packet is not a status
+ */
+int aquarea_state_decode(struct aquarea_state *state, const uint8_t *packet, size_t len)
+{
+	if ((len < AQUAREA_STATUS_LEN) || (packet[0] != AQUAREA_QUERY))
+		return(-1);
+
+	/* One extraction per field, with constant offset and type */
+#define FIELD_DECODE(id, name, offset, type, deadband, interval) \
+	if (T_##type != T_DERIVED) \
+		state->value[AQ_##id] = GET_##type(&packet[offset]);
+	AQUAREA_FIELDS(FIELD_DECODE)
+#undef FIELD_DECODE
+	state->seq++;
+
+	return(0);
+}
+
+/**
+ * @brief Decode a set command packet
+ *
+ * Settings into a command use the same encoding as into status packets, a
+ * zero value means "no change". Only fields present into the command are
+ * updated. This is used by the heatpump simulator (see test/sim).
+ *
+ * @param state  Pointer to the state structure to update
+ * @param packet Pointer to a byte array with the command packet
+ * @param len    Number of bytes into the packet
+ * @return integer Number of fields updated, -1 if packet is not a command
+ */
+int aquarea_state_command(struct aquarea_state *state, const uint8_t *packet, size_t len)
+{
+	int count = 0;
+	int i;
+
+	if ((len < SETTINGS_END) || (packet[0] != AQUAREA_COMMAND))
+		return(-1);
+
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		if ( ! aquarea_state_writable(i))
+			continue;
+		if ((packet[fields[i].offset] & mask(fields[i].type)) == 0)
+			continue;
+		state->value[i] = unpack(&fields[i], packet);
+		count++;
+	}
+	return(count);
+}
+
+/**
+ * @brief Insert a value into a status packet
+ *
+ * This is the inverse of aquarea_state_decode, used to build status packets
+ * (heatpump simulator, tests). Values that can not be encoded are saturated
+ * and rounded like the heatpump does. Derived fields are ignored.
+ *
+ * @param packet Pointer to a status packet (AQUAREA_STATUS_LEN bytes)
+ * @param field  Identifier of the field (see aquarea_field)
+ * @param value  Value of the field
+ * @return integer Zero is returned on success, -1 if field is not into packet
+ */
+int aquarea_state_pack(uint8_t *packet, int field, int32_t value)
+{
+	const struct field_desc *desc;
+	uint8_t *p;
+	uint8_t v;
+
+	if ((field < 0) || (field >= AQ_FIELD_COUNT))
+		return(-1);
+	desc = &fields[field];
+	p = &packet[desc->offset];
+
+	switch(desc->type)
+	{
+		case T_MINUS1:   v = clamp(value + 1, 0, 255);   break;
+		case T_MINUS128: v = clamp(value + 128, 0, 255); break;
+		case T_BIT12:    v = clamp(value + 1, 0, 3) << 6; break;
+		case T_BIT56:    v = clamp(value + 1, 0, 3) << 2; break;
+		case T_BIT78:    v = clamp(value + 1, 0, 3);      break;
+		case T_QUIET:    v = clamp(value + 1, 0, 7) << 3; break;
+		case T_POWER:    v = clamp(((value + 100) / 200) + 1, 0, 255); break;
+		case T_FLOW:
+			value = clamp(value, 0, 25599);
+			p[1] = (value / 100);
+			p[0] = (((value % 100) / 2) * 5) + 1;
+			return(0);
+		case T_ERROR:
+			p[0] = (value >> 8);
+			p[1] = (value & 0xFF);
+			return(0);
+		case T_DERIVED:
+			return(-1);
+		default:
+			v = clamp(value, 0, 255);
+			break;
+	}
+	p[0] = (p[0] & ~mask(desc->type)) | v;
+	return(0);
+}
+
+/**
+ * @brief Test if a field can be modified with a set command
+ *
+ * @param field Identifier of the field (see aquarea_field)
+ * @return integer True (1) if field is writable, 0 if not
+ */
+int aquarea_state_writable(int field)
+{
+	if ((field < 0) || (field >= AQ_FIELD_COUNT))
+		return(0);
+	if (fields[field].type == T_DERIVED)
+		return(0);
+	return(fields[field].offset < SETTINGS_END);
+}
+
+/**
+ * @brief Insert a new value into a set command packet
+ *
+ * The packet must be initialized by the caller (header, other bytes to zero
+ * means "no change"). Many fields can be inserted into the same packet. The
+ * packet pointer can be NULL to only check the value.
+ *
+ * @param packet Pointer to a command packet (or NULL)
+ * @param field  Identifier of the field (see aquarea_field)
+ * @param value  New value of the field
+ * @return integer Zero is returned on success, -1 if field is not writable
+ *                 or value out of range
+ */
+int aquarea_state_encode(uint8_t *packet, int field, int32_t value)
+{
+	int32_t min, max;
+	uint8_t v;
+
+	if ( ! aquarea_state_writable(field))
+		return(-1);
+
+	switch(fields[field].type)
+	{
+		case T_MINUS128: min = -127; max = 127; break;
+		case T_BIT12:
+		case T_BIT78:    min = 0;    max = 1;   break;
+		case T_QUIET:    min = 0;    max = 3;   break;
+		case T_RAW:      min = 0;    max = 255; break;
+		default:
+			return(-1);
+	}
+	if ((value < min) || (value > max))
+		return(-1);
+	if (packet == NULL)
+		return(0);
+
+	switch(fields[field].type)
+	{
+		case T_MINUS128: v = value + 128;       break;
+		case T_BIT12:    v = (value + 1) << 6;  break;
+		case T_BIT78:    v = (value + 1);       break;
+		case T_QUIET:    v = (value + 1) << 3;  break;
+		default:         v = value;             break;
+	}
+	packet[fields[field].offset] &= ~mask(fields[field].type);
+	packet[fields[field].offset] |= v;
+	return(0);
+}
+
+/**
+ * @brief Get the name of a field
+ *
+ * @param field Identifier of the field (see aquarea_field)
+ * @return string Pointer to a constant string with field name
+ */
+const char *aquarea_state_name(int field)
+{
+	if ((field < 0) || (field >= AQ_FIELD_COUNT))
+		return("unknown");
+	return(names[field]);
+}
+
+/**
+ * @brief Initialize a query or a command packet
+ *
+ * The header is inserted and the payload is cleared (no change for a
+ * command). Values can then be added with aquarea_state_encode.
+ *
+ * @param packet Pointer to a buffer of AQUAREA_REQUEST_LEN bytes (or more)
+ * @param type   Type of packet (AQUAREA_QUERY or AQUAREA_COMMAND)
+ */
+void aquarea_state_request(uint8_t *packet, uint8_t type)
+{
+	memset(packet, 0, AQUAREA_REQUEST_LEN);
+	memcpy(packet, request_header, sizeof(request_header));
+	packet[0] = type;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Limit a value to a range
+ *
+ */
+static int32_t clamp(int32_t value, int32_t min, int32_t max)
+{
+	if (value < min)
+		return(min);
+	if (value > max)
+		return(max);
+	return(value);
+}
+
+/**
+ * @brief Get the bits of the first byte used by an encoding
+ *
+ * @param type Type of encoding (T_xxx)
+ * @return uint8 Mask of the bits
+ */
+static uint8_t mask(uint8_t type)
+{
+	switch(type)
+	{
+		case T_BIT12: return(0xC0);
+		case T_BIT56: return(0x0C);
+		case T_BIT78: return(0x03);
+		case T_QUIET: return(0x38);
+		default:      return(0xFF);
+	}
+}
+
+/**
+ * @brief Extract the value of one field from a packet
+ *
+ * @param desc   Pointer to the descriptor of the field
+ * @param packet Pointer to the packet
+ * @return int32 Decoded value
+ */
+static int32_t unpack(const struct field_desc *desc, const uint8_t *packet)
+{
+	const uint8_t *p = &packet[desc->offset];
+
+	switch(desc->type)
+	{
+		case T_MINUS1:   return(GET_MINUS1(p));
+		case T_MINUS128: return(GET_MINUS128(p));
+		case T_BIT12:    return(GET_BIT12(p));
+		case T_BIT56:    return(GET_BIT56(p));
+		case T_BIT78:    return(GET_BIT78(p));
+		case T_QUIET:    return(GET_QUIET(p));
+		case T_POWER:    return(GET_POWER(p));
+		case T_FLOW:     return(GET_FLOW(p));
+		case T_ERROR:    return(GET_ERROR(p));
+		default:         return(GET_RAW(p));
+	}
+}
+/* EOF */
@@ -0,0 +1,52 @@
+/**
+ * @file  main/aquarea_state.h
+ * @brief Headers and definitions for decoded Aquarea state
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef AQUAREA_STATE_H
+#define AQUAREA_STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "aquarea_proto.h"
+
+/* Identifiers of the decoded fields, see aquarea_proto.h for units */
+#define AQ_ENUM(id, name, offset, type, deadband, interval) AQ_##id,
+enum aquarea_field
+{
+	AQUAREA_FIELDS(AQ_ENUM)
+	AQ_FIELD_COUNT
+};
+#undef AQ_ENUM
+
+/**
+ * @brief Decoded state of the heatpump
+ *
+ * All values are signed integers, see aquarea_proto.h for units.
+ */
+struct aquarea_state
+{
+	uint32_t seq;                     /* Number of the decoded frame   */
+	uint32_t time;                    /* Timestamp of the frame (sec.) */
+	int32_t  value[AQ_FIELD_COUNT];
+};
+
+int aquarea_state_decode(struct aquarea_state *state, const uint8_t *packet, size_t len);
+int aquarea_state_command(struct aquarea_state *state, const uint8_t *packet, size_t len);
+int aquarea_state_encode(uint8_t *packet, int field, int32_t value);
+int aquarea_state_pack(uint8_t *packet, int field, int32_t value);
+int aquarea_state_writable(int field);
+const char *aquarea_state_name(int field);
+void aquarea_state_request(uint8_t *packet, uint8_t type);
+
+#endif
@@ -0,0 +1,316 @@
+/**
+ * @file  main/bridge.c
+ * @brief Raw serial bridge : mirror frames of the serial link over TCP
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Protocol
+ * Each frame sent or received on the serial link is sent to all clients as
+ * one record (see bridge_ring.h), with one send per record. When
+ * BRIDGE_INJECT is enabled, raw frames received from a client (header and
+ * payload, checksum is computed again) are sent to Aquarea in place of the
+ * next status query.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "lwip/sockets.h"
+#include "aquarea_ll.h"
+#include "bridge.h"
+#include "bridge_ring.h"
+#include "mem.h"
+#include "os.h"
+#include "tasks.h"
+
+/* Period (ms) used to check for new records */
+#define BRIDGE_PERIOD 20
+
+/**
+ * @brief Context of a connected client
+ */
+struct bridge_client
+{
+	int      fd;   /* Socket, -1 if slot unused        */
+	size_t   len;  /* Number of bytes received (inject) */
+	uint8_t  buf[BRIDGE_DATA_MAX + 2];
+};
+
+static void bridge_task(void *arg);
+static void bridge_tap(int dir, int status, const uint8_t *data, size_t len, int64_t time);
+static void bridge_accept(int sock);
+static void bridge_close(struct bridge_client *c);
+static void bridge_recv(struct bridge_client *c);
+
+static struct bridge_ring   bridge_ring;
+static struct bridge_client bridge_clients[BRIDGE_MAX_CLIENTS];
+static uint8_t bridge_rec[BRIDGE_REC_MAX];
+static volatile int bridge_count;
+#if BRIDGE_INJECT
+static volatile int bridge_inject_ready;
+static uint8_t bridge_inject_buf[BRIDGE_DATA_MAX + 2];
+#endif
+
+#define BRIDGE_STATIC (sizeof(bridge_ring) + sizeof(bridge_clients) + \
+                       sizeof(bridge_rec) + BRIDGE_DATA_MAX + 2)
+_Static_assert(BRIDGE_STATIC <= MEM_BUDGET_BRIDGE, "bridge over memory budget");
+
+/**
+ * @brief Start the serial bridge
+ *
+ * @return integer Zero is returned on success, -1 on error
+ */
+int bridge_init(void)
+{
+	int i;
+
+	bridge_ring_init(&bridge_ring);
+	for (i = 0; i < BRIDGE_MAX_CLIENTS; i++)
+		bridge_clients[i].fd = -1;
+	bridge_count = 0;
+#if BRIDGE_INJECT
+	bridge_inject_ready = 0;
+#endif
+
+	/* Low priority on network core, the bridge must never delay UART */
+	if (os_task_create(bridge_task, "bridge", 3072, NULL,
+	                   TASK_PRIO_BRIDGE, TASK_CORE_NET))
+		return(-1);
+
+	mem_account("bridge", BRIDGE_STATIC, MEM_BUDGET_BRIDGE);
+	aquarea_ll_set_tap(bridge_tap);
+	return(0);
+}
+
+/**
+ * @brief Get a frame injected by a client
+ *
+ * This function is called by the task that process the link, when a frame
+ * can be sent.
+ *
+ * @param packet Pointer to a buffer of 260 bytes where frame is copied
+ * @return integer True (1) if a frame has been copied, 0 if none pending
+ */
+int bridge_inject(uint8_t *packet)
+{
+#if BRIDGE_INJECT
+	if ( ! bridge_inject_ready)
+		return(0);
+	__sync_synchronize();
+	memcpy(packet, bridge_inject_buf, bridge_inject_buf[1] + 3);
+	__sync_synchronize();
+	bridge_inject_ready = 0;
+	return(1);
+#else
+	return(0);
+#endif
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Bridge task, send records to clients and receive injected frames
+ *
+ * @param arg Not used
+ */
+static void bridge_task(void *arg)
+{
+	struct sockaddr_in addr;
+	struct timeval tv;
+	fd_set rfds;
+	size_t len;
+	int sock, fd_max, opt, i;
+
+	(void)arg;
+
+	sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sock < 0)
+		goto error;
+	opt = 1;
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons(BRIDGE_PORT);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+		goto error;
+	if (listen(sock, 1) != 0)
+		goto error;
+
+	while(1)
+	{
+		FD_ZERO(&rfds);
+		FD_SET(sock, &rfds);
+		fd_max = sock;
+		for (i = 0; i < BRIDGE_MAX_CLIENTS; i++)
+		{
+			if (bridge_clients[i].fd < 0)
+				continue;
+			FD_SET(bridge_clients[i].fd, &rfds);
+			if (bridge_clients[i].fd > fd_max)
+				fd_max = bridge_clients[i].fd;
+		}
+		tv.tv_sec  = 0;
+		tv.tv_usec = BRIDGE_PERIOD * 1000;
+		if (select(fd_max + 1, &rfds, NULL, NULL, &tv) > 0)
+		{
+			if (FD_ISSET(sock, &rfds))
+				bridge_accept(sock);
+			for (i = 0; i < BRIDGE_MAX_CLIENTS; i++)
+			{
+				if ((bridge_clients[i].fd >= 0) &&
+				    FD_ISSET(bridge_clients[i].fd, &rfds))
+					bridge_recv(&bridge_clients[i]);
+			}
+		}
+
+		/* Send pending records, one send per frame */
+		while ((len = bridge_ring_pop(&bridge_ring, bridge_rec)) != 0)
+		{
+			for (i = 0; i < BRIDGE_MAX_CLIENTS; i++)
+			{
+				if (bridge_clients[i].fd < 0)
+					continue;
+				if (send(bridge_clients[i].fd, bridge_rec, len, 0) != len)
+					bridge_close(&bridge_clients[i]);
+			}
+		}
+	}
+
+error:
+	printf("BRIDGE: Failed to start server\n");
+	if (sock >= 0)
+		close(sock);
+	os_task_exit();
+}
+
+/**
+ * @brief Tap called by low-level for each frame (task that process link)
+ *
+ * Frames are only copied into the record buffer, this function never waits
+ * for clients. Nothing is copied when no client is connected.
+ *
+ * @param dir    Direction of the frame
+ * @param status Status of the frame
+ * @param data   Pointer to the frame bytes
+ * @param len    Number of bytes
+ * @param time   Time of the frame (us)
+ */
+static void bridge_tap(int dir, int status, const uint8_t *data, size_t len, int64_t time)
+{
+	if (bridge_count == 0)
+		return;
+	bridge_ring_push(&bridge_ring, dir, status, data, len, time);
+}
+
+/**
+ * @brief Accept a new client
+ *
+ * @param sock Listening socket
+ */
+static void bridge_accept(int sock)
+{
+	struct bridge_client *c = NULL;
+	struct timeval tv;
+	int fd, opt, i;
+
+	fd = accept(sock, NULL, NULL);
+	if (fd < 0)
+		return;
+
+	for (i = 0; i < BRIDGE_MAX_CLIENTS; i++)
+	{
+		if (bridge_clients[i].fd < 0)
+		{
+			c = &bridge_clients[i];
+			break;
+		}
+	}
+	if (c == NULL)
+	{
+		close(fd);
+		return;
+	}
+
+	/* One segment per record, no delay */
+	opt = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+	/* A stuck client is closed, others are not delayed too long */
+	tv.tv_sec  = 1;
+	tv.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	/* First client, drop records left by previous ones */
+	if (bridge_count == 0)
+	{
+		while (bridge_ring_pop(&bridge_ring, bridge_rec))
+			;
+	}
+
+	c->fd  = fd;
+	c->len = 0;
+	bridge_count++;
+}
+
+/**
+ * @brief Close the connection with a client
+ *
+ * @param c Pointer to the client
+ */
+static void bridge_close(struct bridge_client *c)
+{
+	close(c->fd);
+	c->fd = -1;
+	bridge_count--;
+}
+
+/**
+ * @brief Receive data from a client (injected frames)
+ *
+ * @param c Pointer to the client
+ */
+static void bridge_recv(struct bridge_client *c)
+{
+	size_t size;
+	int len;
+
+	len = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+	if (len <= 0)
+	{
+		bridge_close(c);
+		return;
+	}
+#if BRIDGE_INJECT
+	c->len += len;
+	while (c->len >= 2)
+	{
+		/* Same framing as the serial link : header, length, ..., checksum */
+		size = c->buf[1] + 3;
+		if (c->len < size)
+			break;
+		if (bridge_inject_ready)
+			printf("BRIDGE: Inject busy, frame dropped\n");
+		else
+		{
+			memcpy(bridge_inject_buf, c->buf, size);
+			__sync_synchronize();
+			bridge_inject_ready = 1;
+		}
+		c->len -= size;
+		memmove(c->buf, c->buf + size, c->len);
+	}
+#else
+	(void)size;
+#endif
+}
+/* EOF */
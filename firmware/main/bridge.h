@@ -0,0 +1,32 @@
+/**
+ * @file  main/bridge.h
+ * @brief Headers and definitions for the raw serial bridge (TCP)
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef BRIDGE_H
+#define BRIDGE_H
+
+#include <stdint.h>
+
+#define BRIDGE_PORT       2000
+#define BRIDGE_MAX_CLIENTS   2
+/* Allow clients to send frames to Aquarea. There is no authentication :
+ * keep it disabled, or build with -DBRIDGE_INJECT=1 on a trusted network */
+#ifndef BRIDGE_INJECT
+#define BRIDGE_INJECT        0
+#endif
+
+int bridge_init(void);
+int bridge_inject(uint8_t *packet);
+
+#endif
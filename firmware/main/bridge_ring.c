@@ -0,0 +1,148 @@
+/**
+ * @file  main/bridge_ring.c
+ * @brief Buffer of frame records used by the serial bridge
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <string.h>
+#include "bridge_ring.h"
+
+static void copy_in (struct bridge_ring *r, uint32_t pos, const uint8_t *src, size_t len);
+static void copy_out(struct bridge_ring *r, uint32_t pos, uint8_t *dst, size_t len);
+
+/**
+ * @brief Initialize a record buffer
+ *
+ * @param r Pointer to the buffer
+ */
+void bridge_ring_init(struct bridge_ring *r)
+{
+	memset(r, 0, sizeof(struct bridge_ring));
+}
+
+/**
+ * @brief Insert a frame record
+ *
+ * This function never waits : when there is not enough free space the
+ * record is dropped, and the next record is marked (BRIDGE_LOST).
+ *
+ * @param r      Pointer to the buffer
+ * @param dir    Direction of the frame (0 for RX, 1 for TX)
+ * @param status Status of the frame
+ * @param data   Pointer to the frame bytes
+ * @param len    Number of bytes (truncated to BRIDGE_DATA_MAX)
+ * @param time   Time of the frame (us)
+ * @return integer Zero on success, -1 if record has been dropped
+ */
+int bridge_ring_push(struct bridge_ring *r, int dir, int status,
+                     const uint8_t *data, size_t len, int64_t time)
+{
+	uint8_t  hdr[BRIDGE_HDR_SIZE];
+	uint32_t head = r->head;
+	int i;
+
+	if (len > BRIDGE_DATA_MAX)
+		len = BRIDGE_DATA_MAX;
+
+	if ((BRIDGE_RING_SIZE - (head - r->tail)) < (BRIDGE_HDR_SIZE + len))
+	{
+		r->dropped++;
+		r->lost = 1;
+		return(-1);
+	}
+
+	hdr[0] = dir ? BRIDGE_TAG_TX : BRIDGE_TAG_RX;
+	hdr[1] = (status & 0x7F) | (r->lost ? BRIDGE_LOST : 0);
+	hdr[2] = (len >> 8);
+	hdr[3] = (len & 0xFF);
+	for (i = 0; i < 8; i++)
+		hdr[4 + i] = (uint8_t)((uint64_t)time >> (56 - (i * 8)));
+	r->lost = 0;
+
+	copy_in(r, head, hdr, BRIDGE_HDR_SIZE);
+	copy_in(r, head + BRIDGE_HDR_SIZE, data, len);
+
+	/* Record must be complete before reader can see it */
+	__sync_synchronize();
+	r->head = head + BRIDGE_HDR_SIZE + len;
+	return(0);
+}
+
+/**
+ * @brief Extract the oldest record
+ *
+ * @param r   Pointer to the buffer
+ * @param rec Pointer to a buffer of BRIDGE_REC_MAX bytes
+ * @return size_t Length of the record (header and data), 0 if empty
+ */
+size_t bridge_ring_pop(struct bridge_ring *r, uint8_t *rec)
+{
+	uint32_t tail = r->tail;
+	size_t len;
+
+	if (r->head == tail)
+		return(0);
+	__sync_synchronize();
+
+	copy_out(r, tail, rec, BRIDGE_HDR_SIZE);
+	len = BRIDGE_HDR_SIZE + ((rec[2] << 8) | rec[3]);
+	copy_out(r, tail + BRIDGE_HDR_SIZE, rec + BRIDGE_HDR_SIZE,
+	         len - BRIDGE_HDR_SIZE);
+
+	/* Data must be copied before writer can reuse space */
+	__sync_synchronize();
+	r->tail = tail + len;
+	return(len);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Copy bytes into the buffer, at a (free running) offset
+ *
+ * @param r   Pointer to the buffer
+ * @param pos Offset where bytes are written
+ * @param src Pointer to the bytes to copy
+ * @param len Number of bytes
+ */
+static void copy_in(struct bridge_ring *r, uint32_t pos, const uint8_t *src, size_t len)
+{
+	uint32_t off = pos & (BRIDGE_RING_SIZE - 1);
+	size_t   n   = BRIDGE_RING_SIZE - off;
+
+	if (n > len)
+		n = len;
+	memcpy(r->data + off, src, n);
+	memcpy(r->data, src + n, len - n);
+}
+
+/**
+ * @brief Copy bytes from the buffer, at a (free running) offset
+ *
+ * @param r   Pointer to the buffer
+ * @param pos Offset where bytes are read
+ * @param dst Pointer to the destination
+ * @param len Number of bytes
+ */
+static void copy_out(struct bridge_ring *r, uint32_t pos, uint8_t *dst, size_t len)
+{
+	uint32_t off = pos & (BRIDGE_RING_SIZE - 1);
+	size_t   n   = BRIDGE_RING_SIZE - off;
+
+	if (n > len)
+		n = len;
+	memcpy(dst, r->data + off, n);
+	memcpy(dst + n, r->data, len - n);
+}
+/* EOF */
@@ -0,0 +1,54 @@
+/**
+ * @file  main/bridge_ring.h
+ * @brief Headers and definitions for the serial bridge record buffer
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef BRIDGE_RING_H
+#define BRIDGE_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BRIDGE_RING_SIZE 4096 /* Size of the buffer (power of 2)       */
+#define BRIDGE_HDR_SIZE    12 /* Size of a record header               */
+#define BRIDGE_DATA_MAX   258 /* Max size of a frame                   */
+#define BRIDGE_REC_MAX (BRIDGE_HDR_SIZE + BRIDGE_DATA_MAX)
+
+/* Record tags (first byte of header) */
+#define BRIDGE_TAG_RX 'R'
+#define BRIDGE_TAG_TX 'T'
+/* Flag set into status byte when records have been lost before this one */
+#define BRIDGE_LOST 0x80
+
+/**
+ * @brief Buffer of frame records, one writer and one reader
+ *
+ * Record format : tag (1 byte), status (1 byte), length (2 bytes), time in
+ * us since boot (8 bytes), then frame bytes. Multi-bytes values are big
+ * endian.
+ */
+struct bridge_ring
+{
+	volatile uint32_t head;    /* Write offset (free running) */
+	volatile uint32_t tail;    /* Read offset (free running)  */
+	uint32_t dropped;          /* Records lost, buffer full   */
+	int      lost;
+	uint8_t  data[BRIDGE_RING_SIZE];
+};
+
+void   bridge_ring_init(struct bridge_ring *r);
+int    bridge_ring_push(struct bridge_ring *r, int dir, int status,
+                        const uint8_t *data, size_t len, int64_t time);
+size_t bridge_ring_pop (struct bridge_ring *r, uint8_t *rec);
+
+#endif
@@ -0,0 +1,332 @@
+/**
+ * @file  main/capture.c
+ * @brief Capture of the serial link into a compact binary format
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <string.h>
+#include "capture.h"
+
+static void     block_new(struct capture *c, int64_t time);
+static size_t   put_varint(uint8_t *p, uint64_t v);
+static int      get_varint(const uint8_t *p, size_t len, uint64_t *v);
+static uint32_t get32(const uint8_t *p);
+static void     put32(uint8_t *p, uint32_t v);
+
+/**
+ * @brief Initialize a capture (empty)
+ *
+ * @param c Pointer to the capture context
+ */
+void capture_init(struct capture *c)
+{
+	memset(c, 0, sizeof(struct capture));
+}
+
+/**
+ * @brief Insert a chunk of bytes into capture
+ *
+ * This function never waits. When the current block is full a new one is
+ * started, the oldest block is overwritten.
+ *
+ * @param c    Pointer to the capture context
+ * @param dir  Direction (0 for RX, 1 for TX)
+ * @param data Pointer to the bytes
+ * @param len  Number of bytes
+ * @param time Time of the chunk (us)
+ */
+void capture_add(struct capture *c, int dir, const uint8_t *data, size_t len, int64_t time)
+{
+	uint8_t  rec[16];
+	uint8_t *blk;
+	uint64_t delay;
+	size_t   size, used;
+
+	if ((len == 0) || (len > (CAPTURE_BLOCK_SIZE - CAPTURE_HDR_SIZE - sizeof(rec))))
+		return;
+
+	/* Clock going backward is saved as a null delay */
+	delay = (c->count && (time > c->time)) ? (uint64_t)(time - c->time) : 0;
+
+	size = 1;
+	if (len < 128)
+		rec[0] = (len << 1) | (dir ? 1 : 0);
+	else
+		rec[0] = (dir ? 1 : 0);
+	size += put_varint(rec + size, delay);
+	if (len >= 128)
+		size += put_varint(rec + size, len);
+
+	blk = c->block[c->seq % CAPTURE_BLOCKS];
+	used = blk[2] | (blk[3] << 8);
+	if ((c->count == 0) || ((used + size + len) > CAPTURE_BLOCK_SIZE))
+	{
+		block_new(c, time);
+		blk  = c->block[c->seq % CAPTURE_BLOCKS];
+		used = CAPTURE_HDR_SIZE;
+		/* First record of a block, relative to the time base */
+		size = 1 + put_varint(rec + 1, 0);
+		if (len >= 128)
+			size += put_varint(rec + size, len);
+	}
+
+	memcpy(blk + used, rec, size);
+	memcpy(blk + used + size, data, len);
+	used += size + len;
+	/* Record must be complete before readers can see it */
+	__sync_synchronize();
+	blk[2] = (used & 0xFF);
+	blk[3] = (used >> 8);
+
+	c->time = time;
+	c->records++;
+	c->bytes += len;
+}
+
+/**
+ * @brief Copy one block of the capture, oldest first
+ *
+ * This function can be called from another task than the writer. Call it
+ * with *seq set to 0 to get the oldest block, then again until it returns
+ * 0. The last (current) block is copied as it is when it's read.
+ *
+ * @param c   Pointer to the capture context
+ * @param seq Pointer to the number of the next block to read (updated)
+ * @param buf Pointer to a buffer of CAPTURE_BLOCK_SIZE bytes
+ * @return size_t Number of bytes copied, 0 if there is no more block
+ */
+size_t capture_export(struct capture *c, uint32_t *seq, uint8_t *buf)
+{
+	const uint8_t *blk;
+	uint32_t cur, first, gen, n;
+	size_t used;
+
+	while(1)
+	{
+		cur = c->seq;
+		__sync_synchronize();
+		if (c->count == 0)
+			return(0);
+		first = cur - (c->count - 1);
+		if ((int32_t)(*seq - first) < 0)
+			*seq = first;
+		if ((int32_t)(*seq - cur) > 0)
+			return(0);
+
+		n   = *seq % CAPTURE_BLOCKS;
+		blk = c->block[n];
+		gen = c->gen[n];
+		__sync_synchronize();
+		if (gen & 1)
+			continue;
+		used = blk[2] | (blk[3] << 8);
+		__sync_synchronize();
+		if (used > CAPTURE_BLOCK_SIZE)
+			used = CAPTURE_BLOCK_SIZE;
+		memcpy(buf, blk, used);
+		__sync_synchronize();
+		/* Block reused during copy, read next one */
+		if ((gen != c->gen[n]) || (get32(buf + 4) != *seq))
+		{
+			(*seq)++;
+			continue;
+		}
+		/* Header copied before last length update, fix it */
+		buf[2] = (used & 0xFF);
+		buf[3] = (used >> 8);
+		(*seq)++;
+		return(used);
+	}
+}
+
+/**
+ * @brief Initialize a reader on a capture stream (blocks one after another)
+ *
+ * @param rd  Pointer to the reader context
+ * @param buf Pointer to the stream
+ * @param len Length of the stream
+ */
+void capture_reader_init(struct capture_reader *rd, const uint8_t *buf, size_t len)
+{
+	memset(rd, 0, sizeof(struct capture_reader));
+	rd->buf = buf;
+	rd->len = len;
+}
+
+/**
+ * @brief Decode the next record of a capture stream
+ *
+ * @param rd   Pointer to the reader context
+ * @param dir  Pointer to a variable where direction is stored
+ * @param data Pointer to a variable where data pointer is stored
+ * @param len  Pointer to a variable where data length is stored
+ * @param time Pointer to a variable where time of the record is stored
+ * @return integer 1 if a record has been read, 0 at end of stream, -1 if
+ *                 the stream is invalid
+ */
+int capture_reader_next(struct capture_reader *rd, int *dir, const uint8_t **data,
+                        size_t *len, int64_t *time)
+{
+	const uint8_t *p;
+	uint64_t delay, size;
+	size_t   used;
+	int n, i;
+
+	/* Start of a new block */
+	while (rd->off >= rd->end)
+	{
+		if (rd->off >= rd->len)
+			return(0);
+		if ((rd->len - rd->off) < CAPTURE_HDR_SIZE)
+			return(-1);
+		p = rd->buf + rd->off;
+		used = p[2] | (p[3] << 8);
+		if (((p[0] | (p[1] << 8)) != CAPTURE_MAGIC) ||
+		    (used < CAPTURE_HDR_SIZE) || (used > CAPTURE_BLOCK_SIZE) ||
+		    (used > (rd->len - rd->off)))
+			return(-1);
+		rd->time = 0;
+		for (i = 7; i >= 0; i--)
+			rd->time = (rd->time << 8) | p[8 + i];
+		rd->end  = rd->off + used;
+		rd->off += CAPTURE_HDR_SIZE;
+	}
+
+	p = rd->buf + rd->off;
+	n = get_varint(p + 1, rd->end - rd->off - 1, &delay);
+	if (n < 0)
+		return(-1);
+	i = 1 + n;
+	size = (p[0] >> 1);
+	if (size == 0)
+	{
+		n = get_varint(p + i, rd->end - rd->off - i, &size);
+		if (n < 0)
+			return(-1);
+		i += n;
+	}
+	if (size > (rd->end - rd->off - i))
+		return(-1);
+
+	rd->time += delay;
+	*dir  = (p[0] & 1);
+	*data = p + i;
+	*len  = size;
+	*time = rd->time;
+	rd->off += i + size;
+	return(1);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Start a new block (overwrite the oldest one if needed)
+ *
+ * @param c    Pointer to the capture context
+ * @param time Time base of the new block
+ */
+static void block_new(struct capture *c, int64_t time)
+{
+	uint8_t *blk;
+	uint32_t n;
+	int i;
+
+	if (c->count)
+		c->seq++;
+	n = c->seq % CAPTURE_BLOCKS;
+	blk = c->block[n];
+
+	c->gen[n]++;
+	__sync_synchronize();
+	blk[0] = (CAPTURE_MAGIC & 0xFF);
+	blk[1] = (CAPTURE_MAGIC >> 8);
+	blk[2] = (CAPTURE_HDR_SIZE & 0xFF);
+	blk[3] = (CAPTURE_HDR_SIZE >> 8);
+	put32(blk + 4, c->seq);
+	for (i = 0; i < 8; i++)
+		blk[8 + i] = (uint8_t)((uint64_t)time >> (i * 8));
+	__sync_synchronize();
+	c->gen[n]++;
+
+	if (c->count < CAPTURE_BLOCKS)
+		c->count++;
+}
+
+/**
+ * @brief Encode an unsigned value as a varint (7 bits per byte)
+ *
+ * @param p Pointer to the destination (up to 10 bytes)
+ * @param v Value to encode
+ * @return size_t Number of bytes written
+ */
+static size_t put_varint(uint8_t *p, uint64_t v)
+{
+	size_t n = 0;
+
+	while (v >= 0x80)
+	{
+		p[n++] = (v & 0x7F) | 0x80;
+		v >>= 7;
+	}
+	p[n++] = v;
+	return(n);
+}
+
+/**
+ * @brief Decode a varint
+ *
+ * @param p   Pointer to the encoded value
+ * @param len Number of available bytes
+ * @param v   Pointer to a variable where value is stored
+ * @return integer Number of bytes read, or -1 if invalid
+ */
+static int get_varint(const uint8_t *p, size_t len, uint64_t *v)
+{
+	size_t n;
+
+	*v = 0;
+	for (n = 0; (n < len) && (n < 10); n++)
+	{
+		*v |= (uint64_t)(p[n] & 0x7F) << (n * 7);
+		if ((p[n] & 0x80) == 0)
+			return(n + 1);
+	}
+	return(-1);
+}
+
+/**
+ * @brief Read a little-endian 32 bits word
+ *
+ * @param p Pointer to the first byte
+ * @return uint32_t Value of the word
+ */
+static uint32_t get32(const uint8_t *p)
+{
+	return(p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+/**
+ * @brief Write a little-endian 32 bits word
+ *
+ * @param p Pointer to the first byte
+ * @param v Value to write
+ */
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+/* EOF */
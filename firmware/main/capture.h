@@ -0,0 +1,70 @@
+/**
+ * @file  main/capture.h
+ * @brief Headers and definitions for the serial link capture
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CAPTURE_BLOCK_SIZE 1024 /* Size of one block                   */
+#define CAPTURE_BLOCKS        8 /* Number of blocks into RAM           */
+#define CAPTURE_HDR_SIZE     16 /* Size of a block header              */
+#define CAPTURE_MAGIC    0x3143 /* "C1" */
+
+/**
+ * @brief Capture of the serial link, into a ring of blocks
+ *
+ * Each block starts with a header : magic (2 bytes), length used (2 bytes),
+ * block number (4 bytes), time base in us (8 bytes), little endian. Then
+ * records :
+ *   - one byte : bit 0 direction (1 for TX), bits 7-1 length (0 if length
+ *     is stored as a varint after the delay)
+ *   - delay since previous record (or since time base) in us, as a varint
+ *   - data bytes
+ * A block is self-contained : when RAM is full the oldest block is dropped.
+ */
+struct capture
+{
+	uint8_t  block[CAPTURE_BLOCKS][CAPTURE_BLOCK_SIZE];
+	volatile uint32_t gen[CAPTURE_BLOCKS]; /* Odd while a block is reset */
+	uint32_t seq;      /* Number of the current block            */
+	uint32_t count;    /* Number of blocks used (0 if no record) */
+	int64_t  time;     /* Time of the last record                */
+	uint32_t records;  /* Statistics                             */
+	uint32_t bytes;
+};
+
+/**
+ * @brief Context used to decode records from a capture stream
+ */
+struct capture_reader
+{
+	const uint8_t *buf;
+	size_t   len;
+	size_t   off;      /* Read offset into the stream           */
+	size_t   end;      /* End of the current block              */
+	int64_t  time;     /* Time of the last record               */
+};
+
+void capture_init(struct capture *c);
+void capture_add (struct capture *c, int dir, const uint8_t *data, size_t len, int64_t time);
+size_t capture_export(struct capture *c, uint32_t *seq, uint8_t *buf);
+
+void capture_reader_init(struct capture_reader *rd, const uint8_t *buf, size_t len);
+int  capture_reader_next(struct capture_reader *rd, int *dir, const uint8_t **data,
+                         size_t *len, int64_t *time);
+
+#endif
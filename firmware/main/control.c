@@ -0,0 +1,307 @@
+/**
+ * @file  main/control.c
+ * @brief Local heating control : weather compensation and time schedule
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Syntax
+ * One parameter per line (or separated by ';') :
+ *   curve <outside> <water> <outside> <water> : heating curve (cold point
+ *                                               first), enable control
+ *   limit <min> <max>                         : limits of the setpoint
+ *   slot  <hh:mm> <offset>                    : offset from this time
+ *   off                                       : disable control
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "control.h"
+
+static int32_t div_round(int32_t num, int32_t den);
+static int     line(struct control_param *p, char *text);
+static int     minutes(const char *text, int32_t *value);
+static int     number(const char *text, int32_t *value);
+
+/**
+ * @brief Initialize the control loop, disabled
+ *
+ * @param c Pointer to the control context
+ */
+void control_init(struct control *c)
+{
+	memset(c, 0, sizeof(struct control));
+	c->setpoint = CONTROL_NONE;
+}
+
+/**
+ * @brief Parse control parameters
+ *
+ * @param p    Pointer to a structure where parameters are stored
+ * @param text Definition of parameters (see Syntax)
+ * @return integer Zero on success, or -(line number) on error
+ */
+int control_load(struct control_param *p, const char *text)
+{
+	char buffer[CONTROL_LINE];
+	int  num = 0;
+	size_t len;
+
+	memset(p, 0, sizeof(struct control_param));
+	p->min = 20;
+	p->max = 55;
+
+	while (*text)
+	{
+		len = strcspn(text, "\n;");
+		num++;
+		if (len >= CONTROL_LINE)
+			goto error;
+		memcpy(buffer, text, len);
+		buffer[len] = 0;
+		text += len;
+		if (*text)
+			text++;
+		if (line(p, buffer))
+			goto error;
+	}
+	if (p->min > p->max)
+		goto error;
+	return(0);
+
+error:
+	printf("CONTROL: Invalid parameter, line %d\n", num);
+	p->enabled = 0;
+	return(-num);
+}
+
+/**
+ * @brief Use new parameters
+ *
+ * The setpoint is computed again, and sent, with the next state.
+ *
+ * @param c Pointer to the control context
+ * @param p Pointer to the new parameters
+ */
+void control_set(struct control *c, const struct control_param *p)
+{
+	memcpy(&c->param, p, sizeof(struct control_param));
+	c->setpoint = CONTROL_NONE;
+}
+
+/**
+ * @brief Compute the water temperature setpoint
+ *
+ * @param p       Pointer to the parameters
+ * @param outside Outside temperature (°C)
+ * @param minute  Minute of the day (local time), -1 if clock is not set
+ * @return int32 Setpoint (°C), or CONTROL_NONE if control is disabled
+ */
+int32_t control_setpoint(const struct control_param *p, int32_t outside, int minute)
+{
+	int32_t sp;
+	int i;
+
+	if ( ! p->enabled)
+		return(CONTROL_NONE);
+
+	/* Heating curve */
+	if (outside <= p->out_lo)
+		sp = p->water_lo;
+	else if (outside >= p->out_hi)
+		sp = p->water_hi;
+	else
+		sp = p->water_lo + div_round((outside - p->out_lo) *
+		                             (p->water_hi - p->water_lo),
+		                             p->out_hi - p->out_lo);
+
+	/* Offset of the current slot, the last one continues after midnight */
+	if ((minute >= 0) && p->slot_count)
+	{
+		i = p->slot_count - 1;
+		while ((i > 0) && (p->slot[i].start > minute))
+			i--;
+		if (p->slot[i].start > minute)
+			i = p->slot_count - 1;
+		sp += p->slot[i].offset;
+	}
+
+	if (sp < p->min)
+		sp = p->min;
+	if (sp > p->max)
+		sp = p->max;
+	return(sp);
+}
+
+/**
+ * @brief Update the control loop with a new state
+ *
+ * A setpoint is sent when it changes. When the heatpump does not report
+ * the requested value, it is sent again after CONTROL_RETRY seconds.
+ *
+ * @param c       Pointer to the control context
+ * @param outside Outside temperature (°C)
+ * @param current Setpoint reported by the heatpump (°C)
+ * @param now     Time since boot (sec.), not the wall clock that may jump
+ * @param minute  Minute of the day (local time), -1 if clock is not set
+ * @return int32 Setpoint to send, or CONTROL_NONE
+ */
+int32_t control_update(struct control *c, int32_t outside, int32_t current,
+                       uint32_t now, int minute)
+{
+	int32_t sp;
+
+	sp = control_setpoint(&c->param, outside, minute);
+	if (sp == CONTROL_NONE)
+		return(CONTROL_NONE);
+
+	if (sp == current)
+	{
+		c->setpoint = sp;
+		return(CONTROL_NONE);
+	}
+	if ((sp == c->setpoint) && ((now - c->tm_sent) < CONTROL_RETRY))
+		return(CONTROL_NONE);
+
+	c->setpoint = sp;
+	c->tm_sent  = now;
+	c->commands++;
+	return(sp);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Integer division, rounded to nearest
+ *
+ * @param num Numerator
+ * @param den Denominator (positive)
+ * @return int32 Result of the division
+ */
+static int32_t div_round(int32_t num, int32_t den)
+{
+	if (num >= 0)
+		return((num + (den / 2)) / den);
+	return((num - (den / 2)) / den);
+}
+
+/**
+ * @brief Parse one line of parameters
+ *
+ * @param p    Pointer to the parameters
+ * @param text Line to parse (modified)
+ * @return integer Zero on success (or empty line), -1 on error
+ */
+static int line(struct control_param *p, char *text)
+{
+	struct control_slot slot;
+	int32_t v[4];
+	char *tok[6];
+	char *save;
+	int n = 0;
+	int i, err;
+
+	for (tok[n] = strtok_r(text, " \t\r", &save); tok[n];
+	     tok[n] = strtok_r(NULL, " \t\r", &save))
+	{
+		if (++n == 6)
+			return(-1);
+	}
+	if (n == 0)
+		return(0);
+
+	/* Arguments, time of day for a slot or numbers */
+	for (i = 1; i < n; i++)
+	{
+		if ((i == 1) && (strcmp(tok[0], "slot") == 0))
+			err = minutes(tok[1], &v[0]);
+		else
+			err = number(tok[i], &v[i - 1]);
+		if (err)
+			return(-1);
+	}
+
+	if ((strcmp(tok[0], "off") == 0) && (n == 1))
+		p->enabled = 0;
+	else if ((strcmp(tok[0], "curve") == 0) && (n == 5))
+	{
+		if (v[0] >= v[2])
+			return(-1);
+		p->out_lo   = v[0];
+		p->water_lo = v[1];
+		p->out_hi   = v[2];
+		p->water_hi = v[3];
+		p->enabled  = 1;
+	}
+	else if ((strcmp(tok[0], "limit") == 0) && (n == 3))
+	{
+		p->min = v[0];
+		p->max = v[1];
+	}
+	else if ((strcmp(tok[0], "slot") == 0) && (n == 3))
+	{
+		if (p->slot_count == CONTROL_SLOTS)
+			return(-1);
+		slot.start  = v[0];
+		slot.offset = v[1];
+		/* Insert, sorted by start time */
+		for (i = p->slot_count; (i > 0) && (p->slot[i - 1].start > slot.start); i--)
+			p->slot[i] = p->slot[i - 1];
+		p->slot[i] = slot;
+		p->slot_count++;
+	}
+	else
+		return(-1);
+	return(0);
+}
+
+/**
+ * @brief Convert a time of day (hh:mm) into minutes
+ *
+ * @param text  String to convert
+ * @param value Pointer to store the result
+ * @return integer Zero on success, -1 if text is not a valid time
+ */
+static int minutes(const char *text, int32_t *value)
+{
+	long h, m;
+	char *end;
+
+	h = strtol(text, &end, 10);
+	if ((end == text) || (*end != ':') || (h < 0) || (h > 23))
+		return(-1);
+	text = end + 1;
+	m = strtol(text, &end, 10);
+	if ((end == text) || *end || (m < 0) || (m > 59))
+		return(-1);
+	*value = (h * 60) + m;
+	return(0);
+}
+
+/**
+ * @brief Convert a decimal number
+ *
+ * @param text  String to convert
+ * @param value Pointer to store the result
+ * @return integer Zero on success, -1 if text is not a number
+ */
+static int number(const char *text, int32_t *value)
+{
+	char *end;
+
+	*value = strtol(text, &end, 10);
+	if ((end == text) || *end)
+		return(-1);
+	return(0);
+}
+/* EOF */
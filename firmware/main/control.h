@@ -0,0 +1,77 @@
+/**
+ * @file  main/control.h
+ * @brief Headers and definitions for the local heating control
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+
+#define CONTROL_SLOTS       8 /* Maximum number of time slots per day      */
+#define CONTROL_LINE       64 /* Maximum length of a parameter line        */
+#define CONTROL_RETRY      60 /* Delay before sending again a setpoint not */
+                              /* applied by the heatpump (sec.)            */
+#define CONTROL_NONE INT32_MIN /* No setpoint to send                      */
+#define CONTROL_CLOCK_VALID 1640995200 /* Clock not set before this date  */
+
+/* Parameters used on boot, control disabled until parameters are pushed */
+#define CONTROL_DEFAULT "off"
+
+/**
+ * @brief Offset applied to the setpoint from a time of day
+ */
+struct control_slot
+{
+	uint16_t start;  /* Minute of the day (0-1439)        */
+	int16_t  offset; /* Added to the curve setpoint (°C)  */
+};
+
+/**
+ * @brief Parameters of the control (pushed by the cloud)
+ *
+ * The heating curve is a line between two points (outside temperature,
+ * water temperature), limited to these points at both ends.
+ */
+struct control_param
+{
+	int      enabled;
+	int32_t  out_lo;   /* Curve, cold point : outside temperature */
+	int32_t  water_lo; /*                     water temperature   */
+	int32_t  out_hi;   /* Curve, warm point : outside temperature */
+	int32_t  water_hi; /*                     water temperature   */
+	int32_t  min;      /* Limits of the setpoint                  */
+	int32_t  max;
+	int      slot_count;
+	struct control_slot slot[CONTROL_SLOTS]; /* Sorted by start    */
+};
+
+/**
+ * @brief Context of the control loop
+ */
+struct control
+{
+	struct control_param param;
+	int32_t  setpoint;   /* Last setpoint sent, or CONTROL_NONE   */
+	uint32_t tm_sent;    /* Uptime of the last command (sec.)     */
+	unsigned int commands;
+};
+
+void    control_init    (struct control *c);
+int     control_load    (struct control_param *p, const char *text);
+void    control_set     (struct control *c, const struct control_param *p);
+int32_t control_setpoint(const struct control_param *p, int32_t outside, int minute);
+int32_t control_update  (struct control *c, int32_t outside, int32_t current,
+                         uint32_t now, int minute);
+
+#endif
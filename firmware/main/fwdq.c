@@ -0,0 +1,393 @@
+/**
+ * @file  main/fwdq.c
+ * @brief Store-and-forward queue of changed-state records
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Format
+ * Each publish contains a JSON array of records, one record per state with
+ * the original timestamp and only the fields changed since previous record :
+ *   [{"time":1640995200,"inlet_temp":31,"outlet_temp":35},{"time":...}]
+ * The first record of a sequence (after boot, after a replay, after data
+ * loss) contains all fields.
+ *
+ * @page Policy
+ * Fields are not all published on each change : sensors jitter by one unit
+ * from one frame to the next, while states and errors must be sent at once.
+ * Each field has a policy (deadband, minimum interval, heartbeat) that is
+ * applied on push, in one pass over the fields with the last published
+ * value and time of each one. Deadband and interval of each field are
+ * set into aquarea_proto.h.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "fwdq.h"
+
+/* Maximum length of one record (timestamp and all fields) */
+#define FWDQ_REC_MAX (16 + (AQ_FIELD_COUNT * 32))
+/* All fields of a state */
+#define FWDQ_MASK_ALL (0xFFFFFFFF >> (32 - AQ_FIELD_COUNT))
+
+/* Declare publish function, must be implemented elsewhere */
+extern int publish_send(const char *data, size_t len);
+/* Declare history reader, must be implemented elsewhere */
+extern int history_replay_start(uint32_t from);
+extern int history_replay_next(struct aquarea_state *state);
+
+static void     batch_begin(struct fwdq *q);
+static int      batch_add  (struct fwdq *q, const struct fwdq_rec *rec);
+static void     batch_end  (struct fwdq *q);
+static uint32_t filter(struct fwdq *q, struct fwdq_track *t,
+                       const struct aquarea_state *state);
+static int      replay(struct fwdq *q);
+
+/* Policy of the firmware : deadband, interval, heartbeat */
+#define FIELD_POLICY(id, name, offset, type, deadband, interval) \
+	[AQ_##id] = { deadband, interval, FWDQ_HEARTBEAT },
+const struct fwdq_policy fwdq_policy_default[AQ_FIELD_COUNT] =
+{
+	AQUAREA_FIELDS(FIELD_POLICY)
+};
+#undef FIELD_POLICY
+
+/* Empty policy, each change is published */
+static const struct fwdq_policy policy_none[AQ_FIELD_COUNT];
+
+/**
+ * @brief Initialize a queue
+ *
+ * @param q Pointer to the queue to initialize
+ */
+void fwdq_init(struct fwdq *q)
+{
+	memset(q, 0, sizeof(struct fwdq));
+	q->policy = fwdq_policy_default;
+	/* Start with a full bucket */
+	q->tokens = (FWDQ_BATCH_SIZE * 2);
+}
+
+/**
+ * @brief Select the publish policy of a queue
+ *
+ * @param q      Pointer to the queue
+ * @param policy Array of policies, one per field (NULL to publish every
+ *               change)
+ */
+void fwdq_set_policy(struct fwdq *q, const struct fwdq_policy *policy)
+{
+	q->policy = policy ? policy : policy_none;
+}
+
+/**
+ * @brief Insert a new state into the queue
+ *
+ * Only fields selected by the policy are saved. When RAM is full, the
+ * oldest record is dropped and its timestamp is added to the range that
+ * will be replayed from history.
+ *
+ * @param q     Pointer to the queue
+ * @param state Pointer to the new state
+ */
+void fwdq_push(struct fwdq *q, const struct aquarea_state *state)
+{
+	struct fwdq_rec *rec;
+	uint32_t mask;
+
+	mask = filter(q, &q->live, state);
+
+	/* Nothing has changed, nothing to publish */
+	if (mask == 0)
+		return;
+
+	if (q->count == FWDQ_RAM_COUNT)
+	{
+		rec = &q->ram[q->head];
+		if ( ! q->spilled)
+		{
+			q->spill_from = rec->time;
+			q->spilled = 1;
+		}
+		q->spill_to = rec->time;
+		q->head = (q->head + 1) % FWDQ_RAM_COUNT;
+		q->count--;
+		q->dropped++;
+		/* Reference of the next record is lost, send it complete */
+		rec = &q->ram[q->head];
+		rec->mask = FWDQ_MASK_ALL;
+	}
+
+	rec = &q->ram[(q->head + q->count) % FWDQ_RAM_COUNT];
+	rec->time = state->time;
+	rec->mask = mask;
+	memcpy(rec->value, state->value, sizeof(rec->value));
+	q->count++;
+	q->pushed++;
+}
+
+/**
+ * @brief Send pending records
+ *
+ * This function must be called periodically while the broker is connected.
+ * Records into RAM (the most recent ones) are sent first. Then, records of
+ * the spilled period are read from history and sent, limited to the replay
+ * bandwidth to not delay live data.
+ *
+ * @param q   Pointer to the queue
+ * @param now Current time (in milliseconds)
+ * @return integer Number of publish made, or -1 if a publish failed
+ */
+int fwdq_process(struct fwdq *q, uint32_t now)
+{
+	unsigned int n;
+	uint32_t delta;
+	int count = 0;
+	int result;
+
+	/* Live records first */
+	while (q->count)
+	{
+		batch_begin(q);
+		for (n = 0; n < q->count; n++)
+		{
+			if (batch_add(q, &q->ram[(q->head + n) % FWDQ_RAM_COUNT]))
+				break;
+		}
+		batch_end(q);
+		if (publish_send(q->batch, q->len) != 0)
+			return(-1);
+		q->head   = (q->head + n) % FWDQ_RAM_COUNT;
+		q->count -= n;
+		q->sent  += n;
+		q->batches++;
+		count++;
+	}
+
+	/* Refill the token bucket */
+	delta = (now - q->tm_tokens);
+	if (delta > ((FWDQ_BATCH_SIZE * 2000) / FWDQ_REPLAY_RATE))
+		q->tokens = (FWDQ_BATCH_SIZE * 2);
+	else
+		q->tokens += (delta * FWDQ_REPLAY_RATE) / 1000;
+	if (q->tokens > (FWDQ_BATCH_SIZE * 2))
+		q->tokens = (FWDQ_BATCH_SIZE * 2);
+	q->tm_tokens = now;
+
+	/* Then old records, a full batch is sent only when bandwidth allows it */
+	while (q->spilled && (q->tokens >= FWDQ_BATCH_SIZE))
+	{
+		result = replay(q);
+		if (result < 0)
+			return(-1);
+		if (result == 0)
+			break;
+		count++;
+	}
+	return(count);
+}
+
+/**
+ * @brief Test if some records are waiting to be sent
+ *
+ * @param q Pointer to the queue
+ * @return integer True (1) if records are pending, 0 if queue is empty
+ */
+int fwdq_pending(struct fwdq *q)
+{
+	return((q->count > 0) || q->spilled);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Start a new publish message
+ *
+ * @param q Pointer to the queue
+ */
+static void batch_begin(struct fwdq *q)
+{
+	q->batch[0] = '[';
+	q->len = 1;
+}
+
+/**
+ * @brief Append one record to the current publish message
+ *
+ * @param q   Pointer to the queue
+ * @param rec Pointer to the record to insert
+ * @return integer Zero on success, -1 if there is no room for this record
+ */
+static int batch_add(struct fwdq *q, const struct fwdq_rec *rec)
+{
+	char   line[FWDQ_REC_MAX];
+	size_t len;
+	int i;
+
+	len = snprintf(line, FWDQ_REC_MAX, "%s{\"time\":%u",
+	               (q->len > 1) ? "," : "", (unsigned int)rec->time);
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		if ((rec->mask & (1UL << i)) == 0)
+			continue;
+		len += snprintf(line + len, FWDQ_REC_MAX - len, ",\"%s\":%d",
+		                aquarea_state_name(i), (int)rec->value[i]);
+	}
+	line[len++] = '}';
+
+	/* Keep one byte for the end of array */
+	if ((q->len + len + 1) > FWDQ_BATCH_SIZE)
+		return(-1);
+
+	memcpy(q->batch + q->len, line, len);
+	q->len += len;
+	return(0);
+}
+
+/**
+ * @brief Terminate the current publish message
+ *
+ * @param q Pointer to the queue
+ */
+static void batch_end(struct fwdq *q)
+{
+	q->batch[q->len++] = ']';
+}
+
+/**
+ * @brief Select the fields of a state to publish, using the policy
+ *
+ * @param q     Pointer to the queue
+ * @param t     Pointer to the last published values (updated)
+ * @param state Pointer to the new state
+ * @return integer Bitmap of the fields to publish (all for the first state)
+ */
+static uint32_t filter(struct fwdq *q, struct fwdq_track *t,
+                       const struct aquarea_state *state)
+{
+	const struct fwdq_policy *p;
+	uint32_t mask = 0;
+	uint32_t age;
+	int32_t  delta;
+	int i;
+
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		if (t->valid)
+		{
+			p = &q->policy[i];
+			age   = state->time - t->time[i];
+			delta = state->value[i] - t->value[i];
+			if (delta < 0)
+				delta = -delta;
+			/* Heartbeat first, then significant change */
+			if (( ! p->heartbeat) || (age < p->heartbeat))
+			{
+				if (delta <= p->deadband)
+					continue;
+				if (age < p->interval)
+				{
+					t->held++;
+					continue;
+				}
+			}
+		}
+		t->value[i] = state->value[i];
+		t->time[i]  = state->time;
+		mask |= (1UL << i);
+	}
+	t->valid = 1;
+	return(mask);
+}
+
+/**
+ * @brief Send one batch of records read back from history
+ *
+ * @param q Pointer to the queue
+ * @return integer Number of records sent, or -1 if publish failed
+ */
+static int replay(struct fwdq *q)
+{
+	struct aquarea_state *state = &q->replay_state;
+	struct fwdq_track track;
+	struct fwdq_rec rec;
+	uint32_t last = 0;
+	int done = 0;
+	int n = 0;
+
+	if ( ! q->replaying)
+	{
+		history_replay_start(q->spill_from);
+		q->replaying = 1;
+		q->replay_pending = 0;
+		q->replay_track.valid = 0;
+	}
+
+	batch_begin(q);
+	while(1)
+	{
+		if ( ! q->replay_pending)
+		{
+			if (history_replay_next(state) == 0)
+			{
+				done = 1;
+				break;
+			}
+			if (state->time < q->spill_from)
+				continue;
+			if (state->time > q->spill_to)
+			{
+				done = 1;
+				break;
+			}
+			q->replay_pending = 1;
+		}
+
+		/* Policy is applied on a copy, until record is in batch */
+		memcpy(&track, &q->replay_track, sizeof(struct fwdq_track));
+		rec.time = state->time;
+		rec.mask = filter(q, &track, state);
+		memcpy(rec.value, state->value, sizeof(rec.value));
+
+		if (rec.mask && batch_add(q, &rec))
+			break;
+
+		memcpy(&q->replay_track, &track, sizeof(struct fwdq_track));
+		q->replay_pending = 0;
+		last = state->time;
+		if (rec.mask)
+			n++;
+	}
+	batch_end(q);
+
+	if (n)
+	{
+		if (publish_send(q->batch, q->len) != 0)
+		{
+			/* Restart from the first record not sent, on next call */
+			q->replaying = 0;
+			return(-1);
+		}
+		q->tokens -= (q->len < q->tokens) ? q->len : q->tokens;
+		q->replayed += n;
+		q->batches++;
+	}
+	if (last)
+		q->spill_from = last + 1;
+	if (done)
+	{
+		q->spilled   = 0;
+		q->replaying = 0;
+	}
+	return(n);
+}
+/* EOF */
@@ -0,0 +1,110 @@
+/**
+ * @file  main/fwdq.h
+ * @brief Headers and definitions for the store-and-forward queue
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef FWDQ_H
+#define FWDQ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "aquarea_state.h"
+
+#define FWDQ_RAM_COUNT     32 /* Number of records kept into RAM       */
+#define FWDQ_BATCH_SIZE  2048 /* Maximum size of one publish (bytes)   */
+#define FWDQ_REPLAY_RATE 1024 /* Bandwidth used to replay (bytes/sec)  */
+#define FWDQ_HEARTBEAT    900 /* Default max silence of a field (sec.) */
+
+/**
+ * @brief Publish policy of one field
+ *
+ * A field is published when it has moved by more than its deadband since it
+ * was last published, but not before the minimum interval. It is published
+ * again, even without change, after the heartbeat delay. Zero disables each
+ * limit : a field with an empty policy is published on every change.
+ */
+struct fwdq_policy
+{
+	int32_t  deadband;  /* Change ignored when not larger (field unit) */
+	uint16_t interval;  /* Minimum delay between two publish (sec.)    */
+	uint16_t heartbeat; /* Maximum delay without publish (sec.)        */
+};
+
+/**
+ * @brief Last published value and time of each field
+ */
+struct fwdq_track
+{
+	int      valid;
+	int32_t  value[AQ_FIELD_COUNT];
+	uint32_t time[AQ_FIELD_COUNT];
+	unsigned int held;  /* Changes not published yet (interval)  */
+};
+
+/**
+ * @brief A changed-state record (only fields set into mask are valid)
+ */
+struct fwdq_rec
+{
+	uint32_t time;
+	uint32_t mask;
+	int32_t  value[AQ_FIELD_COUNT];
+};
+
+/**
+ * @brief Context of a store-and-forward queue
+ *
+ * Last records are kept into RAM. When RAM is full, oldest records are
+ * dropped and the time range they cover is remembered : these states are
+ * already saved into history (flash) and are read back from it to be
+ * replayed when connection is back.
+ */
+struct fwdq
+{
+	struct fwdq_rec ram[FWDQ_RAM_COUNT];
+	unsigned int head;        /* Index of the oldest record into RAM  */
+	unsigned int count;       /* Number of records into RAM           */
+	const struct fwdq_policy *policy; /* One entry per field          */
+	struct fwdq_track live;   /* Last values pushed                   */
+	/* Time range to replay from history */
+	int      spilled;
+	uint32_t spill_from;
+	uint32_t spill_to;
+	/* Replay context */
+	int      replaying;
+	int      replay_pending;
+	struct fwdq_track replay_track;
+	struct aquarea_state replay_state;
+	/* Rate limiter (token bucket) */
+	uint32_t tokens;
+	uint32_t tm_tokens;
+	/* Statistics */
+	unsigned int pushed;
+	unsigned int sent;
+	unsigned int dropped;
+	unsigned int replayed;
+	unsigned int batches;
+	/* Buffer used to build publish messages */
+	size_t   len;
+	char     batch[FWDQ_BATCH_SIZE];
+};
+
+extern const struct fwdq_policy fwdq_policy_default[AQ_FIELD_COUNT];
+
+void fwdq_init(struct fwdq *q);
+void fwdq_set_policy(struct fwdq *q, const struct fwdq_policy *policy);
+void fwdq_push(struct fwdq *q, const struct aquarea_state *state);
+int  fwdq_process(struct fwdq *q, uint32_t now);
+int  fwdq_pending(struct fwdq *q);
+
+#endif
@@ -0,0 +1,358 @@
+/**
+ * @file  main/history.c
+ * @brief Save decoded states into flash, using a background task
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_http_server.h"
+#include "esp_partition.h"
+#include "history.h"
+#include "hlog.h"
+#include "mem.h"
+#include "os.h"
+#include "tasks.h"
+
+/* Maximum length of a CSV line (timestamp and all fields) */
+#define HISTORY_LINE_MAX (11 + (AQ_FIELD_COUNT * 12) + 1)
+/* Value of HISTORY_HTTP_MAX as a string, for response header */
+#define HISTORY_STR(x)     #x
+#define HISTORY_XSTR(x)    HISTORY_STR(x)
+#define HISTORY_HTTP_LIMIT HISTORY_XSTR(HISTORY_HTTP_MAX)
+
+static uint32_t history_fields(char *list);
+static void     history_task(void *arg);
+
+static struct hlog       history_log;
+static struct hlog_reader history_replay_rd;
+static os_queue_t        history_queue = NULL;
+static os_mutex_t        history_lock = NULL;
+static unsigned int      history_drop;
+static volatile unsigned int history_flushed;
+static struct os_queue_static history_qs;
+static uint8_t history_buf[HISTORY_QUEUE_LEN * sizeof(struct aquarea_state)];
+
+#define HISTORY_STATIC (sizeof(history_log) + sizeof(history_replay_rd) + \
+                        sizeof(history_qs) + sizeof(history_buf))
+_Static_assert(HISTORY_STATIC <= MEM_BUDGET_HISTORY, "history over memory budget");
+
+/**
+ * @brief Initialize the history module
+ *
+ * This function mount the history log (stored into a dedicated partition of
+ * the SPI flash) and start the task used to write it.
+ *
+ * @return integer Zero is returned on success, -1 on error
+ */
+int history_init(void)
+{
+	const esp_partition_t *part;
+
+	history_drop = 0;
+
+	part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+	                                HISTORY_PART_SUBTYPE, "history");
+	if (part == NULL)
+	{
+		printf("HISTORY: No partition found\n");
+		return(-1);
+	}
+	if (hlog_init(&history_log, part) != 0)
+	{
+		printf("HISTORY: Failed to mount log\n");
+		return(-1);
+	}
+	printf("HISTORY: %d blocks, current %d (seq %d)\n",
+	       (int)history_log.nsect, (int)history_log.sect,
+	       (int)history_log.seq);
+
+	/* Log is written by history task and read by HTTP server */
+	history_lock = os_mutex_create();
+	if (history_lock == NULL)
+		return(-1);
+
+	history_queue = os_queue_create_static(HISTORY_QUEUE_LEN,
+	                                       sizeof(struct aquarea_state),
+	                                       &history_qs, history_buf);
+	if (history_queue == NULL)
+		return(-1);
+	mem_account("history", HISTORY_STATIC, MEM_BUDGET_HISTORY);
+
+	/* Flash writes are made by a dedicated low priority task */
+	if (os_task_create(history_task, "history", 3072, NULL,
+	                   TASK_PRIO_HISTORY, TASK_CORE_NET))
+		return(-1);
+
+	return(0);
+}
+
+/**
+ * @brief Insert a new state into history
+ *
+ * This function never wait : if the queue is full (flash busy) the state is
+ * dropped and counted.
+ *
+ * @param state Pointer to the state to save
+ */
+void history_push(const struct aquarea_state *state)
+{
+	if (history_queue == NULL)
+		return;
+
+	if (os_queue_send(history_queue, state, 0) != 0)
+		history_drop++;
+}
+
+/**
+ * @brief Write all pending states into flash (before a reboot)
+ *
+ * A flush request (state with a null sequence) is queued behind the states
+ * waiting, then the history task writes them and the incomplete page.
+ *
+ * @param timeout Max delay to wait for the write (ms)
+ * @return integer Zero is returned on success, -1 on error or timeout
+ */
+int history_flush(uint32_t timeout)
+{
+	struct aquarea_state marker;
+	unsigned int count;
+	uint32_t t0;
+
+	if (history_queue == NULL)
+		return(-1);
+
+	memset(&marker, 0, sizeof(struct aquarea_state));
+	count = history_flushed;
+	t0 = os_time_ms();
+	if (os_queue_send(history_queue, &marker, timeout) != 0)
+		return(-1);
+	while (history_flushed == count)
+	{
+		if ((os_time_ms() - t0) >= timeout)
+			return(-1);
+		os_delay(10);
+	}
+	return(0);
+}
+
+/**
+ * @brief HTTP handler used to read history
+ *
+ * Query parameters :
+ *   - from   : timestamp of the first state (default: oldest available)
+ *   - to     : timestamp of the last state (default: newest available)
+ *   - fields : comma separated list of field names (default: all)
+ * States are sent as CSV, one line per state. The response is streamed
+ * from flash using chunks, so memory usage does not depend on the number
+ * of states requested. The server has only one task : to keep other
+ * requests (metrics, live, ...) responsive, a response contains at most
+ * HISTORY_HTTP_MAX states (see X-History-Limit header). When a response is
+ * full, next states are read with from set to the last time plus one.
+ *
+ * @param req Pointer to the HTTP request
+ * @return esp_err ESP_OK on success
+ */
+esp_err_t history_http_get(httpd_req_t *req)
+{
+	char chunk[HISTORY_CHUNK_SIZE];
+	struct hlog_reader   rd;
+	struct aquarea_state state;
+	char     query[256];
+	char     arg[192];
+	uint32_t from = 0;
+	uint32_t to   = 0xFFFFFFFF;
+	uint32_t mask;
+	size_t   len;
+	int i, more, count = 0;
+
+	/* History not available (no partition ?) */
+	if (history_lock == NULL)
+		return(httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL));
+
+	mask = (0xFFFFFFFF >> (32 - AQ_FIELD_COUNT));
+	if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK)
+	{
+		if (httpd_query_key_value(query, "from", arg, sizeof(arg)) == ESP_OK)
+			from = strtoul(arg, NULL, 10);
+		if (httpd_query_key_value(query, "to", arg, sizeof(arg)) == ESP_OK)
+			to = strtoul(arg, NULL, 10);
+		if (httpd_query_key_value(query, "fields", arg, sizeof(arg)) == ESP_OK)
+			mask = history_fields(arg);
+	}
+
+	httpd_resp_set_type(req, "text/csv");
+	httpd_resp_set_hdr(req, "X-History-Limit", HISTORY_HTTP_LIMIT);
+
+	/* First line, name of each column */
+	len = snprintf(chunk, HISTORY_CHUNK_SIZE, "time");
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		if (mask & (1UL << i))
+			len += snprintf(chunk + len, HISTORY_CHUNK_SIZE - len,
+			                ",%s", aquarea_state_name(i));
+	}
+	chunk[len++] = '\n';
+
+	/* Search the block where requested period starts */
+	os_mutex_lock(history_lock);
+	hlog_reader_seek(&history_log, &rd, from);
+	os_mutex_unlock(history_lock);
+
+	while (count < HISTORY_HTTP_MAX)
+	{
+		os_mutex_lock(history_lock);
+		more = hlog_reader_next(&rd, &state);
+		os_mutex_unlock(history_lock);
+		if ((more == 0) || (state.time > to))
+			break;
+		if (state.time < from)
+			continue;
+
+		len += snprintf(chunk + len, HISTORY_CHUNK_SIZE - len,
+		                "%u", (unsigned int)state.time);
+		for (i = 0; i < AQ_FIELD_COUNT; i++)
+		{
+			if (mask & (1UL << i))
+				len += snprintf(chunk + len, HISTORY_CHUNK_SIZE - len,
+				                ",%d", (int)state.value[i]);
+		}
+		chunk[len++] = '\n';
+		count++;
+
+		/* Send the chunk when there is no room for another line */
+		if ((HISTORY_CHUNK_SIZE - len) < HISTORY_LINE_MAX)
+		{
+			if (httpd_resp_send_chunk(req, chunk, len) != ESP_OK)
+				return(ESP_FAIL);
+			len = 0;
+		}
+	}
+	if (len && (httpd_resp_send_chunk(req, chunk, len) != ESP_OK))
+		return(ESP_FAIL);
+
+	/* Empty chunk to terminate response */
+	return(httpd_resp_send_chunk(req, NULL, 0));
+}
+
+/**
+ * @brief Start to read states from history, for replay
+ *
+ * @param from Timestamp of the first state to read
+ * @return integer Zero is returned on success, -1 on error
+ */
+int history_replay_start(uint32_t from)
+{
+	int result;
+
+	if (history_lock == NULL)
+		return(-1);
+
+	os_mutex_lock(history_lock);
+	result = hlog_reader_seek(&history_log, &history_replay_rd, from);
+	os_mutex_unlock(history_lock);
+
+	return(result);
+}
+
+/**
+ * @brief Read the next state for replay
+ *
+ * @param state Pointer to a structure to store the state
+ * @return integer One when a state has been read, 0 at end of history
+ */
+int history_replay_next(struct aquarea_state *state)
+{
+	int result;
+
+	if (history_lock == NULL)
+		return(0);
+
+	os_mutex_lock(history_lock);
+	result = hlog_reader_next(&history_replay_rd, state);
+	os_mutex_unlock(history_lock);
+
+	return(result);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Convert a list of field names into a bitmap
+ *
+ * @param list Comma separated list of names (modified)
+ * @return integer Bitmap of selected fields
+ */
+static uint32_t history_fields(char *list)
+{
+	uint32_t mask = 0;
+	char *name, *save;
+	int i;
+
+	for (name = strtok_r(list, ",", &save); name; name = strtok_r(NULL, ",", &save))
+	{
+		for (i = 0; i < AQ_FIELD_COUNT; i++)
+		{
+			if (strcmp(name, aquarea_state_name(i)) == 0)
+				mask |= (1UL << i);
+		}
+	}
+	return(mask);
+}
+
+/**
+ * @brief Main function of the history task
+ *
+ * @param arg Unused
+ */
+static void history_task(void *arg)
+{
+	struct aquarea_state state;
+	uint32_t tm_flush;
+	uint32_t delay;
+	int flush = 0;
+
+	delay = HISTORY_FLUSH_DELAY * 1000;
+	tm_flush = os_time_ms();
+
+	while(1)
+	{
+		if (os_queue_recv(history_queue, &state, delay) == 0)
+		{
+			/* Flush request, see history_flush() */
+			if (state.seq == 0)
+				flush = 1;
+			else
+			{
+				os_mutex_lock(history_lock);
+				if (hlog_append(&history_log, &state))
+					printf("HISTORY: Failed to save state\n");
+				os_mutex_unlock(history_lock);
+			}
+		}
+		/* Periodically write incomplete page to limit loss on reset */
+		if (flush || ((os_time_ms() - tm_flush) >= delay))
+		{
+			os_mutex_lock(history_lock);
+			hlog_flush(&history_log);
+			os_mutex_unlock(history_lock);
+			tm_flush = os_time_ms();
+			if (flush)
+				history_flushed++;
+			flush = 0;
+		}
+	}
+}
+/* EOF */
@@ -0,0 +1,35 @@
+/**
+ * @file  main/history.h
+ * @brief Headers and definitions for the history module
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "esp_http_server.h"
+#include "aquarea_state.h"
+
+#define HISTORY_PART_SUBTYPE 0x40
+#define HISTORY_QUEUE_LEN    8
+#define HISTORY_FLUSH_DELAY  300 /* Max delay (sec.) before page write */
+#define HISTORY_CHUNK_SIZE  1024 /* Size of HTTP response chunks        */
+#define HISTORY_HTTP_MAX     720 /* Max states into one HTTP response   */
+
+int  history_init(void);
+void history_push(const struct aquarea_state *state);
+int  history_flush(uint32_t timeout);
+int  history_replay_start(uint32_t from);
+int  history_replay_next(struct aquarea_state *state);
+esp_err_t history_http_get(httpd_req_t *req);
+
+#endif
@@ -0,0 +1,712 @@
+/**
+ * @file  main/hlog.c
+ * @brief History log, store decoded states into a flash partition
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Format
+ * The partition is divided into blocks of one sector (4kB, the erase unit of
+ * the flash). Blocks are used one after the other as a circular buffer, so
+ * each sector is erased once per full turn of the log (wear levelling). Each
+ * block starts with a 16 bytes header :
+ *   - magic    (32 bits, little endian)
+ *   - sequence (32 bits, little endian) incremented for each new block
+ *   - time     (32 bits, little endian) timestamp of the first record
+ *   - count    (8 bits) number of fields per state
+ *   - 3 unused bytes (0xFF)
+ * The header is followed by records :
+ *   - Key   : 'K', time (32 bits LE), count, count * value (zigzag varint)
+ *   - Delta : 'D', time delta (varint), bitmap of modified fields (varint),
+ *             then difference with previous value for each modified field
+ *             (zigzag varint)
+ * A byte 0xFF (erased flash) where a record is expected marks the end of the
+ * block. The first record of a block is always a Key, so any block can be
+ * decoded without reading previous ones.
+ */
+#include <stdint.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "hlog.h"
+
+/* Maximum size of an encoded record */
+#define REC_MAX (1 + 5 + 5 + (5 * AQ_FIELD_COUNT))
+
+_Static_assert(AQ_FIELD_COUNT <= 32, "Delta bitmap limited to 32 fields");
+
+static int    block_header(struct hlog *log, uint32_t sect, uint32_t *seq, uint32_t *time);
+static int    block_open(struct hlog *log, uint32_t time);
+static size_t encode_delta(struct hlog *log, const struct aquarea_state *state, uint8_t *rec);
+static size_t encode_key(const struct aquarea_state *state, uint8_t *rec);
+static int    log_write(struct hlog *log, const uint8_t *data, size_t len);
+static void   rd_block(struct hlog_reader *rd, uint32_t sect, uint32_t seq);
+static void   rd_oldest(struct hlog_reader *rd);
+static int    rd_byte(struct hlog_reader *rd, uint8_t *c);
+static int    rd_record(struct hlog_reader *rd);
+static int    rd_varint(struct hlog_reader *rd, uint32_t *v);
+static size_t put_varint(uint8_t *buf, uint32_t v);
+static void   put32(uint8_t *buf, uint32_t v);
+
+static inline uint32_t zigzag(int32_t v)
+{
+	return(((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+}
+
+static inline int32_t unzigzag(uint32_t v)
+{
+	return((int32_t)(v >> 1) ^ -(int32_t)(v & 1));
+}
+
+/**
+ * @brief Initialize (mount) an history log
+ *
+ * This function scan the partition to find the most recent block, then read
+ * this block to restore last values and find the write offset.
+ *
+ * @param log  Pointer to the log context to initialize
+ * @param part Pointer to the flash partition used to store the log
+ * @return integer Zero is returned on success, -1 on error
+ */
+int hlog_init(struct hlog *log, const esp_partition_t *part)
+{
+	struct hlog_reader rd;
+	uint32_t i, seq, base;
+	int best = -1;
+	int result;
+
+	memset(log, 0, sizeof(struct hlog));
+	memset(log->page, 0xFF, HLOG_PAGE_SIZE);
+	log->part    = part;
+	log->nsect   = (part->size / HLOG_SECTOR_SIZE);
+	/* No block opened yet */
+	log->offset  = HLOG_SECTOR_SIZE;
+	log->flushed = HLOG_SECTOR_SIZE;
+
+	if (log->nsect < 2)
+		return(-1);
+
+	/* Search the most recent block */
+	for (i = 0; i < log->nsect; i++)
+	{
+		if (block_header(log, i, &seq, NULL) != 0)
+			continue;
+		if ((best < 0) || (seq > log->seq))
+		{
+			best = i;
+			log->seq = seq;
+		}
+	}
+	/* Empty log, the first block will be sector 0 */
+	if (best < 0)
+	{
+		log->sect = (log->nsect - 1);
+		return(0);
+	}
+	log->sect = best;
+
+	/* Read the whole block to get last values */
+	memset(&rd, 0, sizeof(struct hlog_reader));
+	rd.log = log;
+	rd_block(&rd, log->sect, log->seq);
+	while ((result = rd_record(&rd)) == 1)
+		;
+	/* If the end of block is clean, continue to write into it */
+	if ((result == 0) && (rd.offset > HLOG_HDR_SIZE) &&
+	    (rd.offset < HLOG_SECTOR_SIZE))
+	{
+		log->offset  = rd.offset;
+		log->flushed = rd.offset;
+		log->time    = rd.time;
+		memcpy(log->value, rd.value, sizeof(log->value));
+		/* Load the current page into write cache */
+		base = (log->sect * HLOG_SECTOR_SIZE);
+		base += (rd.offset & ~(HLOG_PAGE_SIZE - 1));
+		if (esp_partition_read(part, base, log->page, HLOG_PAGE_SIZE) != ESP_OK)
+			return(-1);
+	}
+	return(0);
+}
+
+/**
+ * @brief Append a state to the log
+ *
+ * The state is encoded as a delta with the previous record when possible,
+ * then copied into the page cache. Flash is written only when a page is
+ * complete (or when hlog_flush is called).
+ *
+ * @param log   Pointer to the log context
+ * @param state Pointer to the state to save
+ * @return integer Zero is returned on success, -1 on error
+ */
+int hlog_append(struct hlog *log, const struct aquarea_state *state)
+{
+	uint8_t rec[REC_MAX];
+	size_t  len;
+
+	/* Encode the state as a delta (if possible) */
+	if (state->time >= log->time)
+		len = encode_delta(log, state, rec);
+	/* Time goes backward, insert a key record */
+	else
+		len = encode_key(state, rec);
+
+	/* If the record does not fit into current block, open a new one */
+	if ((log->offset + len) > HLOG_SECTOR_SIZE)
+	{
+		if (block_open(log, state->time))
+			return(-1);
+		len = encode_key(state, rec);
+	}
+
+	if (log_write(log, rec, len))
+		return(-1);
+
+	/* Save new values as reference for the next delta */
+	log->time = state->time;
+	memcpy(log->value, state->value, sizeof(log->value));
+
+	return(0);
+}
+
+/**
+ * @brief Write to flash all bytes pending into the page cache
+ *
+ * @param log Pointer to the log context
+ * @return integer Zero is returned on success, -1 on error
+ */
+int hlog_flush(struct hlog *log)
+{
+	uint32_t addr;
+	size_t   len;
+
+	if (log->flushed >= log->offset)
+		return(0);
+
+	len  = (log->offset - log->flushed);
+	addr = (log->sect * HLOG_SECTOR_SIZE) + log->flushed;
+
+	if (esp_partition_write(log->part, addr,
+	                        log->page + (log->flushed & (HLOG_PAGE_SIZE - 1)),
+	                        len) != ESP_OK)
+	{
+		/* Close the block, next record will open a new one */
+		log->offset  = HLOG_SECTOR_SIZE;
+		log->flushed = HLOG_SECTOR_SIZE;
+		return(-1);
+	}
+	log->flushed = log->offset;
+
+	/* If the page is complete, clear cache for the next one */
+	if ((log->offset & (HLOG_PAGE_SIZE - 1)) == 0)
+		memset(log->page, 0xFF, HLOG_PAGE_SIZE);
+
+	return(0);
+}
+
+/**
+ * @brief Initialize a reader, positioned on the oldest record
+ *
+ * @param log Pointer to the log to read
+ * @param rd  Pointer to the reader context to initialize
+ * @return integer Zero is returned on success
+ */
+int hlog_reader_init(struct hlog *log, struct hlog_reader *rd)
+{
+	memset(rd, 0, sizeof(struct hlog_reader));
+	rd->log = log;
+
+	/* Empty log */
+	if (log->seq == 0)
+	{
+		rd->offset = HLOG_SECTOR_SIZE;
+		return(0);
+	}
+	rd_oldest(rd);
+
+	return(0);
+}
+
+/**
+ * @brief Initialize a reader, positioned near a given time
+ *
+ * The reader is moved to the beginning of the last block started before the
+ * requested time. The search uses the timestamp saved into the header of
+ * each block (a sparse time index) so only a few headers are read.
+ *
+ * @param log  Pointer to the log to read
+ * @param rd   Pointer to the reader context to initialize
+ * @param time Timestamp of the first record wanted
+ * @return integer Zero is returned on success
+ */
+int hlog_reader_seek(struct hlog *log, struct hlog_reader *rd, uint32_t time)
+{
+	uint32_t lo, hi, mid, sect, seq, t;
+
+	hlog_reader_init(log, rd);
+	if (log->seq == 0)
+		return(0);
+
+	/* Binary search between oldest block (lo) and current one (hi) */
+	lo = 0;
+	hi = (log->seq - rd->seq);
+	while (lo < hi)
+	{
+		mid  = (lo + hi + 1) / 2;
+		sect = (rd->sect + mid) % log->nsect;
+		if ((block_header(log, sect, &seq, &t) == 0) &&
+		    (seq == (rd->seq + mid)) && (t <= time))
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	rd_block(rd, (rd->sect + lo) % log->nsect, rd->seq + lo);
+
+	return(0);
+}
+
+/**
+ * @brief Read the next record from the log
+ *
+ * When the writer has reused the block being read (the reader is too late,
+ * the oldest block is always the next one erased), records of this block
+ * are lost : the reader continues with the oldest block still valid, and
+ * the resync counter is incremented.
+ *
+ * @param rd    Pointer to the reader context
+ * @param state Pointer to a state structure updated with the record
+ * @return integer 1 if a record is available, 0 at the end of the log
+ */
+int hlog_reader_next(struct hlog_reader *rd, struct aquarea_state *state)
+{
+	struct hlog *log = rd->log;
+	uint32_t sect, seq, s;
+
+	while(1)
+	{
+		if ((rd_record(rd) == 1) && ! rd->stale)
+		{
+			state->seq  = 0;
+			state->time = rd->time;
+			memcpy(state->value, rd->value, sizeof(state->value));
+			return(1);
+		}
+		if (rd->stale)
+		{
+			rd->resync++;
+			rd_oldest(rd);
+			continue;
+		}
+		/* End of block, continue with the next one (if any) */
+		if (rd->seq >= log->seq)
+			return(0);
+		seq  = rd->seq + 1;
+		sect = (rd->sect + 1) % log->nsect;
+		if (block_header(log, sect, &s, NULL))
+			return(0);
+		/* Next block already reused, the reader is too late */
+		if (s > seq)
+		{
+			rd->resync++;
+			rd_oldest(rd);
+			continue;
+		}
+		if (s != seq)
+			return(0);
+		rd_block(rd, sect, seq);
+	}
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Read and verify the header of a block
+ *
+ * @param log  Pointer to the log context
+ * @param sect Index of the block
+ * @param seq  Pointer to a variable where sequence number is stored
+ * @param time Pointer to a variable where block time is stored (or NULL)
+ * @return integer Zero is returned if header is valid, -1 if not
+ */
+static int block_header(struct hlog *log, uint32_t sect, uint32_t *seq, uint32_t *time)
+{
+	uint8_t  hdr[HLOG_HDR_SIZE];
+	uint32_t magic, s;
+
+	/* Header of the current block may be only into page cache */
+	if ((sect == log->sect) && (log->flushed < HLOG_HDR_SIZE) &&
+	    (log->offset >= HLOG_HDR_SIZE))
+		memcpy(hdr, log->page, HLOG_HDR_SIZE);
+	else if (esp_partition_read(log->part, sect * HLOG_SECTOR_SIZE,
+	                            hdr, HLOG_HDR_SIZE) != ESP_OK)
+		return(-1);
+
+	magic = hdr[0] | (hdr[1] << 8) | (hdr[2] << 16) | ((uint32_t)hdr[3] << 24);
+	s     = hdr[4] | (hdr[5] << 8) | (hdr[6] << 16) | ((uint32_t)hdr[7] << 24);
+	if ((magic != HLOG_MAGIC) || (s == 0) || (s == 0xFFFFFFFF))
+		return(-1);
+
+	*seq = s;
+	if (time)
+		*time = hdr[8] | (hdr[9] << 8) | (hdr[10] << 16) | ((uint32_t)hdr[11] << 24);
+	return(0);
+}
+
+/**
+ * @brief Erase the next sector and start a new block into it
+ *
+ * @param log  Pointer to the log context
+ * @param time Timestamp of the first record of the block
+ * @return integer Zero is returned on success, -1 on error
+ */
+static int block_open(struct hlog *log, uint32_t time)
+{
+	uint8_t  hdr[HLOG_HDR_SIZE];
+	uint32_t sect;
+
+	/* Write pending bytes of the previous block */
+	hlog_flush(log);
+
+	sect = (log->sect + 1) % log->nsect;
+	if (esp_partition_erase_range(log->part, sect * HLOG_SECTOR_SIZE,
+	                              HLOG_SECTOR_SIZE) != ESP_OK)
+		return(-1);
+
+	log->sect    = sect;
+	log->seq    += 1;
+	log->offset  = 0;
+	log->flushed = 0;
+	memset(log->page, 0xFF, HLOG_PAGE_SIZE);
+
+	put32(&hdr[0], HLOG_MAGIC);
+	put32(&hdr[4], log->seq);
+	put32(&hdr[8], time);
+	hdr[12] = AQ_FIELD_COUNT;
+	hdr[13] = 0xFF;
+	hdr[14] = 0xFF;
+	hdr[15] = 0xFF;
+
+	return(log_write(log, hdr, HLOG_HDR_SIZE));
+}
+
+/**
+ * @brief Encode a state as differences with the previous record
+ *
+ * @param log   Pointer to the log context (with previous values)
+ * @param state Pointer to the state to encode
+ * @param rec   Pointer to a buffer where record is written
+ * @return integer Length of the encoded record
+ */
+static size_t encode_delta(struct hlog *log, const struct aquarea_state *state, uint8_t *rec)
+{
+	uint32_t mask;
+	int32_t  diff;
+	size_t   len;
+	int i;
+
+	/* Make the bitmap of modified fields */
+	mask = 0;
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		if (state->value[i] ^ log->value[i])
+			mask |= (1UL << i);
+	}
+
+	len = 0;
+	rec[len++] = HLOG_REC_DELTA;
+	len += put_varint(&rec[len], state->time - log->time);
+	len += put_varint(&rec[len], mask);
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		if ((mask & (1UL << i)) == 0)
+			continue;
+		diff = (int32_t)((uint32_t)state->value[i] - (uint32_t)log->value[i]);
+		len += put_varint(&rec[len], zigzag(diff));
+	}
+	return(len);
+}
+
+/**
+ * @brief Encode a full state
+ *
+ * @param state Pointer to the state to encode
+ * @param rec   Pointer to a buffer where record is written
+ * @return integer Length of the encoded record
+ */
+static size_t encode_key(const struct aquarea_state *state, uint8_t *rec)
+{
+	size_t len;
+	int i;
+
+	len = 0;
+	rec[len++] = HLOG_REC_KEY;
+	put32(&rec[len], state->time);
+	len += 4;
+	rec[len++] = AQ_FIELD_COUNT;
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+		len += put_varint(&rec[len], zigzag(state->value[i]));
+
+	return(len);
+}
+
+/**
+ * @brief Copy bytes into page cache, and write each completed page
+ *
+ * @param log  Pointer to the log context
+ * @param data Pointer to the bytes to write
+ * @param len  Number of bytes to write
+ * @return integer Zero is returned on success, -1 on error
+ */
+static int log_write(struct hlog *log, const uint8_t *data, size_t len)
+{
+	size_t pos, n;
+
+	while (len)
+	{
+		pos = (log->offset & (HLOG_PAGE_SIZE - 1));
+		n   = (HLOG_PAGE_SIZE - pos);
+		if (n > len)
+			n = len;
+		memcpy(&log->page[pos], data, n);
+		log->offset += n;
+		data += n;
+		len  -= n;
+		/* Page is complete, write it */
+		if ((log->offset & (HLOG_PAGE_SIZE - 1)) == 0)
+		{
+			if (hlog_flush(log))
+				return(-1);
+		}
+	}
+	return(0);
+}
+
+/**
+ * @brief Move a reader to the first record of a block
+ *
+ * @param rd   Pointer to the reader context
+ * @param sect Index of the block
+ * @param seq  Sequence number of the block
+ */
+static void rd_block(struct hlog_reader *rd, uint32_t sect, uint32_t seq)
+{
+	rd->sect    = sect;
+	rd->seq     = seq;
+	rd->offset  = HLOG_HDR_SIZE;
+	rd->stale   = 0;
+	rd->buf_off = 0;
+	rd->buf_len = 0;
+}
+
+/**
+ * @brief Move a reader to the first record of the oldest block
+ *
+ * @param rd Pointer to the reader context
+ */
+static void rd_oldest(struct hlog_reader *rd)
+{
+	struct hlog *log = rd->log;
+	uint32_t i, sect, prev, seq, s;
+
+	/* Walk backward from the current block while sequence is contiguous */
+	sect = log->sect;
+	seq  = log->seq;
+	for (i = 1; i < log->nsect; i++)
+	{
+		prev = (sect + log->nsect - 1) % log->nsect;
+		if (block_header(log, prev, &s, NULL) || (s != (seq - 1)))
+			break;
+		sect = prev;
+		seq  = s;
+	}
+	rd_block(rd, sect, seq);
+}
+
+/**
+ * @brief Read one byte of the current block
+ *
+ * @param rd Pointer to the reader context
+ * @param c  Pointer to a variable where the byte is stored
+ * @return integer Zero is returned on success, -1 at end of block
+ */
+static int rd_byte(struct hlog_reader *rd, uint8_t *c)
+{
+	struct hlog *log = rd->log;
+	uint32_t len, seq;
+
+	if (rd->offset >= HLOG_SECTOR_SIZE)
+		return(-1);
+
+	/* Bytes not already written to flash are read from page cache */
+	if ((rd->seq == log->seq) && (rd->offset >= log->flushed))
+	{
+		if (rd->offset >= log->offset)
+			return(-1);
+		*c = log->page[rd->offset & (HLOG_PAGE_SIZE - 1)];
+		rd->offset++;
+		return(0);
+	}
+
+	/* Refill the reader cache */
+	if ((rd->offset < rd->buf_off) ||
+	    (rd->offset >= (rd->buf_off + rd->buf_len)))
+	{
+		len = (HLOG_SECTOR_SIZE - rd->offset);
+		if ((rd->seq == log->seq) && (len > (log->flushed - rd->offset)))
+			len = (log->flushed - rd->offset);
+		if (len > HLOG_READ_SIZE)
+			len = HLOG_READ_SIZE;
+		if (esp_partition_read(log->part,
+		                       (rd->sect * HLOG_SECTOR_SIZE) + rd->offset,
+		                       rd->buf, len) != ESP_OK)
+			return(-1);
+		/* Bytes are valid only if the block has not been reused (header
+		 * is verified after the read, an erase may be in progress) */
+		if (block_header(log, rd->sect, &seq, NULL) || (seq != rd->seq))
+		{
+			rd->stale  = 1;
+			rd->offset = HLOG_SECTOR_SIZE;
+			return(-1);
+		}
+		rd->buf_off = rd->offset;
+		rd->buf_len = len;
+	}
+	*c = rd->buf[rd->offset - rd->buf_off];
+	rd->offset++;
+
+	return(0);
+}
+
+/**
+ * @brief Decode one record and update reader values
+ *
+ * @param rd Pointer to the reader context
+ * @return integer 1 for a valid record, 0 at end of block, -1 if corrupted
+ */
+static int rd_record(struct hlog_reader *rd)
+{
+	uint32_t v, mask;
+	uint8_t  type, count, b;
+	int i;
+
+	if (rd_byte(rd, &type))
+		return(0);
+	/* Erased flash, end of block */
+	if (type == 0xFF)
+	{
+		rd->offset--;
+		return(0);
+	}
+
+	if (type == HLOG_REC_KEY)
+	{
+		v = 0;
+		for (i = 0; i < 4; i++)
+		{
+			if (rd_byte(rd, &b))
+				return(-1);
+			v |= ((uint32_t)b << (i * 8));
+		}
+		if (rd_byte(rd, &count) || (count == 0) || (count > 32))
+			return(-1);
+		rd->time = v;
+		memset(rd->value, 0, sizeof(rd->value));
+		for (i = 0; i < count; i++)
+		{
+			if (rd_varint(rd, &v))
+				return(-1);
+			if (i < AQ_FIELD_COUNT)
+				rd->value[i] = unzigzag(v);
+		}
+	}
+	else if (type == HLOG_REC_DELTA)
+	{
+		if (rd_varint(rd, &v) || rd_varint(rd, &mask))
+			return(-1);
+		rd->time += v;
+		for (i = 0; i < 32; i++)
+		{
+			if ((mask & (1UL << i)) == 0)
+				continue;
+			if (rd_varint(rd, &v))
+				return(-1);
+			if (i < AQ_FIELD_COUNT)
+				rd->value[i] = (int32_t)((uint32_t)rd->value[i] + (uint32_t)unzigzag(v));
+		}
+	}
+	else
+		return(-1);
+
+	return(1);
+}
+
+/**
+ * @brief Read a variable length integer (7 bits per byte, LSB first)
+ *
+ * @param rd Pointer to the reader context
+ * @param v  Pointer to a variable where decoded value is stored
+ * @return integer Zero is returned on success, -1 on error
+ */
+static int rd_varint(struct hlog_reader *rd, uint32_t *v)
+{
+	uint8_t b;
+	int i;
+
+	*v = 0;
+	for (i = 0; i < 5; i++)
+	{
+		if (rd_byte(rd, &b))
+			return(-1);
+		*v |= ((uint32_t)(b & 0x7F) << (i * 7));
+		if ((b & 0x80) == 0)
+			return(0);
+	}
+	/* Too many bytes, corrupted record (or erased flash) */
+	return(-1);
+}
+
+/**
+ * @brief Encode a variable length integer (7 bits per byte, LSB first)
+ *
+ * @param buf Pointer to a buffer where encoded bytes are written
+ * @param v   Value to encode
+ * @return integer Number of bytes written
+ */
+static size_t put_varint(uint8_t *buf, uint32_t v)
+{
+	size_t len = 0;
+
+	while (v >= 0x80)
+	{
+		buf[len++] = (v & 0x7F) | 0x80;
+		v >>= 7;
+	}
+	buf[len++] = v;
+
+	return(len);
+}
+
+/**
+ * @brief Write a 32 bits value as little endian
+ *
+ * @param buf Pointer to a buffer where bytes are written
+ * @param v   Value to write
+ */
+static void put32(uint8_t *buf, uint32_t v)
+{
+	buf[0] = (v >>  0) & 0xFF;
+	buf[1] = (v >>  8) & 0xFF;
+	buf[2] = (v >> 16) & 0xFF;
+	buf[3] = (v >> 24) & 0xFF;
+}
+/* EOF */
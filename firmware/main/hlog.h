@@ -0,0 +1,77 @@
+/**
+ * @file  main/hlog.h
+ * @brief Headers and definitions for the history log (flash storage)
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef HLOG_H
+#define HLOG_H
+
+#include <stdint.h>
+#include "esp_partition.h"
+#include "aquarea_state.h"
+
+#define HLOG_SECTOR_SIZE 4096 /* Erase unit, one block per sector */
+#define HLOG_PAGE_SIZE    256 /* Write unit                        */
+#define HLOG_HDR_SIZE      16 /* Size of a block header            */
+#define HLOG_READ_SIZE     64 /* Size of reader cache              */
+#define HLOG_MAGIC 0x31474C48 /* "HLG1" */
+
+/* Types of records */
+#define HLOG_REC_KEY   0x4B /* Full state ('K')             */
+#define HLOG_REC_DELTA 0x44 /* Changes since previous ('D') */
+
+/**
+ * @brief Context of an history log
+ *
+ * The log is a circular list of blocks, each block uses one flash sector
+ * and starts with a keyframe (full state) followed by delta records.
+ */
+struct hlog
+{
+	const esp_partition_t *part;
+	uint32_t nsect;    /* Number of blocks into the partition */
+	uint32_t sect;     /* Index of the current block          */
+	uint32_t seq;      /* Sequence number of current block    */
+	uint32_t offset;   /* Write offset into current block     */
+	uint32_t flushed;  /* Offset of first byte not yet written */
+	uint32_t time;     /* Timestamp of the last record        */
+	int32_t  value[AQ_FIELD_COUNT]; /* Last values (delta reference) */
+	uint8_t  page[HLOG_PAGE_SIZE];  /* Write cache                   */
+};
+
+/**
+ * @brief Context used to read records from an history log
+ */
+struct hlog_reader
+{
+	struct hlog *log;
+	uint32_t sect;     /* Index of the block being read */
+	uint32_t seq;      /* Sequence number of the block  */
+	uint32_t offset;   /* Read offset into the block    */
+	uint32_t time;
+	int32_t  value[AQ_FIELD_COUNT];
+	uint32_t resync;   /* Blocks overwritten before being read */
+	int      stale;    /* Current block has been overwritten   */
+	uint32_t buf_off;  /* Block offset of the cached bytes */
+	uint32_t buf_len;
+	uint8_t  buf[HLOG_READ_SIZE];
+};
+
+int  hlog_init  (struct hlog *log, const esp_partition_t *part);
+int  hlog_append(struct hlog *log, const struct aquarea_state *state);
+int  hlog_flush (struct hlog *log);
+int  hlog_reader_init(struct hlog *log, struct hlog_reader *rd);
+int  hlog_reader_seek(struct hlog *log, struct hlog_reader *rd, uint32_t time);
+int  hlog_reader_next(struct hlog_reader *rd, struct aquarea_state *state);
+
+#endif
@@ -0,0 +1,287 @@
+/**
+ * @file  main/live.c
+ * @brief Live updates : deltas of state, shared by all connected clients
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Format
+ * Each message is a JSON object with the frame number, the timestamp and
+ * only the fields that have changed :
+ *   {"seq":1234,"time":1640995200,"inlet_temp":31}
+ * When a client connects, or when it is too slow to receive all deltas,
+ * the full state (same format, all fields) is sent first.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "live.h"
+#include "mem.h"
+#include "snapshot.h"
+
+/* Declare send and notify functions, must be implemented elsewhere */
+extern int  live_send(int fd, const char *data, size_t len);
+extern void live_notify(void);
+
+static int  copy(uint32_t id, char *buffer, size_t *len);
+static void resync(struct live_client *c, uint32_t head);
+
+static struct live_msg    ring[LIVE_RING];
+static volatile uint32_t  ring_head;  /* Number of the next message */
+static int32_t            last[AQ_FIELD_COUNT];
+static int                has_last;
+static struct live_client clients[LIVE_MAX_CLIENTS];
+static char               live_buf[LIVE_MSG_SIZE];
+
+#define LIVE_STATIC (sizeof(ring) + sizeof(last) + sizeof(clients) + \
+                     sizeof(live_buf))
+_Static_assert(LIVE_STATIC <= MEM_BUDGET_LIVE, "live over memory budget");
+
+/**
+ * @brief Initialize the live module
+ *
+ */
+void live_init(void)
+{
+	int i;
+
+	memset(ring, 0, sizeof(ring));
+	ring_head = 0;
+	has_last = 0;
+	for (i = 0; i < LIVE_MAX_CLIENTS; i++)
+		clients[i].fd = -1;
+	mem_account("live", LIVE_STATIC, MEM_BUDGET_LIVE);
+}
+
+/**
+ * @brief Make a delta message with a new state
+ *
+ * The message is serialized once, then sent to all clients. This function
+ * never waits for clients.
+ *
+ * @param state Pointer to the new state
+ * @return integer 1 if a message has been made, 0 if nothing has changed
+ */
+int live_push(const struct aquarea_state *state)
+{
+	struct live_msg *msg;
+	size_t len;
+	int i, n = 0;
+
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		if ( ! has_last || (last[i] != state->value[i]))
+			n++;
+	}
+	/* Nothing has changed, nothing to publish */
+	if (n == 0)
+		return(0);
+
+	msg = &ring[ring_head % LIVE_RING];
+
+	/* Odd lock while the message is written */
+	msg->lock++;
+	__sync_synchronize();
+	len = snprintf(msg->data, LIVE_MSG_SIZE, "{\"seq\":%u,\"time\":%u",
+	               (unsigned int)state->seq, (unsigned int)state->time);
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		if (has_last && (last[i] == state->value[i]))
+			continue;
+		len += snprintf(msg->data + len, LIVE_MSG_SIZE - len, ",\"%s\":%d",
+		                aquarea_state_name(i), (int)state->value[i]);
+	}
+	len += snprintf(msg->data + len, LIVE_MSG_SIZE - len, "}");
+	msg->len = len;
+	msg->id  = ring_head;
+	__sync_synchronize();
+	msg->lock++;
+
+	memcpy(last, state->value, sizeof(last));
+	has_last = 1;
+
+	__sync_synchronize();
+	ring_head++;
+	live_notify();
+	return(1);
+}
+
+/**
+ * @brief Register a new client
+ *
+ * @param fd Socket of the client
+ * @return integer Zero is returned on success, -1 if too many clients
+ */
+int live_add(int fd)
+{
+	int i;
+
+	for (i = 0; i < LIVE_MAX_CLIENTS; i++)
+	{
+		if (clients[i].fd < 0)
+		{
+			clients[i].fd     = fd;
+			clients[i].resync = 1;
+			clients[i].next   = ring_head;
+			/* Send the current state now */
+			live_notify();
+			return(0);
+		}
+	}
+	return(-1);
+}
+
+/**
+ * @brief Remove a client (disconnected)
+ *
+ * @param fd Socket of the client
+ */
+void live_remove(int fd)
+{
+	int i;
+
+	for (i = 0; i < LIVE_MAX_CLIENTS; i++)
+	{
+		if (clients[i].fd == fd)
+			clients[i].fd = -1;
+	}
+}
+
+/**
+ * @brief Send pending messages to all clients
+ *
+ * Each message is read once from the ring and sent to all clients that wait
+ * for it. A client that can not receive now (busy) is skipped. When it has
+ * missed too many messages (overwritten into the ring) it will receive the
+ * full state instead : pending updates never grow.
+ */
+void live_process(void)
+{
+	struct live_client *c;
+	uint32_t head, id;
+	size_t len;
+	int i, r, wait;
+
+	head = ring_head;
+	__sync_synchronize();
+
+	/* New clients, and clients too late to receive deltas */
+	for (i = 0; i < LIVE_MAX_CLIENTS; i++)
+	{
+		c = &clients[i];
+		if (c->fd < 0)
+			continue;
+		if ((head - c->next) > LIVE_RING)
+			c->resync = 1;
+		if (c->resync)
+			resync(c, head);
+	}
+
+	/* Send each message to all clients waiting for it */
+	for (id = head - LIVE_RING; id != head; id++)
+	{
+		wait = 0;
+		for (i = 0; i < LIVE_MAX_CLIENTS; i++)
+		{
+			c = &clients[i];
+			if ((c->fd >= 0) && ! c->resync && (c->next == id))
+				wait = 1;
+		}
+		if ( ! wait)
+			continue;
+
+		/* Message overwritten since head has been read */
+		if (copy(id, live_buf, &len))
+		{
+			for (i = 0; i < LIVE_MAX_CLIENTS; i++)
+			{
+				if ((clients[i].fd >= 0) && (clients[i].next == id))
+					clients[i].resync = 1;
+			}
+			continue;
+		}
+
+		for (i = 0; i < LIVE_MAX_CLIENTS; i++)
+		{
+			c = &clients[i];
+			if ((c->fd < 0) || c->resync || (c->next != id))
+				continue;
+			r = live_send(c->fd, live_buf, len);
+			if (r == 0)
+				c->next++;
+			else if (r < 0)
+				c->fd = -1;
+		}
+	}
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Copy a message from the ring
+ *
+ * @param id     Number of the message
+ * @param buffer Pointer to a buffer of LIVE_MSG_SIZE bytes (NUL terminated)
+ * @param len    Pointer to a variable where message length is stored
+ * @return integer Zero on success, -1 if message is not available anymore
+ */
+static int copy(uint32_t id, char *buffer, size_t *len)
+{
+	struct live_msg *msg = &ring[id % LIVE_RING];
+	uint32_t lock;
+
+	lock = msg->lock;
+	__sync_synchronize();
+	if ((lock & 1) || (msg->id != id))
+		return(-1);
+	*len = msg->len;
+	memcpy(buffer, msg->data, *len);
+	buffer[*len] = 0;
+	__sync_synchronize();
+	if (lock != msg->lock)
+		return(-1);
+	return(0);
+}
+
+/**
+ * @brief Send the full state to a client
+ *
+ * The full state is read from the snapshot cache (already serialized).
+ *
+ * @param c    Pointer to the client
+ * @param head Number of the next message, after this state
+ */
+static void resync(struct live_client *c, uint32_t head)
+{
+	const struct snapshot *snap;
+	int r;
+
+	snap = snapshot_get();
+	/* No state received yet, only deltas will be sent */
+	if (snap == NULL)
+	{
+		c->resync = 0;
+		c->next = head;
+		return;
+	}
+	r = live_send(c->fd, snap->json, snap->json_len);
+	snapshot_put(snap);
+
+	if (r == 0)
+	{
+		c->resync = 0;
+		c->next = head;
+	}
+	else if (r < 0)
+		c->fd = -1;
+}
+/* EOF */
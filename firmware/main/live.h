@@ -0,0 +1,53 @@
+/**
+ * @file  main/live.h
+ * @brief Headers and definitions for live updates (state deltas)
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef LIVE_H
+#define LIVE_H
+
+#include <stdint.h>
+#include "aquarea_state.h"
+
+#define LIVE_RING        8 /* Number of delta messages kept         */
+#define LIVE_MSG_SIZE 1024 /* Max size of one message               */
+#define LIVE_MAX_CLIENTS 4 /* Max number of connected clients      */
+
+/**
+ * @brief One delta message, protected by a sequence lock
+ */
+struct live_msg
+{
+	volatile uint32_t lock; /* Odd while message is written */
+	uint32_t id;            /* Message number               */
+	size_t   len;
+	char     data[LIVE_MSG_SIZE];
+};
+
+/**
+ * @brief Context of a connected client
+ */
+struct live_client
+{
+	int      fd;     /* Socket, -1 if slot unused           */
+	int      resync; /* Full state must be sent first       */
+	uint32_t next;   /* Number of the next message to send  */
+};
+
+void live_init(void);
+int  live_push(const struct aquarea_state *state);
+int  live_add(int fd);
+void live_remove(int fd);
+void live_process(void);
+
+#endif
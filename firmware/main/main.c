@@ -14,31 +14,53 @@
  * This program is distributed WITHOUT ANY WARRANTY.
  */
 #include <stdio.h>
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
 #include "aquarea.h"
+#include "bridge.h"
+#include "history.h"
+#include "mem.h"
+#include "modbus.h"
+#include "monitor.h"
+#include "network.h"
+#include "os.h"
+#include "ota.h"
+#include "publish.h"
+#include "recorder.h"
+#include "stream.h"
+#include "web.h"
 
 /**
  * @brief Entry point of the main task
  *
  * The main task is created by esp-idf after low-level and FreeRTOS
  * initialization. The special function "app_main" is then called into
- * the main task context.
- * For the moment, initialization and main loop of the firmware are
- * into the function/task.
+ * the main task context. It starts all modules, each one with its own
+ * task (see tasks.h), then the main task is deleted.
  */
 void app_main(void)
 {
 	printf("--=={ Cowmotics-Aquarea }==--\n");
 
-	aquarea_init();
+	/* Dynamic frequency and light sleep, when enabled into sdkconfig */
+	if (os_pm_enable() == 0)
+		printf("Power management enabled\n");
 
-	while(1)
-	{
-		aquarea_process();
+	/* Heatpump link first, alone on its core */
+	aquarea_start();
+	history_init();
+	network_init();
+	web_init();
+	publish_init();
+	modbus_init();
+	bridge_init();
+	stream_init();
+	recorder_init();
+	monitor_init();
+	ota_init();
 
-		/* Small delay for RTOS (and WDT !) */
-		vTaskDelay(1);
-	}
+	/* Static memory of each subsystem, heap left after init */
+	mem_report();
+
+	/* Initialization done, the main task is not needed anymore */
+	os_task_exit();
 }
 /* EOF */
@@ -0,0 +1,210 @@
+/**
+ * @file  main/mem.c
+ * @brief Account static memory and check that sealed tasks never allocate
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Notes
+ * Buffers of the protocol path (frames, queues, decoded state) are static.
+ * Each module checks the size of its buffers against a budget at build
+ * (see mem.h) and declares it on init. When init is done, the link task is
+ * sealed : it must not use the heap anymore, so the link never depends on
+ * fragmentation or on memory used by the network stack. malloc, calloc and
+ * realloc are wrapped at link time (-Wl,--wrap) to count allocations made
+ * by a sealed task. Allocations made inside esp-idf (pvPortMalloc,
+ * heap_caps) are not seen.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+#include "os.h"
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static void sealed_check(size_t size);
+
+/* Regions are declared during init, tasks are started one after the other */
+static struct mem_region  mem_region[MEM_REGION_MAX];
+static int                mem_count;
+static volatile uintptr_t mem_sealed[MEM_SEAL_MAX];
+static volatile uint32_t  mem_sealed_allocs;
+static volatile uint32_t  mem_sealed_bytes;
+
+/**
+ * @brief Declare the static memory of a subsystem
+ *
+ * A subsystem declared again (module initialized twice) is updated.
+ *
+ * @param name   Name of the subsystem (constant string)
+ * @param used   Size of its static buffers (bytes)
+ * @param budget Size allowed for this subsystem (bytes)
+ */
+void mem_account(const char *name, size_t used, size_t budget)
+{
+	int i;
+
+	for (i = 0; i < mem_count; i++)
+	{
+		if (strcmp(mem_region[i].name, name) == 0)
+			break;
+	}
+	if (i == MEM_REGION_MAX)
+	{
+		printf("MEM: Too many regions, %s not accounted\n", name);
+		return;
+	}
+	mem_region[i].name   = name;
+	mem_region[i].used   = used;
+	mem_region[i].budget = budget;
+	if (i == mem_count)
+		mem_count++;
+}
+
+/**
+ * @brief Forbid heap allocations for the current task
+ *
+ * Must be called by the task itself, at the end of its init.
+ */
+void mem_seal(void)
+{
+	uintptr_t id = os_task_id();
+	int i;
+
+	/* No task yet (scheduler not started), 0 is an empty slot */
+	if (id == 0)
+		return;
+
+	for (i = 0; i < MEM_SEAL_MAX; i++)
+	{
+		if (mem_sealed[i] == id)
+			return;
+	}
+	for (i = 0; i < MEM_SEAL_MAX; i++)
+	{
+		if (mem_sealed[i] == 0)
+		{
+			mem_sealed[i] = id;
+			return;
+		}
+	}
+	printf("MEM: Too many sealed tasks\n");
+}
+
+/**
+ * @brief Allow heap allocations again for the current task
+ *
+ */
+void mem_unseal(void)
+{
+	uintptr_t id = os_task_id();
+	int i;
+
+	for (i = 0; i < MEM_SEAL_MAX; i++)
+	{
+		if (mem_sealed[i] == id)
+			mem_sealed[i] = 0;
+	}
+}
+
+/**
+ * @brief Get a report of memory usage
+ *
+ * Stack of each task is measured by the monitor (see monitor_get).
+ *
+ * @param st Pointer to a structure where the report is stored
+ */
+void mem_stats(struct mem_stats *st)
+{
+	st->heap_valid = (os_heap_stats(&st->heap_free, &st->heap_min_free) == 0);
+	st->sealed_allocs = mem_sealed_allocs;
+	st->sealed_bytes  = mem_sealed_bytes;
+	st->count = mem_count;
+	memcpy(st->region, mem_region, mem_count * sizeof(struct mem_region));
+}
+
+/**
+ * @brief Print static memory of each subsystem and free heap
+ *
+ */
+void mem_report(void)
+{
+	uint32_t free, min_free;
+	int i;
+
+	for (i = 0; i < mem_count; i++)
+		printf("MEM: %-8s %5u / %5u bytes\n", mem_region[i].name,
+		       (unsigned int)mem_region[i].used,
+		       (unsigned int)mem_region[i].budget);
+	if (os_heap_stats(&free, &min_free) == 0)
+		printf("MEM: Heap %u bytes free (min %u)\n",
+		       (unsigned int)free, (unsigned int)min_free);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                            Heap wrappers                             -- */
+/* -------------------------------------------------------------------------- */
+
+void *__wrap_malloc(size_t size)
+{
+	sealed_check(size);
+	return(__real_malloc(size));
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+	sealed_check(n * size);
+	return(__real_calloc(n, size));
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	sealed_check(size);
+	return(__real_realloc(ptr, size));
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Count an allocation if the current task is sealed
+ *
+ * Nothing is printed here : printf may allocate itself.
+ *
+ * @param size Number of bytes asked
+ */
+static void sealed_check(size_t size)
+{
+	uintptr_t id = os_task_id();
+	int i;
+
+	/* Startup code of esp-idf, before the scheduler : no task is sealed,
+	 * and 0 would match the empty slots */
+	if (id == 0)
+		return;
+
+	for (i = 0; i < MEM_SEAL_MAX; i++)
+	{
+		if (mem_sealed[i] != id)
+			continue;
+		__sync_fetch_and_add(&mem_sealed_allocs, 1);
+		__sync_fetch_and_add(&mem_sealed_bytes, size);
+#if MEM_GUARD
+		abort();
+#endif
+		break;
+	}
+}
+/* EOF */
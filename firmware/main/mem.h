@@ -0,0 +1,68 @@
+/**
+ * @file  main/mem.h
+ * @brief Headers and definitions for memory accounting
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef MEM_H
+#define MEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MEM_REGION_MAX 12 /* Max number of accounted subsystems       */
+#define MEM_SEAL_MAX    2 /* Max number of sealed tasks               */
+#define MEM_GUARD       0 /* Abort on allocation from a sealed task   */
+
+/* Budget of static memory of each subsystem (bytes), checked at build */
+#define MEM_BUDGET_LL        1024 /* UART frame buffer and counters   */
+#define MEM_BUDGET_LINK      2048 /* TX frame, command queues         */
+#define MEM_BUDGET_STATE     6144 /* Decoded state, metrics, rules    */
+#define MEM_BUDGET_HISTORY   3072
+#define MEM_BUDGET_PUBLISH  10240
+#define MEM_BUDGET_LIVE     10240
+#define MEM_BUDGET_SNAPSHOT  4096
+#define MEM_BUDGET_STREAM    1024
+#define MEM_BUDGET_BRIDGE    6144
+#define MEM_BUDGET_OTA       2048
+
+/**
+ * @brief Static memory of one subsystem
+ */
+struct mem_region
+{
+	const char *name;
+	uint32_t    used;   /* Size of static buffers (bytes)   */
+	uint32_t    budget; /* Size allowed (bytes)             */
+};
+
+/**
+ * @brief Memory usage report
+ */
+struct mem_stats
+{
+	int      heap_valid;    /* Heap counters available          */
+	uint32_t heap_free;     /* Current free heap (bytes)        */
+	uint32_t heap_min_free; /* Lowest free heap since boot      */
+	uint32_t sealed_allocs; /* Allocations from a sealed task   */
+	uint32_t sealed_bytes;  /* Bytes asked by these allocations */
+	int      count;
+	struct mem_region region[MEM_REGION_MAX];
+};
+
+void mem_account(const char *name, size_t used, size_t budget);
+void mem_seal(void);
+void mem_unseal(void);
+void mem_stats(struct mem_stats *st);
+void mem_report(void);
+
+#endif
@@ -0,0 +1,262 @@
+/**
+ * @file  main/metrics.c
+ * @brief Derived metrics (COP, energy, rolling aggregates) updated per frame
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <string.h>
+#include "metrics.h"
+
+static void win_reset (struct metrics_window *w, uint32_t index);
+static void win_insert(struct metrics_window *w, uint32_t time, int32_t v, int period);
+static int32_t ratio(int64_t prod, int64_t cons);
+
+/* Fields with rolling aggregates */
+static const uint8_t track[METRICS_TRACK_COUNT] =
+{
+	AQ_OUTSIDE_TEMP, AQ_INLET_TEMP, AQ_OUTLET_TEMP,
+	AQ_COMPRESSOR_FREQ, AQ_POWER_PROD, AQ_POWER_CONS
+};
+/* Position of powers into the list of tracked fields */
+#define TRACK_PROD 4
+#define TRACK_CONS 5
+
+/* Duration of one bucket (sec.) for each window */
+static const uint16_t period[METRICS_WIN_COUNT] = { 5, 75, 300 };
+static const char *win_names[METRICS_WIN_COUNT] = { "1m", "15m", "1h" };
+
+/**
+ * @brief Initialize the metrics engine
+ *
+ * @param m Pointer to the metrics context
+ */
+void metrics_init(struct metrics *m)
+{
+	memset(m, 0, sizeof(struct metrics));
+}
+
+/**
+ * @brief Update metrics with a new frame, and set derived fields of state
+ *
+ * Energy is integrated using the power of the previous frame during the
+ * interval between frames (limited to METRICS_MAX_GAP when frames are
+ * missing). All computations use integers, cost does not depend on the
+ * window length.
+ *
+ * @param m     Pointer to the metrics context
+ * @param state Pointer to the new state (derived fields are updated)
+ */
+void metrics_update(struct metrics *m, struct aquarea_state *state)
+{
+	uint32_t dt = 0;
+	int32_t *v = state->value;
+	int i, j;
+
+	v[AQ_POWER_PROD] = v[AQ_HEAT_POWER_PROD] + v[AQ_DHW_POWER_PROD];
+	v[AQ_POWER_CONS] = v[AQ_HEAT_POWER_CONS] + v[AQ_DHW_POWER_CONS];
+	v[AQ_COP] = ratio(v[AQ_POWER_PROD], v[AQ_POWER_CONS]);
+
+	/* Energy integrators */
+	if (m->valid && (state->time > m->time))
+	{
+		dt = state->time - m->time;
+		if (dt > METRICS_MAX_GAP)
+			dt = METRICS_MAX_GAP;
+	}
+	if (m->prod > 0)
+		m->joule_prod += (uint64_t)m->prod * dt;
+	if (m->cons > 0)
+		m->joule_cons += (uint64_t)m->cons * dt;
+	m->prod  = v[AQ_POWER_PROD];
+	m->cons  = v[AQ_POWER_CONS];
+	m->time  = state->time;
+	m->valid = 1;
+	v[AQ_ENERGY_PROD] = (int32_t)(m->joule_prod / 3600);
+	v[AQ_ENERGY_CONS] = (int32_t)(m->joule_cons / 3600);
+
+	/* Rolling aggregates */
+	for (i = 0; i < METRICS_TRACK_COUNT; i++)
+	{
+		for (j = 0; j < METRICS_WIN_COUNT; j++)
+			win_insert(&m->win[i][j], state->time, v[track[i]], period[j]);
+	}
+
+	/* COP of each window, ratio of the sums of powers */
+	for (j = 0; j < METRICS_WIN_COUNT; j++)
+		v[AQ_COP_1M + j] = ratio(m->win[TRACK_PROD][j].sum,
+		                         m->win[TRACK_CONS][j].sum);
+}
+
+/**
+ * @brief Read the aggregates of one field over a window
+ *
+ * @param m      Pointer to the metrics context
+ * @param field  Identifier of the field (see aquarea_field)
+ * @param window Identifier of the window (see metrics_win)
+ * @param agg    Pointer to a structure where result is stored
+ * @return integer Zero on success, -1 if field has no aggregates
+ */
+int metrics_window(const struct metrics *m, int field, int window, struct metrics_agg *agg)
+{
+	const struct metrics_window *w;
+	int i;
+
+	if ((window < 0) || (window >= METRICS_WIN_COUNT))
+		return(-1);
+	for (i = 0; i < METRICS_TRACK_COUNT; i++)
+	{
+		if (track[i] == field)
+			break;
+	}
+	if (i == METRICS_TRACK_COUNT)
+		return(-1);
+
+	w = &m->win[i][window];
+	agg->count = w->count;
+	if (w->count == 0)
+	{
+		agg->min = agg->max = agg->avg = 0;
+		return(0);
+	}
+	agg->min = w->min;
+	agg->max = w->max;
+	/* Average, rounded to nearest */
+	if (w->sum >= 0)
+		agg->avg = (w->sum + (int32_t)(w->count / 2)) / (int32_t)w->count;
+	else
+		agg->avg = (w->sum - (int32_t)(w->count / 2)) / (int32_t)w->count;
+	return(0);
+}
+
+/**
+ * @brief Get the identifier of a field with aggregates
+ *
+ * @param n Index into the list of tracked fields
+ * @return integer Field identifier, or -1 if n is out of bounds
+ */
+int metrics_field(int n)
+{
+	if ((n < 0) || (n >= METRICS_TRACK_COUNT))
+		return(-1);
+	return(track[n]);
+}
+
+/**
+ * @brief Get the name of a window
+ *
+ * @param window Identifier of the window (see metrics_win)
+ * @return string Pointer to a constant string, like "15m"
+ */
+const char *metrics_window_name(int window)
+{
+	if ((window < 0) || (window >= METRICS_WIN_COUNT))
+		return("unknown");
+	return(win_names[window]);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Clear all buckets of a window
+ *
+ * @param w     Pointer to the window
+ * @param index Index of the current bucket
+ */
+static void win_reset(struct metrics_window *w, uint32_t index)
+{
+	memset(w, 0, sizeof(struct metrics_window));
+	w->index = index;
+}
+
+/**
+ * @brief Insert a sample into a window
+ *
+ * Buckets are aligned on multiples of the period, the window covers the
+ * current bucket and the previous ones. When a bucket expires, min and max
+ * are computed again : this is made at most once per period.
+ *
+ * @param w      Pointer to the window
+ * @param time   Timestamp of the sample
+ * @param v      Value of the sample
+ * @param period Duration of one bucket (sec.)
+ */
+static void win_insert(struct metrics_window *w, uint32_t time, int32_t v, int period)
+{
+	struct metrics_bucket *b;
+	uint32_t index = time / period;
+	int expired = 0;
+	int i;
+
+	/* Empty window, clock set backward or all buckets expired */
+	if ((w->count == 0) || (index < w->index) ||
+	    ((index - w->index) >= METRICS_BUCKETS))
+		win_reset(w, index);
+	while (w->index < index)
+	{
+		w->index++;
+		b = &w->bucket[w->index % METRICS_BUCKETS];
+		if (b->count)
+		{
+			w->sum   -= b->sum;
+			w->count -= b->count;
+			memset(b, 0, sizeof(struct metrics_bucket));
+			expired = 1;
+		}
+	}
+	if (expired && w->count)
+	{
+		w->min = INT32_MAX;
+		w->max = INT32_MIN;
+		for (i = 0; i < METRICS_BUCKETS; i++)
+		{
+			b = &w->bucket[i];
+			if (b->count == 0)
+				continue;
+			if (b->min < w->min)
+				w->min = b->min;
+			if (b->max > w->max)
+				w->max = b->max;
+		}
+	}
+
+	b = &w->bucket[index % METRICS_BUCKETS];
+	if ((b->count == 0) || (v < b->min))
+		b->min = v;
+	if ((b->count == 0) || (v > b->max))
+		b->max = v;
+	b->sum += v;
+	b->count++;
+
+	if ((w->count == 0) || (v < w->min))
+		w->min = v;
+	if ((w->count == 0) || (v > w->max))
+		w->max = v;
+	w->sum += v;
+	w->count++;
+}
+
+/**
+ * @brief Compute a ratio of powers, like a COP
+ *
+ * @param prod Power (or sum of powers) produced
+ * @param cons Power (or sum of powers) consumed
+ * @return integer Ratio (x100), 0 when nothing is consumed
+ */
+static int32_t ratio(int64_t prod, int64_t cons)
+{
+	if (cons <= 0)
+		return(0);
+	return((int32_t)((prod * 100) / cons));
+}
+/* EOF */
@@ -0,0 +1,91 @@
+/**
+ * @file  main/metrics.h
+ * @brief Headers and definitions for derived metrics
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include "aquarea_state.h"
+
+#define METRICS_BUCKETS     12 /* Number of buckets per window             */
+#define METRICS_MAX_GAP     60 /* Max interval (sec) integrated per frame  */
+#define METRICS_TRACK_COUNT  6 /* Number of fields with rolling aggregates */
+
+/* Identifiers of sliding windows */
+enum metrics_win
+{
+	METRICS_1M = 0,  /* Last minute,     12 buckets of 5s   */
+	METRICS_15M,     /* Last 15 minutes, 12 buckets of 75s  */
+	METRICS_1H,      /* Last hour,       12 buckets of 300s */
+	METRICS_WIN_COUNT
+};
+
+struct metrics_bucket
+{
+	int32_t  min;
+	int32_t  max;
+	int32_t  sum;
+	uint32_t count;
+};
+
+/**
+ * @brief Sliding window, made of time buckets
+ *
+ * Sum and count are updated when a sample is inserted or a bucket expires.
+ * Min and max are updated on insert and only recomputed (over all buckets)
+ * when a bucket expires.
+ */
+struct metrics_window
+{
+	uint32_t index;    /* Index (time / period) of current bucket */
+	int32_t  min;
+	int32_t  max;
+	int32_t  sum;
+	uint32_t count;
+	struct metrics_bucket bucket[METRICS_BUCKETS];
+};
+
+/**
+ * @brief Result of an aggregate over one window
+ */
+struct metrics_agg
+{
+	int32_t  min;
+	int32_t  max;
+	int32_t  avg;
+	uint32_t count;
+};
+
+/**
+ * @brief Context of the metrics engine
+ */
+struct metrics
+{
+	uint32_t time;       /* Timestamp of the last frame          */
+	int      valid;      /* Set when at least one frame received */
+	int32_t  prod;       /* Power produced at last frame (W)     */
+	int32_t  cons;       /* Power consumed at last frame (W)     */
+	uint64_t joule_prod; /* Energy integrators (J)               */
+	uint64_t joule_cons;
+	struct metrics_window win[METRICS_TRACK_COUNT][METRICS_WIN_COUNT];
+};
+
+void metrics_init  (struct metrics *m);
+void metrics_update(struct metrics *m, struct aquarea_state *state);
+int  metrics_window(const struct metrics *m, int field, int window, struct metrics_agg *agg);
+int  metrics_field (int n);
+const char *metrics_window_name(int window);
+
+#endif
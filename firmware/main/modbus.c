@@ -0,0 +1,233 @@
+/**
+ * @file  main/modbus.c
+ * @brief Modbus TCP server
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "lwip/sockets.h"
+#include "aquarea.h"
+#include "modbus.h"
+#include "modbus_pdu.h"
+#include "os.h"
+#include "tasks.h"
+
+/**
+ * @brief Context of a connected master
+ */
+struct modbus_client
+{
+	int      fd;      /* Socket, -1 if slot unused      */
+	uint32_t tm_last; /* Time of the last received data */
+	size_t   len;     /* Number of bytes into buffer    */
+	uint8_t  buf[MODBUS_ADU_SIZE];
+};
+
+static void modbus_task(void *arg);
+static void modbus_accept(int sock);
+static void modbus_close(struct modbus_client *c);
+static void modbus_recv(struct modbus_client *c);
+
+static struct modbus_client modbus_clients[MODBUS_MAX_CLIENTS];
+static struct aquarea_state modbus_state;
+static uint8_t modbus_rsp[MODBUS_ADU_SIZE];
+
+/**
+ * @brief Start the Modbus TCP server
+ *
+ * @return integer Zero is returned on success, -1 on error
+ */
+int modbus_init(void)
+{
+	int i;
+
+	for (i = 0; i < MODBUS_MAX_CLIENTS; i++)
+		modbus_clients[i].fd = -1;
+
+	/* Network core, requests never preempt UART processing */
+	if (os_task_create(modbus_task, "modbus", 3072, NULL,
+	                   TASK_PRIO_MODBUS, TASK_CORE_NET))
+		return(-1);
+	return(0);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Modbus server task
+ *
+ * All masters are handled by this single task, memory used is bounded by
+ * the number of clients (one request buffer each).
+ *
+ * @param arg Not used
+ */
+static void modbus_task(void *arg)
+{
+	struct sockaddr_in addr;
+	struct timeval tv;
+	fd_set rfds;
+	uint32_t now;
+	int sock, fd_max, opt, i;
+
+	(void)arg;
+
+	sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sock < 0)
+		goto error;
+	opt = 1;
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons(MODBUS_PORT);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+		goto error;
+	if (listen(sock, MODBUS_MAX_CLIENTS) != 0)
+		goto error;
+
+	while(1)
+	{
+		FD_ZERO(&rfds);
+		FD_SET(sock, &rfds);
+		fd_max = sock;
+		for (i = 0; i < MODBUS_MAX_CLIENTS; i++)
+		{
+			if (modbus_clients[i].fd < 0)
+				continue;
+			FD_SET(modbus_clients[i].fd, &rfds);
+			if (modbus_clients[i].fd > fd_max)
+				fd_max = modbus_clients[i].fd;
+		}
+		tv.tv_sec  = 1;
+		tv.tv_usec = 0;
+		if (select(fd_max + 1, &rfds, NULL, NULL, &tv) < 0)
+			continue;
+
+		if (FD_ISSET(sock, &rfds))
+			modbus_accept(sock);
+
+		now = os_time_ms();
+		for (i = 0; i < MODBUS_MAX_CLIENTS; i++)
+		{
+			if (modbus_clients[i].fd < 0)
+				continue;
+			if (FD_ISSET(modbus_clients[i].fd, &rfds))
+				modbus_recv(&modbus_clients[i]);
+			else if ((now - modbus_clients[i].tm_last) > (MODBUS_TIMEOUT * 1000))
+				modbus_close(&modbus_clients[i]);
+		}
+	}
+
+error:
+	printf("MODBUS: Failed to start server\n");
+	if (sock >= 0)
+		close(sock);
+	os_task_exit();
+}
+
+/**
+ * @brief Accept a new master
+ *
+ * @param sock Listening socket
+ */
+static void modbus_accept(int sock)
+{
+	struct modbus_client *c = NULL;
+	struct timeval tv;
+	int fd, i;
+
+	fd = accept(sock, NULL, NULL);
+	if (fd < 0)
+		return;
+
+	for (i = 0; i < MODBUS_MAX_CLIENTS; i++)
+	{
+		if (modbus_clients[i].fd < 0)
+		{
+			c = &modbus_clients[i];
+			break;
+		}
+	}
+	if (c == NULL)
+	{
+		printf("MODBUS: Too many masters\n");
+		close(fd);
+		return;
+	}
+	/* Server task is shared by all masters, a stalled one can't block it */
+	tv.tv_sec  = 0;
+	tv.tv_usec = MODBUS_SEND_TIMEOUT * 1000;
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	c->fd  = fd;
+	c->len = 0;
+	c->tm_last = os_time_ms();
+}
+
+/**
+ * @brief Close the connection with a master
+ *
+ * @param c Pointer to the client
+ */
+static void modbus_close(struct modbus_client *c)
+{
+	close(c->fd);
+	c->fd = -1;
+}
+
+/**
+ * @brief Receive data from a master and answer complete requests
+ *
+ * @param c Pointer to the client
+ */
+static void modbus_recv(struct modbus_client *c)
+{
+	size_t used;
+	int len;
+
+	len = recv(c->fd, c->buf + c->len, MODBUS_ADU_SIZE - c->len, 0);
+	if (len <= 0)
+	{
+		modbus_close(c);
+		return;
+	}
+	c->len += len;
+	c->tm_last = os_time_ms();
+
+	/* A master may send many requests without waiting responses */
+	while (c->len)
+	{
+		/* Answer from the last decoded state, never query the heatpump */
+		aquarea_get_state(&modbus_state);
+		len = modbus_adu(&modbus_state, c->buf, c->len, modbus_rsp, &used);
+		if (len < 0)
+		{
+			modbus_close(c);
+			return;
+		}
+		if (len == 0)
+			break;
+		/* Timeout or short write, the master does not read responses */
+		if (send(c->fd, modbus_rsp, len, 0) != len)
+		{
+			modbus_close(c);
+			return;
+		}
+		c->len -= used;
+		memmove(c->buf, c->buf + used, c->len);
+	}
+}
+/* EOF */
@@ -0,0 +1,26 @@
+/**
+ * @file  main/modbus.h
+ * @brief Headers and definitions for the Modbus TCP server
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef MODBUS_H
+#define MODBUS_H
+
+#define MODBUS_PORT        502
+#define MODBUS_MAX_CLIENTS   4 /* Max number of connected masters       */
+#define MODBUS_TIMEOUT      60 /* Inactive masters are closed (seconds) */
+#define MODBUS_SEND_TIMEOUT 500 /* Max delay to send a response (ms)    */
+
+int modbus_init(void);
+
+#endif
@@ -0,0 +1,302 @@
+/**
+ * @file  main/modbus_pdu.c
+ * @brief Process Modbus TCP requests, registers are a view of the state
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Registers
+ * Holding and input registers use the same map :
+ *   0   + n      : value of field n, signed 16 bits (saturated)
+ *   100 + 2n     : value of field n, signed 32 bits (most significant first)
+ *   200, 201     : number of the last decoded frame
+ *   202, 203     : timestamp of the last decoded frame (unix time)
+ * Only fields of the settings area (see aquarea_state_writable) can be
+ * written, using the 16 bits registers. Writes are sent to the heatpump
+ * with the next query.
+ */
+#include <string.h>
+#include "aquarea.h"
+#include "modbus_pdu.h"
+
+/* Max number of registers into one read request */
+#define READ_MAX  125
+/* Max number of registers into one write request */
+#define WRITE_MAX 123
+
+static int      exception(uint8_t *rsp, uint8_t code);
+static int      reg_read (const struct aquarea_state *state, uint16_t addr, uint16_t *v);
+static int      reg_write(uint16_t addr, uint16_t v, struct aquarea_cmd *cmd);
+static int      reg_set  (const struct aquarea_cmd *list, int count);
+static uint16_t get16(const uint8_t *p);
+static void     put16(uint8_t *p, uint16_t v);
+
+/**
+ * @brief Process one Modbus TCP request
+ *
+ * The request is answered only from the specified state : reads never make
+ * a transaction on the serial link.
+ *
+ * @param state Pointer to the state used for reads
+ * @param req   Pointer to received data (may contain a partial request)
+ * @param len   Number of received bytes
+ * @param rsp   Pointer to a buffer of MODBUS_ADU_SIZE bytes for response
+ * @param used  Pointer to a variable where the request length is stored, set
+ *              to zero if the request is not complete yet
+ * @return integer Length of the response, 0 if request is incomplete, or -1
+ *                 if request is invalid (connection must be closed)
+ */
+int modbus_adu(const struct aquarea_state *state, const uint8_t *req,
+               size_t len, uint8_t *rsp, size_t *used)
+{
+	struct aquarea_cmd cmd[AQUAREA_CMD_COUNT], one;
+	const uint8_t *pdu;
+	uint16_t addr, count, v;
+	size_t   size;
+	int i, result;
+
+	*used = 0;
+	/* MBAP header : transaction, protocol, length, unit */
+	if (len < 8)
+		return(0);
+	size = get16(req + 4);
+	if ((get16(req + 2) != 0) || (size < 2) || ((size + 6) > MODBUS_ADU_SIZE))
+		return(-1);
+	if (len < (size + 6))
+		return(0);
+	*used = size + 6;
+
+	pdu = req + 7;
+	size -= 1;
+	/* Response header : same transaction and unit, length set at end */
+	memcpy(rsp, req, 7);
+	rsp[7] = pdu[0];
+
+	switch(pdu[0])
+	{
+		case MODBUS_READ_HOLDING:
+		case MODBUS_READ_INPUT:
+			if (size != 5)
+				return(-1);
+			addr  = get16(pdu + 1);
+			count = get16(pdu + 3);
+			if ((count == 0) || (count > READ_MAX))
+			{
+				result = exception(rsp, MODBUS_EX_VALUE);
+				break;
+			}
+			if (((uint32_t)addr + count) > 0x10000)
+			{
+				result = exception(rsp, MODBUS_EX_ADDRESS);
+				break;
+			}
+			for (i = 0; i < count; i++)
+			{
+				if (reg_read(state, addr + i, &v))
+					break;
+				put16(rsp + 9 + (i * 2), v);
+			}
+			if (i != count)
+			{
+				result = exception(rsp, MODBUS_EX_ADDRESS);
+				break;
+			}
+			rsp[8] = count * 2;
+			result = 9 + (count * 2);
+			break;
+
+		case MODBUS_WRITE_SINGLE:
+			if (size != 5)
+				return(-1);
+			result = reg_write(get16(pdu + 1), get16(pdu + 3), &cmd[0]);
+			if (result == 0)
+				result = reg_set(cmd, 1);
+			if (result)
+			{
+				result = exception(rsp, result);
+				break;
+			}
+			/* Response is an echo of the request */
+			memcpy(rsp + 8, pdu + 1, 4);
+			result = 12;
+			break;
+
+		case MODBUS_WRITE_MULTIPLE:
+			if ((size < 6) || (size != (6u + pdu[5])))
+				return(-1);
+			addr  = get16(pdu + 1);
+			count = get16(pdu + 3);
+			if ((count == 0) || (count > WRITE_MAX) || (pdu[5] != (count * 2)))
+			{
+				result = exception(rsp, MODBUS_EX_VALUE);
+				break;
+			}
+			if (((uint32_t)addr + count) > 0x10000)
+			{
+				result = exception(rsp, MODBUS_EX_ADDRESS);
+				break;
+			}
+			/* Check all registers first, nothing is written on error */
+			result = 0;
+			for (i = 0; (i < count) && (result == 0); i++)
+			{
+				result = reg_write(addr + i, get16(pdu + 6 + (i * 2)), &one);
+				if (i < AQUAREA_CMD_COUNT)
+					cmd[i] = one;
+			}
+			/* Then all commands are queued together, or none */
+			if ((result == 0) && (count > AQUAREA_CMD_COUNT))
+				result = MODBUS_EX_BUSY;
+			if (result == 0)
+				result = reg_set(cmd, count);
+			if (result)
+			{
+				result = exception(rsp, result);
+				break;
+			}
+			memcpy(rsp + 8, pdu + 1, 4);
+			result = 12;
+			break;
+
+		default:
+			result = exception(rsp, MODBUS_EX_FUNCTION);
+			break;
+	}
+
+	/* Update length of MBAP header (unit + PDU) */
+	put16(rsp + 4, result - 6);
+	return(result);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Make an exception response
+ *
+ * @param rsp  Pointer to the response buffer (header already set)
+ * @param code Exception code
+ * @return integer Length of the response
+ */
+static int exception(uint8_t *rsp, uint8_t code)
+{
+	rsp[7] |= 0x80;
+	rsp[8]  = code;
+	return(9);
+}
+
+/**
+ * @brief Read one register
+ *
+ * @param state Pointer to the state
+ * @param addr  Address of the register
+ * @param v     Pointer to a variable where register value is stored
+ * @return integer Zero on success, -1 if there is no register at this address
+ */
+static int reg_read(const struct aquarea_state *state, uint16_t addr, uint16_t *v)
+{
+	uint32_t v32;
+	int32_t  value;
+
+	if (addr < (MODBUS_REG_VALUE + AQ_FIELD_COUNT))
+	{
+		value = state->value[addr - MODBUS_REG_VALUE];
+		if (value > 32767)
+			value = 32767;
+		else if (value < -32768)
+			value = -32768;
+		*v = (uint16_t)value;
+		return(0);
+	}
+
+	if ((addr >= MODBUS_REG_VALUE32) &&
+	    (addr < (MODBUS_REG_VALUE32 + (AQ_FIELD_COUNT * 2))))
+	{
+		addr -= MODBUS_REG_VALUE32;
+		v32 = (uint32_t)state->value[addr / 2];
+	}
+	else if ((addr >= MODBUS_REG_INFO) && (addr < (MODBUS_REG_INFO + 4)))
+	{
+		addr -= MODBUS_REG_INFO;
+		v32 = (addr < 2) ? state->seq : state->time;
+	}
+	else
+		return(-1);
+
+	*v = (addr & 1) ? (v32 & 0xFFFF) : (v32 >> 16);
+	return(0);
+}
+
+/**
+ * @brief Check a write of one register and make the set command
+ *
+ * @param addr Address of the register
+ * @param v    New value of the register
+ * @param cmd  Pointer to the command to fill
+ * @return integer Zero on success, or a Modbus exception code
+ */
+static int reg_write(uint16_t addr, uint16_t v, struct aquarea_cmd *cmd)
+{
+	int field = addr - MODBUS_REG_VALUE;
+	int32_t value = (int16_t)v;
+
+	if ((addr >= (MODBUS_REG_VALUE + AQ_FIELD_COUNT)) ||
+	    ! aquarea_state_writable(field))
+		return(MODBUS_EX_ADDRESS);
+	if (aquarea_state_encode(NULL, field, value))
+		return(MODBUS_EX_VALUE);
+
+	cmd->field = field;
+	cmd->value = value;
+	return(0);
+}
+
+/**
+ * @brief Send the set commands of a write request
+ *
+ * @param list  Pointer to the commands (see reg_write)
+ * @param count Number of commands
+ * @return integer Zero on success, or a Modbus exception code
+ */
+static int reg_set(const struct aquarea_cmd *list, int count)
+{
+	switch(aquarea_set_list(list, count))
+	{
+		case 0:  return(0);
+		case -2: return(MODBUS_EX_BUSY);
+		default: return(MODBUS_EX_VALUE);
+	}
+}
+
+/**
+ * @brief Read a big-endian 16 bits word
+ *
+ * @param p Pointer to the first byte
+ * @return uint16_t Value of the word
+ */
+static uint16_t get16(const uint8_t *p)
+{
+	return((p[0] << 8) | p[1]);
+}
+
+/**
+ * @brief Write a big-endian 16 bits word
+ *
+ * @param p Pointer to the first byte
+ * @param v Value to write
+ */
+static void put16(uint8_t *p, uint16_t v)
+{
+	p[0] = (v >> 8);
+	p[1] = (v & 0xFF);
+}
+/* EOF */
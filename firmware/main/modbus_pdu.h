@@ -0,0 +1,45 @@
+/**
+ * @file  main/modbus_pdu.h
+ * @brief Headers and definitions for Modbus requests processing
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef MODBUS_PDU_H
+#define MODBUS_PDU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "aquarea_state.h"
+
+#define MODBUS_ADU_SIZE 260 /* Max size of a Modbus TCP frame (MBAP + PDU) */
+
+/* Register map (same map for holding and input registers) */
+#define MODBUS_REG_VALUE     0 /* One register per field (int16, saturated) */
+#define MODBUS_REG_VALUE32 100 /* Two registers per field (int32, MSW first) */
+#define MODBUS_REG_INFO    200 /* Frame number, timestamp (uint32, MSW first) */
+
+/* Function codes */
+#define MODBUS_READ_HOLDING   0x03
+#define MODBUS_READ_INPUT     0x04
+#define MODBUS_WRITE_SINGLE   0x06
+#define MODBUS_WRITE_MULTIPLE 0x10
+
+/* Exception codes */
+#define MODBUS_EX_FUNCTION 0x01
+#define MODBUS_EX_ADDRESS  0x02
+#define MODBUS_EX_VALUE    0x03
+#define MODBUS_EX_BUSY     0x06
+
+int modbus_adu(const struct aquarea_state *state, const uint8_t *req,
+               size_t len, uint8_t *rsp, size_t *used);
+
+#endif
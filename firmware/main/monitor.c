@@ -0,0 +1,158 @@
+/**
+ * @file  main/monitor.c
+ * @brief Measure CPU usage and stack of each task
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "monitor.h"
+#include "tasks.h"
+
+static void monitor_task(void *arg);
+
+static struct monitor_task monitor_tab[MONITOR_TASK_MAX];
+static int                 monitor_count;
+static os_mutex_t          monitor_lock = NULL;
+
+/**
+ * @brief Start the monitor task
+ *
+ * @return integer Zero is returned on success, -1 on error
+ */
+int monitor_init(void)
+{
+	monitor_count = 0;
+
+	monitor_lock = os_mutex_create();
+	if (monitor_lock == NULL)
+		return(-1);
+
+	/* Lowest priority, measures must never delay other tasks */
+	if (os_task_create(monitor_task, "monitor", 3072, NULL,
+	                   TASK_PRIO_MONITOR, TASK_CORE_NET))
+		return(-1);
+	return(0);
+}
+
+/**
+ * @brief Get a copy of the last measures
+ *
+ * @param tab Pointer to an array where measures are copied
+ * @param max Number of entries into the array
+ * @return integer Number of tasks copied
+ */
+int monitor_get(struct monitor_task *tab, int max)
+{
+	int count;
+
+	if (monitor_lock == NULL)
+		return(0);
+
+	os_mutex_lock(monitor_lock);
+	count = (monitor_count < max) ? monitor_count : max;
+	memcpy(tab, monitor_tab, count * sizeof(struct monitor_task));
+	os_mutex_unlock(monitor_lock);
+
+	return(count);
+}
+
+/**
+ * @brief Compute new measures from task statistics
+ *
+ * Load of each task is the difference between its runtime counter and the
+ * one of the previous measure (same name and core), the counter can wrap.
+ * A new task has a load of zero.
+ *
+ * @param tab     Pointer to the measures, updated
+ * @param count   Number of measures into tab
+ * @param st      Pointer to the statistics of tasks
+ * @param n       Number of tasks (at most MONITOR_TASK_MAX)
+ * @param elapsed Time since previous statistics (us)
+ * @return integer New number of measures into tab
+ */
+int monitor_update(struct monitor_task *tab, int count,
+                   const struct os_task_stat *st, int n, uint32_t elapsed)
+{
+	struct monitor_task prev[MONITOR_TASK_MAX];
+	uint32_t delta;
+	int i, j;
+
+	memcpy(prev, tab, count * sizeof(struct monitor_task));
+
+	for (i = 0; i < n; i++)
+	{
+		memcpy(tab[i].name, st[i].name, OS_TASK_NAME);
+		tab[i].prio       = st[i].prio;
+		tab[i].core       = st[i].core;
+		tab[i].stack_free = st[i].stack_free;
+		tab[i].runtime    = st[i].runtime;
+		tab[i].load       = 0;
+
+		for (j = 0; j < count; j++)
+		{
+			if ((prev[j].core != st[i].core) ||
+			    strncmp(prev[j].name, st[i].name, OS_TASK_NAME))
+				continue;
+			delta = (st[i].runtime - prev[j].runtime);
+			if (elapsed && (delta <= elapsed))
+				tab[i].load = ((uint64_t)delta * 1000) / elapsed;
+			else if (elapsed)
+				tab[i].load = 1000;
+			break;
+		}
+	}
+	return(n);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Main function of the monitor task
+ *
+ * @param arg Unused
+ */
+static void monitor_task(void *arg)
+{
+	struct os_task_stat st[MONITOR_TASK_MAX];
+	uint32_t tm_last, now;
+	int i, n;
+
+	tm_last = os_time_ms();
+
+	while(1)
+	{
+		os_delay(MONITOR_PERIOD * 1000);
+
+		n = os_task_stats(st, MONITOR_TASK_MAX);
+		if (n < 0)
+			continue;
+		now = os_time_ms();
+
+		os_mutex_lock(monitor_lock);
+		monitor_count = monitor_update(monitor_tab, monitor_count, st, n,
+		                               (now - tm_last) * 1000);
+		os_mutex_unlock(monitor_lock);
+		tm_last = now;
+
+		for (i = 0; i < n; i++)
+		{
+			/* Zero if not known (host) */
+			if (st[i].stack_free && (st[i].stack_free < MONITOR_STACK_LOW))
+				printf("MONITOR: Task %s, only %u bytes of stack free\n",
+				       st[i].name, (unsigned int)st[i].stack_free);
+		}
+	}
+}
+/* EOF */
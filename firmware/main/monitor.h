@@ -0,0 +1,45 @@
+/**
+ * @file  main/monitor.h
+ * @brief Headers and definitions for the tasks monitor
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include <stdint.h>
+#include "os.h"
+
+#define MONITOR_PERIOD    10 /* Period of measures (seconds)          */
+#define MONITOR_TASK_MAX  24 /* Max number of tasks monitored         */
+#define MONITOR_STACK_LOW 512 /* Warning when less free stack (bytes) */
+
+/**
+ * @brief Measures of one task
+ */
+struct monitor_task
+{
+	char     name[OS_TASK_NAME];
+	int      prio;
+	int      core;       /* Core of the task, or OS_CORE_ANY           */
+	uint32_t stack_free; /* Minimum free stack since start (bytes)     */
+	uint16_t load;       /* CPU usage during last period (per mille of */
+	                     /* one core)                                  */
+	uint32_t runtime;    /* Last runtime counter (us)                  */
+};
+
+int  monitor_init(void);
+int  monitor_get(struct monitor_task *tab, int max);
+int  monitor_update(struct monitor_task *tab, int count,
+                    const struct os_task_stat *st, int n, uint32_t elapsed);
+
+#endif
@@ -0,0 +1,150 @@
+/**
+ * @file  main/network.c
+ * @brief Initialize and handle the Ethernet interface
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include "driver/gpio.h"
+#include "esp_err.h"
+#include "esp_eth.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_sntp.h"
+#include "network.h"
+
+/* Ethernet PHY (KSZ8091RN) connected to RMII interface */
+#define ETH_MDC_GPIO    5
+#define ETH_MDIO_GPIO   23
+#define ETH_CLK_EN_GPIO 18 /* Enable the 50MHz oscillator (CLK50_EN) */
+
+static void eth_event(void *arg, esp_event_base_t base, int32_t id, void *data);
+static void ip_event(void *arg, esp_event_base_t base, int32_t id, void *data);
+
+static esp_eth_handle_t eth_handle = NULL;
+static volatile int network_up = 0;
+
+/**
+ * @brief Initialize the network interface
+ *
+ * This function start the Ethernet interface (with DHCP). Network is not
+ * immediately available, use network_is_up() to know when an address has
+ * been received.
+ *
+ * @return integer Zero is returned on success, -1 on error
+ */
+int network_init(void)
+{
+	esp_netif_config_t netif_cfg = ESP_NETIF_DEFAULT_ETH();
+	eth_mac_config_t   mac_cfg   = ETH_MAC_DEFAULT_CONFIG();
+	eth_phy_config_t   phy_cfg   = ETH_PHY_DEFAULT_CONFIG();
+	esp_netif_t    *eth_netif;
+	esp_eth_mac_t  *mac;
+	esp_eth_phy_t  *phy;
+
+	network_up = 0;
+
+	if (esp_netif_init() != ESP_OK)
+		goto init_fail;
+	if (esp_event_loop_create_default() != ESP_OK)
+		goto init_fail;
+	eth_netif = esp_netif_new(&netif_cfg);
+	if (esp_eth_set_default_handlers(eth_netif) != ESP_OK)
+		goto init_fail;
+	esp_event_handler_register(ETH_EVENT, ESP_EVENT_ANY_ID, &eth_event, NULL);
+	esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, &ip_event, NULL);
+
+	/* Enable the RMII reference clock */
+	gpio_reset_pin(ETH_CLK_EN_GPIO);
+	gpio_set_direction(ETH_CLK_EN_GPIO, GPIO_MODE_OUTPUT);
+	gpio_set_level(ETH_CLK_EN_GPIO, 1);
+
+	mac_cfg.smi_mdc_gpio_num  = ETH_MDC_GPIO;
+	mac_cfg.smi_mdio_gpio_num = ETH_MDIO_GPIO;
+	/* RX task on the core of the caller (network core, see tasks.h) */
+	mac_cfg.flags |= ETH_MAC_FLAG_PIN_TO_CORE;
+	phy_cfg.phy_addr       = ESP_ETH_PHY_ADDR_AUTO;
+	phy_cfg.reset_gpio_num = -1;
+
+	mac = esp_eth_mac_new_esp32(&mac_cfg);
+	/* KSZ8091 is register compatible with KSZ8041 for basic functions */
+	phy = esp_eth_phy_new_ksz8041(&phy_cfg);
+
+	esp_eth_config_t eth_cfg = ETH_DEFAULT_CONFIG(mac, phy);
+	if (esp_eth_driver_install(&eth_cfg, &eth_handle) != ESP_OK)
+		goto init_fail;
+	if (esp_netif_attach(eth_netif, esp_eth_new_netif_glue(eth_handle)) != ESP_OK)
+		goto init_fail;
+	if (esp_eth_start(eth_handle) != ESP_OK)
+		goto init_fail;
+
+	/* Use NTP to get current time (timestamps of history and publish) */
+	sntp_setoperatingmode(SNTP_OPMODE_POLL);
+	sntp_setservername(0, NETWORK_NTP_SERVER);
+	sntp_init();
+
+	return(0);
+
+init_fail:
+	printf("NETWORK: Failed to init interface\n");
+	return(-1);
+}
+
+/**
+ * @brief Test if network is available
+ *
+ * @return boolean True if link is up and an IP address is available
+ */
+int network_is_up(void)
+{
+	return(network_up);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Handler called on Ethernet events
+ *
+ */
+static void eth_event(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+	switch (id)
+	{
+		case ETHERNET_EVENT_CONNECTED:
+			printf("NETWORK: Link up\n");
+			break;
+		case ETHERNET_EVENT_DISCONNECTED:
+			printf("NETWORK: Link down\n");
+			network_up = 0;
+			break;
+		case ETHERNET_EVENT_STOP:
+			network_up = 0;
+			break;
+		default:
+			break;
+	}
+}
+
+/**
+ * @brief Handler called when an IP address has been received
+ *
+ */
+static void ip_event(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+	ip_event_got_ip_t *event = (ip_event_got_ip_t *)data;
+
+	printf("NETWORK: Address " IPSTR "\n", IP2STR(&event->ip_info.ip));
+	network_up = 1;
+}
+/* EOF */
@@ -0,0 +1,24 @@
+/**
+ * @file  main/network.h
+ * @brief Headers and definitions for network (Ethernet) functions
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef NETWORK_H
+#define NETWORK_H
+
+#define NETWORK_NTP_SERVER "pool.ntp.org"
+
+int network_init(void);
+int network_is_up(void);
+
+#endif
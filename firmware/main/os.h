@@ -0,0 +1,88 @@
+/**
+ * @file  main/os.h
+ * @brief Headers and definitions for the OS abstraction layer
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef OS_H
+#define OS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OS_FOREVER  0xFFFFFFFF /* Timeout value to wait forever      */
+#define OS_PRIO_IDLE         0 /* Lowest priority of a task          */
+#define OS_CORE_ANY         -1 /* Task not pinned to a core          */
+#define OS_TASK_NAME        16 /* Maximum length of a task name      */
+#define OS_QUEUE_PRIV       32 /* Size of a queue control block (words) */
+
+typedef void (*os_task_fn)(void *arg);
+typedef struct os_queue *os_queue_t;
+typedef struct os_mutex *os_mutex_t;
+typedef struct os_pm_lock *os_pm_lock_t;
+
+/**
+ * @brief Statistics of one task
+ */
+struct os_task_stat
+{
+	char     name[OS_TASK_NAME];
+	int      prio;
+	int      core;       /* Core of the task, or OS_CORE_ANY             */
+	uint32_t stack_free; /* Minimum free stack since start (bytes)       */
+	uint32_t runtime;    /* Time spent running (us, wraps after 71 min)  */
+};
+
+/**
+ * @brief Storage of a queue control block, for queues created without heap
+ *
+ * Content is private to the OS layer.
+ */
+struct os_queue_static
+{
+	uintptr_t priv[OS_QUEUE_PRIV];
+};
+
+/* Tasks and time */
+int      os_task_create(os_task_fn fn, const char *name, size_t stack, void *arg,
+                        int prio, int core);
+int      os_task_stats(struct os_task_stat *st, int max);
+void     os_task_exit(void);
+uintptr_t os_task_id(void);
+void     os_delay(uint32_t ms);
+void     os_yield(void);
+uint32_t os_time_ms(void);
+
+/* Queues (copy of items) */
+os_queue_t   os_queue_create(unsigned int count, size_t size);
+os_queue_t   os_queue_create_static(unsigned int count, size_t size,
+                                    struct os_queue_static *qs, uint8_t *storage);
+int          os_queue_send(os_queue_t q, const void *item, uint32_t timeout);
+void         os_queue_overwrite(os_queue_t q, const void *item);
+int          os_queue_recv(os_queue_t q, void *item, uint32_t timeout);
+unsigned int os_queue_count(os_queue_t q);
+
+/* Mutexes */
+os_mutex_t os_mutex_create(void);
+void       os_mutex_lock(os_mutex_t m);
+void       os_mutex_unlock(os_mutex_t m);
+
+/* Heap */
+int os_heap_stats(uint32_t *free, uint32_t *min_free);
+
+/* Power management (light sleep when no lock is held) */
+int          os_pm_enable(void);
+os_pm_lock_t os_pm_lock_create(const char *name);
+void         os_pm_acquire(os_pm_lock_t l);
+void         os_pm_release(os_pm_lock_t l);
+
+#endif
@@ -0,0 +1,359 @@
+/**
+ * @file  main/os_freertos.c
+ * @brief OS abstraction layer, FreeRTOS backend (firmware)
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Notes
+ * Each function is a direct call to FreeRTOS. Timeouts are in milliseconds
+ * and converted to ticks (rounded up, so a non-zero timeout always waits).
+ */
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_pm.h"
+#include "esp_system.h"
+#include "os.h"
+
+/* Maximum number of tasks read by os_task_stats */
+#define OS_TASK_STATS_MAX 24
+
+_Static_assert(sizeof(StaticQueue_t) <= sizeof(struct os_queue_static),
+               "OS_QUEUE_PRIV too small for StaticQueue_t");
+
+static TickType_t ticks(uint32_t ms);
+
+/**
+ * @brief Create and start a new task
+ *
+ * @param fn    Main function of the task
+ * @param name  Name of the task (debug)
+ * @param stack Size of the stack (bytes)
+ * @param arg   Argument given to the main function
+ * @param prio  Priority of the task (OS_PRIO_IDLE + n)
+ * @param core  Core where the task runs (0 or 1), or OS_CORE_ANY
+ * @return integer Zero is returned on success, -1 on error
+ */
+int os_task_create(os_task_fn fn, const char *name, size_t stack, void *arg,
+                   int prio, int core)
+{
+	BaseType_t id;
+
+	id = (core == OS_CORE_ANY) ? tskNO_AFFINITY : core;
+	if (xTaskCreatePinnedToCore(fn, name, stack, arg, tskIDLE_PRIORITY + prio,
+	                            NULL, id) != pdPASS)
+		return(-1);
+	return(0);
+}
+
+/**
+ * @brief Get statistics of all tasks (including IDLE and esp-idf tasks)
+ *
+ * Needs CONFIG_FREERTOS_USE_TRACE_FACILITY and run time stats (esp_timer
+ * clock) into sdkconfig.
+ *
+ * @param st  Pointer to an array where statistics are copied
+ * @param max Number of entries into the array
+ * @return integer Number of tasks, -1 on error
+ */
+int os_task_stats(struct os_task_stat *st, int max)
+{
+	TaskStatus_t status[OS_TASK_STATS_MAX];
+	UBaseType_t  count;
+	BaseType_t   core;
+	uint32_t total;
+	int i;
+
+	count = uxTaskGetSystemState(status, OS_TASK_STATS_MAX, &total);
+	if (count == 0)
+		return(-1);
+	if (count > max)
+		count = max;
+
+	for (i = 0; i < count; i++)
+	{
+		strncpy(st[i].name, status[i].pcTaskName, OS_TASK_NAME - 1);
+		st[i].name[OS_TASK_NAME - 1] = 0;
+		st[i].prio = status[i].uxCurrentPriority - tskIDLE_PRIORITY;
+		core = xTaskGetAffinity(status[i].xHandle);
+		st[i].core = (core == tskNO_AFFINITY) ? OS_CORE_ANY : core;
+		/* On esp-idf, stack sizes are in bytes */
+		st[i].stack_free = status[i].usStackHighWaterMark;
+		st[i].runtime    = status[i].ulRunTimeCounter;
+	}
+	return(count);
+}
+
+/**
+ * @brief Terminate the current task
+ *
+ */
+void os_task_exit(void)
+{
+	vTaskDelete(NULL);
+}
+
+/**
+ * @brief Get an identifier of the current task
+ *
+ * @return uintptr Identifier, unique while the task runs
+ */
+uintptr_t os_task_id(void)
+{
+	return((uintptr_t)xTaskGetCurrentTaskHandle());
+}
+
+/**
+ * @brief Suspend the current task for a delay
+ *
+ * @param ms Delay in milliseconds (at least one tick)
+ */
+void os_delay(uint32_t ms)
+{
+	vTaskDelay(ticks(ms));
+}
+
+/**
+ * @brief Let other tasks run (wait for the next tick)
+ *
+ */
+void os_yield(void)
+{
+	vTaskDelay(1);
+}
+
+/**
+ * @brief Get a monotonic time, since boot
+ *
+ * @return uint32 Time in milliseconds (wraps after 49 days)
+ */
+uint32_t os_time_ms(void)
+{
+	return(xTaskGetTickCount() * portTICK_PERIOD_MS);
+}
+
+/**
+ * @brief Create a queue
+ *
+ * @param count Maximum number of items into the queue
+ * @param size  Size of one item (bytes)
+ * @return os_queue Handle of the queue, NULL on error
+ */
+os_queue_t os_queue_create(unsigned int count, size_t size)
+{
+	return((os_queue_t)xQueueCreate(count, size));
+}
+
+/**
+ * @brief Create a queue into memory given by the caller (no heap used)
+ *
+ * @param count   Maximum number of items into the queue
+ * @param size    Size of one item (bytes)
+ * @param qs      Pointer to the control block of the queue
+ * @param storage Pointer to the items buffer (count * size bytes)
+ * @return os_queue Handle of the queue, NULL on error
+ */
+os_queue_t os_queue_create_static(unsigned int count, size_t size,
+                                  struct os_queue_static *qs, uint8_t *storage)
+{
+	return((os_queue_t)xQueueCreateStatic(count, size, storage,
+	                                      (StaticQueue_t *)qs));
+}
+
+/**
+ * @brief Insert an item into a queue (copy)
+ *
+ * @param q       Handle of the queue
+ * @param item    Pointer to the item
+ * @param timeout Maximum time to wait for room (ms), 0 to never wait
+ * @return integer Zero is returned on success, -1 if queue is full
+ */
+int os_queue_send(os_queue_t q, const void *item, uint32_t timeout)
+{
+	if (xQueueSend((QueueHandle_t)q, item, ticks(timeout)) != pdTRUE)
+		return(-1);
+	return(0);
+}
+
+/**
+ * @brief Replace the item of a queue of length one (never waits)
+ *
+ * @param q    Handle of the queue
+ * @param item Pointer to the item
+ */
+void os_queue_overwrite(os_queue_t q, const void *item)
+{
+	xQueueOverwrite((QueueHandle_t)q, item);
+}
+
+/**
+ * @brief Get an item from a queue
+ *
+ * @param q       Handle of the queue
+ * @param item    Pointer to a buffer where the item is copied
+ * @param timeout Maximum time to wait for an item (ms), 0 to never wait
+ * @return integer Zero is returned on success, -1 if queue is empty
+ */
+int os_queue_recv(os_queue_t q, void *item, uint32_t timeout)
+{
+	if (xQueueReceive((QueueHandle_t)q, item, ticks(timeout)) != pdTRUE)
+		return(-1);
+	return(0);
+}
+
+/**
+ * @brief Get the number of items into a queue
+ *
+ * @param q Handle of the queue
+ * @return integer Number of items
+ */
+unsigned int os_queue_count(os_queue_t q)
+{
+	return(uxQueueMessagesWaiting((QueueHandle_t)q));
+}
+
+/**
+ * @brief Create a mutex
+ *
+ * @return os_mutex Handle of the mutex, NULL on error
+ */
+os_mutex_t os_mutex_create(void)
+{
+	return((os_mutex_t)xSemaphoreCreateMutex());
+}
+
+/**
+ * @brief Take a mutex (wait until available)
+ *
+ * @param m Handle of the mutex
+ */
+void os_mutex_lock(os_mutex_t m)
+{
+	xSemaphoreTake((SemaphoreHandle_t)m, portMAX_DELAY);
+}
+
+/**
+ * @brief Release a mutex
+ *
+ * @param m Handle of the mutex
+ */
+void os_mutex_unlock(os_mutex_t m)
+{
+	xSemaphoreGive((SemaphoreHandle_t)m);
+}
+
+/**
+ * @brief Get free memory of the heap
+ *
+ * @param free     Pointer to store the current free size (bytes)
+ * @param min_free Pointer to store the lowest free size since boot (bytes)
+ * @return integer Zero is returned on success, -1 if not available
+ */
+int os_heap_stats(uint32_t *free, uint32_t *min_free)
+{
+	*free     = esp_get_free_heap_size();
+	*min_free = esp_get_minimum_free_heap_size();
+	return(0);
+}
+
+/**
+ * @brief Enable dynamic frequency scaling and automatic light sleep
+ *
+ * The CPU runs at full speed only when a task needs it (down to 40 MHz)
+ * and the chip enters light sleep when all tasks wait. Drivers (Ethernet)
+ * and os_pm locks keep the system awake. Needs CONFIG_PM_ENABLE and
+ * CONFIG_FREERTOS_USE_TICKLESS_IDLE into sdkconfig.
+ *
+ * @return integer Zero is returned on success, -1 if not available
+ */
+int os_pm_enable(void)
+{
+#ifdef CONFIG_PM_ENABLE
+	esp_pm_config_esp32_t cfg = {
+		.max_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+		.min_freq_mhz = 40,
+		.light_sleep_enable = true,
+	};
+
+	if (esp_pm_configure(&cfg) != ESP_OK)
+		return(-1);
+	return(0);
+#else
+	return(-1);
+#endif
+}
+
+/**
+ * @brief Create a lock that prevents light sleep while held
+ *
+ * @param name Name of the lock (debug, esp_pm_dump_locks)
+ * @return os_pm_lock Handle of the lock, NULL if power management is not
+ *                    available (acquire and release do nothing)
+ */
+os_pm_lock_t os_pm_lock_create(const char *name)
+{
+#ifdef CONFIG_PM_ENABLE
+	esp_pm_lock_handle_t lock;
+
+	if (esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, name, &lock) != ESP_OK)
+		return(NULL);
+	return((os_pm_lock_t)lock);
+#else
+	return(NULL);
+#endif
+}
+
+/**
+ * @brief Take a power lock, the system stays awake until released
+ *
+ * @param l Handle of the lock
+ */
+void os_pm_acquire(os_pm_lock_t l)
+{
+#ifdef CONFIG_PM_ENABLE
+	if (l)
+		esp_pm_lock_acquire((esp_pm_lock_handle_t)l);
+#endif
+}
+
+/**
+ * @brief Release a power lock
+ *
+ * @param l Handle of the lock
+ */
+void os_pm_release(os_pm_lock_t l)
+{
+#ifdef CONFIG_PM_ENABLE
+	if (l)
+		esp_pm_lock_release((esp_pm_lock_handle_t)l);
+#endif
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Convert a timeout into ticks
+ *
+ * @param ms Timeout in milliseconds (or OS_FOREVER)
+ * @return TickType Number of ticks
+ */
+static TickType_t ticks(uint32_t ms)
+{
+	if (ms == OS_FOREVER)
+		return(portMAX_DELAY);
+	return((ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS);
+}
+/* EOF */
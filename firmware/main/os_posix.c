@@ -0,0 +1,508 @@
+/**
+ * @file  main/os_posix.c
+ * @brief OS abstraction layer, POSIX backend (host build)
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Notes
+ * This file is not part of the firmware, it is used to build the firmware
+ * as a Linux program (see test/host). Tasks are threads, priorities and
+ * cores are ignored (all threads use the default policy of the host) but
+ * reported into statistics, with the CPU time of each thread.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "os.h"
+
+/* Duration of one tick of the firmware (ms) */
+#define OS_TICK_MS 10
+/* Maximum number of tasks (for statistics) */
+#define OS_TASK_MAX 32
+
+struct os_task
+{
+	os_task_fn fn;
+	void      *arg;
+	pthread_t  th;
+	char       name[OS_TASK_NAME];
+	int        prio;
+	int        core;
+};
+
+struct os_queue
+{
+	pthread_mutex_t lock;
+	pthread_cond_t  cond;
+	unsigned int count;  /* Maximum number of items */
+	size_t       size;   /* Size of one item        */
+	unsigned int head;
+	unsigned int used;
+	uint8_t     *data;
+};
+
+_Static_assert(sizeof(struct os_queue) <= sizeof(struct os_queue_static),
+               "OS_QUEUE_PRIV too small for struct os_queue");
+
+struct os_mutex
+{
+	pthread_mutex_t lock;
+};
+
+static void *task_entry(void *arg);
+static void  task_end(void *arg);
+static void  deadline(struct timespec *ts, uint32_t ms);
+static void  queue_setup(struct os_queue *q, unsigned int count, size_t size,
+                         uint8_t *data);
+
+static struct os_task  os_tasks[OS_TASK_MAX];
+static pthread_mutex_t os_tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Create and start a new task
+ *
+ * @param fn    Main function of the task
+ * @param name  Name of the task (visible into debuggers and profilers)
+ * @param stack Size of the stack (bytes, not used)
+ * @param arg   Argument given to the main function
+ * @param prio  Priority of the task (not used)
+ * @param core  Core where the task runs (not used)
+ * @return integer Zero is returned on success, -1 on error
+ */
+int os_task_create(os_task_fn fn, const char *name, size_t stack, void *arg,
+                   int prio, int core)
+{
+	struct os_task *task = NULL;
+	int i;
+
+	/* Search a free slot, slots of terminated tasks are reused */
+	pthread_mutex_lock(&os_tasks_lock);
+	for (i = 0; i < OS_TASK_MAX; i++)
+	{
+		if (os_tasks[i].fn == NULL)
+		{
+			task = &os_tasks[i];
+			break;
+		}
+	}
+	if (task == NULL)
+	{
+		pthread_mutex_unlock(&os_tasks_lock);
+		return(-1);
+	}
+	task->fn   = fn;
+	task->arg  = arg;
+	task->prio = prio;
+	task->core = core;
+	strncpy(task->name, name, OS_TASK_NAME - 1);
+	task->name[OS_TASK_NAME - 1] = 0;
+
+	if (pthread_create(&task->th, NULL, task_entry, task) != 0)
+	{
+		task->fn = NULL;
+		pthread_mutex_unlock(&os_tasks_lock);
+		return(-1);
+	}
+	pthread_setname_np(task->th, task->name);
+	pthread_detach(task->th);
+	pthread_mutex_unlock(&os_tasks_lock);
+	return(0);
+}
+
+/**
+ * @brief Get statistics of all running tasks
+ *
+ * Stack usage is not known on host, stack_free is always zero.
+ *
+ * @param st  Pointer to an array where statistics are copied
+ * @param max Number of entries into the array
+ * @return integer Number of tasks
+ */
+int os_task_stats(struct os_task_stat *st, int max)
+{
+	struct timespec ts;
+	clockid_t clk;
+	int i, count = 0;
+
+	pthread_mutex_lock(&os_tasks_lock);
+	for (i = 0; (i < OS_TASK_MAX) && (count < max); i++)
+	{
+		if (os_tasks[i].fn == NULL)
+			continue;
+		memcpy(st[count].name, os_tasks[i].name, OS_TASK_NAME);
+		st[count].prio = os_tasks[i].prio;
+		st[count].core = os_tasks[i].core;
+		st[count].stack_free = 0;
+		st[count].runtime    = 0;
+		if ((pthread_getcpuclockid(os_tasks[i].th, &clk) == 0) &&
+		    (clock_gettime(clk, &ts) == 0))
+			st[count].runtime = (uint32_t)((ts.tv_sec * 1000000LL) +
+			                               (ts.tv_nsec / 1000));
+		count++;
+	}
+	pthread_mutex_unlock(&os_tasks_lock);
+	return(count);
+}
+
+/**
+ * @brief Terminate the current task
+ *
+ */
+void os_task_exit(void)
+{
+	pthread_exit(NULL);
+}
+
+/**
+ * @brief Get an identifier of the current task
+ *
+ * @return uintptr Identifier, unique while the task runs
+ */
+uintptr_t os_task_id(void)
+{
+	return((uintptr_t)pthread_self());
+}
+
+/**
+ * @brief Suspend the current task for a delay
+ *
+ * @param ms Delay in milliseconds
+ */
+void os_delay(uint32_t ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec  = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	while (nanosleep(&ts, &ts) && (errno == EINTR))
+		;
+}
+
+/**
+ * @brief Let other tasks run (wait for the next tick)
+ *
+ */
+void os_yield(void)
+{
+	os_delay(OS_TICK_MS);
+}
+
+/**
+ * @brief Get a monotonic time
+ *
+ * @return uint32 Time in milliseconds (wraps after 49 days)
+ */
+uint32_t os_time_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((uint32_t)((ts.tv_sec * 1000) + (ts.tv_nsec / 1000000)));
+}
+
+/**
+ * @brief Create a queue
+ *
+ * @param count Maximum number of items into the queue
+ * @param size  Size of one item (bytes)
+ * @return os_queue Handle of the queue, NULL on error
+ */
+os_queue_t os_queue_create(unsigned int count, size_t size)
+{
+	struct os_queue *q;
+
+	q = calloc(1, sizeof(struct os_queue) + (count * size));
+	if (q == NULL)
+		return(NULL);
+	queue_setup(q, count, size, (uint8_t *)(q + 1));
+	return(q);
+}
+
+/**
+ * @brief Create a queue into memory given by the caller (no heap used)
+ *
+ * @param count   Maximum number of items into the queue
+ * @param size    Size of one item (bytes)
+ * @param qs      Pointer to the control block of the queue
+ * @param storage Pointer to the items buffer (count * size bytes)
+ * @return os_queue Handle of the queue, NULL on error
+ */
+os_queue_t os_queue_create_static(unsigned int count, size_t size,
+                                  struct os_queue_static *qs, uint8_t *storage)
+{
+	struct os_queue *q = (struct os_queue *)qs;
+
+	memset(q, 0, sizeof(struct os_queue));
+	queue_setup(q, count, size, storage);
+	return(q);
+}
+
+/**
+ * @brief Insert an item into a queue (copy)
+ *
+ * @param q       Handle of the queue
+ * @param item    Pointer to the item
+ * @param timeout Maximum time to wait for room (ms), 0 to never wait
+ * @return integer Zero is returned on success, -1 if queue is full
+ */
+int os_queue_send(os_queue_t q, const void *item, uint32_t timeout)
+{
+	struct timespec ts;
+	int result = 0;
+
+	deadline(&ts, timeout);
+	pthread_mutex_lock(&q->lock);
+	while (q->used == q->count)
+	{
+		if ((timeout == 0) ||
+		    ((timeout == OS_FOREVER) ? pthread_cond_wait(&q->cond, &q->lock) :
+		     pthread_cond_timedwait(&q->cond, &q->lock, &ts)) == ETIMEDOUT)
+		{
+			result = -1;
+			break;
+		}
+	}
+	if (result == 0)
+	{
+		memcpy(q->data + (((q->head + q->used) % q->count) * q->size), item, q->size);
+		q->used++;
+		pthread_cond_broadcast(&q->cond);
+	}
+	pthread_mutex_unlock(&q->lock);
+	return(result);
+}
+
+/**
+ * @brief Replace the item of a queue of length one (never waits)
+ *
+ * @param q    Handle of the queue
+ * @param item Pointer to the item
+ */
+void os_queue_overwrite(os_queue_t q, const void *item)
+{
+	pthread_mutex_lock(&q->lock);
+	memcpy(q->data + (q->head * q->size), item, q->size);
+	q->used = 1;
+	pthread_cond_broadcast(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+}
+
+/**
+ * @brief Get an item from a queue
+ *
+ * @param q       Handle of the queue
+ * @param item    Pointer to a buffer where the item is copied
+ * @param timeout Maximum time to wait for an item (ms), 0 to never wait
+ * @return integer Zero is returned on success, -1 if queue is empty
+ */
+int os_queue_recv(os_queue_t q, void *item, uint32_t timeout)
+{
+	struct timespec ts;
+	int result = 0;
+
+	deadline(&ts, timeout);
+	pthread_mutex_lock(&q->lock);
+	while (q->used == 0)
+	{
+		if ((timeout == 0) ||
+		    ((timeout == OS_FOREVER) ? pthread_cond_wait(&q->cond, &q->lock) :
+		     pthread_cond_timedwait(&q->cond, &q->lock, &ts)) == ETIMEDOUT)
+		{
+			result = -1;
+			break;
+		}
+	}
+	if (result == 0)
+	{
+		memcpy(item, q->data + (q->head * q->size), q->size);
+		q->head = (q->head + 1) % q->count;
+		q->used--;
+		pthread_cond_broadcast(&q->cond);
+	}
+	pthread_mutex_unlock(&q->lock);
+	return(result);
+}
+
+/**
+ * @brief Get the number of items into a queue
+ *
+ * @param q Handle of the queue
+ * @return integer Number of items
+ */
+unsigned int os_queue_count(os_queue_t q)
+{
+	unsigned int used;
+
+	pthread_mutex_lock(&q->lock);
+	used = q->used;
+	pthread_mutex_unlock(&q->lock);
+	return(used);
+}
+
+/**
+ * @brief Create a mutex
+ *
+ * @return os_mutex Handle of the mutex, NULL on error
+ */
+os_mutex_t os_mutex_create(void)
+{
+	struct os_mutex *m;
+
+	m = malloc(sizeof(struct os_mutex));
+	if (m == NULL)
+		return(NULL);
+	pthread_mutex_init(&m->lock, NULL);
+	return(m);
+}
+
+/**
+ * @brief Take a mutex (wait until available)
+ *
+ * @param m Handle of the mutex
+ */
+void os_mutex_lock(os_mutex_t m)
+{
+	pthread_mutex_lock(&m->lock);
+}
+
+/**
+ * @brief Release a mutex
+ *
+ * @param m Handle of the mutex
+ */
+void os_mutex_unlock(os_mutex_t m)
+{
+	pthread_mutex_unlock(&m->lock);
+}
+
+/**
+ * @brief Get free memory of the heap (not available on host)
+ *
+ * @param free     Pointer to store the current free size (bytes)
+ * @param min_free Pointer to store the lowest free size since boot (bytes)
+ * @return integer Always -1
+ */
+int os_heap_stats(uint32_t *free, uint32_t *min_free)
+{
+	*free     = 0;
+	*min_free = 0;
+	return(-1);
+}
+
+/**
+ * @brief Enable power management (not available on host)
+ *
+ * @return integer Always -1
+ */
+int os_pm_enable(void)
+{
+	return(-1);
+}
+
+/**
+ * @brief Create a power lock (not available on host)
+ *
+ * @param name Name of the lock
+ * @return os_pm_lock Always NULL, acquire and release do nothing
+ */
+os_pm_lock_t os_pm_lock_create(const char *name)
+{
+	return(NULL);
+}
+
+void os_pm_acquire(os_pm_lock_t l)
+{
+}
+
+void os_pm_release(os_pm_lock_t l)
+{
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Entry point of all threads, call the main function of the task
+ *
+ */
+static void *task_entry(void *arg)
+{
+	struct os_task *task = arg;
+
+	/* Also called when the task ends with os_task_exit */
+	pthread_cleanup_push(task_end, task);
+	task->fn(task->arg);
+	pthread_cleanup_pop(1);
+	return(NULL);
+}
+
+/**
+ * @brief Release the slot of a terminated task
+ *
+ * @param arg Pointer to the task
+ */
+static void task_end(void *arg)
+{
+	struct os_task *task = arg;
+
+	pthread_mutex_lock(&os_tasks_lock);
+	task->fn = NULL;
+	pthread_mutex_unlock(&os_tasks_lock);
+}
+
+/**
+ * @brief Compute the absolute time of a timeout
+ *
+ * @param ts Pointer to the structure to fill
+ * @param ms Timeout in milliseconds from now
+ */
+static void deadline(struct timespec *ts, uint32_t ms)
+{
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	if ((ms == 0) || (ms == OS_FOREVER))
+		return;
+	ts->tv_sec  += ms / 1000;
+	ts->tv_nsec += (ms % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L)
+	{
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+/**
+ * @brief Initialize a queue control block
+ *
+ * @param q     Pointer to the queue
+ * @param count Maximum number of items into the queue
+ * @param size  Size of one item (bytes)
+ * @param data  Pointer to the items buffer (count * size bytes)
+ */
+static void queue_setup(struct os_queue *q, unsigned int count, size_t size,
+                        uint8_t *data)
+{
+	pthread_condattr_t attr;
+
+	q->count = count;
+	q->size  = size;
+	q->data  = data;
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&q->cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+/* EOF */
@@ -0,0 +1,406 @@
+/**
+ * @file  main/ota.c
+ * @brief Firmware update over network, while the heatpump link is running
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Usage
+ *   - start an update : POST /ota?url=http://<server>/<image.bin>
+ *                       with header X-OTA-Token: <token>
+ *   - progress        : GET /ota
+ * These requests are available only when the firmware is built with
+ * OTA_ENABLE, signed images, a token (OTA_TOKEN) and an update server
+ * (OTA_SERVER) : an image is downloaded only from this server, and it is
+ * not selected for boot if its signature is not valid.
+ * The image is downloaded by a low priority task on the network core, by
+ * chunks, and written into the slot not running (ota_0 or ota_1). Flash
+ * sectors are erased one by one as they are written, so the flash (and
+ * the cache of the link core) is never busy longer than the UART can
+ * buffer. When the image is complete and verified, the firmware reboots
+ * just after the next frame : the warm state (RTC memory) has this frame,
+ * and the next query is due after the boot.
+ * On the first boot of a new image, it is confirmed when a frame has been
+ * received from the heatpump, else the previous one is restored. When the
+ * heatpump was not answering before the update (unit off, cable removed),
+ * the image is confirmed when the link sends queries and the network is up.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "esp_http_client.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "aquarea.h"
+#include "aquarea_ll.h"
+#include "history.h"
+#include "mem.h"
+#include "network.h"
+#include "os.h"
+#include "ota.h"
+#include "tasks.h"
+
+#if OTA_ENABLE
+#include "sdkconfig.h"
+/* esp_ota_end verifies the signature only with this option */
+#ifndef CONFIG_SECURE_SIGNED_ON_UPDATE
+#error "OTA_ENABLE needs signed images (CONFIG_SECURE_SIGNED_ON_UPDATE)"
+#endif
+_Static_assert(sizeof(OTA_TOKEN) > OTA_TOKEN_MIN, "OTA_TOKEN too short");
+_Static_assert(sizeof(OTA_TOKEN) <= OTA_TOKEN_MAX, "OTA_TOKEN too long");
+
+static void ota_task(void *arg);
+static void ota_reboot(void);
+static int  ota_allowed(const char *url);
+static int  ota_token(httpd_req_t *req);
+
+static char ota_url[OTA_URL_MAX];
+static char ota_buf[OTA_CHUNK_SIZE];
+static volatile uint32_t ota_bytes;
+static volatile uint32_t ota_total;
+
+#define OTA_STATIC (sizeof(ota_url) + sizeof(ota_buf))
+#else
+#define OTA_STATIC 0
+#endif
+static void ota_verify(void *arg);
+
+static volatile int ota_state;
+
+_Static_assert(OTA_STATIC <= MEM_BUDGET_OTA, "ota over memory budget");
+
+/**
+ * @brief Initialize the update module
+ *
+ * @return integer Zero is returned on success, -1 on error
+ */
+int ota_init(void)
+{
+	const esp_partition_t *run;
+	esp_ota_img_states_t st;
+
+	ota_state = OTA_IDLE;
+	mem_account("ota", OTA_STATIC, MEM_BUDGET_OTA);
+
+	run = esp_ota_get_running_partition();
+	if (run == NULL)
+	{
+		printf("OTA: Not available\n");
+		return(-1);
+	}
+	printf("OTA: Running from %s\n", run->label);
+
+	/* First boot of a new image, keep it only if the link works */
+	if ((esp_ota_get_state_partition(run, &st) == ESP_OK) &&
+	    (st == ESP_OTA_IMG_PENDING_VERIFY))
+	{
+		if (os_task_create(ota_verify, "ota", 2048, NULL,
+		                   TASK_PRIO_OTA, TASK_CORE_NET))
+			return(-1);
+	}
+	return(0);
+}
+
+#if OTA_ENABLE
+/**
+ * @brief Start to download and write a new image
+ *
+ * @param url Address of the image (http://...)
+ * @return integer Zero is returned on success, -1 on error
+ */
+int ota_start(const char *url)
+{
+	if ((ota_state == OTA_DOWNLOAD) || (ota_state == OTA_REBOOT))
+		return(-1);
+	if (strlen(url) >= OTA_URL_MAX)
+		return(-1);
+	if ( ! ota_allowed(url))
+	{
+		printf("OTA: Refused, %s is not on update server\n", url);
+		return(-1);
+	}
+
+	strcpy(ota_url, url);
+	ota_bytes = 0;
+	ota_total = 0;
+	ota_state = OTA_DOWNLOAD;
+
+	if (os_task_create(ota_task, "ota", 4096, NULL,
+	                   TASK_PRIO_OTA, TASK_CORE_NET))
+	{
+		ota_state = OTA_ERROR;
+		return(-1);
+	}
+	printf("OTA: Download %s\n", ota_url);
+	return(0);
+}
+
+/**
+ * @brief Get the progress of the update
+ *
+ * @param st Pointer to a structure where status is copied
+ */
+void ota_status(struct ota_status *st)
+{
+	st->state = ota_state;
+	st->bytes = ota_bytes;
+	st->total = ota_total;
+}
+
+/**
+ * @brief HTTP handler used to read the progress of an update
+ *
+ * @param req Pointer to the HTTP request
+ * @return esp_err ESP_OK on success
+ */
+esp_err_t ota_http_get(httpd_req_t *req)
+{
+	static const char *names[] = { "idle", "download", "reboot", "error" };
+	const esp_partition_t *run;
+	struct ota_status st;
+	char buffer[128];
+	int len;
+
+	ota_status(&st);
+	run = esp_ota_get_running_partition();
+
+	len = snprintf(buffer, sizeof(buffer),
+	               "{\"state\":\"%s\",\"bytes\":%u,\"total\":%u,\"running\":\"%s\"}",
+	               names[st.state], (unsigned int)st.bytes,
+	               (unsigned int)st.total, run ? run->label : "");
+
+	httpd_resp_set_type(req, "application/json");
+	return(httpd_resp_send(req, buffer, len));
+}
+
+/**
+ * @brief HTTP handler used to start an update
+ *
+ * @param req Pointer to the HTTP request
+ * @return esp_err ESP_OK on success
+ */
+esp_err_t ota_http_post(httpd_req_t *req)
+{
+	char query[OTA_URL_MAX + 16];
+	char url[OTA_URL_MAX];
+
+	if ( ! ota_token(req))
+		return(httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, NULL));
+
+	if ((httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) ||
+	    (httpd_query_key_value(query, "url", url, sizeof(url)) != ESP_OK))
+		return(httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL));
+
+	if ( ! ota_allowed(url))
+		return(httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, NULL));
+	if (ota_start(url) < 0)
+		return(httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL));
+	return(httpd_resp_send(req, NULL, 0));
+}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+#if OTA_ENABLE
+/**
+ * @brief Test if an image URL is on the update server
+ *
+ * @param url Address of the image
+ * @return integer True (1) if the image can be downloaded, 0 if not
+ */
+static int ota_allowed(const char *url)
+{
+	size_t len = strlen(OTA_SERVER);
+
+	/* The server must end with a slash, else its name can be extended */
+	if ((len == 0) || (OTA_SERVER[len - 1] != '/'))
+		return(0);
+	if (strncmp(url, OTA_SERVER, len) != 0)
+		return(0);
+	/* Only a file name or a path below the server root */
+	if ((url[len] == 0) || strstr(url + len, ".."))
+		return(0);
+	return(1);
+}
+
+/**
+ * @brief Test if a request has the update token
+ *
+ * The comparison time does not depend on the received value.
+ *
+ * @param req Pointer to the HTTP request
+ * @return integer True (1) if the token is valid, 0 if not
+ */
+static int ota_token(httpd_req_t *req)
+{
+	char token[OTA_TOKEN_MAX + 1];
+	uint8_t diff = 0;
+	size_t i;
+
+	memset(token, 0, sizeof(token));
+	if (httpd_req_get_hdr_value_str(req, "X-OTA-Token", token,
+	                                sizeof(token)) != ESP_OK)
+		return(0);
+	for (i = 0; i < sizeof(OTA_TOKEN); i++)
+		diff |= (token[i] ^ OTA_TOKEN[i]);
+	return(diff == 0);
+}
+
+/**
+ * @brief Main function of the update task
+ *
+ * @param arg Unused
+ */
+static void ota_task(void *arg)
+{
+	esp_http_client_config_t config = {
+		.url         = ota_url,
+		.timeout_ms  = OTA_TIMEOUT,
+		.buffer_size = OTA_CHUNK_SIZE,
+	};
+	const esp_partition_t *part;
+	esp_http_client_handle_t client;
+	esp_ota_handle_t handle = 0;
+	int len;
+
+	part = esp_ota_get_next_update_partition(NULL);
+	if (part == NULL)
+		goto error;
+
+	client = esp_http_client_init(&config);
+	if (client == NULL)
+		goto error;
+	if (esp_http_client_open(client, 0) != ESP_OK)
+		goto err_http;
+	len = esp_http_client_fetch_headers(client);
+	if (esp_http_client_get_status_code(client) != 200)
+		goto err_http;
+	ota_total = (len > 0) ? len : 0;
+	if (ota_total > part->size)
+		goto err_http;
+
+	/* Sectors are erased when the write reach them, not all at once */
+	if (esp_ota_begin(part, OTA_WITH_SEQUENTIAL_WRITES, &handle) != ESP_OK)
+		goto err_http;
+
+	while(1)
+	{
+		len = esp_http_client_read(client, ota_buf, OTA_CHUNK_SIZE);
+		if (len < 0)
+			goto err_write;
+		if (len == 0)
+			break;
+		if (esp_ota_write(handle, ota_buf, len) != ESP_OK)
+			goto err_write;
+		ota_bytes += len;
+		/* Leave the network core to other tasks between two chunks */
+		os_delay(OTA_CHUNK_DELAY);
+	}
+	if (!esp_http_client_is_complete_data_received(client))
+		goto err_write;
+	esp_http_client_close(client);
+	esp_http_client_cleanup(client);
+
+	/* Image is verified (checksum and hash) before being selected */
+	if (esp_ota_end(handle) != ESP_OK)
+		goto error;
+	if (esp_ota_set_boot_partition(part) != ESP_OK)
+		goto error;
+
+	printf("OTA: %u bytes written into %s\n", (unsigned int)ota_bytes,
+	       part->label);
+	ota_state = OTA_REBOOT;
+	/* Never returns */
+	ota_reboot();
+
+err_write:
+	esp_ota_abort(handle);
+err_http:
+	esp_http_client_close(client);
+	esp_http_client_cleanup(client);
+error:
+	printf("OTA: Update failed (%u bytes)\n", (unsigned int)ota_bytes);
+	ota_state = OTA_ERROR;
+	os_task_exit();
+}
+
+/**
+ * @brief Reboot on the new image, with a minimal data gap
+ *
+ * The reboot is made just after a frame (or after a timeout if the
+ * heatpump does not answer) : the next query is due after the boot, so
+ * no poll is lost. History is written to flash before.
+ */
+static void ota_reboot(void)
+{
+	struct aquarea_state state;
+	uint32_t seq, t0;
+
+	aquarea_get_state(&state);
+	seq = state.seq;
+	t0 = os_time_ms();
+	while ((os_time_ms() - t0) < OTA_REBOOT_WAIT)
+	{
+		aquarea_get_state(&state);
+		if (state.seq != seq)
+			break;
+		os_delay(10);
+	}
+
+	if (history_flush(1000))
+		printf("OTA: Failed to flush history\n");
+	printf("OTA: Reboot\n");
+	esp_restart();
+}
+#endif
+
+/**
+ * @brief Confirm a new image when the heatpump link works
+ *
+ * The state is restored from warm memory before this task starts : a non
+ * zero frame number means that the heatpump answered before the update,
+ * then a frame is expected with the new image too.
+ *
+ * @param arg Unused
+ */
+static void ota_verify(void *arg)
+{
+	struct aquarea_ll_stats ll;
+	struct aquarea_state state;
+	uint32_t t0;
+	int seen;
+
+	aquarea_get_state(&state);
+	seen = (state.seq != 0);
+	t0 = os_time_ms();
+	while(1)
+	{
+		aquarea_ll_stats(&ll);
+		if (ll.rx_ok || ( ! seen && ll.tx && network_is_up()))
+		{
+			printf("OTA: New image confirmed (%s)\n",
+			       ll.rx_ok ? "frame received" : "no heatpump, link and network up");
+			esp_ota_mark_app_valid_cancel_rollback();
+			break;
+		}
+		if ((os_time_ms() - t0) >= (OTA_VERIFY_DELAY * 1000))
+		{
+			printf("OTA: New image not working, rollback\n");
+			history_flush(1000);
+			esp_ota_mark_app_invalid_rollback_and_reboot();
+			break;
+		}
+		os_delay(1000);
+	}
+	os_task_exit();
+}
+/* EOF */
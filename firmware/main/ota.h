@@ -0,0 +1,68 @@
+/**
+ * @file  main/ota.h
+ * @brief Headers and definitions for firmware update over network
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef OTA_H
+#define OTA_H
+
+#include <stdint.h>
+#include "esp_http_server.h"
+
+/* Update over HTTP is built only when enabled : the image must be signed
+ * (CONFIG_SECURE_SIGNED_ON_UPDATE), and each request must have the shared
+ * token and an image URL on the update server, see Readme */
+#ifndef OTA_ENABLE
+#define OTA_ENABLE           0
+#endif
+#ifndef OTA_TOKEN
+#define OTA_TOKEN           "" /* Value of the X-OTA-Token header          */
+#endif
+#ifndef OTA_SERVER
+#define OTA_SERVER "http://updates.local/" /* Allowed prefix of image URL  */
+#endif
+#define OTA_TOKEN_MIN       16 /* Min length of the token                  */
+#define OTA_TOKEN_MAX       64 /* Max length of the token                  */
+
+#define OTA_URL_MAX        128 /* Max length of the image URL              */
+#define OTA_CHUNK_SIZE    1024 /* Size of each read from the server        */
+#define OTA_CHUNK_DELAY     10 /* Pause between two chunks (ms)            */
+#define OTA_TIMEOUT       5000 /* Max delay without data from server (ms)  */
+#define OTA_REBOOT_WAIT  10000 /* Max wait for a frame before reboot (ms)  */
+#define OTA_VERIFY_DELAY   120 /* Delay to receive a frame after update (s) */
+
+/* State of the updater */
+#define OTA_IDLE     0
+#define OTA_DOWNLOAD 1 /* Image is written into the other slot  */
+#define OTA_REBOOT   2 /* Image complete, waiting to reboot      */
+#define OTA_ERROR    3 /* Last update failed                     */
+
+/**
+ * @brief Progress of an update
+ */
+struct ota_status
+{
+	int      state;
+	uint32_t bytes; /* Bytes written into the slot   */
+	uint32_t total; /* Size of the image, 0 if unknown */
+};
+
+int       ota_init(void);
+#if OTA_ENABLE
+int       ota_start(const char *url);
+void      ota_status(struct ota_status *st);
+esp_err_t ota_http_get(httpd_req_t *req);
+esp_err_t ota_http_post(httpd_req_t *req);
+#endif
+
+#endif
@@ -0,0 +1,300 @@
+/**
+ * @file  main/prom.c
+ * @brief Render values and counters using Prometheus text format
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include "prom.h"
+
+/**
+ * @brief Output buffer context
+ */
+struct prom_out
+{
+	char  *buffer;
+	size_t size;
+	size_t len;
+	int    overflow;
+};
+
+static void out(struct prom_out *o, const char *fmt, ...);
+static void counter(struct prom_out *o, const char *name, uint32_t v);
+static void labels (struct prom_out *o, const struct monitor_task *task);
+
+/**
+ * @brief Render all metrics into a buffer
+ *
+ * Nothing is allocated, the output is written into the specified buffer.
+ * Decoded values are exported only when at least one state has been
+ * received (seq not zero).
+ *
+ * @param buffer Pointer to the output buffer
+ * @param size   Size of the output buffer
+ * @param state  Pointer to the last decoded state
+ * @param ll     Pointer to the link counters
+ * @return integer Number of bytes written, -1 if buffer is too small
+ */
+int prom_render(char *buffer, size_t size, const struct aquarea_state *state,
+                const struct aquarea_ll_stats *ll)
+{
+	struct prom_out o = { buffer, size, 0, 0 };
+	uint32_t cumul;
+	const char *name;
+	int i;
+
+	if (state->seq)
+	{
+		out(&o, "# TYPE aquarea_last_frame_timestamp_seconds gauge\n"
+		        "aquarea_last_frame_timestamp_seconds %u\n",
+		        (unsigned int)state->time);
+		for (i = 0; i < AQ_FIELD_COUNT; i++)
+		{
+			name = aquarea_state_name(i);
+			/* Energy is a counter (reset on power loss) */
+			if ((i == AQ_ENERGY_PROD) || (i == AQ_ENERGY_CONS))
+				out(&o, "# TYPE aquarea_%s_wh_total counter\n"
+				        "aquarea_%s_wh_total %d\n",
+				        name, name, (int)state->value[i]);
+			else
+				out(&o, "# TYPE aquarea_%s gauge\naquarea_%s %d\n",
+				        name, name, (int)state->value[i]);
+		}
+	}
+
+	counter(&o, "aquarea_ll_rx_frames_total",          ll->rx_ok);
+	counter(&o, "aquarea_ll_rx_checksum_errors_total", ll->rx_cksum);
+	counter(&o, "aquarea_ll_rx_resync_total",          ll->rx_resync);
+	counter(&o, "aquarea_ll_tx_frames_total",          ll->tx);
+	if (ll->first_rx)
+		out(&o, "# TYPE aquarea_ll_first_frame_seconds gauge\n"
+		        "aquarea_ll_first_frame_seconds %u.%03u\n",
+		        (unsigned int)(ll->first_rx / 1000),
+		        (unsigned int)(ll->first_rx % 1000));
+
+	/* Latency histogram, buckets are cumulative */
+	out(&o, "# TYPE aquarea_ll_rx_latency_seconds histogram\n");
+	cumul = 0;
+	for (i = 0; i < (AQUAREA_LL_LAT_BUCKETS - 1); i++)
+	{
+		cumul += ll->lat_bucket[i];
+		out(&o, "aquarea_ll_rx_latency_seconds_bucket{le=\"%u.%03u\"} %u\n",
+		    aquarea_ll_lat_bounds[i] / 1000, aquarea_ll_lat_bounds[i] % 1000,
+		    (unsigned int)cumul);
+	}
+	out(&o, "aquarea_ll_rx_latency_seconds_bucket{le=\"+Inf\"} %u\n"
+	        "aquarea_ll_rx_latency_seconds_sum %u.%03u\n"
+	        "aquarea_ll_rx_latency_seconds_count %u\n",
+	        (unsigned int)ll->lat_count,
+	        (unsigned int)(ll->lat_sum / 1000), (unsigned int)(ll->lat_sum % 1000),
+	        (unsigned int)ll->lat_count);
+
+	/* Usage of the line, rates are computed with rate() from counters */
+	counter(&o, "aquarea_ll_rx_bytes_total", ll->rx_bytes);
+	counter(&o, "aquarea_ll_tx_bytes_total", ll->tx_bytes);
+	out(&o, "# TYPE aquarea_ll_rx_busy_seconds_total counter\n"
+	        "aquarea_ll_rx_busy_seconds_total %u.%03u\n"
+	        "# TYPE aquarea_ll_tx_busy_seconds_total counter\n"
+	        "aquarea_ll_tx_busy_seconds_total %u.%03u\n",
+	        (unsigned int)(ll->rx_busy / 1000), (unsigned int)(ll->rx_busy % 1000),
+	        (unsigned int)(ll->tx_busy / 1000), (unsigned int)(ll->tx_busy % 1000));
+	out(&o, "# TYPE aquarea_ll_load_ratio gauge\n"
+	        "aquarea_ll_load_ratio %u.%03u\n",
+	        (unsigned int)(ll->load / 1000), (unsigned int)(ll->load % 1000));
+
+	/* Idle gaps histogram, buckets are cumulative */
+	out(&o, "# TYPE aquarea_ll_gap_seconds histogram\n");
+	cumul = 0;
+	for (i = 0; i < (AQUAREA_LL_GAP_BUCKETS - 1); i++)
+	{
+		cumul += ll->gap_bucket[i];
+		out(&o, "aquarea_ll_gap_seconds_bucket{le=\"%u.%03u\"} %u\n",
+		    aquarea_ll_gap_bounds[i] / 1000, aquarea_ll_gap_bounds[i] % 1000,
+		    (unsigned int)cumul);
+	}
+	out(&o, "aquarea_ll_gap_seconds_bucket{le=\"+Inf\"} %u\n"
+	        "aquarea_ll_gap_seconds_sum %u.%03u\n"
+	        "aquarea_ll_gap_seconds_count %u\n",
+	        (unsigned int)ll->gap_count,
+	        (unsigned int)(ll->gap_sum / 1000), (unsigned int)(ll->gap_sum % 1000),
+	        (unsigned int)ll->gap_count);
+
+	if (o.overflow)
+		return(-1);
+	return(o.len);
+}
+
+/**
+ * @brief Render measures of each task into a buffer
+ *
+ * @param buffer Pointer to the output buffer
+ * @param size   Size of the output buffer
+ * @param tasks  Pointer to an array of task measures
+ * @param count  Number of tasks into the array
+ * @return integer Number of bytes written, -1 if buffer is too small
+ */
+int prom_render_tasks(char *buffer, size_t size,
+                      const struct monitor_task *tasks, int count)
+{
+	struct prom_out o = { buffer, size, 0, 0 };
+	int i;
+
+	/* Nothing measured yet */
+	if (count == 0)
+		return(0);
+
+	out(&o, "# TYPE aquarea_task_cpu_ratio gauge\n");
+	for (i = 0; i < count; i++)
+	{
+		out(&o, "aquarea_task_cpu_ratio");
+		labels(&o, &tasks[i]);
+		out(&o, " %u.%03u\n", tasks[i].load / 1000, tasks[i].load % 1000);
+	}
+	out(&o, "# TYPE aquarea_task_stack_free_bytes gauge\n");
+	for (i = 0; i < count; i++)
+	{
+		out(&o, "aquarea_task_stack_free_bytes");
+		labels(&o, &tasks[i]);
+		out(&o, " %u\n", (unsigned int)tasks[i].stack_free);
+	}
+
+	if (o.overflow)
+		return(-1);
+	return(o.len);
+}
+
+/**
+ * @brief Render the state of each alarm rule into a buffer
+ *
+ * @param buffer Pointer to the output buffer
+ * @param size   Size of the output buffer
+ * @param r      Pointer to the rules context
+ * @return integer Number of bytes written, -1 if buffer is too small
+ */
+int prom_render_alarms(char *buffer, size_t size, const struct rules *r)
+{
+	struct prom_out o = { buffer, size, 0, 0 };
+	uint32_t active = r->active;
+	int i;
+
+	if (r->count == 0)
+		return(0);
+
+	out(&o, "# TYPE aquarea_alarm gauge\n");
+	for (i = 0; i < r->count; i++)
+		out(&o, "aquarea_alarm{rule=\"%s\",field=\"%s\"} %d\n",
+		    r->rule[i].name, aquarea_state_name(r->rule[i].field),
+		    (active & (1UL << i)) ? 1 : 0);
+
+	if (o.overflow)
+		return(-1);
+	return(o.len);
+}
+
+/**
+ * @brief Render memory usage into a buffer
+ *
+ * Heap counters are exported only when available (not on host).
+ *
+ * @param buffer Pointer to the output buffer
+ * @param size   Size of the output buffer
+ * @param st     Pointer to the memory report
+ * @return integer Number of bytes written, -1 if buffer is too small
+ */
+int prom_render_mem(char *buffer, size_t size, const struct mem_stats *st)
+{
+	struct prom_out o = { buffer, size, 0, 0 };
+	int i;
+
+	if (st->heap_valid)
+	{
+		out(&o, "# TYPE aquarea_heap_free_bytes gauge\n"
+		        "aquarea_heap_free_bytes %u\n",
+		        (unsigned int)st->heap_free);
+		out(&o, "# TYPE aquarea_heap_min_free_bytes gauge\n"
+		        "aquarea_heap_min_free_bytes %u\n",
+		        (unsigned int)st->heap_min_free);
+	}
+	counter(&o, "aquarea_heap_sealed_allocs_total", st->sealed_allocs);
+
+	if (st->count == 0)
+		goto end;
+	out(&o, "# TYPE aquarea_static_bytes gauge\n");
+	for (i = 0; i < st->count; i++)
+		out(&o, "aquarea_static_bytes{subsystem=\"%s\"} %u\n",
+		    st->region[i].name, (unsigned int)st->region[i].used);
+	out(&o, "# TYPE aquarea_static_budget_bytes gauge\n");
+	for (i = 0; i < st->count; i++)
+		out(&o, "aquarea_static_budget_bytes{subsystem=\"%s\"} %u\n",
+		    st->region[i].name, (unsigned int)st->region[i].budget);
+
+end:
+	if (o.overflow)
+		return(-1);
+	return(o.len);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Append formatted text to the output buffer
+ *
+ * @param o   Pointer to the output context
+ * @param fmt Format string (printf like)
+ */
+static void out(struct prom_out *o, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (o->overflow)
+		return;
+
+	va_start(ap, fmt);
+	n = vsnprintf(o->buffer + o->len, o->size - o->len, fmt, ap);
+	va_end(ap);
+
+	if ((n < 0) || ((size_t)n >= (o->size - o->len)))
+		o->overflow = 1;
+	else
+		o->len += n;
+}
+
+/**
+ * @brief Append a counter to the output buffer
+ *
+ * @param o    Pointer to the output context
+ * @param name Name of the counter
+ * @param v    Value of the counter
+ */
+static void counter(struct prom_out *o, const char *name, uint32_t v)
+{
+	out(o, "# TYPE %s counter\n%s %u\n", name, name, (unsigned int)v);
+}
+
+/**
+ * @brief Append labels of a task to the output buffer
+ *
+ * @param o    Pointer to the output context
+ * @param task Pointer to the task measures
+ */
+static void labels(struct prom_out *o, const struct monitor_task *task)
+{
+	if (task->core == OS_CORE_ANY)
+		out(o, "{task=\"%s\",core=\"any\"}", task->name);
+	else
+		out(o, "{task=\"%s\",core=\"%d\"}", task->name, task->core);
+}
+/* EOF */
@@ -0,0 +1,35 @@
+/**
+ * @file  main/prom.h
+ * @brief Headers and definitions for the Prometheus exposition format
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef PROM_H
+#define PROM_H
+
+#include <stddef.h>
+#include "aquarea_ll.h"
+#include "aquarea_state.h"
+#include "mem.h"
+#include "monitor.h"
+#include "rules.h"
+
+#define PROM_BUFFER_SIZE 8192
+
+int prom_render(char *buffer, size_t size, const struct aquarea_state *state,
+                const struct aquarea_ll_stats *ll);
+int prom_render_tasks(char *buffer, size_t size,
+                      const struct monitor_task *tasks, int count);
+int prom_render_alarms(char *buffer, size_t size, const struct rules *r);
+int prom_render_mem(char *buffer, size_t size, const struct mem_stats *st);
+
+#endif
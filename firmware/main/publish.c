@@ -0,0 +1,261 @@
+/**
+ * @file  main/publish.c
+ * @brief Publish decoded states to an MQTT broker
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "mqtt_client.h"
+#include "aquarea.h"
+#include "fwdq.h"
+#include "mem.h"
+#include "os.h"
+#include "publish.h"
+#include "tasks.h"
+
+static void publish_control(esp_mqtt_event_handle_t event);
+static void publish_event(void *arg, esp_event_base_t base, int32_t id, void *data);
+static void publish_task(void *arg);
+
+/**
+ * @brief One alarm event, already formatted
+ */
+struct publish_alarm
+{
+	size_t len;
+	char   data[PUBLISH_ALARM_SIZE];
+};
+
+static esp_mqtt_client_handle_t publish_client = NULL;
+static os_queue_t    publish_queue = NULL;
+static os_queue_t    publish_alarms = NULL;
+static struct fwdq   publish_fwdq;
+static volatile int  publish_connected;
+static unsigned int  publish_drop;
+static struct os_queue_static publish_qs, publish_alarm_qs;
+static uint8_t publish_buf[PUBLISH_QUEUE_LEN * sizeof(struct aquarea_state)];
+static uint8_t publish_alarm_buf[PUBLISH_ALARM_LEN * sizeof(struct publish_alarm)];
+
+#define PUBLISH_STATIC (sizeof(publish_fwdq) + sizeof(publish_qs) + \
+                        sizeof(publish_alarm_qs) + sizeof(publish_buf) + \
+                        sizeof(publish_alarm_buf))
+_Static_assert(PUBLISH_STATIC <= MEM_BUDGET_PUBLISH, "publish over memory budget");
+
+/**
+ * @brief Initialize the publish module
+ *
+ * This function start the MQTT client and the task used to send states. The
+ * client connects (and reconnects) to the broker in background, states are
+ * queued meanwhile.
+ *
+ * @return integer Zero is returned on success, -1 on error
+ */
+int publish_init(void)
+{
+	esp_mqtt_client_config_t cfg = {
+		.uri = PUBLISH_BROKER_URI,
+		/* Core is set by sdkconfig (CONFIG_MQTT_USE_CORE_0) */
+		.task_prio = TASK_PRIO_PUBLISH,
+	};
+
+	publish_connected = 0;
+	publish_drop = 0;
+	fwdq_init(&publish_fwdq);
+
+	publish_queue = os_queue_create_static(PUBLISH_QUEUE_LEN,
+	                                       sizeof(struct aquarea_state),
+	                                       &publish_qs, publish_buf);
+	if (publish_queue == NULL)
+		return(-1);
+	publish_alarms = os_queue_create_static(PUBLISH_ALARM_LEN,
+	                                        sizeof(struct publish_alarm),
+	                                        &publish_alarm_qs, publish_alarm_buf);
+	if (publish_alarms == NULL)
+		return(-1);
+	mem_account("publish", PUBLISH_STATIC, MEM_BUDGET_PUBLISH);
+
+	publish_client = esp_mqtt_client_init(&cfg);
+	if (publish_client == NULL)
+	{
+		printf("PUBLISH: Failed to create MQTT client\n");
+		return(-1);
+	}
+	esp_mqtt_client_register_event(publish_client, ESP_EVENT_ANY_ID,
+	                               publish_event, NULL);
+	if (esp_mqtt_client_start(publish_client) != ESP_OK)
+		return(-1);
+
+	/* Network core, catch-up must not delay UART processing */
+	if (os_task_create(publish_task, "publish", 4096, NULL,
+	                   TASK_PRIO_PUBLISH, TASK_CORE_NET))
+		return(-1);
+
+	return(0);
+}
+
+/**
+ * @brief Insert a new state into the publish queue
+ *
+ * This function never wait : if the queue is full the state is dropped and
+ * counted (it is still available into history).
+ *
+ * @param state Pointer to the state to publish
+ */
+void publish_push(const struct aquarea_state *state)
+{
+	if (publish_queue == NULL)
+		return;
+
+	if (os_queue_send(publish_queue, state, 0) != 0)
+		publish_drop++;
+}
+
+/**
+ * @brief Insert an alarm event into the publish queue
+ *
+ * Events are kept until the broker is connected, so an alarm raised during
+ * a network outage is not lost. This function never wait : if the queue is
+ * full the event is dropped and counted.
+ *
+ * @param name   Name of the rule
+ * @param active New state of the alarm (1 raised, 0 cleared)
+ * @param value  Value of the field that changed the alarm
+ * @param time   Timestamp of the state
+ */
+void publish_alarm(const char *name, int active, int32_t value, uint32_t time)
+{
+	struct publish_alarm alarm;
+
+	if (publish_alarms == NULL)
+		return;
+
+	alarm.len = snprintf(alarm.data, PUBLISH_ALARM_SIZE,
+	                     "{\"alarm\":\"%s\",\"active\":%d,\"value\":%d,\"time\":%u}",
+	                     name, active, (int)value, (unsigned int)time);
+	if (os_queue_send(publish_alarms, &alarm, 0) != 0)
+		publish_drop++;
+}
+
+/**
+ * @brief Send a message to the broker
+ *
+ * Messages are sent with QoS 1, once accepted by the MQTT client they are
+ * retransmitted until acknowledged by the broker.
+ *
+ * @param data Pointer to the message content
+ * @param len  Length of the message (in bytes)
+ * @return integer Zero is returned on success, -1 on error
+ */
+int publish_send(const char *data, size_t len)
+{
+	if ( ! publish_connected)
+		return(-1);
+
+	if (esp_mqtt_client_publish(publish_client, PUBLISH_TOPIC,
+	                            data, len, 1, 0) < 0)
+		return(-1);
+
+	return(0);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Process a message received on the control topic
+ *
+ * @param event Pointer to the MQTT data event
+ */
+static void publish_control(esp_mqtt_event_handle_t event)
+{
+	char text[PUBLISH_CONTROL_SIZE];
+
+	if ((event->topic_len != (int)strlen(PUBLISH_CONTROL_TOPIC)) ||
+	    strncmp(event->topic, PUBLISH_CONTROL_TOPIC, event->topic_len))
+		return;
+	/* Parameters must fit into one message */
+	if ((event->current_data_offset != 0) ||
+	    (event->data_len != event->total_data_len) ||
+	    (event->data_len >= PUBLISH_CONTROL_SIZE))
+	{
+		printf("PUBLISH: Control message too long\n");
+		return;
+	}
+	memcpy(text, event->data, event->data_len);
+	text[event->data_len] = 0;
+
+	if (aquarea_control(text) != 0)
+		printf("PUBLISH: Invalid control parameters\n");
+}
+
+/**
+ * @brief Handler of MQTT client events
+ *
+ * @param arg  Unused
+ * @param base Event base (MQTT)
+ * @param id   Identifier of the event
+ * @param data Pointer to event data
+ */
+static void publish_event(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+	switch(id)
+	{
+		case MQTT_EVENT_CONNECTED:
+			printf("PUBLISH: Connected to broker\n");
+			publish_connected = 1;
+			/* Control parameters are retained by broker, received
+			 * again on each connection */
+			esp_mqtt_client_subscribe(publish_client, PUBLISH_CONTROL_TOPIC, 1);
+			break;
+		case MQTT_EVENT_DISCONNECTED:
+			printf("PUBLISH: Disconnected from broker\n");
+			publish_connected = 0;
+			break;
+		case MQTT_EVENT_DATA:
+			publish_control((esp_mqtt_event_handle_t)data);
+			break;
+		default:
+			break;
+	}
+}
+
+/**
+ * @brief Main function of the publish task
+ *
+ * @param arg Unused
+ */
+static void publish_task(void *arg)
+{
+	struct aquarea_state state;
+	struct publish_alarm alarm;
+	int alarm_pending = 0;
+
+	while(1)
+	{
+		if (os_queue_recv(publish_queue, &state, PUBLISH_PERIOD) == 0)
+			fwdq_push(&publish_fwdq, &state);
+
+		/* Alarms first, an event is removed only when sent */
+		if ( ! alarm_pending)
+			alarm_pending = (os_queue_recv(publish_alarms, &alarm, 0) == 0);
+		if (alarm_pending && publish_connected &&
+		    (esp_mqtt_client_publish(publish_client, PUBLISH_ALARM_TOPIC,
+		                             alarm.data, alarm.len, 1, 0) >= 0))
+			alarm_pending = 0;
+
+		if (publish_connected && fwdq_pending(&publish_fwdq))
+			fwdq_process(&publish_fwdq, os_time_ms());
+	}
+}
+/* EOF */
@@ -0,0 +1,38 @@
+/**
+ * @file  main/publish.h
+ * @brief Headers and definitions for the MQTT publisher
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef PUBLISH_H
+#define PUBLISH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "aquarea_state.h"
+
+#define PUBLISH_BROKER_URI "mqtt://mqtt.local"
+#define PUBLISH_TOPIC      "aquarea/state"
+#define PUBLISH_ALARM_TOPIC "aquarea/alarm"
+#define PUBLISH_CONTROL_TOPIC "aquarea/control"
+#define PUBLISH_QUEUE_LEN  16
+#define PUBLISH_ALARM_LEN   8 /* Number of alarm events kept      */
+#define PUBLISH_ALARM_SIZE 96 /* Maximum size of one alarm event  */
+#define PUBLISH_CONTROL_SIZE 512 /* Maximum size of control parameters */
+#define PUBLISH_PERIOD    100 /* Period (ms) of the publish task */
+
+int  publish_init(void);
+void publish_push(const struct aquarea_state *state);
+void publish_alarm(const char *name, int active, int32_t value, uint32_t time);
+int  publish_send(const char *data, size_t len);
+
+#endif
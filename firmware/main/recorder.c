@@ -0,0 +1,238 @@
+/**
+ * @file  main/recorder.c
+ * @brief Capture recorder : keep last frames of the serial link
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Usage
+ * When running, all bytes read or written on the serial link are saved into
+ * a RAM ring (see capture.h for format). The capture can be :
+ *   - downloaded : GET /capture
+ *   - saved into the "capture" flash partition : POST /capture?action=save
+ *   - downloaded from flash : GET /capture?src=flash
+ * POST /capture?action=start|stop|clear control the recorder.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "esp_partition.h"
+#include "aquarea_ll.h"
+#include "capture.h"
+#include "recorder.h"
+
+static void recorder_raw(int dir, const uint8_t *data, size_t len, int64_t time);
+static const esp_partition_t *recorder_part(void);
+
+static struct capture recorder_cap;
+static uint8_t recorder_buf[CAPTURE_BLOCK_SIZE];
+
+/**
+ * @brief Initialize the recorder
+ *
+ * @return integer Zero is returned on success, -1 on error
+ */
+int recorder_init(void)
+{
+	capture_init(&recorder_cap);
+#if RECORDER_AUTOSTART
+	return(recorder_start());
+#else
+	return(0);
+#endif
+}
+
+/**
+ * @brief Start to capture the serial link
+ *
+ * @return integer Zero is returned on success, -1 on error
+ */
+int recorder_start(void)
+{
+	aquarea_ll_set_raw(recorder_raw);
+	return(0);
+}
+
+/**
+ * @brief Stop to capture (content is kept)
+ *
+ */
+void recorder_stop(void)
+{
+	aquarea_ll_set_raw(NULL);
+}
+
+/**
+ * @brief Save the current capture into flash
+ *
+ * Blocks are written oldest first, one after another. The recorder is not
+ * stopped, blocks overwritten during save are skipped.
+ *
+ * @return integer Number of bytes saved, or -1 on error
+ */
+int recorder_save(void)
+{
+	const esp_partition_t *part;
+	uint32_t seq = 0;
+	size_t   size, offset = 0;
+
+	part = recorder_part();
+	if (part == NULL)
+		return(-1);
+
+	size = ((CAPTURE_BLOCKS * CAPTURE_BLOCK_SIZE) + 4095) & ~4095;
+	if (size > part->size)
+		size = part->size;
+	if (esp_partition_erase_range(part, 0, size) != ESP_OK)
+		return(-1);
+
+	while (1)
+	{
+		size = capture_export(&recorder_cap, &seq, recorder_buf);
+		if ((size == 0) || ((offset + size) > part->size))
+			break;
+		if (esp_partition_write(part, offset, recorder_buf, size) != ESP_OK)
+			return(-1);
+		offset += size;
+	}
+	printf("RECORDER: %d bytes saved\n", (int)offset);
+	return(offset);
+}
+
+/**
+ * @brief HTTP handler used to download a capture
+ *
+ * Query parameter "src=flash" read the capture saved into flash, else the
+ * capture into RAM is sent. Response is streamed, one block per chunk.
+ *
+ * @param req Pointer to the HTTP request
+ * @return esp_err ESP_OK on success
+ */
+esp_err_t recorder_http_get(httpd_req_t *req)
+{
+	const esp_partition_t *part;
+	char     query[64];
+	char     arg[16];
+	uint32_t seq = 0;
+	size_t   size, used, offset = 0;
+
+	httpd_resp_set_type(req, "application/octet-stream");
+
+	if ((httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) &&
+	    (httpd_query_key_value(query, "src", arg, sizeof(arg)) == ESP_OK) &&
+	    (strcmp(arg, "flash") == 0))
+	{
+		part = recorder_part();
+		if (part == NULL)
+			return(httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, NULL));
+		/* Blocks are stored one after another, erased flash at end */
+		while ((offset + CAPTURE_HDR_SIZE) <= part->size)
+		{
+			if (esp_partition_read(part, offset, recorder_buf, 4) != ESP_OK)
+				break;
+			used = recorder_buf[2] | (recorder_buf[3] << 8);
+			if (((recorder_buf[0] | (recorder_buf[1] << 8)) != CAPTURE_MAGIC) ||
+			    (used < CAPTURE_HDR_SIZE) || (used > CAPTURE_BLOCK_SIZE) ||
+			    ((offset + used) > part->size))
+				break;
+			if (esp_partition_read(part, offset, recorder_buf, used) != ESP_OK)
+				break;
+			if (httpd_resp_send_chunk(req, (const char *)recorder_buf, used) != ESP_OK)
+				return(ESP_FAIL);
+			offset += used;
+		}
+	}
+	else
+	{
+		while ((size = capture_export(&recorder_cap, &seq, recorder_buf)) != 0)
+		{
+			if (httpd_resp_send_chunk(req, (const char *)recorder_buf, size) != ESP_OK)
+				return(ESP_FAIL);
+		}
+	}
+	/* Empty chunk to terminate response */
+	return(httpd_resp_send_chunk(req, NULL, 0));
+}
+
+/**
+ * @brief HTTP handler used to control the recorder
+ *
+ * Query parameter "action" : start, stop, clear or save.
+ *
+ * @param req Pointer to the HTTP request
+ * @return esp_err ESP_OK on success
+ */
+esp_err_t recorder_http_post(httpd_req_t *req)
+{
+	char query[64];
+	char arg[16];
+	int  result = -1;
+
+	if ((httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) ||
+	    (httpd_query_key_value(query, "action", arg, sizeof(arg)) != ESP_OK))
+		return(httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL));
+
+	if (strcmp(arg, "start") == 0)
+		result = recorder_start();
+	else if (strcmp(arg, "stop") == 0)
+	{
+		recorder_stop();
+		result = 0;
+	}
+	else if (strcmp(arg, "clear") == 0)
+	{
+		/* Writer must be stopped while the ring is cleared */
+		recorder_stop();
+		capture_init(&recorder_cap);
+		result = recorder_start();
+	}
+	else if (strcmp(arg, "save") == 0)
+		result = (recorder_save() < 0) ? -1 : 0;
+	else
+		return(httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL));
+
+	if (result < 0)
+		return(httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL));
+	return(httpd_resp_send(req, NULL, 0));
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Function called by low-level for each chunk of bytes
+ *
+ * @param dir  Direction of the chunk
+ * @param data Pointer to the bytes
+ * @param len  Number of bytes
+ * @param time Time of the chunk (us)
+ */
+static void recorder_raw(int dir, const uint8_t *data, size_t len, int64_t time)
+{
+	capture_add(&recorder_cap, dir, data, len, time);
+}
+
+/**
+ * @brief Get the flash partition used to save captures
+ *
+ * @return esp_partition_t Pointer to the partition, NULL if not found
+ */
+static const esp_partition_t *recorder_part(void)
+{
+	const esp_partition_t *part;
+
+	part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+	                                RECORDER_PART_SUBTYPE, "capture");
+	if (part == NULL)
+		printf("RECORDER: No partition found\n");
+	return(part);
+}
+/* EOF */
@@ -0,0 +1,31 @@
+/**
+ * @file  main/recorder.h
+ * @brief Headers and definitions for the capture recorder
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "esp_http_server.h"
+
+#define RECORDER_PART_SUBTYPE 0x41
+#define RECORDER_AUTOSTART       1 /* Capture is running after boot */
+
+int       recorder_init(void);
+int       recorder_start(void);
+void      recorder_stop(void);
+int       recorder_save(void);
+esp_err_t recorder_http_get(httpd_req_t *req);
+esp_err_t recorder_http_post(httpd_req_t *req);
+
+#endif
@@ -0,0 +1,331 @@
+/**
+ * @file  main/rules.c
+ * @brief Alarm rules, evaluated on each new state for changed fields only
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Syntax
+ * One rule per line (or separated by ';'), '#' starts a comment :
+ *   <name> <field> <op> <value> [hyst <value>] [hold <seconds>]
+ * where op is one of < <= > >= == != and field is a name of the decoded
+ * state (see aquarea_state.c).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rules.h"
+
+static int compare(int op, int32_t x, int32_t value);
+static int field  (const char *name);
+static int line   (struct rules *r, char *text);
+static int oper   (const char *name);
+static void eval  (struct rules *r, int n, const int32_t *v, uint32_t now,
+                   uint32_t time);
+
+static const char *op_names[] = { "<", "<=", ">", ">=", "==", "!=" };
+
+/**
+ * @brief Initialize the rules engine, without any rule
+ *
+ * @param r     Pointer to the rules context
+ * @param event Function called when an alarm is raised or cleared (or NULL)
+ */
+void rules_init(struct rules *r, rules_event_fn event)
+{
+	int i;
+
+	memset(r, 0, sizeof(struct rules));
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+		r->first[i] = -1;
+	r->event = event;
+}
+
+/**
+ * @brief Compile a list of rules and insert them into the field index
+ *
+ * Rules already loaded are kept. On error, the rules of the text are not
+ * loaded at all.
+ *
+ * @param r    Pointer to the rules context
+ * @param text Definition of rules (see Syntax)
+ * @return integer Number of rules loaded, or -(line number) on error
+ */
+int rules_load(struct rules *r, const char *text)
+{
+	char buffer[RULES_LINE];
+	int  count = r->count;
+	int  num = 0;
+	size_t len;
+	int i, f;
+
+	while (*text)
+	{
+		len = strcspn(text, "\n;");
+		num++;
+		if (len >= RULES_LINE)
+			goto error;
+		memcpy(buffer, text, len);
+		buffer[len] = 0;
+		text += len;
+		if (*text)
+			text++;
+		if (line(r, buffer))
+			goto error;
+	}
+
+	/* Build index again, in definition order for each field */
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+		r->first[i] = -1;
+	for (i = r->count - 1; i >= 0; i--)
+	{
+		f = r->rule[i].field;
+		r->rule[i].next = r->first[f];
+		r->first[f] = i;
+	}
+	return(r->count - count);
+
+error:
+	printf("RULES: Invalid rule, line %d\n", num);
+	r->count = count;
+	return(-num);
+}
+
+/**
+ * @brief Evaluate rules with a new state
+ *
+ * Only the rules of the fields that changed since the previous state are
+ * evaluated, and the rules that wait for their hold time. The first state
+ * evaluates all rules. Hold time is measured with a monotonic clock : the
+ * wall clock (state time) may jump when it is set, it is only used as the
+ * timestamp of events.
+ *
+ * @param r     Pointer to the rules context
+ * @param state Pointer to the new state
+ * @param now   Time since boot (sec.)
+ * @return integer Number of rules evaluated
+ */
+int rules_update(struct rules *r, const struct aquarea_state *state,
+                 uint32_t now)
+{
+	uint32_t done = 0;
+	uint32_t todo;
+	unsigned int evals = r->evals;
+	int i, n;
+
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		if (r->has_last && (r->last[i] == state->value[i]))
+			continue;
+		for (n = r->first[i]; n >= 0; n = r->rule[n].next)
+		{
+			eval(r, n, state->value, now, state->time);
+			done |= (1UL << n);
+		}
+	}
+	memcpy(r->last, state->value, sizeof(r->last));
+	r->has_last = 1;
+
+	/* Value has not changed, but hold time may be reached */
+	todo = r->pending & ~done;
+	while (todo)
+	{
+		n = __builtin_ctz(todo);
+		todo &= (todo - 1);
+		eval(r, n, state->value, now, state->time);
+	}
+	r->updates++;
+	return(r->evals - evals);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Compare a value with a threshold
+ *
+ * @param op    Operator (see rules_op)
+ * @param x     Value to test
+ * @param value Threshold
+ * @return integer True (1) if "x op value", 0 if not
+ */
+static int compare(int op, int32_t x, int32_t value)
+{
+	switch(op)
+	{
+		case RULES_LT: return(x <  value);
+		case RULES_LE: return(x <= value);
+		case RULES_GT: return(x >  value);
+		case RULES_GE: return(x >= value);
+		case RULES_EQ: return(x == value);
+		case RULES_NE: return(x != value);
+	}
+	return(0);
+}
+
+/**
+ * @brief Evaluate one rule, and signal alarm changes
+ *
+ * @param r    Pointer to the rules context
+ * @param n    Index of the rule
+ * @param v    Values of the new state
+ * @param now  Time since boot (sec.)
+ * @param time Timestamp of the new state (sec.)
+ */
+static void eval(struct rules *r, int n, const int32_t *v, uint32_t now,
+                 uint32_t time)
+{
+	struct rule *rule = &r->rule[n];
+	int32_t x = v[rule->field];
+	int32_t th;
+
+	r->evals++;
+
+	if (rule->active)
+	{
+		/* Threshold moved back by hysteresis, alarm is kept until crossed */
+		th = rule->value;
+		if ((rule->op == RULES_LT) || (rule->op == RULES_LE))
+			th += rule->hyst;
+		else if ((rule->op == RULES_GT) || (rule->op == RULES_GE))
+			th -= rule->hyst;
+		if (compare(rule->op, x, th))
+			return;
+		rule->active = 0;
+		r->active &= ~(1UL << n);
+		if (r->event)
+			r->event(r, rule, x, time);
+		return;
+	}
+
+	if ( ! compare(rule->op, x, rule->value))
+	{
+		rule->pending = 0;
+		r->pending &= ~(1UL << n);
+		return;
+	}
+	if ( ! rule->pending)
+	{
+		rule->pending = 1;
+		rule->since = now;
+		r->pending |= (1UL << n);
+	}
+	if ((now - rule->since) < rule->hold)
+		return;
+
+	rule->pending = 0;
+	r->pending &= ~(1UL << n);
+	rule->active = 1;
+	r->active |= (1UL << n);
+	if (r->event)
+		r->event(r, rule, x, time);
+}
+
+/**
+ * @brief Search a field by name
+ *
+ * @param name Name of the field
+ * @return integer Identifier of the field, or -1 if not found
+ */
+static int field(const char *name)
+{
+	int i;
+
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		if (strcmp(name, aquarea_state_name(i)) == 0)
+			return(i);
+	}
+	return(-1);
+}
+
+/**
+ * @brief Compile one line of definition
+ *
+ * @param r    Pointer to the rules context
+ * @param text Line to compile (modified)
+ * @return integer Zero on success (or empty line), -1 on error
+ */
+static int line(struct rules *r, char *text)
+{
+	struct rule *rule;
+	char *tok[9];
+	char *save, *end;
+	int n = 0;
+	int i;
+
+	/* Remove comment, then split into words (8 max) */
+	end = strchr(text, '#');
+	if (end)
+		*end = 0;
+	for (tok[n] = strtok_r(text, " \t\r", &save); tok[n];
+	     tok[n] = strtok_r(NULL, " \t\r", &save))
+	{
+		if (++n == 9)
+			return(-1);
+	}
+	if (n == 0)
+		return(0);
+	if ((n < 4) || (n & 1) || (r->count == RULES_MAX))
+		return(-1);
+
+	rule = &r->rule[r->count];
+	memset(rule, 0, sizeof(struct rule));
+	if (strlen(tok[0]) >= RULES_NAME)
+		return(-1);
+	strcpy(rule->name, tok[0]);
+	i = field(tok[1]);
+	if (i < 0)
+		return(-1);
+	rule->field = i;
+	i = oper(tok[2]);
+	if (i < 0)
+		return(-1);
+	rule->op = i;
+	rule->value = strtol(tok[3], &end, 0);
+	if (*end)
+		return(-1);
+
+	/* Options */
+	for (i = 4; i < n; i += 2)
+	{
+		if (strcmp(tok[i], "hyst") == 0)
+			rule->hyst = strtol(tok[i + 1], &end, 0);
+		else if (strcmp(tok[i], "hold") == 0)
+			rule->hold = strtoul(tok[i + 1], &end, 0);
+		else
+			return(-1);
+		if (*end)
+			return(-1);
+	}
+	r->count++;
+	return(0);
+}
+
+/**
+ * @brief Search an operator by name
+ *
+ * @param name Operator (as string)
+ * @return integer Identifier of the operator, or -1 if not found
+ */
+static int oper(const char *name)
+{
+	int i;
+
+	for (i = 0; i < (sizeof(op_names) / sizeof(op_names[0])); i++)
+	{
+		if (strcmp(name, op_names[i]) == 0)
+			return(i);
+	}
+	return(-1);
+}
+/* EOF */
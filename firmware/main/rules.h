@@ -0,0 +1,94 @@
+/**
+ * @file  main/rules.h
+ * @brief Headers and definitions for the alarm rules engine
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef RULES_H
+#define RULES_H
+
+#include <stdint.h>
+#include "aquarea_state.h"
+
+#define RULES_MAX   32 /* Maximum number of rules (one bit per rule) */
+#define RULES_NAME  16 /* Maximum length of a rule name              */
+#define RULES_LINE  96 /* Maximum length of a rule definition        */
+
+/* Rules loaded on boot (see Readme for syntax) */
+#define RULES_DEFAULT \
+	"flow_low    pump_flow   <  1000 hyst 100 hold 30\n" \
+	"outlet_high outlet_temp >  55   hyst 2   hold 10\n" \
+	"error       error       != 0\n"
+
+/* Comparison operators */
+enum rules_op
+{
+	RULES_LT = 0,
+	RULES_LE,
+	RULES_GT,
+	RULES_GE,
+	RULES_EQ,
+	RULES_NE,
+};
+
+/**
+ * @brief One compiled rule
+ *
+ * The alarm is raised when "field op value" has been true during the hold
+ * time, and cleared when the value has moved back by more than hysteresis.
+ */
+struct rule
+{
+	char     name[RULES_NAME];
+	uint8_t  field;
+	uint8_t  op;
+	uint8_t  active;   /* Alarm raised                              */
+	uint8_t  pending;  /* Condition true, waiting for hold time     */
+	int32_t  value;
+	int32_t  hyst;
+	uint32_t hold;     /* Time the condition must stay true (sec.)  */
+	uint32_t since;    /* Uptime when the condition became true     */
+	int8_t   next;     /* Next rule on the same field, -1 at end    */
+};
+
+struct rules;
+typedef void (*rules_event_fn)(struct rules *r, const struct rule *rule,
+                               int32_t value, uint32_t time);
+
+/**
+ * @brief Context of the rules engine
+ *
+ * Rules are indexed by field (linked lists into the rule array) : a new
+ * state only evaluates the rules of the fields that have changed, plus the
+ * rules waiting for their hold time.
+ */
+struct rules
+{
+	struct rule rule[RULES_MAX];
+	int      count;
+	int8_t   first[AQ_FIELD_COUNT]; /* First rule of each field, or -1 */
+	int32_t  last[AQ_FIELD_COUNT];  /* Values of the previous state    */
+	int      has_last;
+	uint32_t pending;               /* Bitmap of pending rules         */
+	uint32_t active;                /* Bitmap of raised alarms         */
+	rules_event_fn event;           /* Called when an alarm changes    */
+	/* Statistics */
+	unsigned int updates;
+	unsigned int evals;
+};
+
+void rules_init  (struct rules *r, rules_event_fn event);
+int  rules_load  (struct rules *r, const char *text);
+int  rules_update(struct rules *r, const struct aquarea_state *state,
+                  uint32_t now);
+
+#endif
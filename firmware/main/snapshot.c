@@ -0,0 +1,221 @@
+/**
+ * @file  main/snapshot.c
+ * @brief Cache of the current state, serialized once per changed frame
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "mem.h"
+#include "snapshot.h"
+
+static size_t encode_json(char *buffer, const struct aquarea_state *state);
+#if SNAPSHOT_CBOR
+static size_t encode_cbor(uint8_t *buffer, const struct aquarea_state *state);
+static size_t cbor_head(uint8_t *p, uint8_t major, uint32_t v);
+#endif
+
+static struct snapshot snap_buf[2];
+static struct snapshot * _Atomic snap_current;
+static int32_t snap_last[AQ_FIELD_COUNT];
+
+#define SNAPSHOT_STATIC (sizeof(snap_buf) + sizeof(snap_last))
+_Static_assert(SNAPSHOT_STATIC <= MEM_BUDGET_SNAPSHOT, "snapshot over memory budget");
+
+/**
+ * @brief Initialize (clear) the snapshot cache
+ *
+ */
+void snapshot_init(void)
+{
+	memset(snap_buf, 0, sizeof(snap_buf));
+	memset(snap_last, 0, sizeof(snap_last));
+	atomic_store(&snap_current, NULL);
+	mem_account("snapshot", SNAPSHOT_STATIC, MEM_BUDGET_SNAPSHOT);
+}
+
+/**
+ * @brief Serialize a new state, if it has changed
+ *
+ * The state is written into the snapshot not used by readers, then this
+ * snapshot becomes the current one. If a slow reader still uses it, the
+ * update is skipped (never wait) and will be made with the next frame.
+ *
+ * @param state Pointer to the new state
+ * @return integer 1 if snapshot updated, 0 if unchanged, -1 if busy
+ */
+int snapshot_update(const struct aquarea_state *state)
+{
+	struct snapshot *cur, *next;
+
+	cur = atomic_load(&snap_current);
+	if (cur && (memcmp(snap_last, state->value, sizeof(snap_last)) == 0))
+		return(0);
+
+	next = (cur == &snap_buf[0]) ? &snap_buf[1] : &snap_buf[0];
+	if (atomic_load(&next->readers) != 0)
+		return(-1);
+
+	next->seq  = state->seq;
+	next->time = state->time;
+	next->json_len = encode_json(next->json, state);
+#if SNAPSHOT_CBOR
+	next->cbor_len = encode_cbor(next->cbor, state);
+#endif
+	memcpy(snap_last, state->value, sizeof(snap_last));
+
+	/* Publish the new snapshot */
+	atomic_store(&snap_current, next);
+	return(1);
+}
+
+/**
+ * @brief Get the current snapshot
+ *
+ * The returned snapshot is not modified until snapshot_put() is called, it
+ * can be used (sent) without copy.
+ *
+ * @return pointer Current snapshot, or NULL if no state received yet
+ */
+const struct snapshot *snapshot_get(void)
+{
+	struct snapshot *snap;
+
+	while(1)
+	{
+		snap = atomic_load(&snap_current);
+		if (snap == NULL)
+			return(NULL);
+		atomic_fetch_add(&snap->readers, 1);
+		/* Still current, writer will not use it anymore */
+		if (snap == atomic_load(&snap_current))
+			return(snap);
+		atomic_fetch_sub(&snap->readers, 1);
+	}
+}
+
+/**
+ * @brief Release a snapshot obtained with snapshot_get()
+ *
+ * @param snap Pointer to the snapshot
+ */
+void snapshot_put(const struct snapshot *snap)
+{
+	if (snap)
+		atomic_fetch_sub(&((struct snapshot *)snap)->readers, 1);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Encode a state as a JSON object
+ *
+ * @param buffer Pointer to a buffer of SNAPSHOT_JSON_SIZE bytes
+ * @param state  Pointer to the state to encode
+ * @return integer Number of bytes written
+ */
+static size_t encode_json(char *buffer, const struct aquarea_state *state)
+{
+	size_t len;
+	int i;
+
+	len = snprintf(buffer, SNAPSHOT_JSON_SIZE, "{\"seq\":%u,\"time\":%u",
+	               (unsigned int)state->seq, (unsigned int)state->time);
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+		len += snprintf(buffer + len, SNAPSHOT_JSON_SIZE - len, ",\"%s\":%d",
+		                aquarea_state_name(i), (int)state->value[i]);
+	len += snprintf(buffer + len, SNAPSHOT_JSON_SIZE - len, "}");
+
+	return(len);
+}
+
+#if SNAPSHOT_CBOR
+/**
+ * @brief Encode a state as a CBOR map (RFC 8949)
+ *
+ * @param buffer Pointer to a buffer of SNAPSHOT_CBOR_SIZE bytes
+ * @param state  Pointer to the state to encode
+ * @return integer Number of bytes written
+ */
+static size_t encode_cbor(uint8_t *buffer, const struct aquarea_state *state)
+{
+	const char *name;
+	int32_t v;
+	size_t len, l;
+	int i;
+
+	len  = cbor_head(buffer, 5, 2 + AQ_FIELD_COUNT);
+	len += cbor_head(buffer + len, 3, 3);
+	memcpy(buffer + len, "seq", 3);
+	len += 3;
+	len += cbor_head(buffer + len, 0, state->seq);
+	len += cbor_head(buffer + len, 3, 4);
+	memcpy(buffer + len, "time", 4);
+	len += 4;
+	len += cbor_head(buffer + len, 0, state->time);
+
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		name = aquarea_state_name(i);
+		l = strlen(name);
+		len += cbor_head(buffer + len, 3, l);
+		memcpy(buffer + len, name, l);
+		len += l;
+		v = state->value[i];
+		if (v >= 0)
+			len += cbor_head(buffer + len, 0, (uint32_t)v);
+		else
+			len += cbor_head(buffer + len, 1, (uint32_t)(-1 - v));
+	}
+	return(len);
+}
+
+/**
+ * @brief Write the head of a CBOR item (major type and argument)
+ *
+ * @param p     Pointer to the output buffer
+ * @param major Major type (0 uint, 1 negative, 3 text, 5 map)
+ * @param v     Argument (value, length or count)
+ * @return integer Number of bytes written
+ */
+static size_t cbor_head(uint8_t *p, uint8_t major, uint32_t v)
+{
+	major <<= 5;
+	if (v < 24)
+	{
+		p[0] = major | v;
+		return(1);
+	}
+	if (v < 0x100)
+	{
+		p[0] = major | 24;
+		p[1] = v;
+		return(2);
+	}
+	if (v < 0x10000)
+	{
+		p[0] = major | 25;
+		p[1] = (v >> 8);
+		p[2] = v;
+		return(3);
+	}
+	p[0] = major | 26;
+	p[1] = (v >> 24);
+	p[2] = (v >> 16);
+	p[3] = (v >>  8);
+	p[4] = v;
+	return(5);
+}
+#endif
+/* EOF */
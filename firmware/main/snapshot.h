@@ -0,0 +1,53 @@
+/**
+ * @file  main/snapshot.h
+ * @brief Headers and definitions for the serialized state cache
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "aquarea_state.h"
+
+#define SNAPSHOT_CBOR         1 /* Set to 0 to disable CBOR encoding  */
+#define SNAPSHOT_JSON_SIZE 1024
+#define SNAPSHOT_CBOR_SIZE  768
+
+/**
+ * @brief One serialized state
+ *
+ * Two snapshots are used : readers use the current one while the next one
+ * is written. A snapshot is never modified while its reader count is not
+ * zero.
+ */
+struct snapshot
+{
+	atomic_int readers;
+	uint32_t seq;       /* Number of the decoded frame  */
+	uint32_t time;      /* Timestamp of the frame       */
+	size_t   json_len;
+	char     json[SNAPSHOT_JSON_SIZE];
+#if SNAPSHOT_CBOR
+	size_t   cbor_len;
+	uint8_t  cbor[SNAPSHOT_CBOR_SIZE];
+#endif
+};
+
+void snapshot_init(void);
+int  snapshot_update(const struct aquarea_state *state);
+const struct snapshot *snapshot_get(void);
+void snapshot_put(const struct snapshot *snap);
+
+#endif
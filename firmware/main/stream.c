@@ -0,0 +1,132 @@
+/**
+ * @file  main/stream.c
+ * @brief Send decoded states as binary records to a UDP multicast group
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Notes
+ * One datagram is sent for each decoded state (see stream_codec.c for the
+ * format), even when nothing has changed so receivers can detect losses.
+ * Any number of listeners can join the group : there is no state per
+ * client on this side, and no retransmission.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "lwip/sockets.h"
+#include "mem.h"
+#include "os.h"
+#include "stream.h"
+#include "stream_codec.h"
+#include "tasks.h"
+
+static void stream_task(void *arg);
+
+static os_queue_t   stream_queue = NULL;
+static unsigned int stream_drop;
+static unsigned int stream_errors;
+static struct os_queue_static stream_qs;
+static uint8_t stream_buf[STREAM_QUEUE_LEN * sizeof(struct aquarea_state)];
+
+#define STREAM_STATIC (sizeof(stream_qs) + sizeof(stream_buf))
+_Static_assert(STREAM_STATIC <= MEM_BUDGET_STREAM, "stream over memory budget");
+
+/**
+ * @brief Start the multicast stream
+ *
+ * @return integer Zero is returned on success, -1 on error
+ */
+int stream_init(void)
+{
+#if STREAM_ENABLE
+	stream_drop = 0;
+	stream_errors = 0;
+
+	stream_queue = os_queue_create_static(STREAM_QUEUE_LEN,
+	                                      sizeof(struct aquarea_state),
+	                                      &stream_qs, stream_buf);
+	if (stream_queue == NULL)
+		return(-1);
+	mem_account("stream", STREAM_STATIC, MEM_BUDGET_STREAM);
+
+	if (os_task_create(stream_task, "stream", 3072, NULL,
+	                   TASK_PRIO_STREAM, TASK_CORE_NET))
+		return(-1);
+#endif
+	return(0);
+}
+
+/**
+ * @brief Insert a new state into the stream
+ *
+ * This function never wait : if the queue is full the state is dropped and
+ * counted (receivers see a lost record).
+ *
+ * @param state Pointer to the state to send
+ */
+void stream_push(const struct aquarea_state *state)
+{
+	if (stream_queue == NULL)
+		return;
+
+	if (os_queue_send(stream_queue, state, 0) != 0)
+		stream_drop++;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Stream task, encode states and send them to the group
+ *
+ * @param arg Not used
+ */
+static void stream_task(void *arg)
+{
+	struct aquarea_state state;
+	struct stream_enc  enc;
+	struct sockaddr_in addr;
+	uint8_t rec[STREAM_REC_MAX];
+	uint8_t ttl;
+	size_t  len;
+	int sock;
+
+	(void)arg;
+
+	sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0)
+		goto error;
+	ttl = STREAM_TTL;
+	setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons(STREAM_PORT);
+	addr.sin_addr.s_addr = inet_addr(STREAM_GROUP);
+
+	stream_enc_init(&enc);
+
+	while(1)
+	{
+		if (os_queue_recv(stream_queue, &state, OS_FOREVER) != 0)
+			continue;
+		len = stream_encode(&enc, &state, rec);
+		/* Network not ready : record is lost, receivers resync on key */
+		if (sendto(sock, rec, len, 0, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+			stream_errors++;
+	}
+
+error:
+	printf("STREAM: Failed to create socket\n");
+	os_task_exit();
+}
+/* EOF */
@@ -0,0 +1,30 @@
+/**
+ * @file  main/stream.h
+ * @brief Headers and definitions for the UDP multicast stream
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "aquarea_state.h"
+
+#define STREAM_ENABLE          1 /* Send states to the multicast group */
+#define STREAM_GROUP "239.255.42.1"
+#define STREAM_PORT         4210
+#define STREAM_TTL             1 /* Local network only                 */
+#define STREAM_QUEUE_LEN       4
+
+int  stream_init(void);
+void stream_push(const struct aquarea_state *state);
+
+#endif
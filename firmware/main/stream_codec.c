@@ -0,0 +1,232 @@
+/**
+ * @file  main/stream_codec.c
+ * @brief Encode and decode binary records of the UDP stream
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Format
+ * One record per datagram, integers are varints (7 bits per byte, low bits
+ * first, bit 7 set when another byte follows) :
+ *   header   : 1 byte, version (4 high bits) and flags (4 low bits)
+ *   sequence : varint, number of the record
+ *   time     : varint, timestamp of the state (sec.)
+ *   fields   : up to the end of datagram, pairs of varints with the field
+ *              id and the zigzag encoded delta from the previous record
+ * Only changed fields are sent. A key record contains the deltas from zero,
+ * a receiver that has lost a record waits for the next key record. Unknown
+ * field ids (newer firmware) are skipped by the decoder.
+ */
+#include <string.h>
+#include "stream_codec.h"
+
+static size_t put_varint(uint8_t *buf, uint32_t value);
+static int    get_varint(const uint8_t **p, const uint8_t *end, uint32_t *value);
+
+/**
+ * @brief Initialize an encoder, the first record will be a key record
+ *
+ * @param e Pointer to the encoder context
+ */
+void stream_enc_init(struct stream_enc *e)
+{
+	memset(e, 0, sizeof(struct stream_enc));
+}
+
+/**
+ * @brief Encode a state into a record
+ *
+ * @param e     Pointer to the encoder context
+ * @param state Pointer to the state to send
+ * @param buf   Pointer to a buffer of STREAM_REC_MAX bytes
+ * @return integer Length of the record
+ */
+size_t stream_encode(struct stream_enc *e, const struct aquarea_state *state, uint8_t *buf)
+{
+	uint32_t delta;
+	size_t len;
+	int key, i;
+
+	key = ((e->seq % STREAM_KEY_PERIOD) == 0);
+
+	buf[0] = (STREAM_VERSION << 4) | (key ? STREAM_FLAG_KEY : 0);
+	len  = 1;
+	len += put_varint(buf + len, e->seq);
+	len += put_varint(buf + len, state->time);
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		delta = (uint32_t)state->value[i];
+		if ( ! key)
+			delta -= (uint32_t)e->last[i];
+		if (delta == 0)
+			continue;
+		len += put_varint(buf + len, i);
+		/* Zigzag, small negative deltas are small numbers too */
+		len += put_varint(buf + len, (delta << 1) ^ (uint32_t)((int32_t)delta >> 31));
+	}
+	memcpy(e->last, state->value, sizeof(e->last));
+	e->seq++;
+	return(len);
+}
+
+/**
+ * @brief Initialize a decoder
+ *
+ * @param d Pointer to the decoder context
+ */
+void stream_dec_init(struct stream_dec *d)
+{
+	memset(d, 0, sizeof(struct stream_dec));
+}
+
+/**
+ * @brief Decode a received record
+ *
+ * Records older than the last one received are ignored (deltas can not be
+ * applied backward). After a lost record, deltas are ignored until the
+ * next key record. The sequence of the sender restarts from 0 on reboot :
+ * a key record with sequence 0, or much older than the last one, starts
+ * a new sequence.
+ *
+ * @param d     Pointer to the decoder context
+ * @param buf   Pointer to the received datagram
+ * @param len   Length of the datagram
+ * @param state Pointer to store the decoded state
+ * @return integer 1 if a state has been decoded, 0 if record is ignored,
+ *                 -1 if record is malformed
+ */
+int stream_decode(struct stream_dec *d, const uint8_t *buf, size_t len,
+                  struct aquarea_state *state)
+{
+	int32_t  value[AQ_FIELD_COUNT];
+	const uint8_t *p   = buf + 1;
+	const uint8_t *end = buf + len;
+	uint32_t seq, time, id, delta;
+	int32_t  diff;
+
+	if ((len < 1) || ((buf[0] >> 4) != STREAM_VERSION))
+		goto invalid;
+	if (get_varint(&p, end, &seq) || get_varint(&p, end, &time))
+		goto invalid;
+
+	if (d->has_seq)
+	{
+		diff = (int32_t)(seq - d->seq);
+		if ((buf[0] & STREAM_FLAG_KEY) && (diff < 0) &&
+		    ((seq == 0) || (diff < -STREAM_LATE_MAX)))
+		{
+			d->restarts++;
+			diff = 1;
+		}
+		if (diff <= 0)
+		{
+			/* Out of order : counted as lost when next one came */
+			if ((diff < 0) && d->lost)
+				d->lost--;
+			d->late++;
+			return(0);
+		}
+		if (diff > 1)
+		{
+			d->lost += (diff - 1);
+			d->synced = 0;
+		}
+	}
+	d->seq = seq;
+	d->has_seq = 1;
+
+	if (buf[0] & STREAM_FLAG_KEY)
+		memset(value, 0, sizeof(value));
+	else if (d->synced)
+		memcpy(value, d->value, sizeof(value));
+	else
+	{
+		d->skipped++;
+		return(0);
+	}
+
+	while (p < end)
+	{
+		if (get_varint(&p, end, &id) || get_varint(&p, end, &delta))
+			goto invalid;
+		if (id >= AQ_FIELD_COUNT)
+			continue;
+		delta = (delta >> 1) ^ (0 - (delta & 1));
+		value[id] = (int32_t)((uint32_t)value[id] + delta);
+	}
+
+	memcpy(d->value, value, sizeof(value));
+	d->synced = 1;
+	d->records++;
+
+	memset(state, 0, sizeof(struct aquarea_state));
+	state->seq  = seq;
+	state->time = time;
+	memcpy(state->value, value, sizeof(value));
+	return(1);
+
+invalid:
+	d->invalid++;
+	d->synced = 0;
+	return(-1);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Write an unsigned varint
+ *
+ * @param buf   Pointer to the buffer (5 bytes max)
+ * @param value Value to encode
+ * @return integer Number of bytes written
+ */
+static size_t put_varint(uint8_t *buf, uint32_t value)
+{
+	size_t len = 0;
+
+	while (value >= 0x80)
+	{
+		buf[len++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	buf[len++] = value;
+	return(len);
+}
+
+/**
+ * @brief Read an unsigned varint
+ *
+ * @param p     Pointer to the read position (updated)
+ * @param end   End of the buffer
+ * @param value Pointer to store the decoded value
+ * @return integer Zero on success, -1 if truncated or too long
+ */
+static int get_varint(const uint8_t **p, const uint8_t *end, uint32_t *value)
+{
+	uint32_t v = 0;
+	int shift;
+
+	for (shift = 0; shift < 35; shift += 7)
+	{
+		if (*p == end)
+			return(-1);
+		v |= (uint32_t)(**p & 0x7F) << shift;
+		if ((*(*p)++ & 0x80) == 0)
+		{
+			*value = v;
+			return(0);
+		}
+	}
+	return(-1);
+}
+/* EOF */
@@ -0,0 +1,63 @@
+/**
+ * @file  main/stream_codec.h
+ * @brief Headers and definitions for binary records of the UDP stream
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef STREAM_CODEC_H
+#define STREAM_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "aquarea_state.h"
+
+#define STREAM_VERSION     1
+#define STREAM_FLAG_KEY 0x01 /* Key record : deltas from zero          */
+#define STREAM_KEY_PERIOD 12 /* One key record every N records         */
+#define STREAM_LATE_MAX   60 /* Key record older than this : restart   */
+/* Maximum size of a record : header, sequence, time and all fields */
+#define STREAM_REC_MAX (1 + 5 + 5 + (AQ_FIELD_COUNT * (1 + 5)))
+
+/**
+ * @brief Context of the encoder (sender)
+ */
+struct stream_enc
+{
+	uint32_t seq;                   /* Number of the next record   */
+	int32_t  last[AQ_FIELD_COUNT];  /* Values of the last record   */
+};
+
+/**
+ * @brief Context of the decoder (receiver)
+ */
+struct stream_dec
+{
+	int      has_seq;  /* At least one record received             */
+	int      synced;   /* Values are valid (key record received)   */
+	uint32_t seq;      /* Number of the last record received       */
+	int32_t  value[AQ_FIELD_COUNT];
+	/* Statistics */
+	unsigned int records;  /* Records decoded                      */
+	unsigned int lost;     /* Records never received               */
+	unsigned int late;     /* Records received out of order        */
+	unsigned int skipped;  /* Records ignored, waiting a key record */
+	unsigned int invalid;  /* Malformed records                    */
+	unsigned int restarts; /* Sender restarted (sequence from 0)   */
+};
+
+void   stream_enc_init(struct stream_enc *e);
+size_t stream_encode  (struct stream_enc *e, const struct aquarea_state *state, uint8_t *buf);
+void   stream_dec_init(struct stream_dec *d);
+int    stream_decode  (struct stream_dec *d, const uint8_t *buf, size_t len,
+                       struct aquarea_state *state);
+
+#endif
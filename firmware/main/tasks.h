@@ -0,0 +1,41 @@
+/**
+ * @file  main/tasks.h
+ * @brief Priority and core of each task of the firmware
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Notes
+ * The heatpump link has APP_CPU for itself : the UART interrupt and the
+ * task that process frames are on this core, so a burst of network traffic
+ * can never delay them. Everything else (Ethernet, lwIP, MQTT, esp_timer
+ * and our servers) runs on PRO_CPU, under the priority of the network stack
+ * (lwIP 18, Ethernet RX 15). Logs and statistics use the lowest priority.
+ */
+#ifndef TASKS_H
+#define TASKS_H
+
+#include "os.h"
+
+#define TASK_CORE_LINK 1 /* APP_CPU : heatpump link only           */
+#define TASK_CORE_NET  0 /* PRO_CPU : network stack and servers    */
+
+#define TASK_PRIO_AQUAREA (OS_PRIO_IDLE + 10)
+#define TASK_PRIO_MODBUS  (OS_PRIO_IDLE + 4)
+#define TASK_PRIO_PUBLISH (OS_PRIO_IDLE + 3)
+#define TASK_PRIO_WEB     (OS_PRIO_IDLE + 3)
+#define TASK_PRIO_STREAM  (OS_PRIO_IDLE + 3)
+#define TASK_PRIO_HISTORY (OS_PRIO_IDLE + 2)
+#define TASK_PRIO_BRIDGE  (OS_PRIO_IDLE + 1)
+#define TASK_PRIO_MONITOR (OS_PRIO_IDLE + 1)
+#define TASK_PRIO_OTA     (OS_PRIO_IDLE + 1)
+
+#endif
@@ -0,0 +1,324 @@
+/**
+ * @file  main/web.c
+ * @brief Embedded HTTP server
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "lwip/sockets.h"
+#include "aquarea.h"
+#include "aquarea_ll.h"
+#include "history.h"
+#include "live.h"
+#include "mem.h"
+#include "monitor.h"
+#include "os.h"
+#include "ota.h"
+#include "prom.h"
+#include "recorder.h"
+#include "snapshot.h"
+#include "tasks.h"
+#include "web.h"
+
+static void      web_close(httpd_handle_t hd, int fd);
+static esp_err_t web_live(httpd_req_t *req);
+static void      web_live_task(void *arg);
+static void      web_live_work(void *arg);
+static esp_err_t web_metrics(httpd_req_t *req);
+static esp_err_t web_state(httpd_req_t *req);
+
+static httpd_handle_t web_server = NULL;
+static volatile int   web_live_pending = 0;
+/* Wake up of the live task, one pending item at most */
+static os_queue_t     web_live_queue = NULL;
+static struct os_queue_static web_live_qs;
+static uint8_t        web_live_buf[1];
+
+/* List of URI handled by the server */
+static const httpd_uri_t web_uri[] =
+{
+	{ .uri = "/capture", .method = HTTP_GET, .handler = recorder_http_get },
+	{ .uri = "/capture", .method = HTTP_POST, .handler = recorder_http_post },
+	{ .uri = "/history", .method = HTTP_GET, .handler = history_http_get },
+	{ .uri = "/live",    .method = HTTP_GET, .handler = web_live,
+	  .is_websocket = true },
+	{ .uri = "/metrics", .method = HTTP_GET, .handler = web_metrics },
+#if OTA_ENABLE
+	{ .uri = "/ota",     .method = HTTP_GET, .handler = ota_http_get },
+	{ .uri = "/ota",     .method = HTTP_POST, .handler = ota_http_post },
+#endif
+	{ .uri = "/state",   .method = HTTP_GET, .handler = web_state },
+#if SNAPSHOT_CBOR
+	{ .uri = "/state.cbor", .method = HTTP_GET, .handler = web_state,
+	  .user_ctx = (void *)1 },
+#endif
+};
+
+/**
+ * @brief Start the HTTP server
+ *
+ * @return integer Zero is returned on success, -1 on error
+ */
+int web_init(void)
+{
+	httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+	int i;
+
+	config.server_port      = WEB_PORT;
+	config.max_uri_handlers = 12;
+	config.lru_purge_enable = true;
+	/* History handler uses a chunk buffer on the stack */
+	config.stack_size       = 4096 + HISTORY_CHUNK_SIZE;
+	/* Network core, requests never preempt UART processing */
+	config.task_priority    = TASK_PRIO_WEB;
+	config.core_id          = TASK_CORE_NET;
+	/* Live clients must be removed when their socket is closed */
+	config.close_fn         = web_close;
+
+	if (httpd_start(&web_server, &config) != ESP_OK)
+	{
+		printf("WEB: Failed to start server\n");
+		return(-1);
+	}
+
+	for (i = 0; i < (sizeof(web_uri) / sizeof(httpd_uri_t)); i++)
+		httpd_register_uri_handler(web_server, &web_uri[i]);
+
+	/* Server is woken up from the network core, see live_notify() */
+	web_live_queue = os_queue_create_static(1, 1, &web_live_qs, web_live_buf);
+	if (web_live_queue == NULL)
+		return(-1);
+	if (os_task_create(web_live_task, "live", 2048, NULL,
+	                   TASK_PRIO_WEB, TASK_CORE_NET))
+		return(-1);
+
+	return(0);
+}
+
+/**
+ * @brief Send a message to a live (websocket) client
+ *
+ * This function is called by the server task only (see web_live_work). A
+ * client that can not receive data now (socket buffer full) is not waited,
+ * other clients are not delayed by a slow one.
+ *
+ * @param fd   Socket of the client
+ * @param data Pointer to the message
+ * @param len  Length of the message
+ * @return integer Zero if sent, 1 if client is busy, -1 on error
+ */
+int live_send(int fd, const char *data, size_t len)
+{
+	httpd_ws_frame_t frame;
+	struct timeval tv;
+	fd_set wfds;
+
+	FD_ZERO(&wfds);
+	FD_SET(fd, &wfds);
+	tv.tv_sec  = 0;
+	tv.tv_usec = 0;
+	if (select(fd + 1, NULL, &wfds, NULL, &tv) <= 0)
+		return(1);
+
+	memset(&frame, 0, sizeof(httpd_ws_frame_t));
+	frame.final   = true;
+	frame.type    = HTTPD_WS_TYPE_TEXT;
+	frame.payload = (uint8_t *)data;
+	frame.len     = len;
+	if (httpd_ws_send_frame_async(web_server, fd, &frame) != ESP_OK)
+	{
+		httpd_sess_trigger_close(web_server, fd);
+		return(-1);
+	}
+	return(0);
+}
+
+/**
+ * @brief Wake up the server task to send live messages
+ *
+ * This function is called by the link task for each new message : it only
+ * sets the item of a queue (never waits, no heap, no lwIP call). Work is
+ * queued to the server by the live task, on the network core.
+ */
+void live_notify(void)
+{
+	static const uint8_t wake = 1;
+
+	if (web_live_queue == NULL)
+		return;
+	os_queue_overwrite(web_live_queue, &wake);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Called by the server when a socket is closed
+ *
+ * @param hd Handle of the server
+ * @param fd Socket to close
+ */
+static void web_close(httpd_handle_t hd, int fd)
+{
+	live_remove(fd);
+	close(fd);
+}
+
+/**
+ * @brief Websocket handler used by clients of live updates
+ *
+ * On handshake the client is registered and will receive the full state then
+ * deltas. Frames sent by clients are not used, they are read and dropped.
+ *
+ * @param req Pointer to the HTTP request
+ * @return esp_err ESP_OK on success
+ */
+static esp_err_t web_live(httpd_req_t *req)
+{
+	static uint8_t buffer[64];
+	httpd_ws_frame_t frame;
+
+	if (req->method == HTTP_GET)
+	{
+		if (live_add(httpd_req_to_sockfd(req)) != 0)
+		{
+			printf("WEB: Too many live clients\n");
+			return(ESP_FAIL);
+		}
+		return(ESP_OK);
+	}
+
+	memset(&frame, 0, sizeof(httpd_ws_frame_t));
+	frame.payload = buffer;
+	return(httpd_ws_recv_frame(req, &frame, sizeof(buffer)));
+}
+
+/**
+ * @brief Main function of the live task
+ *
+ * Queuing a work to the server sends a datagram to its control socket
+ * (heap and lwIP), this is made here and never by the link task. Only one
+ * work is queued even if many messages are pending.
+ *
+ * @param arg Not used
+ */
+static void web_live_task(void *arg)
+{
+	uint8_t wake;
+
+	(void)arg;
+	while(1)
+	{
+		if (os_queue_recv(web_live_queue, &wake, OS_FOREVER) != 0)
+			continue;
+		if (web_live_pending)
+			continue;
+		web_live_pending = 1;
+		if (httpd_queue_work(web_server, web_live_work, NULL) != ESP_OK)
+			web_live_pending = 0;
+	}
+}
+
+/**
+ * @brief Server work used to send pending live messages
+ *
+ * @param arg Not used
+ */
+static void web_live_work(void *arg)
+{
+	(void)arg;
+	web_live_pending = 0;
+	live_process();
+}
+
+/**
+ * @brief HTTP handler used by Prometheus to scrape values and counters
+ *
+ * All requests are processed by the (single) server task, so one static
+ * buffer is used for rendering.
+ *
+ * @param req Pointer to the HTTP request
+ * @return esp_err ESP_OK on success
+ */
+static esp_err_t web_metrics(httpd_req_t *req)
+{
+	static char buffer[PROM_BUFFER_SIZE];
+	static struct monitor_task tasks[MONITOR_TASK_MAX];
+	static struct mem_stats mem;
+	struct aquarea_state    state;
+	struct aquarea_ll_stats ll;
+	int len, n, count;
+
+	aquarea_get_state(&state);
+	aquarea_ll_stats(&ll);
+	count = monitor_get(tasks, MONITOR_TASK_MAX);
+	mem_stats(&mem);
+
+	len = prom_render(buffer, PROM_BUFFER_SIZE, &state, &ll);
+	if (len < 0)
+		return(httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL));
+	n = prom_render_tasks(buffer + len, PROM_BUFFER_SIZE - len, tasks, count);
+	if (n < 0)
+		return(httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL));
+	len += n;
+	n = prom_render_alarms(buffer + len, PROM_BUFFER_SIZE - len, aquarea_rules());
+	if (n < 0)
+		return(httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL));
+	len += n;
+	n = prom_render_mem(buffer + len, PROM_BUFFER_SIZE - len, &mem);
+	if (n < 0)
+		return(httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL));
+	len += n;
+
+	httpd_resp_set_type(req, "text/plain; version=0.0.4");
+	return(httpd_resp_send(req, buffer, len));
+}
+
+/**
+ * @brief HTTP handler used to read the current state
+ *
+ * The response is sent directly from the snapshot cache, the state is not
+ * serialized again for each request.
+ *
+ * @param req Pointer to the HTTP request (user_ctx set for CBOR)
+ * @return esp_err ESP_OK on success
+ */
+static esp_err_t web_state(httpd_req_t *req)
+{
+	const struct snapshot *snap;
+	esp_err_t result;
+
+	snap = snapshot_get();
+	if (snap == NULL)
+		return(httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, NULL));
+
+#if SNAPSHOT_CBOR
+	if (req->user_ctx)
+	{
+		httpd_resp_set_type(req, "application/cbor");
+		result = httpd_resp_send(req, (const char *)snap->cbor, snap->cbor_len);
+	}
+	else
+#endif
+	{
+		httpd_resp_set_type(req, "application/json");
+		result = httpd_resp_send(req, snap->json, snap->json_len);
+	}
+	snapshot_put(snap);
+
+	return(result);
+}
+/* EOF */
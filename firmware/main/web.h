@@ -0,0 +1,23 @@
+/**
+ * @file  main/web.h
+ * @brief Headers and definitions for the embedded HTTP server
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef WEB_H
+#define WEB_H
+
+#define WEB_PORT 80
+
+int web_init(void);
+
+#endif
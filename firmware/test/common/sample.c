@@ -0,0 +1,127 @@
+/**
+ * @file  sample.c
+ * @brief Sample states, like the ones of a running heatpump
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Usage
+ * This file is shared by the unit-tests that need a long sequence of
+ * states (history, forward queue). Any sample can be made again from its
+ * index, so tests can compare what they read with the reference.
+ */
+#include <string.h>
+#include "sample.h"
+
+static void power(int n, int32_t *prod, int32_t *cons);
+static int32_t cop(int n);
+
+/* Status packet captured on a real heatpump */
+static const unsigned char status[AQUAREA_STATUS_LEN] = {
+0x71,0xC8,0x01,0x10,0x56,0x55,0x52,0x49, 0x00,0x55,0x00,0x00,0x00,0x00,0x00,0x00,
+0x00,0x00,0x00,0x00,0x19,0x15,0x12,0x55, 0x15,0x9D,0x55,0x05,0x05,0x00,0x00,0x00,
+0x00,0x00,0x00,0x00,0x00,0x00,0x80,0x80, 0x80,0x80,0xB4,0x71,0x71,0x97,0x99,0x00,
+0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, 0x00,0x00,0x80,0x85,0x15,0x8A,0x85,0x85,
+0xD0,0x7B,0x78,0x1F,0x7E,0x1F,0x1F,0x79, 0x79,0x8D,0x8D,0xBC,0xAD,0x7B,0x8F,0xB7,
+0xA3,0x7B,0x8F,0x98,0x85,0x76,0x8F,0x8A, 0x94,0x9E,0x8F,0x8A,0x94,0x9E,0x85,0x8F,
+0x8A,0x11,0x3D,0x78,0xC1,0x0B,0x00,0x00, 0x00,0x00,0x00,0x00,0x00,0x00,0x55,0xF5,
+0x55,0x21,0xA9,0x15,0x59,0x05,0x12,0x12, 0x65,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+0x00,0xE2,0xCF,0x0D,0x86,0x05,0x12,0xD0, 0x0C,0x95,0x05,0x97,0x00,0x00,0x9A,0x97,
+0x97,0x32,0x32,0xAD,0xA3,0x32,0x32,0x32, 0x80,0xAD,0x97,0x92,0x98,0x97,0x9A,0x94,
+0x94,0x95,0x97,0x46,0x01,0x01,0x01,0x00, 0x00,0x22,0x00,0x01,0x01,0x01,0x01,0x79,
+0x01,0xC9,0xC9,0x01,0x1A,0x00,0x75,0x16, 0x00,0x01,0x00,0x00,0x01,0x00,0x00,0x0D,
+0x02,0x01,0x01,0x01,0x01,0x01,0x01,0x00, 0x00,0x00,0x9D};
+
+/**
+ * @brief Make a sample state, like the ones received from a running heatpump
+ *
+ * States are decoded from a real status packet, then some fields are
+ * modified (slowly, like temperatures) to simulate a running heatpump.
+ * Derived fields are set like metrics.c does : energy counters increase on
+ * almost each sample and rolling COP follow the powers with a delay, so the
+ * size of stored or published states is the one of a real installation.
+ *
+ * @param state Pointer to a state structure to fill
+ * @param n     Index of the sample (one sample every 5 seconds)
+ */
+void test_sample(struct aquarea_state *state, int n)
+{
+	int32_t *v = state->value;
+
+	memset(state, 0, sizeof(struct aquarea_state));
+	aquarea_state_decode(state, status, AQUAREA_STATUS_LEN);
+
+	state->seq  = n;
+	state->time = SAMPLE_TIME_BASE + (n * SAMPLE_PERIOD);
+	v[AQ_OUTSIDE_TEMP]    += (n / 700) % 6;
+	v[AQ_INLET_TEMP]      += (n / 23) % 4;
+	v[AQ_OUTLET_TEMP]     += (n / 17) % 5;
+	v[AQ_COMPRESSOR_FREQ] += (n / 41) % 30;
+	v[AQ_PUMP_FLOW]       += ((n / 3) % 3) * 2;
+	power(n, &v[AQ_HEAT_POWER_PROD], &v[AQ_HEAT_POWER_CONS]);
+	if ((n % 5000) > 4900)
+		v[AQ_DEFROST] = 1;
+
+	/* Derived values */
+	v[AQ_POWER_PROD]  = v[AQ_HEAT_POWER_PROD] + v[AQ_DHW_POWER_PROD];
+	v[AQ_POWER_CONS]  = v[AQ_HEAT_POWER_CONS] + v[AQ_DHW_POWER_CONS];
+	v[AQ_COP]         = cop(n);
+	/* About 4.5 kW produced and 1.3 kW consumed, counters in Wh */
+	v[AQ_ENERGY_PROD] = 2000000 + ((n * 25) / 4);
+	v[AQ_ENERGY_CONS] =  600000 + ((n * 7) / 4);
+	/* Averages of a window, close to the value at its middle */
+	v[AQ_COP_1M]      = cop(n - 6);
+	v[AQ_COP_15M]     = cop(n - 90);
+	v[AQ_COP_1H]      = cop(n - 360);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Get the heat powers of a sample
+ *
+ * @param n    Index of the sample
+ * @param prod Pointer to the power produced, updated (W)
+ * @param cons Pointer to the power consumed, updated (W)
+ */
+static void power(int n, int32_t *prod, int32_t *cons)
+{
+	if (n < 0)
+		n = 0;
+	*prod += ((n / 50) % 10) * 200;
+	*cons += ((n / 90) % 4) * 200;
+}
+
+/**
+ * @brief Get the COP of a sample (x100)
+ *
+ * @param n Index of the sample
+ * @return int32 COP, zero when no power is consumed
+ */
+static int32_t cop(int n)
+{
+	struct aquarea_state ref;
+	int32_t prod, cons;
+
+	memset(&ref, 0, sizeof(struct aquarea_state));
+	aquarea_state_decode(&ref, status, AQUAREA_STATUS_LEN);
+	prod = ref.value[AQ_HEAT_POWER_PROD];
+	cons = ref.value[AQ_HEAT_POWER_CONS];
+	power(n, &prod, &cons);
+	prod += ref.value[AQ_DHW_POWER_PROD];
+	cons += ref.value[AQ_DHW_POWER_CONS];
+	if (cons <= 0)
+		return(0);
+	return((prod * 100) / cons);
+}
+/* EOF */
@@ -0,0 +1,26 @@
+/**
+ * @file  sample.h
+ * @brief Headers and definitions of the states used by unit-tests
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include "aquarea_state.h"
+
+#define SAMPLE_TIME_BASE 1640995200 /* Timestamp of the first sample     */
+#define SAMPLE_PERIOD             5 /* Delay between two samples (sec.)  */
+
+void test_sample(struct aquarea_state *state, int n);
+
+#endif
@@ -0,0 +1,731 @@
+/**
+ * @file  fuzz.c
+ * @brief Coverage-guided fuzzer of the low-level layer (aquarea_ll.c)
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Input
+ * An input is a sequence of chunks given to the simulated UART of the
+ * unit-tests, so the fuzzer controls both the bytes and how they are split :
+ *   - one byte N (1 to 255) followed by N bytes : one chunk read at once
+ *   - one zero byte : silence, longer than the resync delay
+ * The last chunk can be shorter than announced.
+ *
+ * @page Checks
+ * For each input : no access out of the buffers (address sanitizer), the
+ * write index of the layer never exceeds its buffer, all bytes given are
+ * read, every frame delivered is complete and has a valid checksum, and the
+ * processing time stays under a budget per byte (slow path).
+ *
+ * @page Usage
+ *   fuzz <file> ...            Run each input once (regression, AFL @@)
+ *   fuzz -n 100000 <file> ...  Fuzz, starting from these inputs
+ *   fuzz -o out -n 0 <file>    Fuzz forever, new inputs saved into out
+ *   fuzz -g corpus             Generate the seed inputs
+ * Built with LIBFUZZER=1 (clang), only LLVMFuzzerTestOneInput is used.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sanitizer/common_interface_defs.h>
+#include "aquarea_ll.h"
+#include "driver_timer.h"
+#include "driver_uart.h"
+#include "log.h"
+
+#define FUZZ_BUFFER_SIZE    258 /* Size of the RX buffer of the layer     */
+#define FUZZ_INPUT_MAX     4096 /* Max size of one input                  */
+#define FUZZ_CORPUS_MAX    1024 /* Max number of inputs kept              */
+#define FUZZ_MAP_SIZE     65536 /* Size of the coverage map (power of 2)  */
+#define FUZZ_SILENCE     200000 /* Delay of a silence chunk (us)          */
+/* A byte lasts 1146us on the link (9600 bauds, 8E1) : processing must use
+ * less than a tenth of it, each chunk is counted as one more byte */
+#define FUZZ_BUDGET_NS   114600
+
+#define FUZZ_OK     0
+#define FUZZ_ERROR -1
+#define FUZZ_SLOW  -2
+
+/**
+ * @brief An input kept into the corpus
+ */
+struct fuzz_input
+{
+	size_t  len;
+	uint8_t data[FUZZ_INPUT_MAX];
+};
+
+static int      fuzz_run(const uint8_t *data, size_t size);
+static int      fuzz_exec(const uint8_t *data, size_t size, int64_t *ns);
+static int      fuzz_loop(long runs, const char *dir);
+static int      fuzz_novel(void);
+static size_t   mutate(uint8_t *data, size_t len);
+static void     check_frame(const uint8_t *data, size_t len);
+static void     fail(const char *msg);
+static void     save(const char *dir, const char *prefix, const uint8_t *data,
+                     size_t len);
+static int      load(const char *name, struct fuzz_input *in);
+static int      generate(const char *dir);
+static void     death(void);
+static void     tap(int dir, int status, const uint8_t *data, size_t len, int64_t time);
+static uint32_t rnd(void);
+static void     usage(char *appname);
+
+/* Write index of the layer (aquarea_ll.c) */
+extern uint16_t buffer_w;
+/* Bytes not read yet from the simulated UART (driver_uart.c) */
+extern unsigned int buffer_len;
+
+static struct fuzz_input corpus[FUZZ_CORPUS_MAX];
+static int      corpus_count;
+static uint8_t  cov_map[FUZZ_MAP_SIZE];
+static uint8_t  cov_seen[FUZZ_MAP_SIZE];
+static uintptr_t cov_prev;
+static uint32_t rnd_state = 1;
+static const char *fuzz_error;
+static unsigned long fuzz_rx, fuzz_tap_ok;
+static long     budget = FUZZ_BUDGET_NS;
+/* Input being processed, saved if the sanitizer stops the program */
+static const uint8_t *cur_data;
+static size_t         cur_len;
+static const char    *out_dir = ".";
+
+#ifndef FUZZ_LIBFUZZER
+/**
+ * @brief Entry point of the fuzzer
+ *
+ * @param argc Number or command line arguments
+ * @param argv Array of string with command line arguments
+ * @return integer Zero is returned on success, -1 for error
+ */
+int main(int argc, char **argv)
+{
+	static struct fuzz_input in;
+	long runs = -1;
+	int opt, i, result = 0;
+
+	while ((opt = getopt(argc, argv, "b:g:n:o:s:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'b': budget = atol(optarg);     break;
+			case 'g': return(generate(optarg));
+			case 'n': runs = atol(optarg);       break;
+			case 'o': out_dir = optarg;          break;
+			case 's': rnd_state = atoi(optarg);  break;
+			default:
+				usage(argv[0]);
+				return(-1);
+		}
+	}
+	if ((optind >= argc) && (runs < 0))
+	{
+		usage(argv[0]);
+		return(-1);
+	}
+	if (rnd_state == 0)
+		rnd_state = 1;
+
+	/* Messages of the layer and of the drivers are not part of the result */
+	if (freopen("/dev/null", "w", stdout) == NULL)
+		return(-1);
+	log_init();
+	__sanitizer_set_death_callback(death);
+
+	/* Fuzz, starting from the given inputs */
+	if (runs >= 0)
+	{
+		for (i = optind; i < argc; i++)
+		{
+			if ((corpus_count < FUZZ_CORPUS_MAX) &&
+			    (load(argv[i], &corpus[corpus_count]) == 0))
+				corpus_count++;
+		}
+		return(fuzz_loop(runs, out_dir));
+	}
+
+	/* Run each input once */
+	for (i = optind; i < argc; i++)
+	{
+		if (load(argv[i], &in) != 0)
+			return(-1);
+		switch (fuzz_run(in.data, in.len))
+		{
+			case FUZZ_ERROR:
+				fprintf(stderr, "fuzz: %s : %s\n", argv[i], fuzz_error);
+				result = -1;
+				break;
+			case FUZZ_SLOW:
+				fprintf(stderr, "fuzz: %s : slow input\n", argv[i]);
+				result = -1;
+				break;
+		}
+	}
+	return(result);
+}
+#endif
+
+/**
+ * @brief Entry point used by libFuzzer
+ *
+ * @param data Pointer to the input
+ * @param size Size of the input
+ * @return integer Always zero (abort on error)
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	if (freopen("/dev/null", "w", stdout) == NULL)
+		abort();
+
+	switch (fuzz_run(data, size))
+	{
+		case FUZZ_ERROR:
+			fprintf(stderr, "fuzz: %s\n", fuzz_error);
+			abort();
+		case FUZZ_SLOW:
+			fprintf(stderr, "fuzz: slow input\n");
+			abort();
+	}
+	return(0);
+}
+
+/**
+ * @brief The special function "aquarea_rx" is called by low-level layer when
+ *        a valid packet has been received.
+ *
+ * @param packet Pointer to a buffer with the received packet
+ * @param len    Length of the packet
+ */
+void aquarea_rx(unsigned char *packet, size_t len)
+{
+	fuzz_rx++;
+	check_frame(packet, len);
+}
+
+#ifndef FUZZ_LIBFUZZER
+/**
+ * @brief Called by each edge of the instrumented code (gcc trace-pc)
+ *
+ * Consecutive locations are hashed into the coverage map, so the map counts
+ * transitions (edges) rather than blocks.
+ */
+void __sanitizer_cov_trace_pc(void)
+{
+	uintptr_t pc  = (uintptr_t)__builtin_return_address(0);
+	uintptr_t cur = (pc ^ (pc >> 16)) & (FUZZ_MAP_SIZE - 1);
+
+	cov_map[cur ^ cov_prev]++;
+	cov_prev = cur >> 1;
+}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Process one input and check the result
+ *
+ * An input over the time budget is processed again before being reported,
+ * to ignore a preemption of the fuzzer.
+ *
+ * @param data Pointer to the input
+ * @param size Size of the input
+ * @return integer FUZZ_OK, FUZZ_ERROR (see fuzz_error) or FUZZ_SLOW
+ */
+static int fuzz_run(const uint8_t *data, size_t size)
+{
+	int64_t ns, limit;
+	int result;
+
+	cur_data = data;
+	cur_len  = size;
+
+	/* Each byte is either data or a chunk header */
+	limit = (int64_t)budget * (size + 1);
+
+	result = fuzz_exec(data, size, &ns);
+	if ((result == FUZZ_OK) && (ns > limit))
+	{
+		result = fuzz_exec(data, size, &ns);
+		if ((result == FUZZ_OK) && (ns > limit))
+			result = FUZZ_SLOW;
+	}
+	return(result);
+}
+
+/**
+ * @brief Give all chunks of an input to the layer
+ *
+ * @param data Pointer to the input
+ * @param size Size of the input
+ * @param ns   Pointer to store the processing time (ns)
+ * @return integer FUZZ_OK or FUZZ_ERROR
+ */
+static int fuzz_exec(const uint8_t *data, size_t size, int64_t *ns)
+{
+	struct timespec t0, t1;
+	size_t i, n;
+
+	memset(cov_map, 0, sizeof(cov_map));
+	cov_prev = 0;
+	fuzz_error = NULL;
+	fuzz_rx = 0;
+	fuzz_tap_ok = 0;
+
+	uart_init();
+	timer_set(1000000);
+	aquarea_ll_init();
+	aquarea_ll_set_tap(tap);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; (i < size) && (fuzz_error == NULL); i += n)
+	{
+		n = data[i++];
+		if (n == 0)
+		{
+			timer_add(FUZZ_SILENCE);
+			aquarea_ll_process();
+			continue;
+		}
+		if (n > (size - i))
+			n = (size - i);
+		uart_set_buffer((unsigned char *)data + i, n);
+		aquarea_ll_process();
+		timer_add(1146 * n);
+
+		if (buffer_len != 0)
+			fail("bytes not read");
+		if (buffer_w > FUZZ_BUFFER_SIZE)
+			fail("write index out of buffer");
+	}
+	/* End of input, incomplete frame dropped */
+	timer_add(FUZZ_SILENCE);
+	aquarea_ll_process();
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if ((fuzz_error == NULL) && (fuzz_rx != fuzz_tap_ok))
+		fail("frames delivered and tapped differ");
+
+	*ns  = (int64_t)(t1.tv_sec - t0.tv_sec) * 1000000000LL;
+	*ns += (t1.tv_nsec - t0.tv_nsec);
+	return(fuzz_error ? FUZZ_ERROR : FUZZ_OK);
+}
+
+/**
+ * @brief Main loop of the fuzzer
+ *
+ * An input is taken from the corpus and mutated. When it reaches an edge
+ * not seen before (or an edge a new number of times), it is added to the
+ * corpus. Failing and slow inputs are saved, then the fuzzer stops.
+ *
+ * @param runs Number of inputs to try, 0 for no limit
+ * @param dir  Directory where inputs are saved
+ * @return integer Zero is returned on success, -1 if an input failed
+ */
+static int fuzz_loop(long runs, const char *dir)
+{
+	static uint8_t data[FUZZ_INPUT_MAX];
+	struct timespec t0, t1;
+	size_t len;
+	long n;
+	int i, result;
+
+	/* Start from the given inputs, or from an empty one */
+	if (corpus_count == 0)
+		corpus[corpus_count++].len = 0;
+	for (i = 0; i < corpus_count; i++)
+	{
+		result = fuzz_run(corpus[i].data, corpus[i].len);
+		if (result != FUZZ_OK)
+		{
+			fprintf(stderr, "fuzz: input %d fails (%s)\n", i,
+			        (result == FUZZ_SLOW) ? "slow" : fuzz_error);
+			return(-1);
+		}
+		fuzz_novel();
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (n = 1; (runs == 0) || (n <= runs); n++)
+	{
+		i = rnd() % corpus_count;
+		memcpy(data, corpus[i].data, corpus[i].len);
+		len = mutate(data, corpus[i].len);
+
+		result = fuzz_run(data, len);
+		if (result == FUZZ_ERROR)
+		{
+			fprintf(stderr, "fuzz: run %ld, %s\n", n, fuzz_error);
+			save(dir, "crash", data, len);
+			return(-1);
+		}
+		if (result == FUZZ_SLOW)
+		{
+			fprintf(stderr, "fuzz: run %ld, slow input\n", n);
+			save(dir, "slow", data, len);
+			return(-1);
+		}
+		if (fuzz_novel() && (corpus_count < FUZZ_CORPUS_MAX))
+		{
+			corpus[corpus_count].len = len;
+			memcpy(corpus[corpus_count].data, data, len);
+			corpus_count++;
+			if (strcmp(dir, "."))
+				save(dir, "cov", data, len);
+		}
+		if ((n % 100000) == 0)
+			fprintf(stderr, "fuzz: %ld runs, %d inputs\n", n, corpus_count);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	fprintf(stderr, "fuzz: %ld runs in %.1f s, %d inputs, no error\n", runs,
+	        (double)(t1.tv_sec - t0.tv_sec) +
+	        (double)(t1.tv_nsec - t0.tv_nsec) / 1e9, corpus_count);
+	return(0);
+}
+
+/**
+ * @brief Test if the last run has found something new
+ *
+ * Hit counts are grouped by power of two (1, 2, 3-4, 5-8, ...) so a loop
+ * taken a few more times is not new.
+ *
+ * @return integer One if coverage has increased, else zero
+ */
+static int fuzz_novel(void)
+{
+	uint8_t bucket;
+	int i, novel = 0;
+
+	for (i = 0; i < FUZZ_MAP_SIZE; i++)
+	{
+		if (cov_map[i] == 0)
+			continue;
+		bucket = 1;
+		while ((1 << (bucket - 1)) < cov_map[i])
+			bucket++;
+		bucket = 1 << (bucket - 1);
+		if ((cov_seen[i] & bucket) == 0)
+		{
+			cov_seen[i] |= bucket;
+			novel = 1;
+		}
+	}
+	return(novel);
+}
+
+/**
+ * @brief Apply a few random mutations to an input
+ *
+ * @param data Pointer to the input, modified
+ * @param len  Length of the input
+ * @return size New length of the input
+ */
+static size_t mutate(uint8_t *data, size_t len)
+{
+	size_t pos, n, src;
+	int count, i;
+
+	count = 1 + (rnd() % 4);
+	for (i = 0; i < count; i++)
+	{
+		pos = len ? (rnd() % len) : 0;
+		switch (rnd() % 7)
+		{
+			/* Flip one bit */
+			case 0:
+				if (len)
+					data[pos] ^= (1 << (rnd() % 8));
+				break;
+			/* Set one byte */
+			case 1:
+				if (len)
+					data[pos] = rnd();
+				break;
+			/* Set one byte to an interesting value */
+			case 2:
+			{
+				static const uint8_t v[] = { 0x00, 0x01, 0x02, 0x03, 0x04,
+				                             0x71, 0xF1, 0xC8, 0xFE, 0xFF };
+				if (len)
+					data[pos] = v[rnd() % sizeof(v)];
+				break;
+			}
+			/* Insert random bytes */
+			case 3:
+				n = 1 + (rnd() % 16);
+				if ((len + n) > FUZZ_INPUT_MAX)
+					break;
+				memmove(data + pos + n, data + pos, len - pos);
+				for (src = 0; src < n; src++)
+					data[pos + src] = rnd();
+				len += n;
+				break;
+			/* Remove bytes */
+			case 4:
+				n = 1 + (rnd() % 16);
+				if ((pos + n) > len)
+					break;
+				memmove(data + pos, data + pos + n, len - pos - n);
+				len -= n;
+				break;
+			/* Copy a block of this input at another place */
+			case 5:
+				n = 1 + (rnd() % 64);
+				if (!len || (len + n) > FUZZ_INPUT_MAX)
+					break;
+				src = rnd() % len;
+				if ((src + n) > len)
+					n = len - src;
+				memmove(data + pos + n, data + pos, len - pos);
+				memmove(data + pos, data + src + ((src >= pos) ? n : 0), n);
+				len += n;
+				break;
+			/* Append the end of another input of the corpus */
+			case 6:
+			{
+				struct fuzz_input *o = &corpus[rnd() % corpus_count];
+				if (o->len == 0)
+					break;
+				src = rnd() % o->len;
+				n = o->len - src;
+				if ((pos + n) > FUZZ_INPUT_MAX)
+					n = FUZZ_INPUT_MAX - pos;
+				memcpy(data + pos, o->data + src, n);
+				len = pos + n;
+				break;
+			}
+		}
+	}
+	return(len);
+}
+
+/**
+ * @brief Verify a frame given by the layer as valid
+ *
+ * @param data Pointer to the frame
+ * @param len  Length of the frame
+ */
+static void check_frame(const uint8_t *data, size_t len)
+{
+	uint32_t sum = 0;
+	size_t i;
+
+	if ((len < 3) || (len > FUZZ_BUFFER_SIZE) || (len != (size_t)(data[1] + 3)))
+	{
+		fail("frame delivered with an invalid length");
+		return;
+	}
+	for (i = 0; i < len; i++)
+		sum += data[i];
+	if (sum & 0xFF)
+		fail("frame delivered with an invalid checksum");
+}
+
+/**
+ * @brief Frames tap, received frames are verified
+ *
+ */
+static void tap(int dir, int status, const uint8_t *data, size_t len, int64_t time)
+{
+	if (dir != AQUAREA_LL_RX)
+		return;
+	if (len > FUZZ_BUFFER_SIZE)
+		fail("frame tapped with an invalid length");
+	if (status != AQUAREA_LL_OK)
+		return;
+	fuzz_tap_ok++;
+	check_frame(data, len);
+}
+
+/**
+ * @brief Report the first error of a run
+ *
+ * @param msg Description of the error
+ */
+static void fail(const char *msg)
+{
+	if (fuzz_error == NULL)
+		fuzz_error = msg;
+}
+
+/**
+ * @brief Save an input into a file, named with a hash of its content
+ *
+ * @param dir    Directory where the file is created
+ * @param prefix Prefix of the file name
+ * @param data   Pointer to the input
+ * @param len    Length of the input
+ */
+static void save(const char *dir, const char *prefix, const uint8_t *data,
+                 size_t len)
+{
+	char name[512];
+	uint32_t hash = 0x811C9DC5;
+	size_t i;
+	FILE *f;
+
+	for (i = 0; i < len; i++)
+		hash = (hash ^ data[i]) * 0x01000193;
+	snprintf(name, sizeof(name), "%s/%s-%08x.bin", dir, prefix,
+	         (unsigned int)hash);
+
+	f = fopen(name, "wb");
+	if (f == NULL)
+		return;
+	fwrite(data, 1, len, f);
+	fclose(f);
+	if (strcmp(prefix, "cov"))
+		fprintf(stderr, "fuzz: input saved into %s\n", name);
+}
+
+/**
+ * @brief Load an input file
+ *
+ * @param name Name of the file
+ * @param in   Pointer to the input to fill
+ * @return integer Zero is returned on success, -1 on error
+ */
+static int load(const char *name, struct fuzz_input *in)
+{
+	FILE *f;
+
+	f = fopen(name, "rb");
+	if (f == NULL)
+	{
+		fprintf(stderr, "fuzz: failed to open %s\n", name);
+		return(-1);
+	}
+	in->len = fread(in->data, 1, FUZZ_INPUT_MAX, f);
+	fclose(f);
+	return(0);
+}
+
+/**
+ * @brief Generate the seed inputs of the corpus
+ *
+ * A query, a status response split like a real UART, a response with an
+ * invalid checksum followed by a truncated one, and a header with a null
+ * length followed by two full chunks (write index must not run away).
+ *
+ * @param dir Directory where the inputs are created
+ * @return integer Zero is returned on success, -1 for error
+ */
+static int generate(const char *dir)
+{
+	static uint8_t buf[FUZZ_INPUT_MAX];
+	uint8_t frame[203];
+	uint32_t sum;
+	size_t len, n, i;
+
+	/* Query, in one chunk */
+	memset(frame, 0, sizeof(frame));
+	frame[0] = 0x71;
+	frame[1] = 108;
+	frame[2] = 0x01;
+	frame[3] = 0x10;
+	for (sum = 0, i = 0; i < 110; i++)
+		sum += frame[i];
+	frame[110] = ((sum & 0xFF) ^ 0xFF) + 1;
+	buf[0] = 111;
+	memcpy(buf + 1, frame, 111);
+	save(dir, "query", buf, 112);
+
+	/* Status, by chunks of 32 bytes */
+	frame[1] = 200;
+	for (i = 4; i < 202; i++)
+		frame[i] = (uint8_t)(0x80 + (i % 16));
+	for (sum = 0, i = 0; i < 202; i++)
+		sum += frame[i];
+	frame[202] = ((sum & 0xFF) ^ 0xFF) + 1;
+	for (len = 0, i = 0; i < 203; i += n)
+	{
+		n = ((203 - i) > 32) ? 32 : (203 - i);
+		buf[len++] = n;
+		memcpy(buf + len, frame + i, n);
+		len += n;
+	}
+	save(dir, "status", buf, len);
+
+	/* Invalid checksum, then truncated frame, silence and a query */
+	buf[0] = 203;
+	memcpy(buf + 1, frame, 203);
+	buf[100] ^= 0x01;
+	buf[204] = 100;
+	memcpy(buf + 205, frame, 100);
+	buf[305] = 0;
+	buf[306] = 111;
+	memcpy(buf + 307, buf + 1, 4);
+	buf[308] = 108;
+	memset(buf + 311, 0, 106);
+	for (sum = 0, i = 0; i < 110; i++)
+		sum += buf[307 + i];
+	buf[417] = ((sum & 0xFF) ^ 0xFF) + 1;
+	save(dir, "errors", buf, 418);
+
+	/* Header with a null length, then more bytes than the buffer */
+	buf[0] = 4;
+	buf[1] = 0x71;
+	buf[2] = 0x00;
+	buf[3] = 0x01;
+	buf[4] = 0x10;
+	buf[5] = 255;
+	memset(buf + 6, 0x55, 255);
+	buf[261] = 255;
+	memset(buf + 262, 0xAA, 255);
+	save(dir, "length0", buf, 517);
+
+	return(0);
+}
+
+/**
+ * @brief Called by the sanitizer before the program stops
+ *
+ */
+static void death(void)
+{
+	fprintf(stderr, "fuzz: sanitizer error\n");
+	save(out_dir, "crash", cur_data, cur_len);
+}
+
+/**
+ * @brief Pseudo random numbers (xorshift32)
+ *
+ * @return uint32 Next random number
+ */
+static uint32_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return(rnd_state);
+}
+
+/**
+ * @brief Print an help message about command line arguments
+ *
+ */
+static void usage(char *appname)
+{
+	fprintf(stderr, "Usage %s [-b ns] <input> ...\n", appname);
+	fprintf(stderr, "      %s [-b ns] [-s seed] [-o dir] -n runs [input ...]\n", appname);
+	fprintf(stderr, "      %s -g <dir>\n", appname);
+	fprintf(stderr, "  -n : fuzz, starting from the inputs (0 for no limit)\n");
+	fprintf(stderr, "  -o : directory where new inputs are saved\n");
+	fprintf(stderr, "  -s : seed of the random generator\n");
+	fprintf(stderr, "  -b : time budget per byte (ns, default %d)\n", FUZZ_BUDGET_NS);
+	fprintf(stderr, "  -g : generate the seed inputs\n");
+}
+/* EOF */
@@ -0,0 +1,97 @@
+/**
+ * @file  host.c
+ * @brief Entry point of the firmware built as a Linux program
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Usage
+ *   firmware                  Use the simulated heatpump (real time)
+ *   firmware -u /dev/ttyUSB0  Use a real heatpump, or the pty of test/sim
+ *   firmware -f flash.bin     File used as flash (default host_flash.bin)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_timer.h"
+#include "hpsim.h"
+
+/* Declare functions of the host platform */
+int  platform_flash_open(const char *name);
+int  uart_posix_open(const char *dev, struct hpsim *sim);
+/* Declare entry point of the firmware, see main.c */
+void app_main(void);
+
+static void usage(char *appname);
+
+static struct hpsim sim;
+
+/**
+ * @brief Entry point of the program
+ *
+ * @param argc Number or command line arguments
+ * @param argv Array of string with command line arguments
+ * @return integer Only returns on error (-1)
+ */
+int main(int argc, char **argv)
+{
+	struct hpsim_cfg cfg;
+	const char *flash = "host_flash.bin";
+	const char *dev = NULL;
+	int opt;
+
+	memset(&cfg, 0, sizeof(struct hpsim_cfg));
+	cfg.delay = 180000;
+	cfg.seed  = 1;
+
+	while ((opt = getopt(argc, argv, "c:d:f:l:u:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'c': cfg.corrupt = atoi(optarg);        break;
+			case 'd': cfg.delay   = atoi(optarg) * 1000; break;
+			case 'f': flash       = optarg;              break;
+			case 'l': cfg.loss    = atoi(optarg);        break;
+			case 'u': dev         = optarg;              break;
+			default:
+				usage(argv[0]);
+				return(-1);
+		}
+	}
+
+	/* Output is read by tools (tee, grep) */
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	if (platform_flash_open(flash) != 0)
+		printf("HOST: Failed to open %s, no flash\n", flash);
+	hpsim_init(&sim, &cfg, esp_timer_get_time());
+	if (uart_posix_open(dev, &sim) != 0)
+		return(-1);
+
+	app_main();
+	return(-1);
+}
+
+/**
+ * @brief Print an help message about command line arguments
+ *
+ */
+static void usage(char *appname)
+{
+	fprintf(stderr, "Usage %s [options]\n", appname);
+	fprintf(stderr, "  -u <dev> : serial device (default simulated heatpump)\n");
+	fprintf(stderr, "  -f <file>: file used as flash (default host_flash.bin)\n");
+	fprintf(stderr, "  -d <ms>  : simulator, response delay (default 180)\n");
+	fprintf(stderr, "  -c <n>   : simulator, corrupted responses (per 1000)\n");
+	fprintf(stderr, "  -l <n>   : simulator, requests without response (per 1000)\n");
+}
+/* EOF */
@@ -0,0 +1,8 @@
+#ifndef ESP_ATTR_H
+#define ESP_ATTR_H
+
+/* No RTC memory on host, variables are lost when the program exits */
+#define RTC_NOINIT_ATTR
+#define RTC_DATA_ATTR
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef ESP_HTTP_SERVER_H
+#define ESP_HTTP_SERVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "esp_err.h"
+
+typedef void *httpd_handle_t;
+
+typedef enum {
+    HTTP_GET  = 1,
+    HTTP_POST = 3,
+} httpd_method_t;
+
+typedef enum {
+    HTTPD_500_INTERNAL_SERVER_ERROR = 0,
+    HTTPD_400_BAD_REQUEST,
+    HTTPD_404_NOT_FOUND,
+} httpd_err_code_t;
+
+typedef struct httpd_req {
+    httpd_handle_t  handle;             /*!< Handle to server instance */
+    int             method;             /*!< The type of HTTP request */
+    const char      uri[513];           /*!< The URI of this request */
+    size_t          content_len;        /*!< Length of the request body */
+    void           *aux;                /*!< Internally used members */
+    void           *user_ctx;           /*!< User context pointer */
+} httpd_req_t;
+
+typedef struct httpd_uri {
+    const char     *uri;                /*!< The URI to handle */
+    httpd_method_t  method;             /*!< Method supported by the URI */
+    esp_err_t (*handler)(httpd_req_t *r); /*!< Handler to call */
+    void           *user_ctx;           /*!< Pointer to user context data */
+    bool            is_websocket;       /*!< Flag for indicating a websocket endpoint */
+} httpd_uri_t;
+
+typedef void (*httpd_close_func_t)(httpd_handle_t hd, int sockfd);
+
+typedef struct httpd_config {
+    unsigned    task_priority;          /*!< Priority of FreeRTOS task which runs the server */
+    size_t      stack_size;             /*!< The maximum stack size allowed for the server task */
+    int         core_id;                /*!< The core the HTTP server task will run on */
+    uint16_t    server_port;            /*!< TCP Port number for receiving and transmitting HTTP traffic */
+    uint16_t    max_open_sockets;       /*!< Max number of sockets/clients connected at any time */
+    uint16_t    max_uri_handlers;       /*!< Maximum allowed uri handlers */
+    bool        lru_purge_enable;       /*!< Purge "Least Recently Used" connection */
+    httpd_close_func_t close_fn;        /*!< Custom session closing callback */
+} httpd_config_t;
+
+#define HTTPD_DEFAULT_CONFIG() {    \
+        .task_priority    = 5,      \
+        .stack_size       = 4096,   \
+        .core_id          = 0x7FFFFFFF, \
+        .server_port      = 80,     \
+        .max_open_sockets = 7,      \
+        .max_uri_handlers = 8,      \
+        .lru_purge_enable = false,  \
+        .close_fn         = NULL,   \
+}
+
+typedef enum {
+    HTTPD_WS_TYPE_CONTINUE = 0x0,
+    HTTPD_WS_TYPE_TEXT     = 0x1,
+    HTTPD_WS_TYPE_BINARY   = 0x2,
+    HTTPD_WS_TYPE_CLOSE    = 0x8,
+} httpd_ws_type_t;
+
+typedef struct httpd_ws_frame {
+    bool            final;              /*!< Final frame */
+    bool            fragmented;         /*!< Indication that the frame allocated is fragmented */
+    httpd_ws_type_t type;               /*!< WebSocket frame type */
+    uint8_t        *payload;            /*!< Pre-allocated data buffer */
+    size_t          len;                /*!< Length of the WebSocket data */
+} httpd_ws_frame_t;
+
+typedef void (*httpd_work_fn_t)(void *arg);
+
+/* ========================================================================== */
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config);
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler);
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len);
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size);
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type);
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value);
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg);
+int       httpd_req_to_sockfd(httpd_req_t *r);
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg);
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd);
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len);
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame);
+
+#endif
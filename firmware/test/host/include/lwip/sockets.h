@@ -0,0 +1,12 @@
+#ifndef LWIP_SOCKETS_H
+#define LWIP_SOCKETS_H
+
+/* lwip socket API is the BSD one, use the host sockets */
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#endif
@@ -0,0 +1,368 @@
+/**
+ * @file  platform.c
+ * @brief Host versions of the esp-idf services used by the firmware
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Notes
+ * Data partitions are stored into a file (same layout as partitions.csv),
+ * so history and captures survive a restart of the program. The network
+ * is the one of the host : Modbus and bridge servers listen on the host
+ * ports. HTTP server, MQTT client and OTA of esp-idf are not available, these
+ * modules report an init error and the firmware continues without them.
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "esp_http_client.h"
+#include "esp_http_server.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "mqtt_client.h"
+#include "network.h"
+
+#define FLASH_SECTOR 4096
+
+static esp_partition_t partitions[] =
+{
+	{ NULL, ESP_PARTITION_TYPE_DATA, 0x40, 0x1D0000, 0x2E000, "history", false },
+	{ NULL, ESP_PARTITION_TYPE_DATA, 0x41, 0x1FE000, 0x2000,  "capture", false },
+};
+#define PART_COUNT (sizeof(partitions) / sizeof(esp_partition_t))
+
+static int flash_fd = -1;
+
+/**
+ * @brief Open the file used as flash
+ *
+ * @param name Name of the file (created if needed)
+ * @return integer Zero is returned on success, -1 on error
+ */
+int platform_flash_open(const char *name)
+{
+	flash_fd = open(name, O_RDWR | O_CREAT, 0644);
+	if (flash_fd < 0)
+		return(-1);
+	/* Size of the 2MB flash, new area reads as erased */
+	if (lseek(flash_fd, 0, SEEK_END) < 0x200000)
+	{
+		const esp_partition_t *p;
+		for (p = partitions; p < (partitions + PART_COUNT); p++)
+			esp_partition_erase_range(p, 0, p->size);
+	}
+	return(0);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                            Timer and flash                           -- */
+/* -------------------------------------------------------------------------- */
+
+int64_t esp_timer_get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(((int64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000));
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+                       esp_partition_subtype_t subtype, const char* label)
+{
+	int i;
+
+	if (flash_fd < 0)
+		return(NULL);
+	for (i = 0; i < PART_COUNT; i++)
+	{
+		if ((partitions[i].type == type) && (partitions[i].subtype == subtype) &&
+		    ((label == NULL) || (strcmp(label, partitions[i].label) == 0)))
+			return(&partitions[i]);
+	}
+	return(NULL);
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset,
+                             void* dst, size_t size)
+{
+	if ((src_offset + size) > partition->size)
+		return(ESP_FAIL);
+	if (pread(flash_fd, dst, size, partition->address + src_offset) != size)
+		return(ESP_FAIL);
+	return(ESP_OK);
+}
+
+/**
+ * @brief Host version of esp_partition_write
+ *
+ * Like NOR flash, a write can only clear bits.
+ */
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset,
+                              const void* src, size_t size)
+{
+	uint8_t buf[256];
+	size_t n, i;
+
+	if ((dst_offset + size) > partition->size)
+		return(ESP_FAIL);
+	while (size)
+	{
+		n = (size > sizeof(buf)) ? sizeof(buf) : size;
+		if (pread(flash_fd, buf, n, partition->address + dst_offset) != n)
+			return(ESP_FAIL);
+		for (i = 0; i < n; i++)
+			buf[i] &= ((const uint8_t *)src)[i];
+		if (pwrite(flash_fd, buf, n, partition->address + dst_offset) != n)
+			return(ESP_FAIL);
+		src = (const uint8_t *)src + n;
+		dst_offset += n;
+		size -= n;
+	}
+	return(ESP_OK);
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition,
+                                    size_t offset, size_t size)
+{
+	uint8_t buf[FLASH_SECTOR];
+
+	if ((offset % FLASH_SECTOR) || (size % FLASH_SECTOR) ||
+	    ((offset + size) > partition->size))
+		return(ESP_FAIL);
+	memset(buf, 0xFF, FLASH_SECTOR);
+	for (; size; size -= FLASH_SECTOR, offset += FLASH_SECTOR)
+	{
+		if (pwrite(flash_fd, buf, FLASH_SECTOR, partition->address + offset) != FLASH_SECTOR)
+			return(ESP_FAIL);
+	}
+	return(ESP_OK);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                         Network, HTTP and MQTT                       -- */
+/* -------------------------------------------------------------------------- */
+
+int network_init(void)
+{
+	printf("NETWORK: Using host network\n");
+	return(0);
+}
+
+int network_is_up(void)
+{
+	return(1);
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+	printf("HOST: No HTTP server\n");
+	return(ESP_FAIL);
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg)
+{
+	return(ESP_FAIL);
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r)
+{
+	return(-1);
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame)
+{
+	return(ESP_FAIL);
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+	printf("HOST: No MQTT client\n");
+	return(NULL);
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, int32_t event,
+                                         esp_event_handler_t handler, void *arg)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+	return(ESP_FAIL);
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+	return(-1);
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic,
+                            const char *data, int len, int qos, int retain)
+{
+	return(-1);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          OTA and restart                             -- */
+/* -------------------------------------------------------------------------- */
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config)
+{
+	printf("HOST: No HTTP client\n");
+	return(NULL);
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len)
+{
+	return(ESP_FAIL);
+}
+
+int esp_http_client_fetch_headers(esp_http_client_handle_t client)
+{
+	return(-1);
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+	return(-1);
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len)
+{
+	return(-1);
+}
+
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client)
+{
+	return(false);
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+	return(ESP_FAIL);
+}
+
+const esp_partition_t* esp_ota_get_running_partition(void)
+{
+	return(NULL);
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+	return(NULL);
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *ota_state)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size, esp_ota_handle_t* out_handle)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void)
+{
+	return(ESP_FAIL);
+}
+
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot(void)
+{
+	return(ESP_FAIL);
+}
+
+void esp_restart(void)
+{
+	printf("HOST: Restart\n");
+	exit(0);
+}
+/* EOF */
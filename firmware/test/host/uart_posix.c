@@ -0,0 +1,127 @@
+/**
+ * @file  uart_posix.c
+ * @brief Host version of the UART driver (serial port or simulated heatpump)
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Notes
+ * When a device is given (USB adapter, or pseudo-terminal of the simulator)
+ * bytes are read and written to it. Else the heatpump simulator is linked
+ * into the program and used in real time.
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#include "driver/uart.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "hpsim.h"
+
+static int uart_fd = -1;
+static struct hpsim *uart_sim = NULL;
+
+/**
+ * @brief Select the heatpump connected to the UART
+ *
+ * @param dev Name of a serial device, or NULL to use the simulator
+ * @param sim Pointer to an initialized simulator (used when dev is NULL)
+ * @return integer Zero is returned on success, -1 on error
+ */
+int uart_posix_open(const char *dev, struct hpsim *sim)
+{
+	struct termios tio;
+
+	if (dev == NULL)
+	{
+		uart_sim = sim;
+		return(0);
+	}
+
+	uart_fd = open(dev, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if ((uart_fd < 0) || tcgetattr(uart_fd, &tio))
+	{
+		printf("HOST: Failed to open %s\n", dev);
+		return(-1);
+	}
+	/* 9600 bauds, 8 bits, even parity, 1 stop bit */
+	cfmakeraw(&tio);
+	cfsetispeed(&tio, B9600);
+	cfsetospeed(&tio, B9600);
+	tio.c_cflag |= (PARENB | CLOCAL | CREAD);
+	tio.c_cflag &= ~(PARODD | CSTOPB);
+	if (tcsetattr(uart_fd, TCSANOW, &tio))
+		return(-1);
+	return(0);
+}
+
+int uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size,
+                        int queue_size, void *uart_queue, int intr_alloc_flags)
+{
+	if ((uart_fd < 0) && (uart_sim == NULL))
+		return(ESP_FAIL);
+	return(ESP_OK);
+}
+
+int uart_param_config(int uart_num, const uart_config_t *uart_config)
+{
+	return(ESP_OK);
+}
+
+int uart_set_pin(int uart_num, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num)
+{
+	return(ESP_OK);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          UART IOs functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+int uart_get_buffered_data_len(int uart_num, size_t* size)
+{
+	int avail = 0;
+
+	if (uart_sim)
+	{
+		*size = hpsim_avail(uart_sim, esp_timer_get_time());
+		return(ESP_OK);
+	}
+	if (ioctl(uart_fd, FIONREAD, &avail) < 0)
+		return(ESP_FAIL);
+	*size = avail;
+	return(ESP_OK);
+}
+
+int uart_read_bytes(int uart_num, void* buf, uint32_t length, int ticks_to_wait)
+{
+	ssize_t len;
+
+	if (uart_sim)
+		return(hpsim_read(uart_sim, buf, length, esp_timer_get_time()));
+	len = read(uart_fd, buf, length);
+	return((len < 0) ? 0 : len);
+}
+
+int uart_write_bytes(int uart_num, const void *src, int size)
+{
+	int64_t end;
+
+	if (uart_sim)
+	{
+		end = esp_timer_get_time() + ((int64_t)size * HPSIM_BYTE_TIME);
+		hpsim_write(uart_sim, src, size, end);
+		return(size);
+	}
+	return(write(uart_fd, src, size));
+}
+/* EOF */
@@ -0,0 +1,173 @@
+/**
+ * @file  listen.c
+ * @brief Receive and decode the UDP multicast stream of the firmware
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Usage
+ * Each decoded state is printed on one line with the fields changed since
+ * the previous line (all fields after a resync). Records that can not be
+ * decoded (lost, late) are reported on stderr :
+ *   listen                    Join the default group (see main/stream.h)
+ *   listen -g 239.1.2.3 -p 5000
+ *   listen -u -p 4210         Unicast, do not join a group
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "aquarea_state.h"
+#include "stream.h"
+#include "stream_codec.h"
+
+static void print(const struct aquarea_state *state, int full);
+static void usage(char *appname);
+
+static struct aquarea_state last;
+
+/**
+ * @brief Entry point of the listener
+ *
+ * @param argc Number or command line arguments
+ * @param argv Array of string with command line arguments
+ * @return integer Zero is returned on success, -1 for error
+ */
+int main(int argc, char **argv)
+{
+	const char *group = STREAM_GROUP;
+	struct stream_dec  dec;
+	struct aquarea_state state;
+	struct sockaddr_in addr;
+	struct ip_mreq mreq;
+	uint8_t buf[1500];
+	ssize_t len;
+	int port = STREAM_PORT;
+	int unicast = 0;
+	int synced = 0;
+	int sock, opt;
+	unsigned int lost, late, restarts;
+
+	while ((opt = getopt(argc, argv, "g:p:u")) != -1)
+	{
+		switch(opt)
+		{
+			case 'g': group = optarg;       break;
+			case 'p': port = atoi(optarg);  break;
+			case 'u': unicast = 1;          break;
+			default:
+				usage(argv[0]);
+				return(-1);
+		}
+	}
+
+	sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0)
+		return(-1);
+	opt = 1;
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+	{
+		perror("listen: bind");
+		return(-1);
+	}
+	if ( ! unicast)
+	{
+		mreq.imr_multiaddr.s_addr = inet_addr(group);
+		mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+		if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0)
+		{
+			perror("listen: join group");
+			return(-1);
+		}
+	}
+	fprintf(stderr, "listen: waiting records on %s:%d\n",
+	        unicast ? "*" : group, port);
+
+	stream_dec_init(&dec);
+	while(1)
+	{
+		len = recv(sock, buf, sizeof(buf), 0);
+		if (len < 0)
+			break;
+		lost = dec.lost;
+		late = dec.late;
+		restarts = dec.restarts;
+		switch (stream_decode(&dec, buf, len, &state))
+		{
+			case 1:
+				if (dec.restarts != restarts)
+					fprintf(stderr, "listen: sender restarted\n");
+				print(&state, ! synced);
+				synced = 1;
+				break;
+			case 0:
+				if (dec.lost != lost)
+					fprintf(stderr, "listen: %u records lost\n", dec.lost - lost);
+				if (dec.late != late)
+					fprintf(stderr, "listen: late record\n");
+				synced = 0;
+				break;
+			default:
+				fprintf(stderr, "listen: invalid record (%d bytes)\n", (int)len);
+				synced = 0;
+				break;
+		}
+		fflush(stdout);
+	}
+	close(sock);
+	return(0);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Print the changed fields of a decoded state
+ *
+ * @param state Pointer to the decoded state
+ * @param full  When set, all fields are printed
+ */
+static void print(const struct aquarea_state *state, int full)
+{
+	int i;
+
+	printf("%u %u:", (unsigned int)state->seq, (unsigned int)state->time);
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		if (full || (state->value[i] != last.value[i]))
+			printf(" %s=%d", aquarea_state_name(i), (int)state->value[i]);
+	}
+	printf("\n");
+	memcpy(&last, state, sizeof(struct aquarea_state));
+}
+
+/**
+ * @brief Print an help message about command line arguments
+ *
+ */
+static void usage(char *appname)
+{
+	printf("Usage %s [-g group] [-p port] [-u]\n", appname);
+	printf("  -g  Multicast group (default %s)\n", STREAM_GROUP);
+	printf("  -p  UDP port (default %d)\n", STREAM_PORT);
+	printf("  -u  Unicast, do not join the group\n");
+}
+/* EOF */
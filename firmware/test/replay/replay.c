@@ -0,0 +1,366 @@
+/**
+ * @file  replay.c
+ * @brief Host tool used to replay a capture of the serial link
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Usage
+ * Records of a capture (downloaded from /capture) are given to the real
+ * low-level layer (aquarea_ll.c) using the simulated UART and timer of the
+ * unit-tests. Each frame seen by the layer is printed on one line, followed
+ * by the fields changed by the decoded status frames :
+ *   replay capture.bin        Replay as fast as possible
+ *   replay -t capture.bin     Replay with the original timing
+ *   replay -q -n 100 file.bin Benchmark (100 loops, no output)
+ *   replay -g file.bin        Generate a synthetic capture
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "aquarea_ll.h"
+#include "aquarea_state.h"
+#include "capture.h"
+#include "driver_timer.h"
+#include "driver_uart.h"
+#include "log.h"
+
+/* Delay used to flush an incomplete frame at end of capture (us) */
+#define REPLAY_FLUSH 1000000
+
+static int      generate(const char *name);
+static void     gen_cksum(uint8_t *packet);
+static uint8_t *load(const char *name, size_t *len);
+static int64_t  replay(const uint8_t *buf, size_t len, int64_t offset);
+static void     tap(int dir, int status, const uint8_t *data, size_t len, int64_t time);
+static void     usage(char *appname);
+
+static const char *status_name[] = { "OK", "CKSUM", "?", "PARTIAL" };
+
+static FILE *out;
+static int   realtime;
+static struct aquarea_state state;
+static struct aquarea_state last;
+static unsigned long frames;
+static unsigned long errors;
+static unsigned long rx_bytes;
+
+/**
+ * @brief Entry point of the replay tool
+ *
+ * @param argc Number or command line arguments
+ * @param argv Array of string with command line arguments
+ * @return integer Zero is returned on success, -1 for error
+ */
+int main(int argc, char **argv)
+{
+	struct timespec t0, t1;
+	uint8_t *buf;
+	size_t   len;
+	int64_t  offset;
+	double   elapsed;
+	int quiet = 0;
+	int loops = 1;
+	int opt, n;
+
+	while ((opt = getopt(argc, argv, "g:n:qt")) != -1)
+	{
+		switch(opt)
+		{
+			case 'g': return(generate(optarg));
+			case 'n': loops = atoi(optarg); break;
+			case 'q': quiet = 1;            break;
+			case 't': realtime = 1;         break;
+			default:
+				usage(argv[0]);
+				return(-1);
+		}
+	}
+	if ((optind >= argc) || (loops < 1))
+	{
+		usage(argv[0]);
+		return(-1);
+	}
+
+	buf = load(argv[optind], &len);
+	if (buf == NULL)
+		return(-1);
+
+	/* Messages of the layer and of the drivers are not part of the result */
+	out = fdopen(dup(1), "w");
+	if (freopen("/dev/null", "w", stdout) == NULL)
+		return(-1);
+	if (quiet)
+		out = stdout;
+
+	log_init();
+	uart_init();
+	timer_set(0);
+	if (aquarea_ll_init() != 0)
+		return(-1);
+	aquarea_ll_set_tap(tap);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	offset = 0;
+	for (n = 0; n < loops; n++)
+	{
+		offset = replay(buf, len, offset);
+		if (offset < 0)
+		{
+			fprintf(stderr, "replay: invalid capture at loop %d\n", n);
+			return(-1);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	fflush(out);
+
+	elapsed  = (double)(t1.tv_sec - t0.tv_sec);
+	elapsed += (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+	fprintf(stderr, "replay: %lu frames (%lu errors), %lu bytes received\n",
+	        frames, errors, rx_bytes);
+	if (loops > 1)
+		fprintf(stderr, "replay: %.3f s, %.2f MB/s, %.0f frames/s\n", elapsed,
+		        (double)rx_bytes / elapsed / 1e6, (double)frames / elapsed);
+
+	free(buf);
+	return(0);
+}
+
+/**
+ * @brief The special function "aquarea_rx" is called by low-level layer when
+ *        a valid packet has been received.
+ *
+ * @param packet Pointer to a buffer with the received packet
+ * @param len    Length of the packet
+ */
+void aquarea_rx(unsigned char *packet, size_t len)
+{
+	int i;
+
+	if (aquarea_state_decode(&state, packet, len) != 0)
+		return;
+
+	fprintf(out, "  state %u:", (unsigned int)state.seq);
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		if ((state.seq == 1) || (state.value[i] != last.value[i]))
+			fprintf(out, " %s=%d", aquarea_state_name(i), (int)state.value[i]);
+	}
+	fprintf(out, "\n");
+	memcpy(&last, &state, sizeof(struct aquarea_state));
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Replay all records of a capture
+ *
+ * @param buf    Pointer to a buffer with the capture
+ * @param len    Length of the capture
+ * @param offset Time added to each record (used to loop)
+ * @return int64 Time offset for the next loop, or -1 if capture is invalid
+ */
+static int64_t replay(const uint8_t *buf, size_t len, int64_t offset)
+{
+	struct capture_reader rd;
+	const uint8_t *data;
+	uint8_t packet[260];
+	int64_t time, prev = -1;
+	size_t  dlen;
+	int dir, result;
+
+	capture_reader_init(&rd, buf, len);
+	while ((result = capture_reader_next(&rd, &dir, &data, &dlen, &time)) == 1)
+	{
+		if (realtime && (prev >= 0) && (time > prev))
+			usleep(time - prev);
+		prev = time;
+
+		/* Let the layer see the silence before these bytes (resync) */
+		timer_set(offset + time);
+		aquarea_ll_process();
+
+		if (dir == AQUAREA_LL_RX)
+		{
+			uart_set_buffer((unsigned char *)data, dlen);
+			aquarea_ll_process();
+			rx_bytes += dlen;
+		}
+		else if ((dlen >= 4) && (dlen == (size_t)(data[1] + 3)))
+		{
+			memcpy(packet, data, dlen);
+			aquarea_ll_send(packet);
+		}
+		else
+			fprintf(out, "%lld TX ignored %u\n", (long long)time, (unsigned int)dlen);
+	}
+	if (result < 0)
+		return(-1);
+
+	/* End of capture, drop incomplete frame (if any) */
+	timer_set(offset + prev + REPLAY_FLUSH);
+	aquarea_ll_process();
+
+	return(offset + prev + (2 * REPLAY_FLUSH));
+}
+
+/**
+ * @brief Frames tap, print one line per frame
+ *
+ */
+static void tap(int dir, int status, const uint8_t *data, size_t len, int64_t time)
+{
+	frames++;
+	if (status != AQUAREA_LL_OK)
+		errors++;
+	fprintf(out, "%lld %s %s %u\n", (long long)time,
+	        (dir == AQUAREA_LL_TX) ? "TX" : "RX",
+	        status_name[status & 3], (unsigned int)len);
+}
+
+/**
+ * @brief Load a capture file into memory
+ *
+ * @param name Name of the file
+ * @param len  Pointer to a variable where the length is stored
+ * @return uint8 Pointer to an allocated buffer, NULL on error
+ */
+static uint8_t *load(const char *name, size_t *len)
+{
+	uint8_t *buf;
+	FILE *f;
+	long sz;
+
+	f = fopen(name, "rb");
+	if (f == NULL)
+	{
+		fprintf(stderr, "replay: failed to open %s\n", name);
+		return(NULL);
+	}
+	fseek(f, 0, SEEK_END);
+	sz = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	buf = malloc(sz > 0 ? sz : 1);
+	if (buf && (fread(buf, 1, sz, f) != (size_t)sz))
+	{
+		free(buf);
+		buf = NULL;
+	}
+	fclose(f);
+	*len = (size_t)sz;
+	return(buf);
+}
+
+/**
+ * @brief Compute and insert the checksum of a packet
+ *
+ */
+static void gen_cksum(uint8_t *packet)
+{
+	uint32_t sum = 0;
+	int i;
+
+	for (i = 0; i < (packet[1] + 2); i++)
+		sum += packet[i];
+	packet[packet[1] + 2] = ((sum & 0xFF) ^ 0xFF) + 1;
+}
+
+/**
+ * @brief Generate a synthetic capture, used as seed of the corpus
+ *
+ * Query/response cycles every 5 seconds, responses received by chunks like
+ * with a real UART at 9600 bauds. One response has an invalid checksum and
+ * one is truncated.
+ *
+ * @param name Name of the file to create
+ * @return integer Zero is returned on success, -1 for error
+ */
+static int generate(const char *name)
+{
+	static struct capture cap;
+	static uint8_t block[CAPTURE_BLOCK_SIZE];
+	uint8_t query[111];
+	uint8_t rsp[203];
+	uint32_t seq = 0;
+	int64_t t;
+	size_t  n, len, rsp_len;
+	FILE *f;
+	int cycle, i;
+
+	capture_init(&cap);
+
+	memset(query, 0, sizeof(query));
+	query[0] = 0x71;
+	query[1] = 108;
+	query[2] = 0x01;
+	query[3] = 0x10;
+	gen_cksum(query);
+
+	t = 1000000;
+	for (cycle = 0; cycle < 16; cycle++)
+	{
+		capture_add(&cap, AQUAREA_LL_TX, query, sizeof(query), t);
+
+		rsp[0] = 0x71;
+		rsp[1] = 200;
+		rsp[2] = 0x01;
+		rsp[3] = 0x10;
+		for (i = 4; i < 202; i++)
+			rsp[i] = (uint8_t)(0x80 + (i % 16) + ((i % 7 == 0) ? (cycle / 3) : 0));
+		gen_cksum(rsp);
+		rsp_len = sizeof(rsp);
+		if (cycle == 5)
+			rsp[100] ^= 0x01;
+		if (cycle == 10)
+			rsp_len = 100;
+
+		/* Response after 180ms, then about 1.15ms per byte */
+		t += 180000;
+		for (n = 0; n < rsp_len; n += len)
+		{
+			len = ((rsp_len - n) > 32) ? 32 : (rsp_len - n);
+			capture_add(&cap, AQUAREA_LL_RX, rsp + n, len, t);
+			t += 1146 * len;
+		}
+		t = 1000000 + ((int64_t)(cycle + 1) * 5000000);
+	}
+
+	f = fopen(name, "wb");
+	if (f == NULL)
+		return(-1);
+	while ((n = capture_export(&cap, &seq, block)) != 0)
+		fwrite(block, 1, n, f);
+	fclose(f);
+
+	fprintf(stderr, "replay: %u records, %u bytes into %s\n",
+	        (unsigned int)cap.records, (unsigned int)cap.bytes, name);
+	return(0);
+}
+
+/**
+ * @brief Print an help message about command line arguments
+ *
+ */
+static void usage(char *appname)
+{
+	fprintf(stderr, "Usage %s [-q] [-t] [-n loops] <capture>\n", appname);
+	fprintf(stderr, "      %s -g <capture>\n", appname);
+	fprintf(stderr, "  -t : replay with the original timing\n");
+	fprintf(stderr, "  -n : replay the capture many times (benchmark)\n");
+	fprintf(stderr, "  -q : quiet, print only the results\n");
+	fprintf(stderr, "  -g : generate a synthetic capture\n");
+}
+/* EOF */
@@ -0,0 +1,72 @@
+/**
+ * @file  driver_uart.c
+ * @brief Simulated UART connected to the heatpump simulator
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include "driver/uart.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "hpsim.h"
+
+/* Heatpump connected to the UART, must be set before init */
+struct hpsim *uart_sim = NULL;
+
+int uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size,
+                        int queue_size, void *uart_queue, int intr_alloc_flags)
+{
+	if (uart_sim == NULL)
+		return(ESP_FAIL);
+	return(ESP_OK);
+}
+
+int uart_param_config(int uart_num, const uart_config_t *uart_config)
+{
+	return(ESP_OK);
+}
+
+int uart_set_pin(int uart_num, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num)
+{
+	return(ESP_OK);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          UART IOs functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+int uart_get_buffered_data_len(int uart_num, size_t* size)
+{
+	*size = hpsim_avail(uart_sim, esp_timer_get_time());
+	return(ESP_OK);
+}
+
+int uart_read_bytes(int uart_num, void* buf, uint32_t length, int ticks_to_wait)
+{
+	return(hpsim_read(uart_sim, buf, length, esp_timer_get_time()));
+}
+
+/**
+ * @brief Simulated version of esp-idf function uart_write_bytes
+ *
+ * Bytes are given to the heatpump with the time of the last byte on the
+ * line, like a real 9600 bauds link.
+ */
+int uart_write_bytes(int uart_num, const void *src, int size)
+{
+	int64_t end;
+
+	end = esp_timer_get_time() + ((int64_t)size * HPSIM_BYTE_TIME);
+	hpsim_write(uart_sim, src, size, end);
+	return(size);
+}
+/* EOF */
@@ -0,0 +1,355 @@
+/**
+ * @file  hpsim.c
+ * @brief Simulator of an Aquarea heatpump (serial protocol and behaviour)
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Model
+ * The simulated heatpump answers status queries (0x71) and set commands
+ * (0xF1) with a status packet. Its state evolves with time : outside
+ * temperature follows a daily cycle, the compressor is regulated to reach a
+ * target given by a heating curve (or by the zone 1 request when set, as in
+ * direct mode), water temperatures follow the power produced, DHW tank is
+ * heated when forced or too cold and defrost cycles occur when outside is
+ * cold. This is not a thermal model of a real house,
+ * only a source of realistic and evolving values.
+ */
+#include <math.h>
+#include <string.h>
+#include "hpsim.h"
+
+/* Max delay between two bytes of a request, else request is dropped (us) */
+#define HPSIM_RESYNC 100000
+
+static void     handle(struct hpsim *sim, int64_t now);
+static void     model(struct hpsim *sim, double t, double dt);
+static void     publish(struct hpsim *sim, double t);
+static uint32_t rnd(struct hpsim *sim);
+static double   limit(double v, double min, double max);
+
+/**
+ * @brief Initialize a simulated heatpump
+ *
+ * @param sim Pointer to the simulator context
+ * @param cfg Pointer to the configuration (delays, errors)
+ * @param now Current time (us)
+ */
+void hpsim_init(struct hpsim *sim, const struct hpsim_cfg *cfg, int64_t now)
+{
+	memset(sim, 0, sizeof(struct hpsim));
+	memcpy(&sim->cfg, cfg, sizeof(struct hpsim_cfg));
+	sim->rand = cfg->seed ? cfg->seed : 1;
+	sim->time = now;
+
+	sim->state.value[AQ_HP_STATE]        = 1;
+	sim->state.value[AQ_OPERATING_MODE]  = 0x12;
+	sim->state.value[AQ_DHW_TARGET_TEMP] = 50;
+	sim->t_in  = 30.0;
+	sim->t_out = 33.0;
+	sim->t_dhw = 45.0;
+	publish(sim, now / 1e6);
+}
+
+/**
+ * @brief Bytes sent by the firmware to the heatpump
+ *
+ * @param sim  Pointer to the simulator context
+ * @param data Pointer to the bytes
+ * @param len  Number of bytes
+ * @param now  Current time (us)
+ */
+void hpsim_write(struct hpsim *sim, const uint8_t *data, size_t len, int64_t now)
+{
+	size_t i;
+
+	/* Incomplete request followed by a silence, drop it */
+	if (sim->rx_len && ((now - sim->rx_time) > HPSIM_RESYNC))
+		sim->rx_len = 0;
+	sim->rx_time = now;
+
+	for (i = 0; i < len; i++)
+	{
+		sim->rx[sim->rx_len++] = data[i];
+		if ((sim->rx_len >= 2) && (sim->rx_len == (size_t)(sim->rx[1] + 3)))
+		{
+			handle(sim, now);
+			sim->rx_len = 0;
+		}
+	}
+}
+
+/**
+ * @brief Get the number of bytes that can be read by the firmware
+ *
+ * Bytes of a response are available one by one, with the timing of a
+ * 9600 bauds link.
+ *
+ * @param sim Pointer to the simulator context
+ * @param now Current time (us)
+ * @return size_t Number of bytes available
+ */
+size_t hpsim_avail(struct hpsim *sim, int64_t now)
+{
+	size_t n;
+
+	if ((sim->tx_len == 0) || (now < sim->tx_start))
+		return(0);
+	n = (size_t)((now - sim->tx_start) / HPSIM_BYTE_TIME) + 1;
+	if (n > sim->tx_len)
+		n = sim->tx_len;
+	return(n - sim->tx_sent);
+}
+
+/**
+ * @brief Read bytes sent by the heatpump
+ *
+ * @param sim  Pointer to the simulator context
+ * @param data Pointer to a buffer to store bytes
+ * @param len  Size of the buffer
+ * @param now  Current time (us)
+ * @return size_t Number of bytes read
+ */
+size_t hpsim_read(struct hpsim *sim, uint8_t *data, size_t len, int64_t now)
+{
+	size_t n;
+
+	n = hpsim_avail(sim, now);
+	if (n > len)
+		n = len;
+	memcpy(data, sim->tx + sim->tx_sent, n);
+	sim->tx_sent += n;
+	if (sim->tx_len && (sim->tx_sent == sim->tx_len))
+	{
+		sim->stats.responses++;
+		sim->tx_len  = 0;
+		sim->tx_sent = 0;
+	}
+	return(n);
+}
+
+/**
+ * @brief Update the simulated state up to a given time
+ *
+ * @param sim Pointer to the simulator context
+ * @param now Current time (us)
+ */
+void hpsim_step(struct hpsim *sim, int64_t now)
+{
+	double t, dt;
+
+	if (now <= sim->time)
+		return;
+	t  = sim->time / 1e6;
+	dt = (now - sim->time) / 1e6;
+	/* Large steps are cut to keep the model stable */
+	while (dt > 0)
+	{
+		model(sim, t, (dt > 1.0) ? 1.0 : dt);
+		t  += 1.0;
+		dt -= 1.0;
+	}
+	sim->time = now;
+	publish(sim, now / 1e6);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Process a complete request
+ *
+ * @param sim Pointer to the simulator context
+ * @param now Current time (us)
+ */
+static void handle(struct hpsim *sim, int64_t now)
+{
+	uint8_t *rsp = sim->tx;
+	uint32_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < sim->rx_len; i++)
+		sum += sim->rx[i];
+	if (sum & 0xFF)
+	{
+		sim->stats.invalid++;
+		return;
+	}
+
+	if (sim->rx[0] == AQUAREA_QUERY)
+		sim->stats.queries++;
+	else if (sim->rx[0] == AQUAREA_COMMAND)
+		sim->stats.commands++;
+	else
+		return;
+
+	/* Half-duplex link, a request during a response is not seen */
+	if (sim->tx_len)
+	{
+		sim->stats.busy++;
+		return;
+	}
+	if ((rnd(sim) % 1000) < sim->cfg.loss)
+	{
+		sim->stats.lost++;
+		return;
+	}
+
+	hpsim_step(sim, now);
+	if (sim->rx[0] == AQUAREA_COMMAND)
+	{
+		aquarea_state_command(&sim->state, sim->rx, sim->rx_len);
+		publish(sim, now / 1e6);
+	}
+
+	/* Build the status packet */
+	memset(rsp, 0, AQUAREA_STATUS_LEN);
+	rsp[0] = AQUAREA_QUERY;
+	rsp[1] = AQUAREA_STATUS_LEN - 3;
+	rsp[2] = 0x01;
+	rsp[3] = 0x10;
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+		aquarea_state_pack(rsp, i, sim->state.value[i]);
+	sum = 0;
+	for (i = 0; i < (AQUAREA_STATUS_LEN - 1); i++)
+		sum += rsp[i];
+	rsp[AQUAREA_STATUS_LEN - 1] = ((sum & 0xFF) ^ 0xFF) + 1;
+	memcpy(&sim->tx_state, &sim->state, sizeof(struct aquarea_state));
+
+	if ((rnd(sim) % 1000) < sim->cfg.corrupt)
+	{
+		rsp[4 + (rnd(sim) % (AQUAREA_STATUS_LEN - 5))] ^= 0x10;
+		sim->stats.corrupted++;
+	}
+
+	sim->tx_len   = AQUAREA_STATUS_LEN;
+	sim->tx_sent  = 0;
+	sim->tx_start = now + sim->cfg.delay;
+	if (sim->cfg.jitter)
+		sim->tx_start += rnd(sim) % sim->cfg.jitter;
+}
+
+/**
+ * @brief Evolution of the physical state
+ *
+ * @param sim Pointer to the simulator context
+ * @param t   Time at the beginning of the step (s)
+ * @param dt  Duration of the step (s)
+ */
+static void model(struct hpsim *sim, double t, double dt)
+{
+	int32_t *v = sim->state.value;
+	double outside, target, fmax, want, cop;
+	int    dhw;
+
+	outside = 5.0 + 6.0 * sin(2 * M_PI * t / 86400.0);
+	if (v[AQ_Z1_HEAT_REQUEST])
+		target = v[AQ_Z1_HEAT_REQUEST];
+	else
+		target = limit(38.0 - (outside / 2.0), 25.0, 45.0);
+
+	/* Defrost 4 minutes every 40 minutes when outside is cold */
+	v[AQ_DEFROST] = (v[AQ_HP_STATE] == 1) && (outside < 3.0) &&
+	                (fmod(t, 2400.0) < 240.0);
+
+	/* DHW is heated when forced or when tank is too cold */
+	if (sim->t_dhw < (v[AQ_DHW_TARGET_TEMP] - 8))
+		v[AQ_FORCE_DHW] = 1;
+	dhw = (v[AQ_HP_STATE] == 1) && (v[AQ_FORCE_DHW] == 1);
+
+	/* Compressor regulation, limited by quiet mode */
+	fmax = 90.0 - (15.0 * limit(v[AQ_QUIET_MODE], 0, 3));
+	if ((v[AQ_HP_STATE] != 1) || v[AQ_DEFROST])
+		want = 0;
+	else if (dhw)
+		want = fmax;
+	else if (sim->t_out > (target + 2.0))
+		want = 0;
+	else
+		want = limit(25.0 + 10.0 * (target - sim->t_out), 16.0, fmax);
+	if (sim->freq < want)
+		sim->freq = limit(sim->freq + dt, 0, want);
+	else
+		sim->freq = limit(sim->freq - 2 * dt, want, 120);
+
+	/* Water temperatures */
+	if (dhw)
+	{
+		sim->t_dhw += dt * sim->freq / 36000.0;
+		if (sim->t_dhw >= v[AQ_DHW_TARGET_TEMP])
+			v[AQ_FORCE_DHW] = 0;
+	}
+	else
+		sim->t_out += (sim->t_in + (sim->freq * 0.12) - sim->t_out) * dt / 60.0;
+	sim->t_in  += ((sim->t_out - 4.0) - sim->t_in) * dt / 300.0;
+	sim->t_in  -= (sim->t_in - outside) * dt / 20000.0;
+	sim->t_dhw -= dt / 3600.0;
+
+	/* Powers */
+	cop = limit(6.5 - (0.1 * (sim->t_out - outside)), 1.5, 6.0);
+	v[AQ_OUTSIDE_TEMP]     = lround(outside);
+	v[AQ_TARGET_TEMP]      = lround(target);
+	v[AQ_HEAT_POWER_PROD]  = dhw ? 0 : lround(sim->freq * 110.0 / 200.0) * 200;
+	v[AQ_HEAT_POWER_CONS]  = dhw ? 0 : lround(sim->freq * 110.0 / cop / 200.0) * 200;
+	v[AQ_DHW_POWER_PROD]   = dhw ? lround(sim->freq * 100.0 / 200.0) * 200 : 0;
+	v[AQ_DHW_POWER_CONS]   = dhw ? lround(sim->freq * 100.0 / cop / 200.0) * 200 : 0;
+}
+
+/**
+ * @brief Update the values reported into status packets
+ *
+ * Values are rounded like the heatpump encodes them.
+ *
+ * @param sim Pointer to the simulator context
+ * @param t   Current time (s)
+ */
+static void publish(struct hpsim *sim, double t)
+{
+	int32_t *v = sim->state.value;
+	int on = (sim->freq > 0);
+
+	v[AQ_INLET_TEMP]      = lround(sim->t_in);
+	v[AQ_OUTLET_TEMP]     = lround(sim->t_out);
+	v[AQ_Z1_WATER_TEMP]   = lround(sim->t_out);
+	v[AQ_DHW_TEMP]        = lround(sim->t_dhw);
+	v[AQ_COMPRESSOR_FREQ] = lround(sim->freq);
+	/* Flow is encoded with a resolution of 0.02 l/min */
+	v[AQ_PUMP_FLOW]       = on ? (1500 + (((int32_t)t % 7) * 2)) : 0;
+	v[AQ_ERROR]           = 0;
+	sim->state.time       = (uint32_t)t;
+}
+
+/**
+ * @brief Random generator (xorshift), reproducible with the same seed
+ *
+ */
+static uint32_t rnd(struct hpsim *sim)
+{
+	sim->rand ^= sim->rand << 13;
+	sim->rand ^= sim->rand >> 17;
+	sim->rand ^= sim->rand << 5;
+	return(sim->rand);
+}
+
+/**
+ * @brief Limit a value to a range
+ *
+ */
+static double limit(double v, double min, double max)
+{
+	if (v < min)
+		return(min);
+	if (v > max)
+		return(max);
+	return(v);
+}
+/* EOF */
@@ -0,0 +1,88 @@
+/**
+ * @file  hpsim.h
+ * @brief Headers and definitions for the heatpump simulator
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef HPSIM_H
+#define HPSIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "aquarea_state.h"
+
+#define HPSIM_BYTE_TIME 1146 /* One byte at 9600 bauds 8E1 (us)  */
+#define HPSIM_FRAME_MAX  258
+
+/**
+ * @brief Configuration of the simulated heatpump
+ */
+struct hpsim_cfg
+{
+	uint32_t delay;     /* Delay before a response (us)                 */
+	uint32_t jitter;    /* Random delay added to each response (us)     */
+	uint32_t corrupt;   /* Responses with a corrupted byte (per 1000)   */
+	uint32_t loss;      /* Requests without response (per 1000)         */
+	uint32_t seed;      /* Seed of the random generator                 */
+};
+
+/**
+ * @brief Statistics of the simulated heatpump
+ */
+struct hpsim_stats
+{
+	uint32_t queries;   /* Status queries received                      */
+	uint32_t commands;  /* Set commands received                        */
+	uint32_t invalid;   /* Frames received with a bad checksum          */
+	uint32_t busy;      /* Requests received while sending a response   */
+	uint32_t lost;      /* Requests not answered (simulated loss)       */
+	uint32_t corrupted; /* Responses sent with a corrupted byte         */
+	uint32_t responses; /* Responses sent                               */
+};
+
+/**
+ * @brief Context of a simulated heatpump
+ *
+ * Time is given by the caller for each call (microseconds), so the same
+ * simulator can run in real time or in virtual time.
+ */
+struct hpsim
+{
+	struct hpsim_cfg   cfg;
+	struct hpsim_stats stats;
+	/* Simulated physical state */
+	struct aquarea_state state;
+	double   t_in;      /* Water inlet temperature                      */
+	double   t_out;     /* Water outlet temperature                     */
+	double   t_dhw;     /* DHW tank temperature                         */
+	double   freq;      /* Compressor frequency                         */
+	int64_t  time;      /* Time of the last model update                */
+	uint32_t rand;
+	/* Frame received from the firmware */
+	uint8_t  rx[HPSIM_FRAME_MAX];
+	size_t   rx_len;
+	int64_t  rx_time;   /* Time of the last byte received               */
+	/* Response being sent */
+	uint8_t  tx[HPSIM_FRAME_MAX];
+	size_t   tx_len;
+	size_t   tx_sent;
+	int64_t  tx_start;  /* Time of the first byte                       */
+	struct aquarea_state tx_state; /* State sent into the response      */
+};
+
+void   hpsim_init (struct hpsim *sim, const struct hpsim_cfg *cfg, int64_t now);
+void   hpsim_write(struct hpsim *sim, const uint8_t *data, size_t len, int64_t now);
+size_t hpsim_avail(struct hpsim *sim, int64_t now);
+size_t hpsim_read (struct hpsim *sim, uint8_t *data, size_t len, int64_t now);
+void   hpsim_step (struct hpsim *sim, int64_t now);
+
+#endif
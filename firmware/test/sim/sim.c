@@ -0,0 +1,298 @@
+/**
+ * @file  sim.c
+ * @brief Host tool to run the serial link against a simulated heatpump
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Usage
+ * By default, the real low-level layer (aquarea_ll.c) is connected to the
+ * simulator using a simulated UART and runs into virtual time : the main
+ * loop is called every tick (10ms like the firmware) and a query is sent
+ * every poll period. Time can run as fast as possible or at real time.
+ *   sim -T 86400               One simulated day, as fast as possible
+ *   sim -r 1 -v                Real time, print decoded states
+ *   sim -p 300 -d 200          Poll faster than the heatpump can answer
+ *   sim -k                     Check decoded values and set commands
+ *   sim -P                     Heatpump on a pseudo-terminal
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "aquarea_ll.h"
+#include "aquarea_state.h"
+#include "driver_timer.h"
+#include "hpsim.h"
+
+static int     pty(struct hpsim *sim);
+static int64_t wall(void);
+static void    usage(char *appname);
+
+extern struct hpsim *uart_sim;
+
+static struct hpsim sim;
+static struct aquarea_state state;
+static int      verbose;
+static int      check;
+static uint32_t mismatch;
+
+/**
+ * @brief Entry point of the simulator
+ *
+ * @param argc Number or command line arguments
+ * @param argv Array of string with command line arguments
+ * @return integer Zero is returned on success, -1 for error
+ */
+int main(int argc, char **argv)
+{
+	struct aquarea_ll_stats st;
+	struct hpsim_cfg cfg;
+	uint8_t  req[260];
+	int64_t  duration = 3600;
+	int64_t  period = 5000;
+	int64_t  tick = 10;
+	int64_t  now, next, end, t0, t1;
+	uint32_t polls = 0;
+	double   rate = 0;
+	double   elapsed;
+	int use_pty = 0;
+	int opt;
+
+	memset(&cfg, 0, sizeof(struct hpsim_cfg));
+	cfg.delay = 180000;
+	cfg.seed  = 1;
+
+	while ((opt = getopt(argc, argv, "c:d:i:j:kl:p:Pr:s:T:v")) != -1)
+	{
+		switch(opt)
+		{
+			case 'c': cfg.corrupt = atoi(optarg);        break;
+			case 'd': cfg.delay   = atoi(optarg) * 1000; break;
+			case 'i': tick        = atoi(optarg);        break;
+			case 'j': cfg.jitter  = atoi(optarg) * 1000; break;
+			case 'k': check       = 1;                   break;
+			case 'l': cfg.loss    = atoi(optarg);        break;
+			case 'p': period      = atoi(optarg);        break;
+			case 'P': use_pty     = 1;                   break;
+			case 'r': rate        = atof(optarg);        break;
+			case 's': cfg.seed    = atoi(optarg);        break;
+			case 'T': duration    = atoll(optarg);       break;
+			case 'v': verbose     = 1;                   break;
+			default:
+				usage(argv[0]);
+				return(-1);
+		}
+	}
+	if ((tick < 1) || (period < tick))
+	{
+		usage(argv[0]);
+		return(-1);
+	}
+
+	if (use_pty)
+	{
+		hpsim_init(&sim, &cfg, wall());
+		return(pty(&sim));
+	}
+
+	/* Messages of the layer are not part of the result */
+	if ( ! verbose && (freopen("/dev/null", "w", stdout) == NULL))
+		return(-1);
+
+	now = 0;
+	timer_set(now);
+	hpsim_init(&sim, &cfg, now);
+	uart_sim = &sim;
+	if (aquarea_ll_init() != 0)
+		return(-1);
+
+	t0 = wall();
+	next = 0;
+	end  = duration * 1000000;
+	tick   *= 1000;
+	period *= 1000;
+	while (now < end)
+	{
+		timer_set(now);
+		aquarea_ll_process();
+
+		if (now >= next)
+		{
+			/* In check mode, change settings at half of the run */
+			if (check && (now >= (end / 2)) && (now < ((end / 2) + period)))
+			{
+				aquarea_state_request(req, AQUAREA_COMMAND);
+				aquarea_state_encode(req, AQ_DHW_TARGET_TEMP, 55);
+				aquarea_state_encode(req, AQ_QUIET_MODE, 2);
+			}
+			else
+				aquarea_state_request(req, AQUAREA_QUERY);
+			aquarea_ll_send(req);
+			polls++;
+			next += period;
+		}
+
+		now += tick;
+		if (rate > 0)
+			usleep((useconds_t)(tick / rate));
+	}
+	t1 = wall();
+
+	aquarea_ll_stats(&st);
+	elapsed = (t1 - t0) / 1e6;
+	fprintf(stderr, "sim: %lld s simulated in %.3f s (x%.0f)\n",
+	        (long long)duration, elapsed, duration / (elapsed > 0 ? elapsed : 1e-6));
+	fprintf(stderr, "sim: %u polls (%.0f/s), %u valid frames, %u checksum errors, "
+	        "%u resync\n", polls, polls / (elapsed > 0 ? elapsed : 1e-6),
+	        st.rx_ok, st.rx_cksum, st.rx_resync);
+	fprintf(stderr, "sim: latency avg %u ms\n",
+	        st.lat_count ? (unsigned int)(st.lat_sum / st.lat_count) : 0);
+	fprintf(stderr, "sim: line busy %u ms rx, %u ms tx (load %u.%u%%), "
+	        "gaps min %u ms avg %u ms\n", st.rx_busy, st.tx_busy,
+	        st.load / 10, st.load % 10, st.gap_min,
+	        st.gap_count ? (unsigned int)(st.gap_sum / st.gap_count) : 0);
+	fprintf(stderr, "sim: heatpump %u queries, %u commands, %u responses, "
+	        "%u busy, %u lost, %u corrupted\n", sim.stats.queries,
+	        sim.stats.commands, sim.stats.responses, sim.stats.busy,
+	        sim.stats.lost, sim.stats.corrupted);
+
+	if (check)
+	{
+		if (state.value[AQ_DHW_TARGET_TEMP] != 55)
+			mismatch++;
+		if (state.value[AQ_QUIET_MODE] != 2)
+			mismatch++;
+		if ((st.rx_ok + st.rx_cksum) != sim.stats.responses)
+			mismatch++;
+		fprintf(stderr, "sim: check %s (%u mismatch)\n",
+		        mismatch ? "FAILED" : "passed", mismatch);
+		return(mismatch ? -1 : 0);
+	}
+	return(0);
+}
+
+/**
+ * @brief The special function "aquarea_rx" is called by low-level layer when
+ *        a valid packet has been received.
+ *
+ * @param packet Pointer to a buffer with the received packet
+ * @param len    Length of the packet
+ */
+void aquarea_rx(unsigned char *packet, size_t len)
+{
+	int i;
+
+	if (aquarea_state_decode(&state, packet, len) != 0)
+		return;
+
+	/* Decoded values must be the ones sent by the simulator */
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		if (state.value[i] == sim.tx_state.value[i])
+			continue;
+		fprintf(stderr, "sim: %s decoded %d, expected %d\n",
+		        aquarea_state_name(i), (int)state.value[i],
+		        (int)sim.tx_state.value[i]);
+		mismatch++;
+	}
+
+	if (verbose)
+	{
+		printf("SIM: %u", (unsigned int)sim.tx_state.time);
+		for (i = 0; i < AQ_FIELD_COUNT; i++)
+			printf(" %d", (int)state.value[i]);
+		printf("\n");
+	}
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Run the heatpump on a pseudo-terminal, in real time
+ *
+ * A firmware or a tool can open the slave side like a serial port. Bytes
+ * are sent with the timing of a 9600 bauds link.
+ *
+ * @param sim Pointer to the simulator
+ * @return integer Only returns on error (-1)
+ */
+static int pty(struct hpsim *sim)
+{
+	struct termios tio;
+	uint8_t buf[HPSIM_FRAME_MAX];
+	ssize_t n;
+	int master, slave;
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if ((master < 0) || grantpt(master) || unlockpt(master))
+		return(-1);
+	/* Keep slave open, raw mode, so the line is usable at any time */
+	slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+	if ((slave < 0) || tcgetattr(slave, &tio))
+		return(-1);
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+	fcntl(master, F_SETFL, O_NONBLOCK);
+	fprintf(stderr, "sim: heatpump available on %s\n", ptsname(master));
+
+	while(1)
+	{
+		n = read(master, buf, sizeof(buf));
+		if (n > 0)
+			hpsim_write(sim, buf, n, wall());
+		n = hpsim_read(sim, buf, sizeof(buf), wall());
+		if ((n > 0) && (write(master, buf, n) != n))
+			return(-1);
+		usleep(1000);
+	}
+	return(-1);
+}
+
+/**
+ * @brief Get the current time of the host (us)
+ *
+ */
+static int64_t wall(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(((int64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000));
+}
+
+/**
+ * @brief Print an help message about command line arguments
+ *
+ */
+static void usage(char *appname)
+{
+	fprintf(stderr, "Usage %s [options]\n", appname);
+	fprintf(stderr, "  -T <s>  : simulated duration (default 3600)\n");
+	fprintf(stderr, "  -p <ms> : poll period (default 5000)\n");
+	fprintf(stderr, "  -i <ms> : period of the main loop (default 10)\n");
+	fprintf(stderr, "  -r <x>  : speed, 1 for real time (default as fast as possible)\n");
+	fprintf(stderr, "  -d <ms> : response delay (default 180)\n");
+	fprintf(stderr, "  -j <ms> : random delay added to responses\n");
+	fprintf(stderr, "  -c <n>  : corrupted responses (per 1000)\n");
+	fprintf(stderr, "  -l <n>  : requests without response (per 1000)\n");
+	fprintf(stderr, "  -s <n>  : seed of the random generator\n");
+	fprintf(stderr, "  -k      : check decoded values and set commands\n");
+	fprintf(stderr, "  -v      : print decoded states\n");
+	fprintf(stderr, "  -P      : heatpump on a pseudo-terminal (real time)\n");
+}
+/* EOF */
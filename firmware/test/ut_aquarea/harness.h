@@ -0,0 +1,38 @@
+/**
+ * @file  harness.h
+ * @brief Headers and definitions of the simulated environment of the tests
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include <stdint.h>
+#include "hpsim.h"
+
+#define FRAME_MAX 4096
+
+/* Heatpump connected to the simulated UART */
+extern struct hpsim sim;
+
+/* Frames seen on the link (time in us) */
+extern int     frame_count;
+extern int64_t frame_time[FRAME_MAX];
+extern int     frame_dir[FRAME_MAX];
+extern int     frame_status[FRAME_MAX];
+extern uint8_t frame_type[FRAME_MAX];
+
+void harness_start(uint32_t loss);
+void harness_run(int64_t ms, uint32_t (*stall)(int64_t now));
+int  harness_task(int64_t ms);
+
+#endif
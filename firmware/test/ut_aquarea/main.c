@@ -0,0 +1,212 @@
+/**
+ * @file  main.c
+ * @brief Entry point of this unit-test
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aquarea.h"
+#include "aquarea_ll.h"
+#include "harness.h"
+#include "log.h"
+#include "os.h"
+#include "vtime.h"
+
+/* Declare functions for each group of tests */
+int  test_poll(void);
+int  test_backoff(void);
+int  test_power(void);
+int  test_boot(void);
+int  test_control(void);
+int  test_heap(void);
+
+static void tap(int dir, int status, const uint8_t *data, size_t len, int64_t time);
+static void usage(char *appname);
+
+/* Heatpump connected to the simulated UART */
+extern struct hpsim *uart_sim;
+struct hpsim sim;
+
+/* Frames seen on the link (see harness.h) */
+int     frame_count;
+int64_t frame_time[FRAME_MAX];
+int     frame_dir[FRAME_MAX];
+int     frame_status[FRAME_MAX];
+uint8_t frame_type[FRAME_MAX];
+
+/**
+ * @brief Entry point of this unit-test
+ *
+ * @param argc Number or command line arguments
+ * @param argv Array of string with command line arguments
+ * @return integer Zero is returned on success, -1 for error
+ */
+int main(int argc, char **argv)
+{
+	int test_num;
+	int result = 0;
+
+	if (argc < 2)
+	{
+		usage(argv[0]);
+		return(-1);
+	}
+
+	log_init();
+
+	test_num = atoi(argv[1]);
+
+	if ((test_num == 1) || (test_num == 0))
+	{
+		if (test_poll() != 0)
+			result = -1;
+	}
+	if ((test_num == 2) || (test_num == 0))
+	{
+		if (test_backoff() != 0)
+			result = -1;
+	}
+	if ((test_num == 3) || (test_num == 0))
+	{
+		if (test_power() != 0)
+			result = -1;
+	}
+	if ((test_num == 4) || (test_num == 0))
+	{
+		if (test_boot() != 0)
+			result = -1;
+	}
+	if ((test_num == 5) || (test_num == 0))
+	{
+		if (test_control() != 0)
+			result = -1;
+	}
+	if ((test_num == 6) || (test_num == 0))
+	{
+		if (test_heap() != 0)
+			result = -1;
+	}
+
+	return(result);
+}
+
+/**
+ * @brief Start the module at time zero, with a new simulated heatpump
+ *
+ * @param loss Requests without response (per 1000)
+ */
+void harness_start(uint32_t loss)
+{
+	struct hpsim_cfg cfg;
+
+	memset(&cfg, 0, sizeof(struct hpsim_cfg));
+	cfg.delay = 180000;
+	cfg.loss  = loss;
+	cfg.seed  = 1;
+
+	vtime_set(0);
+	hpsim_init(&sim, &cfg, 0);
+	uart_sim = &sim;
+	aquarea_init();
+	aquarea_ll_set_tap(tap);
+	frame_count = 0;
+}
+
+/**
+ * @brief Run the main loop of the firmware, during a virtual time
+ *
+ * @param ms    Duration (milliseconds)
+ * @param stall Function called on each loop, return an extra delay (ms)
+ */
+void harness_run(int64_t ms, uint32_t (*stall)(int64_t now))
+{
+	int64_t end = vtime_now() + (ms * 1000);
+
+	while (vtime_now() < end)
+	{
+		aquarea_process();
+		if (stall)
+			os_delay(stall(vtime_now()));
+		os_yield();
+	}
+}
+
+/**
+ * @brief Run the Aquarea task, that sleeps between exchanges
+ *
+ * @param ms Duration (milliseconds)
+ * @return integer Number of wake-ups of the task
+ */
+int harness_task(int64_t ms)
+{
+	int64_t end = vtime_now() + (ms * 1000);
+	uint32_t delay;
+	int count = 0;
+
+	while (vtime_now() < end)
+	{
+		delay = aquarea_process();
+		if (delay)
+			os_delay(delay);
+		else
+			os_yield();
+		count++;
+	}
+	return(count);
+}
+
+/**
+ * @brief Hooks used by the Aquarea module, not tested here
+ *
+ */
+int  bridge_inject(uint8_t *packet) { return(0); }
+void history_push(const struct aquarea_state *state) { }
+void publish_push(const struct aquarea_state *state) { }
+void publish_alarm(const char *name, int active, int32_t value, uint32_t time) { }
+int  live_send(int fd, const char *data, size_t len) { return(0); }
+void live_notify(void) { }
+void stream_push(const struct aquarea_state *state) { }
+
+/**
+ * @brief Frames tap, save time and status of each frame
+ *
+ */
+static void tap(int dir, int status, const uint8_t *data, size_t len, int64_t time)
+{
+	if (frame_count == FRAME_MAX)
+		return;
+	frame_time[frame_count]   = time;
+	frame_dir[frame_count]    = dir;
+	frame_status[frame_count] = status;
+	frame_type[frame_count]   = data[0];
+	frame_count++;
+}
+
+/**
+ * @brief Print an help message about command line arguments
+ *
+ */
+static void usage(char *appname)
+{
+	printf("Usage %s <test_num>\n", appname);
+	printf("  where test_num can be:\n");
+	printf("    0: Run all tests\n");
+	printf("    1: Test poll cadence (latency, late main loop, set commands)\n");
+	printf("    2: Test back-off when heatpump does not answer\n");
+	printf("    3: Test sleep between polls (power management)\n");
+	printf("    4: Test first frame after boot and warm state\n");
+	printf("    5: Test local heating control (closed loop)\n");
+	printf("    6: Test memory (no heap used by the link after init)\n");
+}
+/* EOF */
@@ -0,0 +1,132 @@
+/**
+ * @file  test_backoff.c
+ * @brief Some tests to verify requests when the heatpump does not answer
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include "aquarea.h"
+#include "aquarea_ll.h"
+#include "harness.h"
+#include "log.h"
+
+/* Functions for each sub-test */
+static int test_silent(void);
+static int test_recover(void);
+static int check_tx(int first, const int *seconds, int count);
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_backoff(void)
+{
+	int result = 0;
+
+	/* Heatpump off, requests slow down */
+	if (test_silent())
+		result = -1;
+	/* Heatpump back, normal period restored */
+	if (test_recover())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_silent(void)
+{
+	const int expect[] = { 0, 5, 15, 35, 75, 135, 195, 255, 315, 375 };
+
+	printf(COLOR_BLUE " * Backoff : no response " COLOR_NONE);
+
+	log_start("/tmp/ut_log_aquarea.txt");
+
+	harness_start(1000);
+	harness_run(400000, NULL);
+	if (check_tx(0, expect, 10))
+		goto error;
+	if ((sim.stats.lost != 10) || (sim.stats.responses != 0))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_aquarea.txt");
+	return(-1);
+}
+
+static int test_recover(void)
+{
+	const int expect[] = { 315, 375, 380, 385, 390, 395, 400 };
+	int first;
+
+	printf(COLOR_BLUE " * Backoff : heatpump answers again " COLOR_NONE);
+
+	log_start("/tmp/ut_log_aquarea.txt");
+
+	harness_start(1000);
+	harness_run(300000, NULL);
+	first = frame_count;
+
+	/* The request at 315s is answered, period is restored on next one */
+	sim.cfg.loss = 0;
+	harness_run(101000, NULL);
+	if (check_tx(first, expect, 7))
+		goto error;
+	if (sim.stats.responses != 7)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_aquarea.txt");
+	return(-1);
+}
+
+/**
+ * @brief Compare the time of each request with a list
+ *
+ * @param first   Index of the first frame to test
+ * @param seconds Array with expected time of each request (s)
+ * @param count   Number of expected requests
+ * @return integer Zero if requests match, -1 if not
+ */
+static int check_tx(int first, const int *seconds, int count)
+{
+	int i, n = 0;
+
+	for (i = first; i < frame_count; i++)
+	{
+		if (frame_dir[i] != AQUAREA_LL_TX)
+			continue;
+		if ((n == count) || (frame_time[i] != (int64_t)seconds[n] * 1000000))
+		{
+			printf("Request %d at %lld us\n", n, (long long)frame_time[i]);
+			return(-1);
+		}
+		n++;
+	}
+	if (n != count)
+		return(-1);
+	return(0);
+}
+/* EOF */
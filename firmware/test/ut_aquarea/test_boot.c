@@ -0,0 +1,126 @@
+/**
+ * @file  test_boot.c
+ * @brief Some tests to verify the first exchange and the warm boot
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "aquarea.h"
+#include "aquarea_ll.h"
+#include "harness.h"
+#include "log.h"
+#include "snapshot.h"
+
+/* Functions for each sub-test */
+static int test_first(void);
+static int test_warm(void);
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_boot(void)
+{
+	int result = 0;
+
+	/* First request sent on init, not after one period */
+	if (test_first())
+		result = -1;
+	/* State and counters restored after a reset */
+	if (test_warm())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_first(void)
+{
+	struct aquarea_ll_stats stats;
+
+	printf(COLOR_BLUE " * Boot : first frame " COLOR_NONE);
+
+	log_start("/tmp/ut_log_aquarea.txt");
+
+	harness_start(0);
+	harness_task(1000);
+
+	if ((frame_count < 2) || (frame_dir[0] != AQUAREA_LL_TX) ||
+	    (frame_time[0] != 0))
+		goto error;
+	aquarea_ll_stats(&stats);
+	/* Request and response at 9600 bauds, plus heatpump delay */
+	if ((stats.rx_ok != 1) || (stats.first_rx == 0) || (stats.first_rx > 600))
+		goto error;
+
+	log_end();
+	printf("(%u ms) ", (unsigned int)stats.first_rx);
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_aquarea.txt");
+	return(-1);
+}
+
+static int test_warm(void)
+{
+	const struct snapshot *snap;
+	struct aquarea_state before, after;
+	uint32_t seq;
+
+	printf(COLOR_BLUE " * Boot : warm state restored " COLOR_NONE);
+
+	log_start("/tmp/ut_log_aquarea.txt");
+
+	harness_start(0);
+	harness_run(3600000, NULL);
+	aquarea_get_state(&before);
+	if ((before.seq == 0) || (before.value[AQ_ENERGY_CONS] == 0))
+		goto error;
+
+	/* Reset : RTC memory is kept, all other variables are initialized */
+	harness_start(0);
+	aquarea_get_state(&after);
+	if (memcmp(&before, &after, sizeof(struct aquarea_state)) != 0)
+		goto error;
+	/* Data available for servers, before any frame */
+	snap = snapshot_get();
+	seq = snap->seq;
+	snapshot_put(snap);
+	if (seq != before.seq)
+		goto error;
+
+	/* Decode continues, energy counters too */
+	harness_run(1000, NULL);
+	aquarea_get_state(&after);
+	if (after.seq != (before.seq + 1))
+		goto error;
+	if ((after.value[AQ_ENERGY_PROD] < before.value[AQ_ENERGY_PROD]) ||
+	    (after.value[AQ_ENERGY_CONS] < before.value[AQ_ENERGY_CONS]))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_aquarea.txt");
+	return(-1);
+}
+/* EOF */
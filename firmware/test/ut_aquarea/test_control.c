@@ -0,0 +1,152 @@
+/**
+ * @file  test_control.c
+ * @brief Some tests to verify the local heating control
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "aquarea.h"
+#include "aquarea_ll.h"
+#include "harness.h"
+#include "log.h"
+#include "vtime.h"
+
+/* Setpoint of the curve below, for the simulated outside temperature (5°C) */
+#define TEST_CURVE    "curve -10 45 15 30"
+#define TEST_SETPOINT 36
+
+/* Functions for each sub-test */
+static int test_loop(void);
+static int test_reset(void);
+static int commands(int64_t *first);
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_control(void)
+{
+	int result = 0;
+
+	/* Setpoint sent by the device itself, within one poll */
+	if (test_loop())
+		result = -1;
+	/* Control continues after a reset, without network */
+	if (test_reset())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_loop(void)
+{
+	struct aquarea_state state;
+	int64_t start, first;
+
+	printf(COLOR_BLUE " * Control : closed loop " COLOR_NONE);
+
+	log_start("/tmp/ut_log_aquarea.txt");
+
+	harness_start(0);
+	/* Disabled, heatpump keeps its own settings */
+	harness_run(60000, NULL);
+	if ((commands(NULL) != 0) || sim.state.value[AQ_Z1_HEAT_REQUEST])
+		goto error;
+
+	if (aquarea_control("limit 20 50\ncurve -10") != -1)
+		goto error;
+	if (aquarea_control(TEST_CURVE) != 0)
+		goto error;
+	frame_count = 0;
+	start = vtime_now();
+	harness_run(600000, NULL);
+	/* One command, in place of the next query */
+	if (commands(&first) != 1)
+		goto error;
+	first -= start;
+	if (first > ((AQUAREA_POLL_PERIOD + 1000) * 1000LL))
+		goto error;
+	aquarea_get_state(&state);
+	if ((sim.state.value[AQ_Z1_HEAT_REQUEST] != TEST_SETPOINT) ||
+	    (state.value[AQ_Z1_HEAT_REQUEST] != TEST_SETPOINT))
+		goto error;
+
+	log_end();
+	printf("(%u ms) ", (unsigned int)(first / 1000));
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_aquarea.txt");
+	return(-1);
+}
+
+static int test_reset(void)
+{
+	printf(COLOR_BLUE " * Control : kept after reset " COLOR_NONE);
+
+	log_start("/tmp/ut_log_aquarea.txt");
+
+	/* New device and heatpump, parameters kept into RTC memory */
+	harness_start(0);
+	harness_run(60000, NULL);
+	if ((commands(NULL) != 1) ||
+	    (sim.state.value[AQ_Z1_HEAT_REQUEST] != TEST_SETPOINT))
+		goto error;
+
+	/* Disabled again, nothing more sent */
+	if (aquarea_control("off") != 0)
+		goto error;
+	sim.state.value[AQ_Z1_HEAT_REQUEST] = 0;
+	frame_count = 0;
+	harness_run(60000, NULL);
+	if ((commands(NULL) != 0) || sim.state.value[AQ_Z1_HEAT_REQUEST])
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_aquarea.txt");
+	return(-1);
+}
+
+/**
+ * @brief Count set commands sent since last frames reset
+ *
+ * @param first Pointer to store the time of the first command (or NULL)
+ * @return integer Number of commands
+ */
+static int commands(int64_t *first)
+{
+	int count = 0;
+	int i;
+
+	for (i = 0; i < frame_count; i++)
+	{
+		if ((frame_dir[i] != AQUAREA_LL_TX) || (frame_type[i] != 0xF1))
+			continue;
+		if (first && (count == 0))
+			*first = frame_time[i];
+		count++;
+	}
+	return(count);
+}
+/* EOF */
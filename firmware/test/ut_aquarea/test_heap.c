@@ -0,0 +1,178 @@
+/**
+ * @file  test_heap.c
+ * @brief Unit-test of memory usage : no heap used by the link after init
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aquarea.h"
+#include "harness.h"
+#include "log.h"
+#include "mem.h"
+#include "vtime.h"
+
+/* Functions for each sub-test */
+static int test_detect(void);
+static int test_steady(void);
+static int test_budget(void);
+
+/* Keep the test allocation, so the compiler can not remove it */
+static void * volatile heap_ptr;
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_heap(void)
+{
+	int result = 0;
+
+	/* An allocation from a sealed task is counted */
+	if (test_detect())
+		result = -1;
+	/* Polls, commands and control, without any allocation */
+	if (test_steady())
+		result = -1;
+	/* Each subsystem declared, into its budget */
+	if (test_budget())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_detect(void)
+{
+	struct mem_stats before, after;
+
+	printf(COLOR_BLUE " * Heap : allocation detected " COLOR_NONE);
+
+	log_start("/tmp/ut_log_aquarea.txt");
+
+	mem_stats(&before);
+	mem_seal();
+	heap_ptr = malloc(16);
+	heap_ptr = realloc(heap_ptr, 32);
+	mem_unseal();
+	free(heap_ptr);
+	heap_ptr = malloc(16);
+	free(heap_ptr);
+	/* Before the scheduler (no task), while a task is sealed */
+	mem_seal();
+	vtime_task(0);
+	heap_ptr = malloc(16);
+	free(heap_ptr);
+	vtime_task(1);
+	mem_unseal();
+	mem_stats(&after);
+
+	if ((after.sealed_allocs - before.sealed_allocs) != 2)
+		goto error;
+	if ((after.sealed_bytes - before.sealed_bytes) != 48)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_aquarea.txt");
+	return(-1);
+}
+
+static int test_steady(void)
+{
+	struct mem_stats before, after;
+	struct aquarea_state state;
+
+	printf(COLOR_BLUE " * Heap : steady state " COLOR_NONE);
+
+	log_start("/tmp/ut_log_aquarea.txt");
+
+	harness_start(20);
+	mem_stats(&before);
+	mem_seal();
+	/* Commands and control are pushed by other tasks, then processed by
+	 * the link : only the processing is into the sealed task */
+	aquarea_set(AQ_Z1_HEAT_REQUEST, 2);
+	aquarea_control("curve -10 45 15 30");
+	harness_run(3600000, NULL);
+	mem_unseal();
+	mem_stats(&after);
+
+	aquarea_get_state(&state);
+	if (state.seq < 500)
+		goto error;
+	if (after.sealed_allocs != before.sealed_allocs)
+		goto error;
+
+	log_end();
+	printf("(%u states) ", (unsigned int)state.seq);
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_aquarea.txt");
+	return(-1);
+}
+
+static int test_budget(void)
+{
+	static const char *names[] = { "ll", "link", "state", "snapshot", "live" };
+	struct mem_stats st;
+	uint32_t total = 0;
+	int i, j;
+
+	printf(COLOR_BLUE " * Heap : static budgets " COLOR_NONE);
+
+	log_start("/tmp/ut_log_aquarea.txt");
+
+	harness_start(0);
+	mem_stats(&st);
+
+	for (i = 0; i < (sizeof(names) / sizeof(names[0])); i++)
+	{
+		for (j = 0; j < st.count; j++)
+		{
+			if (strcmp(st.region[j].name, names[i]) == 0)
+				break;
+		}
+		if (j == st.count)
+			goto error;
+		if ((st.region[j].used == 0) ||
+		    (st.region[j].used > st.region[j].budget))
+			goto error;
+		total += st.region[j].used;
+	}
+	/* Initialized twice (harness), declared once */
+	if (st.count != 5)
+		goto error;
+
+	log_end();
+	printf("(%u bytes) ", (unsigned int)total);
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_aquarea.txt");
+	return(-1);
+}
+/* EOF */
@@ -0,0 +1,281 @@
+/**
+ * @file  test_poll.c
+ * @brief Some tests to verify the cadence of requests sent to the heatpump
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <time.h>
+#include "aquarea.h"
+#include "aquarea_ll.h"
+#include "harness.h"
+#include "log.h"
+#include "os.h"
+#include "vtime.h"
+
+#define CYCLES_COUNT 1000
+#define LOAD_COUNT   20000
+
+/* Functions for each sub-test */
+static int test_cadence(void);
+static int test_late(void);
+static int test_command(void);
+static int test_load(void);
+static uint32_t stall(int64_t now);
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_poll(void)
+{
+	int result = 0;
+
+	/* Period and latency with a responsive heatpump */
+	if (test_cadence())
+		result = -1;
+	/* Main loop sometimes late, or stalled */
+	if (test_late())
+		result = -1;
+	/* Set commands replace the next query */
+	if (test_command())
+		result = -1;
+	/* A lot of cycles, measure the speed of the harness */
+	if (test_load())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_cadence(void)
+{
+	int64_t lat, lat_min, lat_max;
+	int64_t tx = 0;
+	int n_tx = 0;
+	int n_rx = 0;
+	int i;
+
+	printf(COLOR_BLUE " * Poll : period and latency " COLOR_NONE);
+
+	log_start("/tmp/ut_log_aquarea.txt");
+
+	harness_start(0);
+	harness_run((int64_t)(CYCLES_COUNT - 1) * AQUAREA_POLL_PERIOD + 1000, NULL);
+
+	lat_min = INT64_MAX;
+	lat_max = 0;
+	for (i = 0; i < frame_count; i++)
+	{
+		if (frame_dir[i] == AQUAREA_LL_TX)
+		{
+			/* Each request exactly on its schedule */
+			n_tx++;
+			tx = frame_time[i];
+			if (tx != ((int64_t)(n_tx - 1) * AQUAREA_POLL_PERIOD * 1000))
+				goto error;
+			if (frame_type[i] != 0x71)
+				goto error;
+		}
+		else
+		{
+			if (frame_status[i] != AQUAREA_LL_OK)
+				goto error;
+			n_rx++;
+			lat = frame_time[i] - tx;
+			if (lat < lat_min)
+				lat_min = lat;
+			if (lat > lat_max)
+				lat_max = lat;
+		}
+	}
+	if ((n_tx != CYCLES_COUNT) || (n_rx != CYCLES_COUNT))
+		goto error;
+	/* Response latency is only delayed by the main loop period */
+	if ((lat_max - lat_min) > (VTIME_TICK * 1000))
+		goto error;
+	if (lat_max > 1000000)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_aquarea.txt");
+	return(-1);
+}
+
+static int test_late(void)
+{
+	int64_t sched, prev;
+	int n_tx = 0;
+	int first, i;
+
+	printf(COLOR_BLUE " * Poll : late main loop, no drift " COLOR_NONE);
+
+	log_start("/tmp/ut_log_aquarea.txt");
+
+	harness_start(0);
+	harness_run((int64_t)(CYCLES_COUNT - 1) * AQUAREA_POLL_PERIOD + 1000, stall);
+
+	/* Requests can be late, but the schedule does not drift */
+	for (i = 0; i < frame_count; i++)
+	{
+		if (frame_dir[i] != AQUAREA_LL_TX)
+			continue;
+		sched = ((int64_t)n_tx * AQUAREA_POLL_PERIOD * 1000);
+		n_tx++;
+		if ((frame_time[i] < sched) || (frame_time[i] > (sched + 750000)))
+			goto error;
+	}
+	if (n_tx != CYCLES_COUNT)
+		goto error;
+
+	/* Long stall (more than 2 periods) : one request, then a new schedule */
+	os_delay(AQUAREA_POLL_PERIOD * 2 + 2000);
+	first = frame_count;
+	harness_run(AQUAREA_POLL_PERIOD * 4 + 1000, NULL);
+	prev = 0;
+	n_tx = 0;
+	for (i = first; i < frame_count; i++)
+	{
+		if (frame_dir[i] != AQUAREA_LL_TX)
+			continue;
+		if (prev && ((frame_time[i] - prev) != (AQUAREA_POLL_PERIOD * 1000)))
+			goto error;
+		prev = frame_time[i];
+		n_tx++;
+	}
+	if (n_tx != 5)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_aquarea.txt");
+	return(-1);
+}
+
+static int test_command(void)
+{
+	struct aquarea_state state;
+	int i, n;
+
+	printf(COLOR_BLUE " * Poll : set commands " COLOR_NONE);
+
+	log_start("/tmp/ut_log_aquarea.txt");
+
+	harness_start(0);
+	harness_run(1000, NULL);
+	if ((sim.stats.queries != 1) || (sim.stats.commands != 0))
+		goto error;
+
+	/* Two commands, sent into the same packet in place of next query */
+	if (aquarea_set(AQ_DHW_TARGET_TEMP, 55) != 0)
+		goto error;
+	if (aquarea_set(AQ_QUIET_MODE, 2) != 0)
+		goto error;
+	harness_run(AQUAREA_POLL_PERIOD, NULL);
+	if ((sim.stats.queries != 1) || (sim.stats.commands != 1))
+		goto error;
+	aquarea_get_state(&state);
+	if ((state.value[AQ_DHW_TARGET_TEMP] != 55) ||
+	    (state.value[AQ_QUIET_MODE] != 2))
+		goto error;
+
+	/* Then, queries again */
+	n = frame_count;
+	harness_run(AQUAREA_POLL_PERIOD * 2, NULL);
+	if ((sim.stats.queries != 3) || (sim.stats.commands != 1))
+		goto error;
+	for (i = n; i < frame_count; i++)
+	{
+		if ((frame_dir[i] == AQUAREA_LL_TX) && (frame_type[i] != 0x71))
+			goto error;
+	}
+
+	/* Command queue full, set is refused but never waits */
+	for (i = 0; i < AQUAREA_CMD_COUNT; i++)
+	{
+		if (aquarea_set(AQ_DHW_TARGET_TEMP, 40 + i) != 0)
+			goto error;
+	}
+	if (aquarea_set(AQ_DHW_TARGET_TEMP, 50) != -2)
+		goto error;
+	/* Not writable */
+	if (aquarea_set(AQ_DHW_TEMP, 50) != -1)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_aquarea.txt");
+	return(-1);
+}
+
+static int test_load(void)
+{
+	struct aquarea_ll_stats stats;
+	struct timespec t0, t1;
+	long ms;
+
+	printf(COLOR_BLUE " * Poll : %d cycles " COLOR_NONE, LOAD_COUNT);
+
+	log_start("/tmp/ut_log_aquarea.txt");
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	harness_start(0);
+	harness_run((int64_t)(LOAD_COUNT - 1) * AQUAREA_POLL_PERIOD + 1000, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	aquarea_ll_stats(&stats);
+	if ((sim.stats.queries != LOAD_COUNT) || (stats.rx_ok != LOAD_COUNT))
+		goto error;
+
+	log_end();
+	ms = ((t1.tv_sec - t0.tv_sec) * 1000) + ((t1.tv_nsec - t0.tv_nsec) / 1000000);
+	printf("(%ld ms) ", ms);
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_aquarea.txt");
+	return(-1);
+}
+
+/**
+ * @brief Simulate a busy main loop (other modules), late up to 730ms
+ *
+ * @param now Current time (us)
+ * @return integer Extra delay (ms)
+ */
+static uint32_t stall(int64_t now)
+{
+	if (((now / 10000) % 7) == 0)
+		return(730);
+	return(0);
+}
+/* EOF */
@@ -0,0 +1,141 @@
+/**
+ * @file  test_power.c
+ * @brief Some tests to verify that the system sleeps between polls
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include "aquarea.h"
+#include "aquarea_ll.h"
+#include "harness.h"
+#include "log.h"
+#include "vtime.h"
+
+#define CYCLES_COUNT 1000
+
+/* Typical current of the ESP32 (datasheet, mA x10), used for estimation */
+#define CURRENT_ACTIVE 400 /* CPU at 160 MHz, radio off */
+#define CURRENT_SLEEP    8 /* Light sleep               */
+
+/* Functions for each sub-test */
+static int test_sleep(void);
+static int test_timeout(void);
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_power(void)
+{
+	int result = 0;
+
+	/* Awake only during exchanges, no frame lost */
+	if (test_sleep())
+		result = -1;
+	/* Heatpump does not answer, lock released after timeout */
+	if (test_timeout())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_sleep(void)
+{
+	struct aquarea_ll_stats stats;
+	int64_t duration, awake;
+	int wakeups, ratio, current;
+	int n_tx = 0;
+	int i;
+
+	printf(COLOR_BLUE " * Power : sleep between polls " COLOR_NONE);
+
+	log_start("/tmp/ut_log_aquarea.txt");
+
+	harness_start(0);
+	duration = (int64_t)(CYCLES_COUNT - 1) * AQUAREA_POLL_PERIOD + 1000;
+	wakeups = harness_task(duration);
+	awake = vtime_awake();
+
+	/* Same schedule and no frame lost, compared to a loop on each tick */
+	for (i = 0; i < frame_count; i++)
+	{
+		if (frame_dir[i] != AQUAREA_LL_TX)
+			continue;
+		if (frame_time[i] != ((int64_t)n_tx * AQUAREA_POLL_PERIOD * 1000))
+			goto error;
+		n_tx++;
+	}
+	aquarea_ll_stats(&stats);
+	if ((n_tx != CYCLES_COUNT) || (stats.rx_ok != CYCLES_COUNT))
+		goto error;
+	if (stats.rx_cksum || stats.rx_resync)
+		goto error;
+
+	/* Awake from request to response only (about 540ms of 5s) */
+	ratio = (awake * 1000) / (duration * 1000);
+	printf("Awake %d per mille, %d wake-ups\n", ratio, wakeups);
+	if ((ratio < 80) || (ratio > 130))
+		goto error;
+	/* One wake-up per tick during exchange, else one per poll */
+	if (wakeups > (CYCLES_COUNT * 60))
+		goto error;
+
+	log_end();
+	current = ((ratio * CURRENT_ACTIVE) + ((1000 - ratio) * CURRENT_SLEEP)) / 1000;
+	printf("(awake %d.%d%%, ~%d.%d mA vs %d mA) ", ratio / 10, ratio % 10,
+	       current / 10, current % 10, CURRENT_ACTIVE / 10);
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_aquarea.txt");
+	return(-1);
+}
+
+static int test_timeout(void)
+{
+	int64_t awake;
+	int n_tx = 0;
+	int i;
+
+	printf(COLOR_BLUE " * Power : no response, lock released " COLOR_NONE);
+
+	log_start("/tmp/ut_log_aquarea.txt");
+
+	/* Requests at 0, 5, 15, 35, 75, 135, 195, 255, 315 and 375s */
+	harness_start(1000);
+	harness_task(400000);
+	awake = vtime_awake();
+	for (i = 0; i < frame_count; i++)
+	{
+		if (frame_dir[i] == AQUAREA_LL_TX)
+			n_tx++;
+	}
+	printf("%d requests, awake %lld ms\n", n_tx, (long long)(awake / 1000));
+	if ((n_tx != 10) || (awake != ((int64_t)n_tx * AQUAREA_RSP_TIMEOUT * 1000)))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_aquarea.txt");
+	return(-1);
+}
+/* EOF */
@@ -0,0 +1,267 @@
+/**
+ * @file  vtime.c
+ * @brief OS abstraction layer with a virtual time (single task)
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Notes
+ * Time only advances when the task waits (os_delay, os_yield, or a queue
+ * operation with a timeout), so a test gives the exact same result on each
+ * run and hours of operation take a few milliseconds. There is only one
+ * task : waiting for a queue can never succeed, the timeout elapses.
+ * Power locks are counted, to measure the time the system stays awake.
+ * The wall clock (time) follows the virtual time, and is not reset by
+ * vtime_set : like the RTC, it continues across a simulated reset.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_timer.h"
+#include "os.h"
+#include "vtime.h"
+
+struct os_queue
+{
+	unsigned int count;
+	size_t       size;
+	unsigned int head;
+	unsigned int used;
+	uint8_t     *data;
+};
+
+struct os_pm_lock
+{
+	int held;
+};
+
+static int64_t vtime_us = 0;
+static int64_t vtime_wall = 1640995200000000LL; /* Wall clock at vtime 0 */
+static int     vtime_locks;      /* Number of power locks held      */
+static int64_t vtime_awake_sum;  /* Time with at least one lock (us) */
+static int64_t vtime_awake_from;
+static uintptr_t vtime_task_id = 1; /* Running task, 0 before scheduler */
+
+/**
+ * @brief Set the current virtual time, and restart power measures
+ *
+ * @param us New time (microseconds)
+ */
+void vtime_set(int64_t us)
+{
+	vtime_wall += (vtime_us - us);
+	vtime_us = us;
+	/* New simulation, locks of the previous one are forgotten */
+	vtime_locks      = 0;
+	vtime_awake_sum  = 0;
+	vtime_awake_from = us;
+}
+
+/**
+ * @brief Get the current virtual time
+ *
+ * @return int64 Current time (microseconds)
+ */
+int64_t vtime_now(void)
+{
+	return(vtime_us);
+}
+
+/**
+ * @brief Get the time spent with a power lock held (since vtime_set)
+ *
+ * @return int64 Time awake (microseconds)
+ */
+int64_t vtime_awake(void)
+{
+	if (vtime_locks)
+		return(vtime_awake_sum + (vtime_us - vtime_awake_from));
+	return(vtime_awake_sum);
+}
+
+/**
+ * @brief Set the identifier returned by os_task_id
+ *
+ * @param id Identifier of the running task (0 : scheduler not started)
+ */
+void vtime_task(uintptr_t id)
+{
+	vtime_task_id = id;
+}
+
+/**
+ * @brief Simulated version of esp-idf function esp_timer_get_time
+ *
+ */
+int64_t esp_timer_get_time(void)
+{
+	return(vtime_us);
+}
+
+/**
+ * @brief Simulated version of libc function time (wall clock)
+ *
+ */
+time_t time(time_t *t)
+{
+	time_t now = (time_t)((vtime_wall + vtime_us) / 1000000);
+
+	if (t)
+		*t = now;
+	return(now);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          OS layer functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+int os_task_create(os_task_fn fn, const char *name, size_t stack, void *arg,
+                   int prio, int core)
+{
+	/* Only one task */
+	return(-1);
+}
+
+void os_task_exit(void)
+{
+}
+
+uintptr_t os_task_id(void)
+{
+	/* Only one task, see vtime_task() */
+	return(vtime_task_id);
+}
+
+void os_delay(uint32_t ms)
+{
+	vtime_us += (int64_t)ms * 1000;
+}
+
+void os_yield(void)
+{
+	os_delay(VTIME_TICK);
+}
+
+uint32_t os_time_ms(void)
+{
+	return((uint32_t)(vtime_us / 1000));
+}
+
+os_queue_t os_queue_create(unsigned int count, size_t size)
+{
+	struct os_queue *q;
+
+	q = calloc(1, sizeof(struct os_queue) + (count * size));
+	if (q == NULL)
+		return(NULL);
+	q->count = count;
+	q->size  = size;
+	q->data  = (uint8_t *)(q + 1);
+	return(q);
+}
+
+os_queue_t os_queue_create_static(unsigned int count, size_t size,
+                                  struct os_queue_static *qs, uint8_t *storage)
+{
+	struct os_queue *q = (struct os_queue *)qs;
+
+	memset(q, 0, sizeof(struct os_queue));
+	q->count = count;
+	q->size  = size;
+	q->data  = storage;
+	return(q);
+}
+
+int os_queue_send(os_queue_t q, const void *item, uint32_t timeout)
+{
+	if (q->used == q->count)
+	{
+		if (timeout != OS_FOREVER)
+			os_delay(timeout);
+		return(-1);
+	}
+	memcpy(q->data + (((q->head + q->used) % q->count) * q->size), item, q->size);
+	q->used++;
+	return(0);
+}
+
+void os_queue_overwrite(os_queue_t q, const void *item)
+{
+	memcpy(q->data + (q->head * q->size), item, q->size);
+	q->used = 1;
+}
+
+int os_queue_recv(os_queue_t q, void *item, uint32_t timeout)
+{
+	if (q->used == 0)
+	{
+		if (timeout != OS_FOREVER)
+			os_delay(timeout);
+		return(-1);
+	}
+	memcpy(item, q->data + (q->head * q->size), q->size);
+	q->head = (q->head + 1) % q->count;
+	q->used--;
+	return(0);
+}
+
+unsigned int os_queue_count(os_queue_t q)
+{
+	return(q->used);
+}
+
+os_mutex_t os_mutex_create(void)
+{
+	static int dummy;
+	return((os_mutex_t)&dummy);
+}
+
+void os_mutex_lock(os_mutex_t m)
+{
+}
+
+void os_mutex_unlock(os_mutex_t m)
+{
+}
+
+int os_heap_stats(uint32_t *free, uint32_t *min_free)
+{
+	*free     = 0;
+	*min_free = 0;
+	return(-1);
+}
+
+int os_pm_enable(void)
+{
+	return(0);
+}
+
+os_pm_lock_t os_pm_lock_create(const char *name)
+{
+	return(calloc(1, sizeof(struct os_pm_lock)));
+}
+
+void os_pm_acquire(os_pm_lock_t l)
+{
+	if (l->held++)
+		return;
+	if (vtime_locks++ == 0)
+		vtime_awake_from = vtime_us;
+}
+
+void os_pm_release(os_pm_lock_t l)
+{
+	if (--l->held)
+		return;
+	if (--vtime_locks == 0)
+		vtime_awake_sum += (vtime_us - vtime_awake_from);
+}
+/* EOF */
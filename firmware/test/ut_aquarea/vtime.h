@@ -0,0 +1,28 @@
+/**
+ * @file  vtime.h
+ * @brief Headers and definitions for the virtual time OS backend
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef VTIME_H
+#define VTIME_H
+
+#include <stdint.h>
+
+#define VTIME_TICK 10 /* Period of the main loop (ms), like the firmware */
+
+void    vtime_set(int64_t us);
+int64_t vtime_now(void);
+int64_t vtime_awake(void);
+void    vtime_task(uintptr_t id);
+
+#endif
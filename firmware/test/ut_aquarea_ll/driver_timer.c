@@ -0,0 +1,44 @@
+/**
+ * @file  driver_timer.c
+ * @brief Simulated esp_timer, time is controlled by tests
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "esp_timer.h"
+#include "driver_timer.h"
+
+static int64_t timer_now = 0;
+
+/**
+ * @brief Simulated version of esp-idf function esp_timer_get_time
+ *
+ * @return integer Current time (in microseconds)
+ */
+int64_t esp_timer_get_time(void)
+{
+	return(timer_now);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                       Internal tests functions                       -- */
+/* -------------------------------------------------------------------------- */
+
+void timer_set(int64_t us)
+{
+	timer_now = us;
+}
+
+void timer_add(int64_t us)
+{
+	timer_now += us;
+}
+/* EOF */
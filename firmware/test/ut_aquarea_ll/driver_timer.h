@@ -0,0 +1,24 @@
+/**
+ * @file  driver_timer.h
+ * @brief Headers and definitions for the simulated timer
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef DRIVER_TIMER_H
+#define DRIVER_TIMER_H
+
+#include <stdint.h>
+
+void timer_set(int64_t us);
+void timer_add(int64_t us);
+
+#endif
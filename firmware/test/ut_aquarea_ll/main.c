@@ -28,6 +28,8 @@ int  test_rx(void);
 void test_rx_rx(unsigned char *packet, size_t len);
 int  test_cksum(void);
 void test_cksum_rx(unsigned char *packet, size_t len);
+int  test_stats(void);
+int  test_tap(void);
 
 static void usage(char *appname);
 
@@ -69,6 +71,16 @@ int main(int argc, char **argv)
 		if (test_cksum() != 0)
 			result = -1;
 	}
+	if ((test_num == 4) || (test_num == 0))
+	{
+		if (test_stats() != 0)
+			result = -1;
+	}
+	if ((test_num == 5) || (test_num == 0))
+	{
+		if (test_tap() != 0)
+			result = -1;
+	}
 
 	return(result);
 }
@@ -103,5 +115,7 @@ static void usage(char *appname)
 	printf("    1: Test uart_driver_install\n");
 	printf("    2: Test data reception and processing\n");
 	printf("    2: Test data checksums\n");
+	printf("    4: Test link counters\n");
+	printf("    5: Test frames tap\n");
 }
 /* EOF */
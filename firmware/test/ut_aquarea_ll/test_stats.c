@@ -0,0 +1,326 @@
+/**
+ * @file  test_stats.c
+ * @brief Some tests to verify link counters, latency and usage of the line
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aquarea_ll.h"
+#include "driver_timer.h"
+#include "driver_uart.h"
+#include "log.h"
+
+/* Functions for each sub-test */
+static int test_counters(void);
+static int test_resync(void);
+static int test_latency(void);
+static int test_length(void);
+static int test_bus(void);
+
+/* Status packet, defined into test_cksum.c */
+extern unsigned char t2[203];
+static unsigned char rx_buffer[1024];
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_stats(void)
+{
+	int result = 0;
+
+	/* Counters of valid and invalid packets */
+	if (test_counters())
+		result = -1;
+	/* Incomplete packet dropped after a delay */
+	if (test_resync())
+		result = -1;
+	/* Histogram of response delays */
+	if (test_latency())
+		result = -1;
+	/* Length into header too short, or the largest possible */
+	if (test_length())
+		result = -1;
+	/* Usage of the line and idle gaps */
+	if (test_bus())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_counters(void)
+{
+	struct aquarea_ll_stats st;
+	unsigned char query[260];
+	int i;
+
+	printf(COLOR_BLUE " * LL Stats : packet counters " COLOR_NONE);
+
+	log_start("/tmp/ut_log_stats.txt");
+	uart_init();
+	timer_set(1000000);
+
+	if (aquarea_ll_init())
+		goto error;
+
+	/* One valid packet, then one with wrong checksum */
+	memcpy(rx_buffer, t2, 203);
+	memcpy(rx_buffer + 203, t2, 203);
+	rx_buffer[203 + 10] = 0xFF;
+	uart_set_buffer(rx_buffer, 406);
+	for (i = 0; i < 10; i++)
+	{
+		aquarea_ll_process();
+		timer_add(10000);
+	}
+	memset(query, 0, sizeof(query));
+	query[0] = 0x71;
+	query[1] = 108;
+	aquarea_ll_send(query);
+	aquarea_ll_send(query);
+
+	aquarea_ll_stats(&st);
+	if ((st.rx_ok != 1) || (st.rx_cksum != 1) || (st.tx != 2) ||
+	    (st.rx_resync != 0))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_stats.txt");
+	return(-1);
+}
+
+static int test_resync(void)
+{
+	struct aquarea_ll_stats st;
+	int i;
+
+	printf(COLOR_BLUE " * LL Stats : drop incomplete packet " COLOR_NONE);
+
+	log_start("/tmp/ut_log_stats.txt");
+	uart_init();
+	timer_set(1000000);
+
+	if (aquarea_ll_init())
+		goto error;
+
+	/* Only the first part of a packet is received */
+	memcpy(rx_buffer, t2, 203);
+	uart_set_buffer(rx_buffer, 100);
+	for (i = 0; i < 5; i++)
+	{
+		aquarea_ll_process();
+		timer_add(10000);
+	}
+	aquarea_ll_stats(&st);
+	if (st.rx_resync != 0)
+		goto error;
+	/* Nothing more during 200ms */
+	for (i = 0; i < 20; i++)
+	{
+		aquarea_ll_process();
+		timer_add(10000);
+	}
+	/* Then, a complete packet must be received */
+	uart_set_buffer(rx_buffer, 203);
+	for (i = 0; i < 5; i++)
+	{
+		aquarea_ll_process();
+		timer_add(10000);
+	}
+	aquarea_ll_stats(&st);
+	if ((st.rx_resync != 1) || (st.rx_ok != 1) || (st.rx_cksum != 0))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_stats.txt");
+	return(-1);
+}
+
+static int test_latency(void)
+{
+	static const int delay[5] = { 240, 280, 600, 1500, 5000 };
+	static const int bucket[5] = { 0, 1, 4, 6, 7 };
+	struct aquarea_ll_stats st;
+	unsigned char query[260];
+	int i, sum = 0;
+
+	printf(COLOR_BLUE " * LL Stats : latency histogram " COLOR_NONE);
+
+	log_start("/tmp/ut_log_stats.txt");
+	uart_init();
+	timer_set(1000000);
+
+	if (aquarea_ll_init())
+		goto error;
+
+	/* Packet received without query is not measured */
+	memcpy(rx_buffer, t2, 203);
+	uart_set_buffer(rx_buffer, 203);
+	aquarea_ll_process();
+
+	memset(query, 0, sizeof(query));
+	query[0] = 0x71;
+	query[1] = 108;
+	for (i = 0; i < 5; i++)
+	{
+		aquarea_ll_send(query);
+		timer_add(delay[i] * 1000);
+		uart_set_buffer(rx_buffer, 203);
+		aquarea_ll_process();
+		sum += delay[i];
+
+		aquarea_ll_stats(&st);
+		if (st.lat_bucket[bucket[i]] != 1)
+		{
+			printf("Latency %d ms not into bucket %d\n", delay[i], bucket[i]);
+			goto error;
+		}
+	}
+	if ((st.lat_count != 5) || (st.lat_sum != sum) || (st.rx_ok != 6))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_stats.txt");
+	return(-1);
+}
+static int test_length(void)
+{
+	struct aquarea_ll_stats st;
+	unsigned char *pkt;
+	unsigned int sum;
+	int i;
+
+	printf(COLOR_BLUE " * LL Stats : invalid and max length into header " COLOR_NONE);
+
+	log_start("/tmp/ut_log_stats.txt");
+	uart_init();
+	timer_set(1000000);
+
+	if (aquarea_ll_init())
+		goto error;
+
+	/* A header with a null length, then a valid packet */
+	rx_buffer[0] = 0x71;
+	rx_buffer[1] = 0x00;
+	rx_buffer[2] = 0x01;
+	rx_buffer[3] = 0x10;
+	memcpy(rx_buffer + 4, t2, 203);
+	/* Then a packet with the max length (one byte), received entirely */
+	pkt = rx_buffer + 207;
+	pkt[0] = 0x71;
+	pkt[1] = 0xFF;
+	memset(pkt + 2, 0x55, 255);
+	for (i = 0, sum = 0; i < 257; i++)
+		sum += pkt[i];
+	pkt[257] = (uint8_t)(0x100 - sum);
+	uart_set_buffer(rx_buffer, 207 + 258);
+	for (i = 0; i < 10; i++)
+	{
+		aquarea_ll_process();
+		timer_add(10000);
+	}
+	aquarea_ll_stats(&st);
+	if ((st.rx_resync != 1) || (st.rx_ok != 2) || (st.rx_cksum != 0))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_stats.txt");
+	return(-1);
+}
+
+static int test_bus(void)
+{
+	struct aquarea_ll_stats st;
+	unsigned char query[260];
+	int i;
+
+	printf(COLOR_BLUE " * LL Stats : line usage and idle gaps " COLOR_NONE);
+
+	log_start("/tmp/ut_log_stats.txt");
+	uart_init();
+	timer_set(1000000);
+
+	if (aquarea_ll_init())
+		goto error;
+
+	memset(query, 0, sizeof(query));
+	query[0] = 0x71;
+	query[1] = 108;
+	memcpy(rx_buffer, t2, 203);
+	/* Query (111 bytes), 50ms of silence, response (203 bytes), then one
+	 * second before the next query */
+	for (i = 0; i < 10; i++)
+	{
+		aquarea_ll_send(query);
+		timer_add((111 + 203) * AQUAREA_LL_BYTE_US + 50000);
+		uart_set_buffer(rx_buffer, 203);
+		aquarea_ll_process();
+		timer_add(1000000);
+	}
+	aquarea_ll_stats(&st);
+	printf("load %u, rx %u B/s, tx %u B/s\n", (unsigned int)st.load,
+	       (unsigned int)st.rx_rate, (unsigned int)st.tx_rate);
+
+	if ((st.rx_bytes != 2030) || (st.tx_bytes != 1110))
+		goto error;
+	if ((st.rx_busy != 2326) || (st.tx_busy != 1272))
+		goto error;
+	if (st.elapsed != 14098)
+		goto error;
+	/* First query has no gap before it */
+	if ((st.gap_count != 19) || (st.gap_sum != 9500) || (st.gap_min != 50))
+		goto error;
+	if ((st.gap_bucket[1] != 10) || (st.gap_bucket[5] != 9))
+		goto error;
+	/* Window closed on the 8th response (10.28s), before reading it */
+	if ((st.rx_rate != 138) || (st.tx_rate != 86) || (st.load != 257))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_stats.txt");
+	return(-1);
+}
+/* EOF */
@@ -0,0 +1,130 @@
+/**
+ * @file  test_tap.c
+ * @brief Some tests to verify frames given to the tap (serial bridge)
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aquarea_ll.h"
+#include "driver_timer.h"
+#include "driver_uart.h"
+#include "log.h"
+
+#define TAP_MAX 8
+
+/* Status packet, defined into test_cksum.c */
+extern unsigned char t2[203];
+static unsigned char rx_buffer[1024];
+
+/* Frames received by the tap */
+static int     tap_count;
+static int     tap_dir[TAP_MAX];
+static int     tap_status[TAP_MAX];
+static size_t  tap_len[TAP_MAX];
+static int64_t tap_time[TAP_MAX];
+static uint8_t tap_data[TAP_MAX][260];
+
+static void tap(int dir, int status, const uint8_t *data, size_t len, int64_t time);
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_tap(void)
+{
+	unsigned char query[260];
+	int i;
+
+	printf(COLOR_BLUE " * LL Tap : frames sent and received " COLOR_NONE);
+
+	log_start("/tmp/ut_log_tap.txt");
+	uart_init();
+	timer_set(1000000);
+	tap_count = 0;
+
+	if (aquarea_ll_init())
+		goto error;
+	aquarea_ll_set_tap(tap);
+
+	/* One query */
+	memset(query, 0, sizeof(query));
+	query[0] = 0x71;
+	query[1] = 108;
+	aquarea_ll_send(query);
+	timer_add(300000);
+
+	/* Then a valid packet, a packet with bad checksum and a partial one */
+	memcpy(rx_buffer, t2, 203);
+	memcpy(rx_buffer + 203, t2, 203);
+	rx_buffer[203 + 10] ^= 0xFF;
+	memcpy(rx_buffer + 406, t2, 50);
+	uart_set_buffer(rx_buffer, 456);
+	for (i = 0; i < 30; i++)
+	{
+		aquarea_ll_process();
+		timer_add(10000);
+	}
+
+	if (tap_count != 4)
+		goto error;
+	if ((tap_dir[0] != AQUAREA_LL_TX) || (tap_status[0] != AQUAREA_LL_OK) ||
+	    (tap_len[0] != 111) || (tap_time[0] != 1000000) ||
+	    memcmp(tap_data[0], query, 111))
+		goto error;
+	if ((tap_dir[1] != AQUAREA_LL_RX) || (tap_status[1] != AQUAREA_LL_OK) ||
+	    (tap_len[1] != 203) || (tap_time[1] != 1300000) ||
+	    memcmp(tap_data[1], t2, 203))
+		goto error;
+	if ((tap_dir[2] != AQUAREA_LL_RX) || (tap_status[2] != AQUAREA_LL_CKSUM) ||
+	    (tap_len[2] != 203) || memcmp(tap_data[2], rx_buffer + 203, 203))
+		goto error;
+	if ((tap_dir[3] != AQUAREA_LL_RX) || (tap_status[3] != AQUAREA_LL_PARTIAL) ||
+	    (tap_len[3] != 50) || memcmp(tap_data[3], t2, 50))
+		goto error;
+
+	/* Tap removed */
+	aquarea_ll_set_tap(NULL);
+	aquarea_ll_send(query);
+	if (tap_count != 4)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	printf("\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_tap.txt");
+	printf("\n");
+	return(-1);
+}
+
+/**
+ * @brief Tap function, save a copy of each frame
+ *
+ */
+static void tap(int dir, int status, const uint8_t *data, size_t len, int64_t time)
+{
+	if (tap_count == TAP_MAX)
+		return;
+	tap_dir[tap_count]    = dir;
+	tap_status[tap_count] = status;
+	tap_len[tap_count]    = len;
+	tap_time[tap_count]   = time;
+	memcpy(tap_data[tap_count], data, len);
+	tap_count++;
+}
+/* EOF */
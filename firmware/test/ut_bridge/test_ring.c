@@ -0,0 +1,303 @@
+/**
+ * @file  test_ring.c
+ * @brief Some tests to verify the record buffer of the serial bridge
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "bridge_ring.h"
+#include "log.h"
+
+#define THREAD_COUNT 200000
+
+/* Functions for each sub-test */
+static int test_format(void);
+static int test_overflow(void);
+static int test_thread(void);
+static void  make_frame(uint8_t *data, size_t len, uint32_t n);
+static int   check_rec(const uint8_t *rec, size_t len, uint32_t *n);
+static void *writer(void *arg);
+
+static struct bridge_ring ring;
+static volatile int writer_done;
+static unsigned int writer_drop;
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_ring(void)
+{
+	int result = 0;
+
+	/* Content of records */
+	if (test_format())
+		result = -1;
+	/* Buffer full, records dropped and marked */
+	if (test_overflow())
+		result = -1;
+	/* Writer and reader into two threads */
+	if (test_thread())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_format(void)
+{
+	uint8_t data[BRIDGE_DATA_MAX + 10];
+	uint8_t rec[BRIDGE_REC_MAX];
+	size_t len;
+	int i;
+
+	printf(COLOR_BLUE " * Ring : record format " COLOR_NONE);
+
+	log_start("/tmp/ut_log_bridge.txt");
+
+	bridge_ring_init(&ring);
+	if (bridge_ring_pop(&ring, rec) != 0)
+		goto error;
+
+	make_frame(data, 203, 1);
+	if (bridge_ring_push(&ring, 0, 1, data, 203, 0x0102030405060708LL))
+		goto error;
+	len = bridge_ring_pop(&ring, rec);
+	if (len != (BRIDGE_HDR_SIZE + 203))
+		goto error;
+	if ((rec[0] != 'R') || (rec[1] != 1) || (rec[2] != 0) || (rec[3] != 203))
+		goto error;
+	for (i = 0; i < 8; i++)
+	{
+		if (rec[4 + i] != (i + 1))
+			goto error;
+	}
+	if (memcmp(rec + BRIDGE_HDR_SIZE, data, 203))
+		goto error;
+
+	/* TX record, frame larger than max is truncated */
+	make_frame(data, sizeof(data), 2);
+	bridge_ring_push(&ring, 1, 0, data, sizeof(data), 5);
+	len = bridge_ring_pop(&ring, rec);
+	if ((len != BRIDGE_REC_MAX) || (rec[0] != 'T') || (rec[11] != 5) ||
+	    memcmp(rec + BRIDGE_HDR_SIZE, data, BRIDGE_DATA_MAX))
+		goto error;
+
+	/* Records cross the end of buffer */
+	for (i = 0; i < 100; i++)
+	{
+		make_frame(data, 111 + i, i);
+		if (bridge_ring_push(&ring, 0, 0, data, 111 + i, i))
+			goto error;
+		len = bridge_ring_pop(&ring, rec);
+		if ((len != (BRIDGE_HDR_SIZE + 111 + i)) ||
+		    memcmp(rec + BRIDGE_HDR_SIZE, data, 111 + i))
+			goto error;
+	}
+	if (bridge_ring_pop(&ring, rec) != 0)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_bridge.txt");
+	return(-1);
+}
+
+static int test_overflow(void)
+{
+	uint8_t data[BRIDGE_DATA_MAX];
+	uint8_t rec[BRIDGE_REC_MAX];
+	int i, count;
+
+	printf(COLOR_BLUE " * Ring : buffer full " COLOR_NONE);
+
+	log_start("/tmp/ut_log_bridge.txt");
+
+	bridge_ring_init(&ring);
+	make_frame(data, 203, 0);
+
+	/* Nobody reads : writer is never blocked, records are dropped */
+	count = 0;
+	for (i = 0; i < 100; i++)
+	{
+		if (bridge_ring_push(&ring, 0, 0, data, 203, i) == 0)
+			count++;
+	}
+	printf("%d records kept, %u dropped\n", count, ring.dropped);
+	if ((count != (BRIDGE_RING_SIZE / (BRIDGE_HDR_SIZE + 203))) ||
+	    (ring.dropped != (100 - count)))
+		goto error;
+
+	/* Kept records are the first ones, without mark */
+	for (i = 0; i < count; i++)
+	{
+		bridge_ring_pop(&ring, rec);
+		if ((rec[11] != i) || (rec[1] & BRIDGE_LOST))
+			goto error;
+	}
+	/* Next record is marked */
+	bridge_ring_push(&ring, 0, 0, data, 203, 1000);
+	bridge_ring_push(&ring, 0, 0, data, 203, 1001);
+	bridge_ring_pop(&ring, rec);
+	if ((rec[1] & BRIDGE_LOST) == 0)
+		goto error;
+	bridge_ring_pop(&ring, rec);
+	if (rec[1] & BRIDGE_LOST)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_bridge.txt");
+	return(-1);
+}
+
+static int test_thread(void)
+{
+	pthread_t th;
+	uint8_t rec[BRIDGE_REC_MAX];
+	uint32_t n, last = 0xFFFFFFFF;
+	unsigned int count = 0, lost = 0;
+	size_t len;
+	int errors = 0;
+
+	printf(COLOR_BLUE " * Ring : concurrent writer and reader " COLOR_NONE);
+
+	log_start("/tmp/ut_log_bridge.txt");
+
+	bridge_ring_init(&ring);
+	writer_done = 0;
+	if (pthread_create(&th, NULL, writer, NULL))
+		goto error;
+
+	while(1)
+	{
+		len = bridge_ring_pop(&ring, rec);
+		if (len == 0)
+		{
+			if (writer_done && (ring.head == ring.tail))
+				break;
+			continue;
+		}
+		if (check_rec(rec, len, &n))
+		{
+			errors++;
+			continue;
+		}
+		/* Records are in order, a gap is always marked */
+		if (n != (last + 1))
+		{
+			if ((rec[1] & BRIDGE_LOST) == 0)
+				errors++;
+			lost += (n - last - 1);
+		}
+		last = n;
+		count++;
+	}
+	pthread_join(th, NULL);
+	lost += (THREAD_COUNT - 1 - last);
+
+	printf("%u received, %u lost (%u dropped), %d errors\n",
+	       count, lost, writer_drop, errors);
+	if (errors || (lost != writer_drop) || ((count + lost) != THREAD_COUNT))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_bridge.txt");
+	return(-1);
+}
+
+/**
+ * @brief Writer thread, push numbered frames (never waits for reader)
+ *
+ */
+static void *writer(void *arg)
+{
+	uint8_t data[BRIDGE_DATA_MAX];
+	uint32_t n;
+	size_t len;
+
+	(void)arg;
+	writer_drop = 0;
+	for (n = 0; n < THREAD_COUNT; n++)
+	{
+		len = 8 + (n % 200);
+		make_frame(data, len, n);
+		if (bridge_ring_push(&ring, n & 1, 0, data, len, n))
+			writer_drop++;
+		/* Bursts of frames, like the serial link */
+		if ((n & 15) == 15)
+			usleep(20);
+	}
+	writer_done = 1;
+	return(NULL);
+}
+
+/**
+ * @brief Make a frame with a known content
+ *
+ * @param data Pointer to a buffer for the frame
+ * @param len  Length of the frame
+ * @param n    Number of the frame (seed of the content)
+ */
+static void make_frame(uint8_t *data, size_t len, uint32_t n)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		data[i] = (uint8_t)(n + (i * 7));
+}
+
+/**
+ * @brief Verify a record made by the writer thread
+ *
+ * @param rec Pointer to the record
+ * @param len Length of the record
+ * @param n   Pointer to a variable where number of the frame is stored
+ * @return integer Zero if valid, -1 if not
+ */
+static int check_rec(const uint8_t *rec, size_t len, uint32_t *n)
+{
+	uint8_t data[BRIDGE_DATA_MAX];
+	int i;
+
+	*n = 0;
+	for (i = 0; i < 8; i++)
+		*n = (*n << 8) | rec[4 + i];
+	if ((len != (BRIDGE_HDR_SIZE + 8 + (*n % 200))) ||
+	    (rec[0] != ((*n & 1) ? 'T' : 'R')))
+		return(-1);
+	make_frame(data, len - BRIDGE_HDR_SIZE, *n);
+	if (memcmp(rec + BRIDGE_HDR_SIZE, data, len - BRIDGE_HDR_SIZE))
+		return(-1);
+	return(0);
+}
+/* EOF */
@@ -0,0 +1,329 @@
+/**
+ * @file  test_capture.c
+ * @brief Some tests to verify capture format, ring of blocks and export
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "capture.h"
+#include "log.h"
+
+#define STREAM_SIZE (CAPTURE_BLOCKS * CAPTURE_BLOCK_SIZE)
+#define THREAD_COUNT 100000
+
+/* Functions for each sub-test */
+static int test_format(void);
+static int test_ring(void);
+static int test_thread(void);
+static size_t export_all(struct capture *c, uint8_t *stream);
+static void   make_chunk(uint8_t *data, size_t len, uint32_t n);
+static size_t chunk_len(uint32_t n);
+static void  *writer(void *arg);
+
+static struct capture cap;
+static uint8_t stream[STREAM_SIZE];
+static volatile int writer_done;
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_capture(void)
+{
+	int result = 0;
+
+	/* Records decoded back, size of the format */
+	if (test_format())
+		result = -1;
+	/* Oldest blocks are dropped */
+	if (test_ring())
+		result = -1;
+	/* Export while capture is running */
+	if (test_thread())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_format(void)
+{
+	struct capture_reader rd;
+	const uint8_t *data;
+	uint8_t ref[300];
+	int64_t time, t;
+	size_t  len, size;
+	int dir, n, count;
+
+	printf(COLOR_BLUE " * Capture : format " COLOR_NONE);
+
+	log_start("/tmp/ut_log_capture.txt");
+
+	capture_init(&cap);
+	if (export_all(&cap, stream) != 0)
+		goto error;
+
+	/* Typical traffic : query, then response received into small chunks */
+	t = 5000000000LL;
+	count = 0;
+	for (n = 0; n < 20; n++)
+	{
+		make_chunk(ref, 111, n);
+		capture_add(&cap, 1, ref, 111, t);
+		t += 180000;
+		for (size = 0; size < 203; size += 40)
+		{
+			len = ((203 - size) < 40) ? (203 - size) : 40;
+			make_chunk(ref, len, n + size);
+			capture_add(&cap, 0, ref, len, t);
+			t += 41667;
+		}
+		t += 5000000;
+		count += 7;
+	}
+	size = export_all(&cap, stream);
+	printf("%d records, %u data bytes, %d bytes captured\n",
+	       count, cap.bytes, (int)size);
+	/* Overhead must be small : header of blocks and about 4 bytes/record */
+	if (size > (cap.bytes + (count * 5) + (CAPTURE_BLOCKS * CAPTURE_HDR_SIZE)))
+		goto error;
+
+	/* Decode and compare */
+	capture_reader_init(&rd, stream, size);
+	t = 5000000000LL;
+	for (n = 0; n < 20; n++)
+	{
+		if ((capture_reader_next(&rd, &dir, &data, &len, &time) != 1) ||
+		    (dir != 1) || (len != 111) || (time != t))
+			goto error;
+		make_chunk(ref, 111, n);
+		if (memcmp(ref, data, 111))
+			goto error;
+		t += 180000;
+		for (size = 0; size < 203; size += 40)
+		{
+			if (capture_reader_next(&rd, &dir, &data, &len, &time) != 1)
+				goto error;
+			make_chunk(ref, len, n + size);
+			if ((dir != 0) || (time != t) || memcmp(ref, data, len))
+				goto error;
+			t += 41667;
+		}
+		t += 5000000;
+	}
+	if (capture_reader_next(&rd, &dir, &data, &len, &time) != 0)
+		goto error;
+
+	/* Truncated or corrupted stream is detected */
+	capture_reader_init(&rd, stream, size - 10);
+	while ((n = capture_reader_next(&rd, &dir, &data, &len, &time)) == 1)
+		;
+	if (n != -1)
+		goto error;
+	stream[0] = 0;
+	capture_reader_init(&rd, stream, size);
+	if (capture_reader_next(&rd, &dir, &data, &len, &time) != -1)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_capture.txt");
+	return(-1);
+}
+
+static int test_ring(void)
+{
+	struct capture_reader rd;
+	const uint8_t *data;
+	uint8_t ref[300];
+	int64_t time;
+	size_t  len, size;
+	uint32_t n, first = 0;
+	int dir, r, blocks = 0;
+
+	printf(COLOR_BLUE " * Capture : ring of blocks " COLOR_NONE);
+
+	log_start("/tmp/ut_log_capture.txt");
+
+	capture_init(&cap);
+	for (n = 0; n < 1000; n++)
+	{
+		make_chunk(ref, chunk_len(n), n);
+		capture_add(&cap, n & 1, ref, chunk_len(n), 1000 * n);
+	}
+	size = export_all(&cap, stream);
+	if ((size == 0) || (size > STREAM_SIZE))
+		goto error;
+
+	/* Last records are kept, without hole */
+	capture_reader_init(&rd, stream, size);
+	while ((r = capture_reader_next(&rd, &dir, &data, &len, &time)) == 1)
+	{
+		n = time / 1000;
+		if (blocks == 0)
+			first = n;
+		else if (n != (first + blocks))
+			goto error;
+		make_chunk(ref, chunk_len(n), n);
+		if ((dir != (n & 1)) || (len != chunk_len(n)) || memcmp(ref, data, len))
+			goto error;
+		blocks++;
+	}
+	printf("records %u to %u kept\n", first, first + blocks - 1);
+	if ((r != 0) || ((first + blocks) != 1000) || (first == 0))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_capture.txt");
+	return(-1);
+}
+
+static int test_thread(void)
+{
+	struct capture_reader rd;
+	const uint8_t *data;
+	uint8_t ref[300];
+	pthread_t th;
+	int64_t time, last;
+	size_t  len, size;
+	uint32_t n;
+	int dir, r, exports = 0, errors = 0;
+
+	printf(COLOR_BLUE " * Capture : export during capture " COLOR_NONE);
+
+	log_start("/tmp/ut_log_capture.txt");
+
+	capture_init(&cap);
+	writer_done = 0;
+	if (pthread_create(&th, NULL, writer, NULL))
+		goto error;
+
+	while ( ! writer_done)
+	{
+		size = export_all(&cap, stream);
+		exports++;
+		/* Each export must be a valid stream, records in order */
+		last = -1;
+		capture_reader_init(&rd, stream, size);
+		while ((r = capture_reader_next(&rd, &dir, &data, &len, &time)) == 1)
+		{
+			n = time / 10;
+			make_chunk(ref, chunk_len(n), n);
+			if ((time <= last) || (len != chunk_len(n)) || memcmp(ref, data, len))
+			{
+				errors++;
+				break;
+			}
+			last = time;
+		}
+		if (r < 0)
+			errors++;
+	}
+	pthread_join(th, NULL);
+
+	printf("%d exports, %d errors\n", exports, errors);
+	if (errors || (exports == 0))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_capture.txt");
+	return(-1);
+}
+
+/**
+ * @brief Writer thread, capture numbered chunks
+ *
+ */
+static void *writer(void *arg)
+{
+	uint8_t data[300];
+	uint32_t n;
+
+	(void)arg;
+	for (n = 0; n < THREAD_COUNT; n++)
+	{
+		make_chunk(data, chunk_len(n), n);
+		capture_add(&cap, n & 1, data, chunk_len(n), 10 * n);
+		if ((n & 63) == 63)
+			usleep(10);
+	}
+	writer_done = 1;
+	return(NULL);
+}
+
+/**
+ * @brief Export all blocks of a capture into a stream
+ *
+ * @param c      Pointer to the capture
+ * @param stream Pointer to a buffer of STREAM_SIZE bytes
+ * @return size_t Length of the stream
+ */
+static size_t export_all(struct capture *c, uint8_t *stream)
+{
+	uint32_t seq = 0;
+	size_t len = 0, n;
+
+	while ((len + CAPTURE_BLOCK_SIZE) <= STREAM_SIZE)
+	{
+		n = capture_export(c, &seq, stream + len);
+		if (n == 0)
+			break;
+		len += n;
+	}
+	return(len);
+}
+
+/**
+ * @brief Length of a numbered chunk (1 to 258 bytes)
+ *
+ */
+static size_t chunk_len(uint32_t n)
+{
+	return(1 + ((n * 37) % 258));
+}
+
+/**
+ * @brief Make a chunk with a known content
+ *
+ * @param data Pointer to a buffer for the chunk
+ * @param len  Length of the chunk
+ * @param n    Number of the chunk (seed of the content)
+ */
+static void make_chunk(uint8_t *data, size_t len, uint32_t n)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		data[i] = (uint8_t)(n * 3 + (i * 11));
+}
+/* EOF */
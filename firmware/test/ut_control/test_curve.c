@@ -0,0 +1,135 @@
+/**
+ * @file  test_curve.c
+ * @brief Some tests to verify the computation of the setpoint
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "control.h"
+#include "log.h"
+
+/* Functions for each sub-test */
+static int test_points(void);
+static int test_slots(void);
+
+static struct control_param param;
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_curve(void)
+{
+	int result = 0;
+
+	/* Heating curve, interpolation and limits */
+	if (test_points())
+		result = -1;
+	/* Offsets by time of day */
+	if (test_slots())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_points(void)
+{
+	/* Outside temperature, then expected setpoint */
+	const int32_t outside[] = { -20, -10, -5, 0, 2, 3, 7, 15, 25 };
+	const int32_t expect[]  = {  45,  45, 42, 39, 38, 37, 35, 30, 30 };
+	int32_t sp;
+	int i;
+
+	printf(COLOR_BLUE " * Curve : interpolation and limits " COLOR_NONE);
+
+	log_start("/tmp/ut_log_control.txt");
+
+	/* Disabled by default */
+	if (control_load(&param, CONTROL_DEFAULT) != 0)
+		goto error;
+	if (control_setpoint(&param, 0, -1) != CONTROL_NONE)
+		goto error;
+
+	if (control_load(&param, "curve -10 45 15 30") != 0)
+		goto error;
+	for (i = 0; i < (sizeof(outside) / sizeof(outside[0])); i++)
+	{
+		sp = control_setpoint(&param, outside[i], -1);
+		if (sp != expect[i])
+		{
+			printf("Outside %d : setpoint %d\n", (int)outside[i], (int)sp);
+			goto error;
+		}
+	}
+
+	/* Limits apply after the curve */
+	if (control_load(&param, "curve -10 45 15 30\nlimit 32 40") != 0)
+		goto error;
+	if ((control_setpoint(&param, -20, -1) != 40) ||
+	    (control_setpoint(&param,   0, -1) != 39) ||
+	    (control_setpoint(&param,  25, -1) != 32))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_control.txt");
+	return(-1);
+}
+
+static int test_slots(void)
+{
+	/* Minute of the day, then expected setpoint (curve gives 39) */
+	const int     minute[] = { -1, 0, 359, 360, 600, 1079, 1080, 1320, 1439 };
+	const int32_t expect[] = { 39, 36, 36, 41, 41,  41,   39,   36,   36 };
+	int32_t sp;
+	int i;
+
+	printf(COLOR_BLUE " * Curve : time slots " COLOR_NONE);
+
+	log_start("/tmp/ut_log_control.txt");
+
+	/* Slots are given out of order, last one continues after midnight */
+	if (control_load(&param, "curve -10 45 15 30;slot 22:00 -3;"
+	                         "slot 06:00 2;slot 18:00 0") != 0)
+		goto error;
+	if ((param.slot_count != 3) || (param.slot[0].start != 360) ||
+	    (param.slot[2].start != 1320))
+		goto error;
+	for (i = 0; i < (sizeof(minute) / sizeof(minute[0])); i++)
+	{
+		sp = control_setpoint(&param, 0, minute[i]);
+		if (sp != expect[i])
+		{
+			printf("Minute %d : setpoint %d\n", minute[i], (int)sp);
+			goto error;
+		}
+	}
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_control.txt");
+	return(-1);
+}
+/* EOF */
@@ -0,0 +1,149 @@
+/**
+ * @file  test_loop.c
+ * @brief Some tests to verify the control loop
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "control.h"
+#include "log.h"
+
+/* Functions for each sub-test */
+static int test_syntax(void);
+static int test_commands(void);
+
+static struct control       control;
+static struct control_param param;
+
+/* Invalid parameters, the error is always on second line */
+static const char *invalid[] =
+{
+	"limit 20 50\ncurve 15 30 -10 45",
+	"limit 20 50\ncurve -10 45 15",
+	"limit 20 50\ncurve -10 45 15 3O",
+	"limit 20 50\nlimit 50 20",
+	"limit 20 50\nslot 24:00 1",
+	"limit 20 50\nslot 6h 1",
+	"limit 20 50\nstart",
+	NULL
+};
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_loop(void)
+{
+	int result = 0;
+
+	/* Parameters syntax, errors */
+	if (test_syntax())
+		result = -1;
+	/* Setpoint sent on change, sent again if not applied */
+	if (test_commands())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_syntax(void)
+{
+	int i;
+
+	printf(COLOR_BLUE " * Loop : syntax " COLOR_NONE);
+
+	log_start("/tmp/ut_log_control.txt");
+
+	for (i = 0; invalid[i]; i++)
+	{
+		if (control_load(&param, invalid[i]) != -2)
+		{
+			printf("Invalid parameters %d not detected\n", i);
+			goto error;
+		}
+		if (param.enabled)
+			goto error;
+	}
+	/* Too many slots, ';' separates lines too */
+	if (control_load(&param, "slot 0:00 1;slot 1:00 1;slot 2:00 1;"
+	                         "slot 3:00 1;slot 4:00 1;slot 5:00 1;"
+	                         "slot 6:00 1;slot 7:00 1;slot 8:00 1") != -9)
+		goto error;
+	/* Empty lines, blanks and last command wins */
+	if (control_load(&param, "\n  curve -5 40 10 30 \r\n\noff;curve -10 45 15 30\n") != 0)
+		goto error;
+	if (( ! param.enabled) || (param.out_lo != -10) || (param.water_hi != 30) ||
+	    (param.min != 20) || (param.max != 55))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_control.txt");
+	return(-1);
+}
+
+static int test_commands(void)
+{
+	printf(COLOR_BLUE " * Loop : commands and retry " COLOR_NONE);
+
+	log_start("/tmp/ut_log_control.txt");
+
+	control_init(&control);
+	/* Disabled, heatpump uses its own settings */
+	if (control_update(&control, 0, 25, 0, -1) != CONTROL_NONE)
+		goto error;
+
+	if (control_load(&param, "curve -10 45 15 30") != 0)
+		goto error;
+	control_set(&control, &param);
+	/* New setpoint, sent once */
+	if (control_update(&control, 0, 25, 5, -1) != 39)
+		goto error;
+	if (control_update(&control, 0, 25, 10, -1) != CONTROL_NONE)
+		goto error;
+	/* Applied by heatpump */
+	if (control_update(&control, 0, 39, 15, -1) != CONTROL_NONE)
+		goto error;
+	/* Outside changes, new setpoint */
+	if (control_update(&control, 5, 39, 20, -1) != 36)
+		goto error;
+	/* Not applied, sent again after retry delay */
+	if (control_update(&control, 5, 39, 20 + CONTROL_RETRY - 5, -1) != CONTROL_NONE)
+		goto error;
+	if (control_update(&control, 5, 39, 20 + CONTROL_RETRY, -1) != 36)
+		goto error;
+	/* Already at the setpoint after new parameters, nothing to send */
+	control_set(&control, &param);
+	if (control_update(&control, 5, 36, 100, -1) != CONTROL_NONE)
+		goto error;
+	if (control.commands != 3)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_control.txt");
+	return(-1);
+}
+/* EOF */
@@ -0,0 +1,251 @@
+/**
+ * @file  broker.c
+ * @brief Broker stand-in, a local TCP server running into a child process
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ *
+ * @page Protocol
+ * Each message is sent with a 32 bits length (host order) followed by the
+ * content. The broker appends the content to a file (one line per message)
+ * then answers with one byte, like a QoS 1 acknowledge.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "broker.h"
+
+static void broker_main(int srv, const char *filename);
+static int  xfer(int fd, void *buffer, size_t len, int rx);
+
+static pid_t    broker_pid  = 0;
+static uint16_t broker_port = 0;
+static int      broker_sock = -1;
+
+/**
+ * @brief Start the broker process
+ *
+ * The first call choose a free TCP port, next calls (restart) use the same
+ * port.
+ *
+ * @param filename Name of the file where received messages are saved
+ * @return integer Zero is returned on success, -1 on error
+ */
+int broker_start(const char *filename)
+{
+	struct sockaddr_in addr;
+	socklen_t alen;
+	int srv, opt;
+
+	srv = socket(AF_INET, SOCK_STREAM, 0);
+	if (srv < 0)
+		return(-1);
+	opt = 1;
+	setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(broker_port);
+	if (bind(srv, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		goto error;
+	if (listen(srv, 1) < 0)
+		goto error;
+	alen = sizeof(addr);
+	getsockname(srv, (struct sockaddr *)&addr, &alen);
+	broker_port = ntohs(addr.sin_port);
+
+	fflush(stdout);
+	broker_pid = fork();
+	if (broker_pid < 0)
+		goto error;
+	if (broker_pid == 0)
+		broker_main(srv, filename);
+
+	/* Listen socket is now owned by the child */
+	close(srv);
+	return(0);
+
+error:
+	close(srv);
+	return(-1);
+}
+
+/**
+ * @brief Kill the broker process (like a crash, without any cleanup)
+ *
+ */
+void broker_stop(void)
+{
+	if (broker_pid > 0)
+	{
+		kill(broker_pid, SIGKILL);
+		waitpid(broker_pid, NULL, 0);
+		broker_pid = 0;
+	}
+	if (broker_sock >= 0)
+	{
+		close(broker_sock);
+		broker_sock = -1;
+	}
+}
+
+/**
+ * @brief Open a connection to the broker
+ *
+ * @return integer Zero is returned on success, -1 on error
+ */
+int broker_connect(void)
+{
+	struct sockaddr_in addr;
+	struct timeval tv;
+	int one = 1;
+
+	if (broker_sock >= 0)
+		return(0);
+
+	broker_sock = socket(AF_INET, SOCK_STREAM, 0);
+	if (broker_sock < 0)
+		return(-1);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(broker_port);
+	if (connect(broker_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		close(broker_sock);
+		broker_sock = -1;
+		return(-1);
+	}
+	/* Do not wait forever for an acknowledge */
+	tv.tv_sec  = 1;
+	tv.tv_usec = 0;
+	setsockopt(broker_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	/* Header and message are two sends, do not wait for the ack of first */
+	setsockopt(broker_sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return(0);
+}
+
+/**
+ * @brief Test if the connection to the broker is open
+ *
+ * @return integer True (1) if connected
+ */
+int broker_connected(void)
+{
+	return(broker_sock >= 0);
+}
+
+/**
+ * @brief Send a message and wait for the acknowledge
+ *
+ * @param data Pointer to the message content
+ * @param len  Length of the message
+ * @return integer Zero is returned on success, -1 on error (disconnected)
+ */
+int broker_send(const char *data, size_t len)
+{
+	uint32_t hdr = len;
+	char ack;
+
+	if (broker_sock < 0)
+		return(-1);
+
+	if (xfer(broker_sock, &hdr, sizeof(hdr), 0) ||
+	    xfer(broker_sock, (void *)data, len, 0) ||
+	    xfer(broker_sock, &ack, 1, 1))
+	{
+		close(broker_sock);
+		broker_sock = -1;
+		return(-1);
+	}
+	return(0);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Main loop of the broker process
+ *
+ * @param srv      Listen socket
+ * @param filename Name of the file where received messages are saved
+ */
+static void broker_main(int srv, const char *filename)
+{
+	static char buffer[65536];
+	uint32_t len;
+	int fd, cnx;
+	char ack = 'A';
+
+	while(1)
+	{
+		cnx = accept(srv, NULL, NULL);
+		if (cnx < 0)
+			continue;
+		while(1)
+		{
+			if (xfer(cnx, &len, sizeof(len), 1) || (len >= sizeof(buffer)))
+				break;
+			if (xfer(cnx, buffer, len, 1))
+				break;
+			buffer[len++] = '\n';
+			/* Message is saved before acknowledge */
+			fd = open(filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
+			if (fd < 0)
+				break;
+			write(fd, buffer, len);
+			close(fd);
+			if (xfer(cnx, &ack, 1, 0))
+				break;
+		}
+		close(cnx);
+	}
+}
+
+/**
+ * @brief Send or receive an exact number of bytes
+ *
+ * @param fd     Socket to use
+ * @param buffer Pointer to data
+ * @param len    Number of bytes to transfer
+ * @param rx     True (1) to receive, 0 to send
+ * @return integer Zero is returned on success, -1 on error
+ */
+static int xfer(int fd, void *buffer, size_t len, int rx)
+{
+	char *p = buffer;
+	ssize_t n;
+
+	while (len)
+	{
+		if (rx)
+			n = recv(fd, p, len, 0);
+		else
+			n = send(fd, p, len, MSG_NOSIGNAL);
+		if (n <= 0)
+			return(-1);
+		p   += n;
+		len -= n;
+	}
+	return(0);
+}
+/* EOF */
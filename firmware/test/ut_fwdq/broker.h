@@ -0,0 +1,27 @@
+/**
+ * @file  broker.h
+ * @brief Headers and definitions for the broker stand-in
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef BROKER_H
+#define BROKER_H
+
+#include <stddef.h>
+
+int  broker_start(const char *filename);
+void broker_stop(void);
+int  broker_connect(void);
+int  broker_connected(void);
+int  broker_send(const char *data, size_t len);
+
+#endif
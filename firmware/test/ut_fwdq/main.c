@@ -0,0 +1,249 @@
+/**
+ * @file  main.c
+ * @brief Entry point of this unit-test
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aquarea_state.h"
+#include "broker.h"
+#include "log.h"
+#include "sample.h"
+
+#define TEST_MAX_SAMPLES 6000
+
+/* Global variable used to route calls to "publish_send" (see below) */
+int send_switch;
+
+/* Declare functions for each group of tests */
+int  test_queue(void);
+int  test_queue_send(const char *data, size_t len);
+int  test_broker(void);
+int  test_policy(void);
+int  test_policy_send(const char *data, size_t len);
+
+static void usage(char *appname);
+
+/* States saved into (simulated) history */
+static struct aquarea_state history[TEST_MAX_SAMPLES];
+static int history_count;
+static int history_pos;
+
+/**
+ * @brief Entry point of this unit-test
+ *
+ * @param argc Number or command line arguments
+ * @param argv Array of string with command line arguments
+ * @return integer Zero is returned on success, -1 for error
+ */
+int main(int argc, char **argv)
+{
+	int test_num;
+	int result = 0;
+
+	if (argc < 2)
+	{
+		usage(argv[0]);
+		return(-1);
+	}
+
+	send_switch = 0;
+	log_init();
+
+	test_num = atoi(argv[1]);
+
+	if ((test_num == 1) || (test_num == 0))
+	{
+		if (test_queue() != 0)
+			result = -1;
+	}
+	if ((test_num == 2) || (test_num == 0))
+	{
+		if (test_broker() != 0)
+			result = -1;
+	}
+	if ((test_num == 3) || (test_num == 0))
+	{
+		if (test_policy() != 0)
+			result = -1;
+	}
+
+	return(result);
+}
+
+/**
+ * @brief Publish handler
+ *
+ * The special function "publish_send" is called by the queue to send a
+ * message to the broker. During tests, this function forward calls to each
+ * specific test using the global send_switch variable value.
+ *
+ * @param data Pointer to the message content
+ * @param len  Length of the message
+ * @return integer Zero is returned on success, -1 on error
+ */
+int publish_send(const char *data, size_t len)
+{
+	if (send_switch == 1)
+		return(test_queue_send(data, len));
+	else if (send_switch == 2)
+		return(broker_send(data, len));
+	else if (send_switch == 3)
+		return(test_policy_send(data, len));
+	return(-1);
+}
+
+/**
+ * @brief Clear the simulated history
+ *
+ */
+void test_history_reset(void)
+{
+	history_count = 0;
+	history_pos = 0;
+}
+
+/**
+ * @brief Insert a state into the simulated history
+ *
+ * @param state Pointer to the state to save
+ */
+void test_history_push(const struct aquarea_state *state)
+{
+	if (history_count < TEST_MAX_SAMPLES)
+		memcpy(&history[history_count++], state, sizeof(struct aquarea_state));
+}
+
+/**
+ * @brief Start to read the simulated history (see history.c)
+ *
+ * @param from Timestamp of the first state to read
+ * @return integer Always zero
+ */
+int history_replay_start(uint32_t from)
+{
+	for (history_pos = 0; history_pos < history_count; history_pos++)
+	{
+		if (history[history_pos].time >= from)
+			break;
+	}
+	return(0);
+}
+
+/**
+ * @brief Read next state of the simulated history (see history.c)
+ *
+ * @param state Pointer to a structure to store the state
+ * @return integer One when a state has been read, 0 at end of history
+ */
+int history_replay_next(struct aquarea_state *state)
+{
+	if (history_pos >= history_count)
+		return(0);
+	memcpy(state, &history[history_pos++], sizeof(struct aquarea_state));
+	return(1);
+}
+
+/**
+ * @brief Test if a sample has some changes since the previous one
+ *
+ * @param n Index of the sample
+ * @return integer True (1) if sample has changes
+ */
+int test_changed(int n)
+{
+	struct aquarea_state a, b;
+
+	if (n == 0)
+		return(1);
+	test_sample(&a, n - 1);
+	test_sample(&b, n);
+	return(memcmp(a.value, b.value, sizeof(a.value)) != 0);
+}
+
+/**
+ * @brief Verify the content of a published message
+ *
+ * Each record of the message is compared with the sample that has the same
+ * timestamp, and the sample is marked as received.
+ *
+ * @param data Pointer to the message content
+ * @param len  Length of the message
+ * @param seen Array of flags, one per sample, set when sample is received
+ * @return integer Number of records into the message, -1 if malformed
+ */
+int test_check(const char *data, size_t len, unsigned char *seen)
+{
+	struct aquarea_state ref;
+	const char *p, *end;
+	char *next;
+	long t, v;
+	int i, n, count = 0;
+
+	end = data + len;
+	if ((len < 2) || (data[0] != '[') || (end[-1] != ']'))
+		return(-1);
+	p = data + 1;
+	while (p < (end - 1))
+	{
+		if (count && (*p++ != ','))
+			return(-1);
+		if (strncmp(p, "{\"time\":", 8) != 0)
+			return(-1);
+		t = strtol(p + 8, &next, 10);
+		p = next;
+		n = (t - SAMPLE_TIME_BASE) / SAMPLE_PERIOD;
+		if ((n < 0) || (n >= TEST_MAX_SAMPLES))
+			return(-1);
+		test_sample(&ref, n);
+		/* Compare each field with the reference */
+		while (*p == ',')
+		{
+			p += 2;
+			for (i = 0; i < AQ_FIELD_COUNT; i++)
+			{
+				size_t l = strlen(aquarea_state_name(i));
+				if ((strncmp(p, aquarea_state_name(i), l) == 0) &&
+				    (strncmp(p + l, "\":", 2) == 0))
+					break;
+			}
+			if (i == AQ_FIELD_COUNT)
+				return(-1);
+			v = strtol(p + strlen(aquarea_state_name(i)) + 2, &next, 10);
+			if (v != ref.value[i])
+				return(-1);
+			p = next;
+		}
+		if (*p++ != '}')
+			return(-1);
+		seen[n] = 1;
+		count++;
+	}
+	return(count);
+}
+
+/**
+ * @brief Print an help message about command line arguments
+ *
+ */
+static void usage(char *appname)
+{
+	printf("Usage %s <test_num>\n", appname);
+	printf("  where test_num can be:\n");
+	printf("    0: Run all tests\n");
+	printf("    1: Test queue, batches and replay\n");
+	printf("    2: Test with a broker killed and restarted\n");
+	printf("    3: Test publish policy of fields (deadband, heartbeat)\n");
+}
+/* EOF */
@@ -0,0 +1,162 @@
+/**
+ * @file  test_broker.c
+ * @brief Test the queue with a broker stand-in killed and restarted
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "broker.h"
+#include "fwdq.h"
+#include "log.h"
+#include "sample.h"
+
+#define TEST_MAX_SAMPLES 6000
+#define BROKER_FILE "/tmp/ut_fwdq_broker.txt"
+
+static int check_file(int count);
+
+extern int  send_switch;
+extern void test_history_reset(void);
+extern void test_history_push(const struct aquarea_state *state);
+extern int  test_changed(int n);
+extern int  test_check(const char *data, size_t len, unsigned char *seen);
+
+static struct fwdq   queue;
+static unsigned char seen[TEST_MAX_SAMPLES];
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ * The broker is killed (no clean disconnect) two times : once while the
+ * queue is idle, once during replay of the first outage.
+ */
+int test_broker(void)
+{
+	struct aquarea_state state;
+	uint32_t now;
+	int i, late = 0;
+
+	printf(COLOR_BLUE " * Broker : killed and restarted " COLOR_NONE);
+
+	log_start("/tmp/ut_log_fwdq.txt");
+
+	send_switch = 2;
+	unlink(BROKER_FILE);
+	test_history_reset();
+	fwdq_init(&queue);
+	fwdq_set_policy(&queue, NULL);
+	if (broker_start(BROKER_FILE))
+		goto error;
+
+	now = 0;
+	for (i = 0; i < 3000; i++)
+	{
+		test_sample(&state, i);
+		test_history_push(&state);
+		fwdq_push(&queue, &state);
+
+		if ((i == 800) || (i == 1850))
+			broker_stop();
+		if ((i == 1800) || (i == 1900))
+		{
+			if (broker_start(BROKER_FILE))
+				goto error;
+		}
+
+		if ( ! broker_connected())
+			broker_connect();
+		if (broker_connected())
+		{
+			fwdq_process(&queue, now);
+			/* Live records must never wait for replay */
+			if (broker_connected() && queue.count)
+				late++;
+		}
+		now += 5000;
+	}
+	/* Wait end of replay */
+	for (i = 0; (i < 10000) && fwdq_pending(&queue); i++)
+	{
+		now += 1000;
+		fwdq_process(&queue, now);
+	}
+	broker_stop();
+
+	printf("%d dropped from RAM, %d replayed, %d messages\n",
+	       queue.dropped, queue.replayed, queue.batches);
+	if (late || fwdq_pending(&queue) || (queue.replayed == 0))
+		goto error;
+	if (check_file(3000))
+		goto error;
+
+	send_switch = 0;
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	printf("\n");
+	return(0);
+
+error:
+	broker_stop();
+	send_switch = 0;
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_fwdq.txt");
+	printf("\n");
+	return(-1);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Verify messages saved by the broker
+ *
+ * @param count Number of samples
+ * @return integer Zero is returned on success, -1 on error
+ */
+static int check_file(int count)
+{
+	static char line[65536];
+	FILE *f;
+	int i;
+
+	memset(seen, 0, sizeof(seen));
+
+	f = fopen(BROKER_FILE, "r");
+	if (f == NULL)
+		return(-1);
+	while (fgets(line, sizeof(line), f))
+	{
+		if (test_check(line, strlen(line) - 1, seen) < 0)
+		{
+			printf("Malformed message: %s\n", line);
+			fclose(f);
+			return(-1);
+		}
+	}
+	fclose(f);
+
+	for (i = 0; i < count; i++)
+	{
+		if (test_changed(i) && ! seen[i])
+		{
+			printf("Sample %d not received\n", i);
+			return(-1);
+		}
+	}
+	return(0);
+}
+/* EOF */
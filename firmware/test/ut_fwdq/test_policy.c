@@ -0,0 +1,229 @@
+/**
+ * @file  test_policy.c
+ * @brief Some tests to verify the publish policy of each field
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "fwdq.h"
+#include "log.h"
+#include "sample.h"
+
+/* Two hours of frames, an error is reported during one of them */
+#define TEST_FRAMES    1440
+#define TEST_ERROR_AT   700
+
+/* Functions for each sub-test */
+static int test_rules(void);
+static int test_volume(void);
+static uint32_t push(struct aquarea_state *state);
+static int  run(const struct fwdq_policy *policy);
+
+extern int  send_switch;
+
+static struct fwdq queue;
+static size_t send_bytes;
+static int    send_count;
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_policy(void)
+{
+	int result = 0;
+
+	send_switch = 3;
+
+	/* Deadband, interval and heartbeat of one field */
+	if (test_rules())
+		result = -1;
+	/* Volume of a jittering heatpump, with and without policy */
+	if (test_volume())
+		result = -1;
+
+	send_switch = 0;
+
+	printf("\n");
+
+	return(result);
+}
+
+/**
+ * @brief Publish handler, called by the queue (see main.c)
+ *
+ */
+int test_policy_send(const char *data, size_t len)
+{
+	send_bytes += len;
+	send_count++;
+	return(0);
+}
+
+static int test_rules(void)
+{
+	static const struct fwdq_policy policy[AQ_FIELD_COUNT] =
+	{
+		[AQ_OUTSIDE_TEMP] = { 1, 60, 300 },
+	};
+	/* Time (sec.), outside temperature, then expected publish */
+	const uint32_t time[]  = { 0, 5, 10, 15, 20, 55, 60, 65, 70, 120, 300, 305 };
+	const int32_t  value[] = { 5, 6,  4,  7,  7,  7,  7,  5,  9,   9,   9,   9 };
+	const int      pub[]   = { 1, 0,  0,  0,  0,  0,  1,  0,  0,   1,   0,   0 };
+	struct aquarea_state state;
+	uint32_t mask;
+	int i;
+
+	printf(COLOR_BLUE " * Policy : deadband, interval, heartbeat " COLOR_NONE);
+
+	log_start("/tmp/ut_log_fwdq.txt");
+
+	fwdq_init(&queue);
+	fwdq_set_policy(&queue, policy);
+	test_sample(&state, 0);
+
+	for (i = 0; i < (sizeof(time) / sizeof(time[0])); i++)
+	{
+		state.time = SAMPLE_TIME_BASE + time[i];
+		state.value[AQ_OUTSIDE_TEMP] = value[i];
+		mask = push(&state);
+		if (((mask >> AQ_OUTSIDE_TEMP) & 1) != pub[i])
+		{
+			printf("Time %u: outside %spublished\n", time[i],
+			       pub[i] ? "not " : "");
+			goto error;
+		}
+	}
+	/* Changes of other fields are published at once */
+	state.value[AQ_ERROR] = 0x4801;
+	if (push(&state) != (1UL << AQ_ERROR))
+		goto error;
+	/* Five minutes without publish, heartbeat */
+	state.time = SAMPLE_TIME_BASE + 420;
+	if (push(&state) != (1UL << AQ_OUTSIDE_TEMP))
+		goto error;
+	if (queue.live.held != 5)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_fwdq.txt");
+	return(-1);
+}
+
+static int test_volume(void)
+{
+	size_t bytes_all, bytes_policy;
+
+	printf(COLOR_BLUE " * Policy : message volume " COLOR_NONE);
+
+	log_start("/tmp/ut_log_fwdq.txt");
+
+	if (run(NULL) != 0)
+		goto error;
+	bytes_all = send_bytes;
+	if (run(fwdq_policy_default) != 0)
+		goto error;
+	bytes_policy = send_bytes;
+	/* At least half of the volume is jitter */
+	if ((bytes_policy * 2) > bytes_all)
+		goto error;
+
+	log_end();
+	printf("(%u vs %u bytes) ", (unsigned int)bytes_policy,
+	       (unsigned int)bytes_all);
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_fwdq.txt");
+	return(-1);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Insert a state into the queue
+ *
+ * @param state Pointer to the state
+ * @return integer Bitmap of the fields of the new record (0 if no record)
+ */
+static uint32_t push(struct aquarea_state *state)
+{
+	unsigned int count = queue.count;
+
+	fwdq_push(&queue, state);
+	if (queue.count == count)
+		return(0);
+	return(queue.ram[(queue.head + queue.count - 1) % FWDQ_RAM_COUNT].mask);
+}
+
+/**
+ * @brief Publish the states of a heatpump with jittering sensors
+ *
+ * @param policy Policy of the queue (NULL to publish each change)
+ * @return integer Zero on success, -1 if a field has not been published
+ *         on time
+ */
+static int run(const struct fwdq_policy *policy)
+{
+	struct aquarea_state state;
+	uint32_t last[AQ_FIELD_COUNT];
+	uint32_t mask, rnd = 1;
+	int i, n;
+
+	fwdq_init(&queue);
+	fwdq_set_policy(&queue, policy);
+	send_bytes = 0;
+	send_count = 0;
+
+	for (n = 0; n < TEST_FRAMES; n++)
+	{
+		test_sample(&state, n);
+		/* Sensors jitter by one unit (0.5°C rounded) */
+		rnd = (rnd * 1103515245) + 12345;
+		state.value[AQ_OUTSIDE_TEMP]  += (rnd >> 16) & 1;
+		state.value[AQ_INLET_TEMP]    += (rnd >> 17) & 1;
+		state.value[AQ_OUTLET_TEMP]   += (rnd >> 18) & 1;
+		state.value[AQ_Z1_WATER_TEMP] += (rnd >> 19) & 1;
+		state.value[AQ_PUMP_FLOW]     += (rnd >> 20) & 15;
+		if (n >= TEST_ERROR_AT)
+			state.value[AQ_ERROR] = 0x4801;
+
+		mask = push(&state);
+		for (i = 0; i < AQ_FIELD_COUNT; i++)
+		{
+			if (mask & (1UL << i))
+				last[i] = state.time;
+			/* Heartbeat, never silent longer (plus one frame) */
+			else if (policy && ((state.time - last[i]) > (FWDQ_HEARTBEAT + 5)))
+				return(-1);
+		}
+		/* Important fields are not delayed */
+		if ((n == TEST_ERROR_AT) && ((mask & (1UL << AQ_ERROR)) == 0))
+			return(-1);
+		if (fwdq_process(&queue, n * 5000) < 0)
+			return(-1);
+	}
+	return(0);
+}
+/* EOF */
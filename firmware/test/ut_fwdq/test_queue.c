@@ -0,0 +1,306 @@
+/**
+ * @file  test_queue.c
+ * @brief Some tests to verify the store-and-forward queue
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fwdq.h"
+#include "log.h"
+#include "sample.h"
+
+#define TEST_MAX_SAMPLES 6000
+
+/* Functions for each sub-test */
+static int test_live(void);
+static int test_spill(void);
+static int test_rate(void);
+static void push(int n);
+static int  check_seen(int count);
+
+extern int  send_switch;
+extern void test_history_reset(void);
+extern void test_history_push(const struct aquarea_state *state);
+extern int  test_changed(int n);
+extern int  test_check(const char *data, size_t len, unsigned char *seen);
+
+static struct fwdq   queue;
+static unsigned char seen[TEST_MAX_SAMPLES];
+static int    send_fail;     /* Simulate a disconnected broker   */
+static int    send_count;    /* Number of messages received      */
+static int    send_records;  /* Number of records received       */
+static size_t send_bytes;    /* Number of bytes received         */
+static int    send_first;    /* Timestamp of the first record    */
+static int    send_error;
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_queue(void)
+{
+	int result = 0;
+
+	send_switch = 1;
+
+	/* Publish while connected */
+	if (test_live())
+		result = -1;
+	/* Disconnect, then replay */
+	if (test_spill())
+		result = -1;
+	/* Replay must be limited to the configured bandwidth */
+	if (test_rate())
+		result = -1;
+
+	send_switch = 0;
+
+	printf("\n");
+
+	return(result);
+}
+
+/**
+ * @brief Publish handler, called by the queue (see main.c)
+ *
+ */
+int test_queue_send(const char *data, size_t len)
+{
+	int count;
+
+	if (send_fail)
+		return(-1);
+
+	count = test_check(data, len, seen);
+	if (count < 0)
+	{
+		printf("Malformed message: %.*s\n", (int)len, data);
+		send_error++;
+		return(0);
+	}
+	/* Save timestamp of the first record sent */
+	if (send_count == 0)
+		send_first = atoi(data + 9);
+	send_count++;
+	send_records += count;
+	send_bytes   += len;
+	return(0);
+}
+
+static int test_live(void)
+{
+	int i, count;
+
+	printf(COLOR_BLUE " * Queue : live publish " COLOR_NONE);
+
+	log_start("/tmp/ut_log_fwdq.txt");
+
+	memset(seen, 0, sizeof(seen));
+	send_fail = 0;
+	send_count = 0;
+	send_records = 0;
+	send_error = 0;
+	test_history_reset();
+	fwdq_init(&queue);
+	fwdq_set_policy(&queue, NULL);
+
+	count = 0;
+	for (i = 0; i < 100; i++)
+	{
+		push(i);
+		if (fwdq_process(&queue, i * 5000) < 0)
+			goto error;
+		if (test_changed(i))
+			count++;
+		/* One message per state with changes, nothing else */
+		if ((send_count != count) || (send_records != count))
+		{
+			printf("Sample %d: %d messages, %d expected\n", i, send_count, count);
+			goto error;
+		}
+		if (fwdq_pending(&queue))
+			goto error;
+	}
+	if (check_seen(100) || send_error)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_fwdq.txt");
+	return(-1);
+}
+
+static int test_spill(void)
+{
+	uint32_t first;
+	int i, now;
+
+	printf(COLOR_BLUE " * Queue : spill to history and replay " COLOR_NONE);
+
+	log_start("/tmp/ut_log_fwdq.txt");
+
+	memset(seen, 0, sizeof(seen));
+	send_count = 0;
+	send_records = 0;
+	send_error = 0;
+	test_history_reset();
+	fwdq_init(&queue);
+	fwdq_set_policy(&queue, NULL);
+
+	/* Broker not available during 500 polls */
+	send_fail = 1;
+	for (i = 0; i < 500; i++)
+	{
+		push(i);
+		if (fwdq_process(&queue, i * 5000) != -1)
+			goto error;
+	}
+	if ((queue.count != FWDQ_RAM_COUNT) || (queue.spilled == 0))
+		goto error;
+	printf("%d records dropped from RAM\n", queue.dropped);
+
+	/* Broker is back, most recent records must be sent first */
+	send_fail = 0;
+	first = queue.ram[queue.head].time;
+	now = 500 * 5000;
+	if (fwdq_process(&queue, now) < 2)
+		goto error;
+	if ((send_first != first) || (seen[0] == 0))
+		goto error;
+	for (i = 0; (i < 1000) && fwdq_pending(&queue); i++)
+	{
+		now += 100;
+		if (fwdq_process(&queue, now) < 0)
+			goto error;
+	}
+	if (fwdq_pending(&queue))
+		goto error;
+	if (check_seen(500) || send_error)
+		goto error;
+	printf("%d messages, %d records\n", send_count, send_records);
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_fwdq.txt");
+	return(-1);
+}
+
+static int test_rate(void)
+{
+	size_t limit;
+	int i, now;
+
+	printf(COLOR_BLUE " * Queue : replay bandwidth " COLOR_NONE);
+
+	log_start("/tmp/ut_log_fwdq.txt");
+
+	memset(seen, 0, sizeof(seen));
+	send_count = 0;
+	send_error = 0;
+	test_history_reset();
+	fwdq_init(&queue);
+	fwdq_set_policy(&queue, NULL);
+
+	send_fail = 1;
+	for (i = 0; i < 5000; i++)
+		push(i);
+
+	/* Reconnect, then process every 100ms during 30 seconds */
+	send_fail = 0;
+	send_bytes = 0;
+	now = 5000 * 5000;
+	for (i = 0; i < 300; i++)
+	{
+		now += 100;
+		if (fwdq_process(&queue, now) < 0)
+			goto error;
+	}
+	/* Live records (RAM) are not limited, old ones are */
+	limit = (FWDQ_RAM_COUNT * 1024) + (FWDQ_BATCH_SIZE * 2) + (30 * FWDQ_REPLAY_RATE);
+	printf("%d bytes sent in 30s, limit %d\n", (int)send_bytes, (int)limit);
+	if ((send_bytes > limit) || (send_bytes < (20 * FWDQ_REPLAY_RATE)))
+		goto error;
+	if ( ! fwdq_pending(&queue))
+		goto error;
+
+	/* Queue must be empty after some time */
+	for (i = 0; (i < 100000) && fwdq_pending(&queue); i++)
+	{
+		now += 100;
+		if (fwdq_process(&queue, now) < 0)
+			goto error;
+	}
+	if (check_seen(5000) || send_error)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_fwdq.txt");
+	return(-1);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Insert a sample into history and queue (like aquarea_rx)
+ *
+ * @param n Index of the sample
+ */
+static void push(int n)
+{
+	struct aquarea_state state;
+
+	test_sample(&state, n);
+	test_history_push(&state);
+	fwdq_push(&queue, &state);
+}
+
+/**
+ * @brief Verify that all states with changes have been received
+ *
+ * @param count Number of samples
+ * @return integer Zero is returned on success, -1 on error
+ */
+static int check_seen(int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		if (test_changed(i) && ! seen[i])
+		{
+			printf("Sample %d not received\n", i);
+			return(-1);
+		}
+	}
+	return(0);
+}
+/* EOF */
@@ -0,0 +1,8 @@
+#ifndef ESP_ERR_H
+#define ESP_ERR_H
+
+/* Definitions for error constants. */
+#define ESP_OK          0       /*!< esp_err_t value indicating success (no error) */
+#define ESP_FAIL        -1      /*!< Generic esp_err_t code indicating failure */
+
+#endif
@@ -0,0 +1,98 @@
+/**
+ * @file  main.c
+ * @brief Entry point of this unit-test
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aquarea_state.h"
+#include "log.h"
+#include "sample.h"
+
+/* Declare functions for each group of tests */
+int  test_format(void);
+int  test_mount(void);
+int  test_wear(void);
+
+static void usage(char *appname);
+
+/**
+ * @brief Entry point of this unit-test
+ *
+ * @param argc Number or command line arguments
+ * @param argv Array of string with command line arguments
+ * @return integer Zero is returned on success, -1 for error
+ */
+int main(int argc, char **argv)
+{
+	int test_num;
+	int result = 0;
+
+	if (argc < 2)
+	{
+		usage(argv[0]);
+		return(-1);
+	}
+
+	log_init();
+
+	test_num = atoi(argv[1]);
+
+	if ((test_num == 1) || (test_num == 0))
+	{
+		if (test_format() != 0)
+			result = -1;
+	}
+	if ((test_num == 2) || (test_num == 0))
+	{
+		if (test_mount() != 0)
+			result = -1;
+	}
+	if ((test_num == 3) || (test_num == 0))
+	{
+		if (test_wear() != 0)
+			result = -1;
+	}
+
+	return(result);
+}
+
+/**
+ * @brief Compare two states
+ *
+ * @return integer Zero is returned if states are equals
+ */
+int test_compare(const struct aquarea_state *a, const struct aquarea_state *b)
+{
+	if (a->time != b->time)
+		return(-1);
+	if (memcmp(a->value, b->value, sizeof(a->value)) != 0)
+		return(-1);
+	return(0);
+}
+
+/**
+ * @brief Print an help message about command line arguments
+ *
+ */
+static void usage(char *appname)
+{
+	printf("Usage %s <test_num>\n", appname);
+	printf("  where test_num can be:\n");
+	printf("    0: Run all tests\n");
+	printf("    1: Test record format and compression\n");
+	printf("    2: Test log mount (restart, power loss)\n");
+	printf("    3: Test circular use of flash (wear levelling)\n");
+}
+/* EOF */
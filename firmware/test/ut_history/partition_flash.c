@@ -0,0 +1,206 @@
+/**
+ * @file  partition_flash.c
+ * @brief Simulate esp-idf partition API using a file as flash memory
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "partition_flash.h"
+#include "log.h"
+
+static esp_partition_t part;
+static int fd = -1;
+static unsigned int *erase_count = NULL;
+static unsigned int errors;
+static unsigned int writes;
+
+/* -------------------------------------------------------------------------- */
+/* --                      Simulated partition API                         -- */
+/* -------------------------------------------------------------------------- */
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+                       esp_partition_subtype_t subtype, const char* label)
+{
+	if (fd < 0)
+		return(NULL);
+	return(&part);
+}
+
+/**
+ * @brief Simulated version of esp-idf function esp_partition_read
+ *
+ * @param partition Pointer to partition structure
+ * @param src_offset Address (into partition) of data to read
+ * @param dst Pointer to a buffer where readed data are stored
+ * @param size Number of bytes to read
+ * @return integer ESP_OK is returned of success, else ESP_FAIL
+ */
+esp_err_t esp_partition_read(const esp_partition_t* partition,
+                             size_t src_offset, void* dst, size_t size)
+{
+	if ((partition != &part) || ((src_offset + size) > part.size))
+	{
+		printf(COLOR_RED "FLASH: Read out of partition %d %d" COLOR_NONE "\n", (int)src_offset, (int)size);
+		errors++;
+		return(ESP_FAIL);
+	}
+	if (pread(fd, dst, size, src_offset) != size)
+		return(ESP_FAIL);
+	return(ESP_OK);
+}
+
+/**
+ * @brief Simulated version of esp-idf function esp_partition_write
+ *
+ * Like a real NOR flash, a write can only clear bits. Any attempt to set a
+ * bit (write over a non-erased byte) is reported as an error.
+ *
+ * @param partition Pointer to partition structure
+ * @param dst_offset Address (into partition) where data are written
+ * @param src Pointer to a buffer with data to write
+ * @param size Number of bytes to write
+ * @return integer ESP_OK is returned of success, else ESP_FAIL
+ */
+esp_err_t esp_partition_write(const esp_partition_t* partition,
+                              size_t dst_offset, const void* src, size_t size)
+{
+	const unsigned char *psrc = src;
+	unsigned char *cur;
+	size_t i;
+
+	if ((partition != &part) || ((dst_offset + size) > part.size))
+	{
+		printf(COLOR_RED "FLASH: Write out of partition %d %d" COLOR_NONE "\n", (int)dst_offset, (int)size);
+		errors++;
+		return(ESP_FAIL);
+	}
+	cur = malloc(size);
+	if (pread(fd, cur, size, dst_offset) != size)
+	{
+		free(cur);
+		return(ESP_FAIL);
+	}
+	for (i = 0; i < size; i++)
+	{
+		if ((cur[i] & psrc[i]) != psrc[i])
+		{
+			printf(COLOR_RED "FLASH: Write over non-erased byte at %d" COLOR_NONE "\n", (int)(dst_offset + i));
+			errors++;
+		}
+		cur[i] &= psrc[i];
+	}
+	pwrite(fd, cur, size, dst_offset);
+	free(cur);
+	writes++;
+
+	return(ESP_OK);
+}
+
+/**
+ * @brief Simulated version of esp-idf function esp_partition_erase_range
+ *
+ * @param partition Pointer to partition structure
+ * @param offset Address (into partition) of the first sector to erase
+ * @param size Number of bytes to erase (multiple of sector size)
+ * @return integer ESP_OK is returned of success, else ESP_FAIL
+ */
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition,
+                                    size_t offset, size_t size)
+{
+	unsigned char sector[FLASH_SECTOR_SIZE];
+
+	if ((partition != &part) || ((offset + size) > part.size) ||
+	    (offset % FLASH_SECTOR_SIZE) || (size % FLASH_SECTOR_SIZE))
+	{
+		printf(COLOR_RED "FLASH: Invalid erase %d %d" COLOR_NONE "\n", (int)offset, (int)size);
+		errors++;
+		return(ESP_FAIL);
+	}
+	memset(sector, 0xFF, FLASH_SECTOR_SIZE);
+	while (size)
+	{
+		pwrite(fd, sector, FLASH_SECTOR_SIZE, offset);
+		erase_count[offset / FLASH_SECTOR_SIZE]++;
+		offset += FLASH_SECTOR_SIZE;
+		size   -= FLASH_SECTOR_SIZE;
+	}
+	return(ESP_OK);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                       Internal tests functions                       -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Create a new (fully erased) simulated flash
+ *
+ * @param name Name of the file used to store flash content
+ * @param size Size of the partition in bytes
+ * @return pointer Partition structure to use with esp_partition functions
+ */
+const esp_partition_t *flash_open(const char *name, unsigned int size)
+{
+	unsigned char sector[FLASH_SECTOR_SIZE];
+	unsigned int i;
+
+	flash_close();
+
+	fd = open(name, O_CREAT | O_RDWR | O_TRUNC, 0666);
+	if (fd < 0)
+		return(NULL);
+	memset(sector, 0xFF, FLASH_SECTOR_SIZE);
+	for (i = 0; i < size; i += FLASH_SECTOR_SIZE)
+		write(fd, sector, FLASH_SECTOR_SIZE);
+
+	memset(&part, 0, sizeof(esp_partition_t));
+	part.type    = ESP_PARTITION_TYPE_DATA;
+	part.subtype = 0x40;
+	part.size    = size;
+	strcpy(part.label, "history");
+
+	erase_count = calloc(size / FLASH_SECTOR_SIZE, sizeof(unsigned int));
+	errors = 0;
+	writes = 0;
+
+	return(&part);
+}
+
+void flash_close(void)
+{
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
+	free(erase_count);
+	erase_count = NULL;
+}
+
+unsigned int flash_erase_count(int sector)
+{
+	return(erase_count[sector]);
+}
+
+unsigned int flash_errors(void)
+{
+	return(errors);
+}
+
+unsigned int flash_writes(void)
+{
+	return(writes);
+}
+/* EOF */
@@ -0,0 +1,29 @@
+/**
+ * @file  partition_flash.h
+ * @brief Headers and definition for special functions of flash simulation
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef PARTITION_FLASH_H
+#define PARTITION_FLASH_H
+
+#include "esp_partition.h"
+
+#define FLASH_SECTOR_SIZE 4096
+
+const esp_partition_t *flash_open(const char *name, unsigned int size);
+void flash_close(void);
+unsigned int flash_erase_count(int sector);
+unsigned int flash_errors(void);
+unsigned int flash_writes(void);
+
+#endif
@@ -0,0 +1,285 @@
+/**
+ * @file  test_format.c
+ * @brief Some tests to verify history records encoding
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hlog.h"
+#include "partition_flash.h"
+#include "log.h"
+#include "sample.h"
+
+/* Functions for each sub-test */
+static int test_roundtrip(void);
+static int test_backward(void);
+static int test_ratio(void);
+static int test_seek(void);
+
+extern int  test_compare(const struct aquarea_state *a, const struct aquarea_state *b);
+
+static struct hlog log_ctx;
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_format(void)
+{
+	int result = 0;
+
+	/* Write then read back some states */
+	if (test_roundtrip())
+		result = -1;
+	/* Test with a timestamp that goes backward */
+	if (test_backward())
+		result = -1;
+	/* Measure average size of records */
+	if (test_ratio())
+		result = -1;
+	/* Search records by time */
+	if (test_seek())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_roundtrip(void)
+{
+	const esp_partition_t *part;
+	struct hlog_reader rd;
+	struct aquarea_state ref, st;
+	int i;
+
+	printf(COLOR_BLUE " * History format : write and read back states " COLOR_NONE);
+
+	log_start("/tmp/ut_log_history.txt");
+
+	part = flash_open("/tmp/ut_flash_history.bin", 16 * FLASH_SECTOR_SIZE);
+	if (hlog_init(&log_ctx, part))
+		goto error;
+
+	for (i = 0; i < 1000; i++)
+	{
+		test_sample(&ref, i);
+		if (hlog_append(&log_ctx, &ref))
+			goto error;
+	}
+
+	/* Read all states (last ones are still into page cache) */
+	hlog_reader_init(&log_ctx, &rd);
+	for (i = 0; hlog_reader_next(&rd, &st); i++)
+	{
+		test_sample(&ref, i);
+		if (test_compare(&ref, &st))
+		{
+			printf("State %d differ\n", i);
+			goto error;
+		}
+	}
+	if (i != 1000)
+	{
+		printf("Read %d states, 1000 expected\n", i);
+		goto error;
+	}
+	if (flash_errors())
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_history.txt");
+	return(-1);
+}
+
+static int test_backward(void)
+{
+	const esp_partition_t *part;
+	struct hlog_reader rd;
+	struct aquarea_state ref, st;
+	int i;
+
+	printf(COLOR_BLUE " * History format : timestamp going backward " COLOR_NONE);
+
+	log_start("/tmp/ut_log_history.txt");
+
+	part = flash_open("/tmp/ut_flash_history.bin", 16 * FLASH_SECTOR_SIZE);
+	if (hlog_init(&log_ctx, part))
+		goto error;
+
+	for (i = 0; i < 200; i++)
+	{
+		test_sample(&ref, i);
+		/* Clock adjusted (by SNTP for example) after 100 states */
+		if (i >= 100)
+			ref.time -= 3600;
+		if (hlog_append(&log_ctx, &ref))
+			goto error;
+	}
+
+	hlog_reader_init(&log_ctx, &rd);
+	for (i = 0; hlog_reader_next(&rd, &st); i++)
+	{
+		test_sample(&ref, i);
+		if (i >= 100)
+			ref.time -= 3600;
+		if (test_compare(&ref, &st))
+		{
+			printf("State %d differ\n", i);
+			goto error;
+		}
+	}
+	if (i != 200)
+	{
+		printf("Read %d states, 200 expected\n", i);
+		goto error;
+	}
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_history.txt");
+	return(-1);
+}
+
+static int test_ratio(void)
+{
+	const esp_partition_t *part;
+	struct aquarea_state ref;
+	unsigned int used;
+	double ratio;
+	int count = 5000;
+	int i;
+
+	printf(COLOR_BLUE " * History format : compression ratio " COLOR_NONE);
+
+	log_start("/tmp/ut_log_history.txt");
+
+	part = flash_open("/tmp/ut_flash_history.bin", 64 * FLASH_SECTOR_SIZE);
+	if (hlog_init(&log_ctx, part))
+		goto error;
+
+	for (i = 0; i < count; i++)
+	{
+		test_sample(&ref, i);
+		if (hlog_append(&log_ctx, &ref))
+			goto error;
+	}
+
+	/* Bytes used by all blocks (header included) */
+	used = ((log_ctx.seq - 1) * HLOG_SECTOR_SIZE) + log_ctx.offset;
+	ratio = (double)used / count;
+	printf("%d states into %d bytes : %.2f bytes per state (raw %d)\n",
+	       count, used, ratio, (int)sizeof(ref.value));
+	/* Expect at least 10x smaller than raw values */
+	if (ratio > (sizeof(ref.value) / 10))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_history.txt");
+	return(-1);
+}
+static int test_seek(void)
+{
+	const esp_partition_t *part;
+	struct hlog_reader rd;
+	struct aquarea_state ref, st;
+	uint32_t t;
+	int count = 20000;
+	int i, skipped;
+
+	printf(COLOR_BLUE " * History format : seek by time " COLOR_NONE);
+
+	log_start("/tmp/ut_log_history.txt");
+
+	part = flash_open("/tmp/ut_flash_history.bin", 16 * FLASH_SECTOR_SIZE);
+	if (hlog_init(&log_ctx, part))
+		goto error;
+	for (i = 0; i < count; i++)
+	{
+		test_sample(&ref, i);
+		hlog_append(&log_ctx, &ref);
+	}
+
+	/* Seek at some positions : before, into and after the log */
+	for (i = 0; i < count; i += 997)
+	{
+		test_sample(&ref, i);
+		t = ref.time;
+		hlog_reader_seek(&log_ctx, &rd, t);
+		skipped = 0;
+		while (hlog_reader_next(&rd, &st))
+		{
+			if (st.time >= t)
+				break;
+			skipped++;
+		}
+		/* Oldest states are no more into the log */
+		if (st.time > t)
+		{
+			test_sample(&ref, (st.time - SAMPLE_TIME_BASE) / SAMPLE_PERIOD);
+			if (test_compare(&ref, &st) || (skipped != 0))
+			{
+				printf("Seek %d: bad oldest state\n", i);
+				goto error;
+			}
+			continue;
+		}
+		if (test_compare(&ref, &st))
+		{
+			printf("Seek %d: state differ\n", i);
+			goto error;
+		}
+		/* Seek must stop into the right block */
+		if (skipped > (HLOG_SECTOR_SIZE / 2))
+		{
+			printf("Seek %d: %d states skipped\n", i, skipped);
+			goto error;
+		}
+	}
+
+	/* Seek after the last state */
+	hlog_reader_seek(&log_ctx, &rd, 0xFFFFFFF0);
+	for (i = 0; hlog_reader_next(&rd, &st); i++)
+		;
+	if ((i == 0) || (i > (HLOG_SECTOR_SIZE / 2)))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_history.txt");
+	return(-1);
+}
+/* EOF */
@@ -0,0 +1,248 @@
+/**
+ * @file  test_mount.c
+ * @brief Some tests to verify history log restart (mount)
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hlog.h"
+#include "partition_flash.h"
+#include "log.h"
+#include "sample.h"
+
+/* Functions for each sub-test */
+static int test_remount(void);
+static int test_noflush(void);
+static int test_truncated(void);
+static int check_log(int first, int count, int skip_from, int skip_to);
+
+extern int  test_compare(const struct aquarea_state *a, const struct aquarea_state *b);
+
+static struct hlog log_ctx;
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_mount(void)
+{
+	int result = 0;
+
+	/* Restart after a clean flush */
+	if (test_remount())
+		result = -1;
+	/* Restart without flush (reset) */
+	if (test_noflush())
+		result = -1;
+	/* Restart with a partially written record (power loss) */
+	if (test_truncated())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_remount(void)
+{
+	const esp_partition_t *part;
+	struct aquarea_state ref;
+	int i;
+
+	printf(COLOR_BLUE " * History mount : restart after flush " COLOR_NONE);
+
+	log_start("/tmp/ut_log_history.txt");
+
+	part = flash_open("/tmp/ut_flash_history.bin", 16 * FLASH_SECTOR_SIZE);
+	if (hlog_init(&log_ctx, part))
+		goto error;
+	for (i = 0; i < 700; i++)
+	{
+		test_sample(&ref, i);
+		hlog_append(&log_ctx, &ref);
+	}
+	hlog_flush(&log_ctx);
+
+	/* Mount the log again, and continue */
+	if (hlog_init(&log_ctx, part))
+		goto error;
+	if ((log_ctx.time != ref.time) ||
+	    memcmp(log_ctx.value, ref.value, sizeof(ref.value)))
+	{
+		printf("Last state not restored\n");
+		goto error;
+	}
+	for (i = 700; i < 1400; i++)
+	{
+		test_sample(&ref, i);
+		hlog_append(&log_ctx, &ref);
+	}
+	if (check_log(0, 1400, 0, 0))
+		goto error;
+	if (flash_errors())
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_history.txt");
+	return(-1);
+}
+
+static int test_noflush(void)
+{
+	const esp_partition_t *part;
+	struct hlog_reader rd;
+	struct aquarea_state ref, st;
+	int i, saved;
+
+	printf(COLOR_BLUE " * History mount : restart without flush " COLOR_NONE);
+
+	log_start("/tmp/ut_log_history.txt");
+
+	part = flash_open("/tmp/ut_flash_history.bin", 16 * FLASH_SECTOR_SIZE);
+	if (hlog_init(&log_ctx, part))
+		goto error;
+	for (i = 0; i < 700; i++)
+	{
+		test_sample(&ref, i);
+		hlog_append(&log_ctx, &ref);
+	}
+
+	/* Mount again, states into page cache are lost */
+	if (hlog_init(&log_ctx, part))
+		goto error;
+	hlog_reader_init(&log_ctx, &rd);
+	for (saved = 0; hlog_reader_next(&rd, &st); saved++)
+		;
+	printf("%d states saved on flash\n", saved);
+	/* Loss must be limited to the content of one page */
+	if ((saved < (700 - HLOG_PAGE_SIZE)) || (saved >= 700))
+		goto error;
+
+	for (i = 700; i < 1000; i++)
+	{
+		test_sample(&ref, i);
+		hlog_append(&log_ctx, &ref);
+	}
+	if (check_log(0, 1000, saved, 700))
+		goto error;
+	if (flash_errors())
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_history.txt");
+	return(-1);
+}
+
+static int test_truncated(void)
+{
+	const esp_partition_t *part;
+	struct aquarea_state ref;
+	unsigned char partial[2] = {HLOG_REC_DELTA, 0x85};
+	int i;
+
+	printf(COLOR_BLUE " * History mount : restart with truncated record " COLOR_NONE);
+
+	log_start("/tmp/ut_log_history.txt");
+
+	part = flash_open("/tmp/ut_flash_history.bin", 16 * FLASH_SECTOR_SIZE);
+	if (hlog_init(&log_ctx, part))
+		goto error;
+	for (i = 0; i < 100; i++)
+	{
+		test_sample(&ref, i);
+		hlog_append(&log_ctx, &ref);
+	}
+	hlog_flush(&log_ctx);
+	/* Simulate a power loss during write of next record */
+	esp_partition_write(part, (log_ctx.sect * HLOG_SECTOR_SIZE) + log_ctx.offset,
+	                    partial, 2);
+
+	if (hlog_init(&log_ctx, part))
+		goto error;
+	/* Corrupted block must be closed */
+	if (log_ctx.offset != HLOG_SECTOR_SIZE)
+	{
+		printf("Corrupted block not closed\n");
+		goto error;
+	}
+	for (i = 100; i < 300; i++)
+	{
+		test_sample(&ref, i);
+		hlog_append(&log_ctx, &ref);
+	}
+	if (check_log(0, 300, 0, 0))
+		goto error;
+	if (flash_errors())
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_history.txt");
+	return(-1);
+}
+
+/**
+ * @brief Read the whole log and compare with expected states
+ *
+ * @param first Index of the first expected sample
+ * @param count Number of samples written
+ * @param skip_from Index of the first lost sample
+ * @param skip_to   Index of the first sample after lost ones
+ * @return integer Zero is returned if log content is valid
+ */
+static int check_log(int first, int count, int skip_from, int skip_to)
+{
+	struct hlog_reader rd;
+	struct aquarea_state ref, st;
+	int i;
+
+	hlog_reader_init(&log_ctx, &rd);
+	i = first;
+	while (hlog_reader_next(&rd, &st))
+	{
+		if ((i == skip_from) && (skip_to > skip_from))
+			i = skip_to;
+		test_sample(&ref, i);
+		if (test_compare(&ref, &st))
+		{
+			printf("State %d differ\n", i);
+			return(-1);
+		}
+		i++;
+	}
+	if (i != count)
+	{
+		printf("Log end at %d, %d expected\n", i, count);
+		return(-1);
+	}
+	return(0);
+}
+/* EOF */
@@ -0,0 +1,265 @@
+/**
+ * @file  test_wear.c
+ * @brief Some tests to verify circular use of the flash (wear levelling)
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hlog.h"
+#include "partition_flash.h"
+#include "log.h"
+#include "sample.h"
+
+#define WEAR_SECTORS 8
+
+/* Functions for each sub-test */
+static int test_wrap(void);
+static int test_wrap_remount(void);
+static int test_overrun(void);
+static int check_tail(int count);
+
+extern int  test_compare(const struct aquarea_state *a, const struct aquarea_state *b);
+
+static struct hlog log_ctx;
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_wear(void)
+{
+	int result = 0;
+
+	/* Fill the log many times */
+	if (test_wrap())
+		result = -1;
+	/* Fill the log many times, with restart */
+	if (test_wrap_remount())
+		result = -1;
+	/* Reader overtaken by the writer */
+	if (test_overrun())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_wrap(void)
+{
+	const esp_partition_t *part;
+	struct aquarea_state ref;
+	unsigned int min, max, n;
+	int count = 40000;
+	int i;
+
+	printf(COLOR_BLUE " * History wear : circular use of sectors " COLOR_NONE);
+
+	log_start("/tmp/ut_log_history.txt");
+
+	part = flash_open("/tmp/ut_flash_history.bin", WEAR_SECTORS * FLASH_SECTOR_SIZE);
+	if (hlog_init(&log_ctx, part))
+		goto error;
+	for (i = 0; i < count; i++)
+	{
+		test_sample(&ref, i);
+		if (hlog_append(&log_ctx, &ref))
+			goto error;
+	}
+
+	/* All sectors must have been erased the same number of times */
+	min = max = flash_erase_count(0);
+	for (i = 1; i < WEAR_SECTORS; i++)
+	{
+		n = flash_erase_count(i);
+		if (n < min)
+			min = n;
+		if (n > max)
+			max = n;
+	}
+	printf("Sector erase count : min %d max %d\n", min, max);
+	if ((min < 2) || ((max - min) > 1))
+		goto error;
+
+	if (check_tail(count))
+		goto error;
+	if (flash_errors())
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_history.txt");
+	return(-1);
+}
+
+static int test_wrap_remount(void)
+{
+	const esp_partition_t *part;
+	struct aquarea_state ref;
+	int count = 40000;
+	int i;
+
+	printf(COLOR_BLUE " * History wear : circular use with restarts " COLOR_NONE);
+
+	log_start("/tmp/ut_log_history.txt");
+
+	part = flash_open("/tmp/ut_flash_history.bin", WEAR_SECTORS * FLASH_SECTOR_SIZE);
+	if (hlog_init(&log_ctx, part))
+		goto error;
+	for (i = 0; i < count; i++)
+	{
+		test_sample(&ref, i);
+		if (hlog_append(&log_ctx, &ref))
+			goto error;
+		/* Flush and restart regularly */
+		if ((i % 3001) == 3000)
+		{
+			hlog_flush(&log_ctx);
+			if (hlog_init(&log_ctx, part))
+				goto error;
+		}
+	}
+	if (check_tail(count))
+		goto error;
+	if (flash_errors())
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_history.txt");
+	return(-1);
+}
+
+static int test_overrun(void)
+{
+	const esp_partition_t *part;
+	struct hlog_reader rd;
+	struct aquarea_state ref, st;
+	int count = 3000;
+	int i, n, last = -1;
+
+	printf(COLOR_BLUE " * History wear : writer wraps past a reader " COLOR_NONE);
+
+	log_start("/tmp/ut_log_history.txt");
+
+	part = flash_open("/tmp/ut_flash_history.bin", WEAR_SECTORS * FLASH_SECTOR_SIZE);
+	if (hlog_init(&log_ctx, part))
+		goto error;
+	for (i = 0; i < count; i++)
+	{
+		test_sample(&ref, i);
+		if (hlog_append(&log_ctx, &ref))
+			goto error;
+	}
+
+	/* Read some records of the oldest block */
+	hlog_reader_init(&log_ctx, &rd);
+	for (i = 0; i < 10; i++)
+	{
+		if (hlog_reader_next(&rd, &st) == 0)
+			goto error;
+		last = (st.time - SAMPLE_TIME_BASE) / SAMPLE_PERIOD;
+	}
+
+	/* Then the writer reuses all sectors, some of them twice */
+	for (i = count; i < (count * 4); i++)
+	{
+		test_sample(&ref, i);
+		if (hlog_append(&log_ctx, &ref))
+			goto error;
+	}
+
+	/* Records read after that are only valid and recent ones */
+	while (hlog_reader_next(&rd, &st))
+	{
+		n = (st.time - SAMPLE_TIME_BASE) / SAMPLE_PERIOD;
+		if (n <= last)
+		{
+			printf("State %d after state %d\n", n, last);
+			goto error;
+		}
+		test_sample(&ref, n);
+		if (test_compare(&ref, &st))
+		{
+			printf("State %d differ\n", n);
+			goto error;
+		}
+		last = n;
+	}
+	printf("%d resync, last state %d\n", (int)rd.resync, last);
+	if ((rd.resync == 0) || (last != ((count * 4) - 1)))
+		goto error;
+	if (flash_errors())
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_history.txt");
+	return(-1);
+}
+
+/**
+ * @brief Verify that the log contains the most recent states, in order
+ *
+ * @param count Number of states written
+ * @return integer Zero is returned if log content is valid
+ */
+static int check_tail(int count)
+{
+	struct hlog_reader rd;
+	struct aquarea_state ref, st;
+	int first, i;
+
+	hlog_reader_init(&log_ctx, &rd);
+	if (hlog_reader_next(&rd, &st) == 0)
+		return(-1);
+	/* Find index of the oldest state still into log */
+	first = (st.time - SAMPLE_TIME_BASE) / SAMPLE_PERIOD;
+	i = first;
+	do
+	{
+		test_sample(&ref, i);
+		if (test_compare(&ref, &st))
+		{
+			printf("State %d differ\n", i);
+			return(-1);
+		}
+		i++;
+	} while (hlog_reader_next(&rd, &st));
+
+	printf("Log contains states %d to %d\n", first, i - 1);
+	if (i != count)
+		return(-1);
+	/* At least all blocks but one must be available (about 9 bytes per
+	 * state, derived fields change on almost each state) */
+	if ((i - first) < (((WEAR_SECTORS - 1) * HLOG_SECTOR_SIZE) / 10))
+		return(-1);
+	return(0);
+}
+/* EOF */
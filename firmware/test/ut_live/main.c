@@ -0,0 +1,173 @@
+/**
+ * @file  main.c
+ * @brief Entry point of this unit-test
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aquarea_state.h"
+#include "log.h"
+#include "mem.h"
+
+#define CLIENT_COUNT 8
+
+/* Declare functions for each group of tests */
+int  test_live(void);
+
+static void usage(char *appname);
+
+/* Simulated clients (indexed by socket) */
+int         client_busy[CLIENT_COUNT];
+int         client_fail[CLIENT_COUNT];
+int         client_count[CLIENT_COUNT];
+int         client_full[CLIENT_COUNT];
+int32_t     client_value[CLIENT_COUNT][AQ_FIELD_COUNT];
+uint32_t    client_seq[CLIENT_COUNT];
+const char *client_last[CLIENT_COUNT];
+int         notify_count;
+
+/**
+ * @brief Entry point of this unit-test
+ *
+ * @param argc Number or command line arguments
+ * @param argv Array of string with command line arguments
+ * @return integer Zero is returned on success, -1 for error
+ */
+int main(int argc, char **argv)
+{
+	int test_num;
+	int result = 0;
+
+	if (argc < 2)
+	{
+		usage(argv[0]);
+		return(-1);
+	}
+
+	log_init();
+
+	test_num = atoi(argv[1]);
+
+	if ((test_num == 1) || (test_num == 0))
+	{
+		if (test_live() != 0)
+			result = -1;
+	}
+
+	return(result);
+}
+
+/**
+ * @brief Reset the simulated clients
+ *
+ */
+void client_reset(void)
+{
+	memset(client_busy,  0, sizeof(client_busy));
+	memset(client_fail,  0, sizeof(client_fail));
+	memset(client_count, 0, sizeof(client_count));
+	memset(client_full,  0, sizeof(client_full));
+	memset(client_value, 0, sizeof(client_value));
+	memset(client_seq,   0, sizeof(client_seq));
+	memset(client_last,  0, sizeof(client_last));
+	notify_count = 0;
+}
+
+/**
+ * @brief Hook used by live module to send a message (simulated client)
+ *
+ * The message is decoded and applied to the values known by the client, like
+ * a dashboard would do.
+ *
+ * @param fd   Socket of the client
+ * @param data Pointer to the message
+ * @param len  Length of the message
+ * @return integer Zero if sent, 1 if client is busy, -1 on error
+ */
+int live_send(int fd, const char *data, size_t len)
+{
+	char key[32];
+	const char *p, *end;
+	int fields = 0;
+	long v;
+	int i, n;
+
+	if (client_fail[fd])
+		return(-1);
+	if (client_busy[fd])
+		return(1);
+
+	client_count[fd]++;
+	client_last[fd] = data;
+
+	if ((len == 0) || (data[0] != '{') || (data[len - 1] != '}'))
+	{
+		printf("Client %d: bad message %.*s\n", fd, (int)len, data);
+		return(0);
+	}
+	p   = data + 1;
+	end = data + len - 1;
+	while (p < end)
+	{
+		if (sscanf(p, "\"%31[^\"]\":%ld%n", key, &v, &n) != 2)
+			break;
+		p += n;
+		if (*p == ',')
+			p++;
+		if (strcmp(key, "seq") == 0)
+		{
+			client_seq[fd] = v;
+			continue;
+		}
+		if (strcmp(key, "time") == 0)
+			continue;
+		for (i = 0; i < AQ_FIELD_COUNT; i++)
+		{
+			if (strcmp(key, aquarea_state_name(i)) == 0)
+				client_value[fd][i] = v;
+		}
+		fields++;
+	}
+	if (fields == AQ_FIELD_COUNT)
+		client_full[fd]++;
+	return(0);
+}
+
+/**
+ * @brief Hook used by live module to wake up the sender
+ *
+ */
+void live_notify(void)
+{
+	notify_count++;
+}
+
+/**
+ * @brief Memory accounting, not tested here
+ *
+ */
+void mem_account(const char *name, size_t used, size_t budget) { }
+
+/**
+ * @brief Print an help message about command line arguments
+ *
+ */
+static void usage(char *appname)
+{
+	printf("Usage %s <test_num>\n", appname);
+	printf("  where test_num can be:\n");
+	printf("    0: Run all tests\n");
+	printf("    1: Test live updates (deltas, slow clients)\n");
+}
+/* EOF */
@@ -0,0 +1,361 @@
+/**
+ * @file  test_live.c
+ * @brief Some tests to verify live updates (deltas and client queues)
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "live.h"
+#include "snapshot.h"
+#include "log.h"
+
+/* Simulated clients, see main.c */
+extern int         client_busy[];
+extern int         client_fail[];
+extern int         client_count[];
+extern int         client_full[];
+extern int32_t     client_value[][AQ_FIELD_COUNT];
+extern uint32_t    client_seq[];
+extern const char *client_last[];
+extern int         notify_count;
+extern void client_reset(void);
+
+/* Functions for each sub-test */
+static int test_delta(void);
+static int test_shared(void);
+static int test_slow(void);
+static int test_clients(void);
+static void frame(struct aquarea_state *s);
+static int  check(struct aquarea_state *s, int fd);
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_live(void)
+{
+	int result = 0;
+
+	/* Full state on connect, then only changed fields */
+	if (test_delta())
+		result = -1;
+	/* One serialization for all clients */
+	if (test_shared())
+		result = -1;
+	/* Slow clients never delay others nor grow a queue */
+	if (test_slow())
+		result = -1;
+	/* Client limit and broken clients */
+	if (test_clients())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_delta(void)
+{
+	struct aquarea_state s;
+	int count;
+
+	printf(COLOR_BLUE " * Live : full state then deltas " COLOR_NONE);
+
+	log_start("/tmp/ut_log_live.txt");
+
+	client_reset();
+	snapshot_init();
+	live_init();
+	memset(&s, 0, sizeof(struct aquarea_state));
+
+	/* Client connected before the first frame : nothing to send yet */
+	if (live_add(1) != 0)
+		goto error;
+	live_process();
+	if (client_count[1] != 0)
+		goto error;
+
+	/* First frame contains all fields */
+	frame(&s);
+	live_process();
+	printf("first: %.60s...\n", client_last[1]);
+	if ((client_count[1] != 1) || (client_full[1] != 1) || check(&s, 1))
+		goto error;
+
+	/* Unchanged frame : no message, no notify */
+	count = notify_count;
+	s.seq++;
+	snapshot_update(&s);
+	if (live_push(&s) != 0)
+		goto error;
+	live_process();
+	if ((notify_count != count) || (client_count[1] != 1))
+		goto error;
+
+	/* Only one field changed */
+	s.seq++;
+	s.value[AQ_INLET_TEMP] += 3;
+	snapshot_update(&s);
+	if (live_push(&s) != 1)
+		goto error;
+	live_process();
+	printf("delta: %s\n", client_last[1]);
+	if ((client_count[1] != 2) || check(&s, 1))
+		goto error;
+	if (strncmp(client_last[1], "{\"seq\":", 7) ||
+	    (strstr(client_last[1], aquarea_state_name(AQ_INLET_TEMP)) == NULL) ||
+	    (strstr(client_last[1], aquarea_state_name(AQ_OUTLET_TEMP)) != NULL))
+		goto error;
+
+	/* Client connected later receives the full state first */
+	if (live_add(2) != 0)
+		goto error;
+	live_process();
+	if ((client_count[2] != 1) || (client_full[2] != 1) || check(&s, 2))
+		goto error;
+	frame(&s);
+	live_process();
+	if ((client_count[2] != 2) || check(&s, 1) || check(&s, 2))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_live.txt");
+	return(-1);
+}
+
+static int test_shared(void)
+{
+	struct aquarea_state s;
+	int i, fd;
+
+	printf(COLOR_BLUE " * Live : shared serialization " COLOR_NONE);
+
+	log_start("/tmp/ut_log_live.txt");
+
+	client_reset();
+	snapshot_init();
+	live_init();
+	memset(&s, 0, sizeof(struct aquarea_state));
+	frame(&s);
+
+	for (fd = 1; fd <= LIVE_MAX_CLIENTS; fd++)
+		if (live_add(fd) != 0)
+			goto error;
+	live_process();
+
+	for (i = 0; i < 20; i++)
+	{
+		frame(&s);
+		live_process();
+		/* All clients receive the same buffer, not a copy per client */
+		for (fd = 2; fd <= LIVE_MAX_CLIENTS; fd++)
+		{
+			if (client_last[fd] != client_last[1])
+			{
+				printf("Client %d: not the same buffer\n", fd);
+				goto error;
+			}
+		}
+	}
+	for (fd = 1; fd <= LIVE_MAX_CLIENTS; fd++)
+	{
+		if ((client_count[fd] != 21) || check(&s, fd))
+			goto error;
+	}
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_live.txt");
+	return(-1);
+}
+
+static int test_slow(void)
+{
+	struct aquarea_state s;
+	int i;
+
+	printf(COLOR_BLUE " * Live : slow clients " COLOR_NONE);
+
+	log_start("/tmp/ut_log_live.txt");
+
+	client_reset();
+	snapshot_init();
+	live_init();
+	memset(&s, 0, sizeof(struct aquarea_state));
+	frame(&s);
+	live_add(1);
+	live_add(2);
+	live_process();
+
+	/* Short lag : missed deltas are sent when the client is back */
+	client_busy[2] = 1;
+	for (i = 0; i < (LIVE_RING / 2); i++)
+	{
+		frame(&s);
+		live_process();
+	}
+	if ((client_count[1] != (1 + LIVE_RING / 2)) || (client_count[2] != 1))
+		goto error;
+	client_busy[2] = 0;
+	frame(&s);
+	live_process();
+	printf("short lag: %d messages, %d full\n", client_count[2], client_full[2]);
+	if ((client_count[2] != client_count[1]) || (client_full[2] != 1))
+		goto error;
+	if (check(&s, 1) || check(&s, 2))
+		goto error;
+
+	/* Long lag : deltas are dropped, one full state is sent instead */
+	client_busy[2] = 1;
+	for (i = 0; i < (LIVE_RING * 10); i++)
+	{
+		frame(&s);
+		live_process();
+		if (check(&s, 1))
+			goto error;
+	}
+	client_busy[2] = 0;
+	i = client_count[2];
+	frame(&s);
+	live_process();
+	printf("long lag: %d messages, %d full\n", client_count[2] - i, client_full[2]);
+	if ((client_count[2] - i) != 1)
+		goto error;
+	if ((client_full[2] != 2) || check(&s, 2))
+		goto error;
+
+	/* Then deltas again */
+	frame(&s);
+	live_process();
+	if ((client_full[2] != 2) || check(&s, 1) || check(&s, 2))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_live.txt");
+	return(-1);
+}
+
+static int test_clients(void)
+{
+	struct aquarea_state s;
+	int fd;
+
+	printf(COLOR_BLUE " * Live : client limit and errors " COLOR_NONE);
+
+	log_start("/tmp/ut_log_live.txt");
+
+	client_reset();
+	snapshot_init();
+	live_init();
+	memset(&s, 0, sizeof(struct aquarea_state));
+	frame(&s);
+
+	for (fd = 1; fd <= LIVE_MAX_CLIENTS; fd++)
+		if (live_add(fd) != 0)
+			goto error;
+	if (live_add(fd) == 0)
+		goto error;
+	live_process();
+
+	/* A broken client is removed, others continue */
+	client_fail[1] = 1;
+	frame(&s);
+	live_process();
+	client_fail[1] = 0;
+	frame(&s);
+	live_process();
+	if ((client_count[1] != 1) || (client_count[2] != 3))
+		goto error;
+
+	/* Its slot can be used again */
+	if (live_add(fd) != 0)
+		goto error;
+	/* A disconnected client receives nothing */
+	live_remove(2);
+	frame(&s);
+	live_process();
+	if ((client_count[2] != 3) || (client_count[fd] != 1) || check(&s, fd))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_live.txt");
+	return(-1);
+}
+
+/**
+ * @brief Simulate a new frame (some fields changed)
+ *
+ * @param s Pointer to the state to update
+ */
+static void frame(struct aquarea_state *s)
+{
+	s->seq++;
+	s->time = 1640995200 + (s->seq * 5);
+	s->value[s->seq % AQ_FIELD_COUNT] += 1;
+	s->value[AQ_OUTSIDE_TEMP] = (s->seq & 7) - 3;
+	/* Same order as aquarea_rx() */
+	snapshot_update(s);
+	live_push(s);
+}
+
+/**
+ * @brief Compare the values known by a client with a state
+ *
+ * @param s  Pointer to the reference state
+ * @param fd Socket of the client
+ * @return integer Zero if values are the same, -1 if not
+ */
+static int check(struct aquarea_state *s, int fd)
+{
+	int i;
+
+	if (client_seq[fd] != s->seq)
+	{
+		printf("Client %d: seq %u, expected %u\n", fd, client_seq[fd], s->seq);
+		return(-1);
+	}
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		if (client_value[fd][i] != s->value[i])
+		{
+			printf("Client %d: %s=%d, expected %d\n", fd,
+			       aquarea_state_name(i), client_value[fd][i], s->value[i]);
+			return(-1);
+		}
+	}
+	return(0);
+}
+/* EOF */
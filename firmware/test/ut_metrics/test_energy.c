@@ -0,0 +1,182 @@
+/**
+ * @file  test_energy.c
+ * @brief Some tests to verify COP and energy integrators
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "metrics.h"
+#include "log.h"
+
+/* Functions for each sub-test */
+static int test_constant(void);
+static int test_gap(void);
+static int test_steps(void);
+static void frame(struct aquarea_state *s, uint32_t time, int prod, int cons);
+
+static struct metrics m;
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_energy(void)
+{
+	int result = 0;
+
+	/* One hour with constant power */
+	if (test_constant())
+		result = -1;
+	/* Missing frames must not be integrated */
+	if (test_gap())
+		result = -1;
+	/* Variable power, compared with a direct computation */
+	if (test_steps())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_constant(void)
+{
+	struct aquarea_state s;
+	int i;
+
+	printf(COLOR_BLUE " * Energy : constant power during one hour " COLOR_NONE);
+
+	log_start("/tmp/ut_log_metrics.txt");
+
+	metrics_init(&m);
+	/* One frame every 5 seconds, 720 intervals */
+	for (i = 0; i <= 720; i++)
+		frame(&s, 1640995200 + (i * 5), 2000, 500);
+
+	printf("prod=%d Wh cons=%d Wh cop=%d cop_1h=%d\n",
+	       s.value[AQ_ENERGY_PROD], s.value[AQ_ENERGY_CONS],
+	       s.value[AQ_COP], s.value[AQ_COP_1H]);
+	if ((s.value[AQ_ENERGY_PROD] != 2000) || (s.value[AQ_ENERGY_CONS] != 500))
+		goto error;
+	if ((s.value[AQ_POWER_PROD] != 2000) || (s.value[AQ_POWER_CONS] != 500))
+		goto error;
+	if ((s.value[AQ_COP] != 400) || (s.value[AQ_COP_1M] != 400) ||
+	    (s.value[AQ_COP_15M] != 400) || (s.value[AQ_COP_1H] != 400))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_metrics.txt");
+	return(-1);
+}
+
+static int test_gap(void)
+{
+	struct aquarea_state s;
+
+	printf(COLOR_BLUE " * Energy : missing frames " COLOR_NONE);
+
+	log_start("/tmp/ut_log_metrics.txt");
+
+	metrics_init(&m);
+	frame(&s, 1000, 3600, 1800);
+	/* 1000 seconds without frame, only METRICS_MAX_GAP are integrated */
+	frame(&s, 2000, 0, 0);
+	if ((s.value[AQ_ENERGY_PROD] != 60) || (s.value[AQ_ENERGY_CONS] != 30))
+		goto error;
+	/* Clock set backward, nothing integrated */
+	frame(&s, 1500, 3600, 1800);
+	frame(&s, 1400, 3600, 1800);
+	if (s.value[AQ_ENERGY_PROD] != 60)
+		goto error;
+	/* COP without consumption */
+	if (s.value[AQ_COP] != 200)
+		goto error;
+	frame(&s, 1410, 1000, 0);
+	if (s.value[AQ_COP] != 0)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_metrics.txt");
+	return(-1);
+}
+
+static int test_steps(void)
+{
+	struct aquarea_state s;
+	uint64_t joule = 0;
+	uint32_t t = 1640995200;
+	int i, prod = 0;
+
+	printf(COLOR_BLUE " * Energy : variable power, one week " COLOR_NONE);
+
+	log_start("/tmp/ut_log_metrics.txt");
+
+	metrics_init(&m);
+	for (i = 0; i < (7 * 24 * 720); i++)
+	{
+		frame(&s, t, prod, 200);
+		/* Power of the previous frame during the interval */
+		t += 3 + (i % 5);
+		joule += (uint64_t)prod * (3 + (i % 5));
+		prod = ((i / 37) % 9) * 200;
+	}
+	frame(&s, t, prod, 200);
+	printf("%d Wh, expected %d Wh\n", s.value[AQ_ENERGY_PROD], (int)(joule / 3600));
+	if (s.value[AQ_ENERGY_PROD] != (int32_t)(joule / 3600))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_metrics.txt");
+	return(-1);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Process a frame with specified powers (split between heat and DHW)
+ *
+ * @param s    Pointer to a state structure
+ * @param time Timestamp of the frame
+ * @param prod Power produced (W)
+ * @param cons Power consumed (W)
+ */
+static void frame(struct aquarea_state *s, uint32_t time, int prod, int cons)
+{
+	memset(s, 0, sizeof(struct aquarea_state));
+	s->time = time;
+	s->value[AQ_HEAT_POWER_PROD] = prod / 2;
+	s->value[AQ_DHW_POWER_PROD]  = prod - (prod / 2);
+	s->value[AQ_HEAT_POWER_CONS] = cons;
+	metrics_update(&m, s);
+}
+/* EOF */
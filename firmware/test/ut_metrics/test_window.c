@@ -0,0 +1,190 @@
+/**
+ * @file  test_window.c
+ * @brief Some tests to verify sliding window aggregates
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "metrics.h"
+#include "log.h"
+
+#define SAMPLES 20000
+
+/* Functions for each sub-test */
+static int test_compare(void);
+static int test_query(void);
+static int check(int count, int first);
+
+static struct metrics m;
+static uint32_t s_time[SAMPLES];
+static int32_t  s_value[SAMPLES];
+
+/* Duration of one bucket (sec.) for each window */
+static const int period[METRICS_WIN_COUNT] = { 5, 75, 300 };
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_window(void)
+{
+	int result = 0;
+
+	/* Compare with a direct computation over all samples */
+	if (test_compare())
+		result = -1;
+	/* Query of a field without aggregates */
+	if (test_query())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_compare(void)
+{
+	struct aquarea_state s;
+	uint32_t t = 1640995200;
+	int i, first = 0;
+
+	printf(COLOR_BLUE " * Window : compare with direct computation " COLOR_NONE);
+
+	log_start("/tmp/ut_log_metrics.txt");
+
+	srand(1234);
+	metrics_init(&m);
+	for (i = 0; i < SAMPLES; i++)
+	{
+		/* Irregular interval, some long gaps and one clock change */
+		if ((i % 5000) == 4999)
+			t += 5000;
+		else if (i == 12000)
+		{
+			t -= 100000;
+			first = i;
+		}
+		else
+			t += 1 + (rand() % 9);
+
+		memset(&s, 0, sizeof(s));
+		s.time = t;
+		s.value[AQ_OUTSIDE_TEMP] = (rand() % 60) - 20;
+		metrics_update(&m, &s);
+		s_time[i]  = t;
+		s_value[i] = s.value[AQ_OUTSIDE_TEMP];
+
+		if (check(i + 1, first))
+		{
+			printf("Sample %d: aggregates differ\n", i);
+			goto error;
+		}
+	}
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_metrics.txt");
+	return(-1);
+}
+
+static int test_query(void)
+{
+	struct metrics_agg agg;
+
+	printf(COLOR_BLUE " * Window : query " COLOR_NONE);
+
+	log_start("/tmp/ut_log_metrics.txt");
+
+	if (metrics_window(&m, AQ_ERROR, METRICS_1M, &agg) != -1)
+		goto error;
+	if (metrics_window(&m, AQ_OUTSIDE_TEMP, METRICS_WIN_COUNT, &agg) != -1)
+		goto error;
+	if ((metrics_field(0) < 0) || (metrics_field(METRICS_TRACK_COUNT) != -1))
+		goto error;
+	if (strcmp(metrics_window_name(METRICS_15M), "15m") != 0)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_metrics.txt");
+	return(-1);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Compare aggregates of all windows with a direct computation
+ *
+ * A window contains samples of the current bucket and of the 11 previous
+ * ones (buckets aligned on multiples of the period).
+ *
+ * @param count Number of samples inserted
+ * @param first Index of the first sample after the clock change
+ * @return integer Zero is returned on success, -1 on error
+ */
+static int check(int count, int first)
+{
+	struct metrics_agg agg;
+	int32_t min, max, avg, sum;
+	uint32_t index;
+	int i, w, n;
+
+	for (w = 0; w < METRICS_WIN_COUNT; w++)
+	{
+		index = s_time[count - 1] / period[w];
+		n = 0;
+		sum = 0;
+		min = max = 0;
+		for (i = first; i < count; i++)
+		{
+			if ((s_time[i] / period[w]) + METRICS_BUCKETS <= index)
+				continue;
+			if ((n == 0) || (s_value[i] < min))
+				min = s_value[i];
+			if ((n == 0) || (s_value[i] > max))
+				max = s_value[i];
+			sum += s_value[i];
+			n++;
+		}
+		if (sum >= 0)
+			avg = (sum + (n / 2)) / n;
+		else
+			avg = (sum - (n / 2)) / n;
+
+		if (metrics_window(&m, AQ_OUTSIDE_TEMP, w, &agg))
+			return(-1);
+		if ((agg.count != n) || (agg.min != min) ||
+		    (agg.max != max) || (agg.avg != avg))
+		{
+			printf("Window %s: count %d/%d min %d/%d max %d/%d avg %d/%d\n",
+			       metrics_window_name(w), agg.count, n, agg.min, min,
+			       agg.max, max, agg.avg, avg);
+			return(-1);
+		}
+	}
+	return(0);
+}
+/* EOF */
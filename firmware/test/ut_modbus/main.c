@@ -0,0 +1,113 @@
+/**
+ * @file  main.c
+ * @brief Entry point of this unit-test
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aquarea.h"
+#include "log.h"
+
+#define SET_MAX 16
+
+/* Declare functions for each group of tests */
+int  test_read(void);
+int  test_write(void);
+
+static void usage(char *appname);
+
+/* Commands received by the simulated command path */
+const int set_max = SET_MAX;
+int     set_busy;
+int     set_count;
+int     set_field[SET_MAX];
+int32_t set_value[SET_MAX];
+
+/**
+ * @brief Entry point of this unit-test
+ *
+ * @param argc Number or command line arguments
+ * @param argv Array of string with command line arguments
+ * @return integer Zero is returned on success, -1 for error
+ */
+int main(int argc, char **argv)
+{
+	int test_num;
+	int result = 0;
+
+	if (argc < 2)
+	{
+		usage(argv[0]);
+		return(-1);
+	}
+
+	log_init();
+
+	test_num = atoi(argv[1]);
+
+	if ((test_num == 1) || (test_num == 0))
+	{
+		if (test_read() != 0)
+			result = -1;
+	}
+	if ((test_num == 2) || (test_num == 0))
+	{
+		if (test_write() != 0)
+			result = -1;
+	}
+
+	return(result);
+}
+
+/**
+ * @brief Hook used by Modbus module to send set commands (simulated)
+ *
+ * @param list  Pointer to the commands
+ * @param count Number of commands
+ * @return integer Zero on success, -1 if invalid, -2 if busy
+ */
+int aquarea_set_list(const struct aquarea_cmd *list, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		if (aquarea_state_encode(NULL, list[i].field, list[i].value))
+			return(-1);
+	}
+	/* Like the real command queue, all commands or none */
+	if (set_busy || ((set_count + count) > SET_MAX))
+		return(-2);
+	for (i = 0; i < count; i++)
+	{
+		set_field[set_count] = list[i].field;
+		set_value[set_count] = list[i].value;
+		set_count++;
+	}
+	return(0);
+}
+
+/**
+ * @brief Print an help message about command line arguments
+ *
+ */
+static void usage(char *appname)
+{
+	printf("Usage %s <test_num>\n", appname);
+	printf("  where test_num can be:\n");
+	printf("    0: Run all tests\n");
+	printf("    1: Test register reads and framing\n");
+	printf("    2: Test register writes (command path)\n");
+}
+/* EOF */
@@ -0,0 +1,280 @@
+/**
+ * @file  test_read.c
+ * @brief Some tests to verify register reads and Modbus TCP framing
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "modbus_pdu.h"
+#include "log.h"
+
+extern int set_count;
+
+/* Functions for each sub-test */
+static int test_map(void);
+static int test_errors(void);
+static int test_framing(void);
+static void make_state(struct aquarea_state *s);
+static size_t make_read(uint8_t *req, uint16_t tid, uint8_t fc, uint16_t addr, uint16_t count);
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_read(void)
+{
+	int result = 0;
+
+	/* Registers are a view of the state */
+	if (test_map())
+		result = -1;
+	/* Invalid requests */
+	if (test_errors())
+		result = -1;
+	/* Partial and pipelined requests */
+	if (test_framing())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_map(void)
+{
+	struct aquarea_state s;
+	uint8_t req[MODBUS_ADU_SIZE];
+	uint8_t rsp[MODBUS_ADU_SIZE];
+	size_t len, used;
+	int32_t v, ref;
+	int i, r;
+
+	printf(COLOR_BLUE " * Read : register map " COLOR_NONE);
+
+	log_start("/tmp/ut_log_modbus.txt");
+
+	make_state(&s);
+	set_count = 0;
+
+	/* 16 bits values, with holding and input registers */
+	len = make_read(req, 0x1234, MODBUS_READ_INPUT, MODBUS_REG_VALUE, AQ_FIELD_COUNT);
+	r = modbus_adu(&s, req, len, rsp, &used);
+	if ((r != (9 + AQ_FIELD_COUNT * 2)) || (used != len))
+		goto error;
+	if ((rsp[0] != 0x12) || (rsp[1] != 0x34) || (rsp[6] != 0x11) ||
+	    (rsp[7] != MODBUS_READ_INPUT) || (rsp[8] != (AQ_FIELD_COUNT * 2)) ||
+	    (((rsp[4] << 8) | rsp[5]) != (r - 6)))
+		goto error;
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		v = (int16_t)((rsp[9 + i * 2] << 8) | rsp[10 + i * 2]);
+		ref = s.value[i];
+		if (ref > 32767)  ref = 32767;
+		if (ref < -32768) ref = -32768;
+		if (v != ref)
+		{
+			printf("Register %d: %d, expected %d\n", i, v, ref);
+			goto error;
+		}
+	}
+	len = make_read(req, 1, MODBUS_READ_HOLDING, MODBUS_REG_VALUE, AQ_FIELD_COUNT);
+	if ((modbus_adu(&s, req, len, rsp + 128, &used) != r) ||
+	    memcmp(rsp + 8, rsp + 128 + 8, r - 8))
+		goto error;
+
+	/* 32 bits values */
+	len = make_read(req, 2, MODBUS_READ_INPUT, MODBUS_REG_VALUE32, AQ_FIELD_COUNT * 2);
+	r = modbus_adu(&s, req, len, rsp, &used);
+	if (r != (9 + AQ_FIELD_COUNT * 4))
+		goto error;
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		v = (rsp[9 + i * 4] << 24) | (rsp[10 + i * 4] << 16) |
+		    (rsp[11 + i * 4] << 8) | rsp[12 + i * 4];
+		if (v != s.value[i])
+		{
+			printf("Register32 %d: %d, expected %d\n", i, v, s.value[i]);
+			goto error;
+		}
+	}
+
+	/* Frame number and timestamp */
+	len = make_read(req, 3, MODBUS_READ_INPUT, MODBUS_REG_INFO, 4);
+	if (modbus_adu(&s, req, len, rsp, &used) != 17)
+		goto error;
+	if ((((uint32_t)rsp[9] << 24 | rsp[10] << 16 | rsp[11] << 8 | rsp[12]) != s.seq) ||
+	    (((uint32_t)rsp[13] << 24 | rsp[14] << 16 | rsp[15] << 8 | rsp[16]) != s.time))
+		goto error;
+
+	/* Reads never use the command path */
+	if (set_count != 0)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_modbus.txt");
+	return(-1);
+}
+
+static int test_errors(void)
+{
+	struct aquarea_state s;
+	uint8_t req[MODBUS_ADU_SIZE];
+	uint8_t rsp[MODBUS_ADU_SIZE];
+	size_t len, used;
+
+	printf(COLOR_BLUE " * Read : exceptions " COLOR_NONE);
+
+	log_start("/tmp/ut_log_modbus.txt");
+
+	make_state(&s);
+
+	/* Hole into the register map */
+	len = make_read(req, 1, MODBUS_READ_INPUT, AQ_FIELD_COUNT - 1, 2);
+	if ((modbus_adu(&s, req, len, rsp, &used) != 9) ||
+	    (rsp[7] != (0x80 | MODBUS_READ_INPUT)) || (rsp[8] != MODBUS_EX_ADDRESS) ||
+	    (rsp[5] != 3) || (used != len))
+		goto error;
+	/* Invalid quantities */
+	len = make_read(req, 1, MODBUS_READ_HOLDING, 0, 0);
+	if ((modbus_adu(&s, req, len, rsp, &used) != 9) || (rsp[8] != MODBUS_EX_VALUE))
+		goto error;
+	len = make_read(req, 1, MODBUS_READ_HOLDING, 0, 126);
+	if ((modbus_adu(&s, req, len, rsp, &used) != 9) || (rsp[8] != MODBUS_EX_VALUE))
+		goto error;
+	/* Address overflow must not wrap to register 0 */
+	len = make_read(req, 1, MODBUS_READ_HOLDING, 0xFFFF, 2);
+	if ((modbus_adu(&s, req, len, rsp, &used) != 9) || (rsp[8] != MODBUS_EX_ADDRESS))
+		goto error;
+	/* Unknown function */
+	len = make_read(req, 1, 0x2B, 0, 1);
+	if ((modbus_adu(&s, req, len, rsp, &used) != 9) ||
+	    (rsp[7] != 0xAB) || (rsp[8] != MODBUS_EX_FUNCTION))
+		goto error;
+	/* Bad protocol identifier, bad length : connection must be closed */
+	len = make_read(req, 1, MODBUS_READ_INPUT, 0, 1);
+	req[3] = 1;
+	if (modbus_adu(&s, req, len, rsp, &used) != -1)
+		goto error;
+	req[3] = 0;
+	req[4] = 1;
+	if (modbus_adu(&s, req, len, rsp, &used) != -1)
+		goto error;
+	req[4] = 0;
+	req[5] = 7;
+	if (modbus_adu(&s, req, MODBUS_ADU_SIZE, rsp, &used) != -1)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_modbus.txt");
+	return(-1);
+}
+
+static int test_framing(void)
+{
+	struct aquarea_state s;
+	uint8_t req[MODBUS_ADU_SIZE];
+	uint8_t rsp[MODBUS_ADU_SIZE];
+	size_t len, used, i;
+
+	printf(COLOR_BLUE " * Read : partial and pipelined requests " COLOR_NONE);
+
+	log_start("/tmp/ut_log_modbus.txt");
+
+	make_state(&s);
+
+	/* Received byte by byte : nothing until complete */
+	len = make_read(req, 7, MODBUS_READ_INPUT, 0, 4);
+	for (i = 0; i < len; i++)
+	{
+		if ((modbus_adu(&s, req, i, rsp, &used) != 0) || (used != 0))
+			goto error;
+	}
+	if ((modbus_adu(&s, req, len, rsp, &used) != 17) || (used != len))
+		goto error;
+
+	/* Two requests into the same buffer */
+	len  = make_read(req, 8, MODBUS_READ_INPUT, 0, 1);
+	len += make_read(req + len, 9, MODBUS_READ_INPUT, 1, 1);
+	if ((modbus_adu(&s, req, len, rsp, &used) != 11) || (used != 12) || (rsp[1] != 8))
+		goto error;
+	if ((modbus_adu(&s, req + used, len - used, rsp, &used) != 11) ||
+	    (used != 12) || (rsp[1] != 9))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_modbus.txt");
+	return(-1);
+}
+
+/**
+ * @brief Make a state with various values (including large ones)
+ *
+ * @param s Pointer to the state to fill
+ */
+static void make_state(struct aquarea_state *s)
+{
+	int i;
+
+	s->seq  = 0x12345;
+	s->time = 1640995200;
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+		s->value[i] = (i & 1) ? (i * 3) : -(i * 5);
+	s->value[AQ_ENERGY_PROD] = 123456;
+	s->value[AQ_ENERGY_CONS] = -40000;
+}
+
+/**
+ * @brief Make a read request
+ *
+ * @param req   Pointer to a buffer for the request
+ * @param tid   Transaction identifier
+ * @param fc    Function code
+ * @param addr  Address of the first register
+ * @param count Number of registers
+ * @return size_t Length of the request
+ */
+static size_t make_read(uint8_t *req, uint16_t tid, uint8_t fc, uint16_t addr, uint16_t count)
+{
+	req[0]  = tid >> 8;
+	req[1]  = tid & 0xFF;
+	req[2]  = 0;
+	req[3]  = 0;
+	req[4]  = 0;
+	req[5]  = 6;
+	req[6]  = 0x11;
+	req[7]  = fc;
+	req[8]  = addr >> 8;
+	req[9]  = addr & 0xFF;
+	req[10] = count >> 8;
+	req[11] = count & 0xFF;
+	return(12);
+}
+/* EOF */
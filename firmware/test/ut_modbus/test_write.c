@@ -0,0 +1,347 @@
+/**
+ * @file  test_write.c
+ * @brief Some tests to verify register writes (command path)
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "modbus_pdu.h"
+#include "log.h"
+
+/* Simulated command path, see main.c */
+extern const int set_max;
+extern int     set_busy;
+extern int     set_count;
+extern int     set_field[];
+extern int32_t set_value[];
+
+/* Functions for each sub-test */
+static int test_single(void);
+static int test_multiple(void);
+static int test_encode(void);
+static int test_status(void);
+static int write_single(uint16_t addr, int16_t value);
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_write(void)
+{
+	int result = 0;
+
+	/* Function 6, write single register */
+	if (test_single())
+		result = -1;
+	/* Function 16, write multiple registers */
+	if (test_multiple())
+		result = -1;
+	/* Set command packet content */
+	if (test_encode())
+		result = -1;
+	/* Status packet made from the list of fields */
+	if (test_status())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_single(void)
+{
+	printf(COLOR_BLUE " * Write : single register " COLOR_NONE);
+
+	log_start("/tmp/ut_log_modbus.txt");
+
+	set_count = 0;
+	set_busy  = 0;
+
+	if (write_single(MODBUS_REG_VALUE + AQ_DHW_TARGET_TEMP, 50) != 0)
+		goto error;
+	if (write_single(MODBUS_REG_VALUE + AQ_DHW_TARGET_TEMP, -10) != 0)
+		goto error;
+	if (write_single(MODBUS_REG_VALUE + AQ_HP_STATE, 1) != 0)
+		goto error;
+	if ((set_count != 3) ||
+	    (set_field[0] != AQ_DHW_TARGET_TEMP) || (set_value[0] != 50) ||
+	    (set_field[1] != AQ_DHW_TARGET_TEMP) || (set_value[1] != -10) ||
+	    (set_field[2] != AQ_HP_STATE) || (set_value[2] != 1))
+		goto error;
+
+	/* Read-only fields, registers out of the map */
+	if (write_single(MODBUS_REG_VALUE + AQ_INLET_TEMP, 30) != MODBUS_EX_ADDRESS)
+		goto error;
+	if (write_single(MODBUS_REG_VALUE + AQ_COP, 300) != MODBUS_EX_ADDRESS)
+		goto error;
+	if (write_single(MODBUS_REG_VALUE32, 1) != MODBUS_EX_ADDRESS)
+		goto error;
+	/* Invalid values */
+	if (write_single(MODBUS_REG_VALUE + AQ_HP_STATE, 2) != MODBUS_EX_VALUE)
+		goto error;
+	if (write_single(MODBUS_REG_VALUE + AQ_QUIET_MODE, -1) != MODBUS_EX_VALUE)
+		goto error;
+	/* Too many pending commands */
+	set_busy = 1;
+	if (write_single(MODBUS_REG_VALUE + AQ_QUIET_MODE, 2) != MODBUS_EX_BUSY)
+		goto error;
+	set_busy = 0;
+	if (set_count != 3)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_modbus.txt");
+	return(-1);
+}
+
+static int test_multiple(void)
+{
+	struct aquarea_state s;
+	uint8_t req[MODBUS_ADU_SIZE];
+	uint8_t rsp[MODBUS_ADU_SIZE];
+	size_t used;
+	int r;
+
+	printf(COLOR_BLUE " * Write : multiple registers " COLOR_NONE);
+
+	log_start("/tmp/ut_log_modbus.txt");
+
+	memset(&s, 0, sizeof(struct aquarea_state));
+	set_count = 0;
+
+	/* force_dhw and operating_mode */
+	memcpy(req, "\x00\x05\x00\x00\x00\x0B\x01\x10\x00\x02\x00\x02\x04\x00\x01\x00\x12", 17);
+	r = modbus_adu(&s, req, 17, rsp, &used);
+	if ((r != 12) || (used != 17) || memcmp(rsp, "\x00\x05\x00\x00\x00\x06\x01\x10\x00\x02\x00\x02", 12))
+		goto error;
+	if ((set_count != 2) ||
+	    (set_field[0] != AQ_FORCE_DHW) || (set_value[0] != 1) ||
+	    (set_field[1] != AQ_OPERATING_MODE) || (set_value[1] != 0x12))
+		goto error;
+
+	/* One invalid value : nothing is written */
+	set_count = 0;
+	req[14] = 3;
+	r = modbus_adu(&s, req, 17, rsp, &used);
+	if ((r != 9) || (rsp[7] != 0x90) || (rsp[8] != MODBUS_EX_VALUE) || (set_count != 0))
+		goto error;
+	/* One read-only register : nothing is written */
+	memcpy(req, "\x00\x06\x00\x00\x00\x0B\x01\x10\x00\x00\x00\x02\x04\x00\x01\x00\x01", 17);
+	r = modbus_adu(&s, req, 17, rsp, &used);
+	if ((r != 9) || (rsp[8] != MODBUS_EX_ADDRESS) || (set_count != 0))
+		goto error;
+	/* Room for only one command : nothing is written */
+	memcpy(req, "\x00\x07\x00\x00\x00\x0B\x01\x10\x00\x02\x00\x02\x04\x00\x01\x00\x12", 17);
+	set_count = set_max - 1;
+	r = modbus_adu(&s, req, 17, rsp, &used);
+	if ((r != 9) || (rsp[8] != MODBUS_EX_BUSY) || (set_count != (set_max - 1)))
+		goto error;
+	set_count = 0;
+	/* Byte count does not match quantity */
+	req[12] = 2;
+	req[5]  = 9;
+	r = modbus_adu(&s, req, 15, rsp, &used);
+	if ((r != 9) || (rsp[8] != MODBUS_EX_VALUE) || (set_count != 0))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_modbus.txt");
+	return(-1);
+}
+
+static int test_encode(void)
+{
+	struct aquarea_state s;
+	uint8_t pkt[260];
+	int i, count;
+
+	printf(COLOR_BLUE " * Write : set command packet " COLOR_NONE);
+
+	log_start("/tmp/ut_log_modbus.txt");
+
+	/* Settings only */
+	count = 0;
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		if (aquarea_state_writable(i))
+		{
+			printf("writable: %s\n", aquarea_state_name(i));
+			count++;
+		}
+	}
+	if ((count != 6) || ! aquarea_state_writable(AQ_HP_STATE) ||
+	    ! aquarea_state_writable(AQ_FORCE_DHW) ||
+	    ! aquarea_state_writable(AQ_OPERATING_MODE) ||
+	    ! aquarea_state_writable(AQ_QUIET_MODE) ||
+	    ! aquarea_state_writable(AQ_DHW_TARGET_TEMP) ||
+	    ! aquarea_state_writable(AQ_Z1_HEAT_REQUEST))
+		goto error;
+
+	/* Set command uses the same encoding than status : decode it back */
+	memset(pkt, 0, sizeof(pkt));
+	aquarea_state_request(pkt, AQUAREA_COMMAND);
+	if ((pkt[0] != 0xF1) || (pkt[1] != 108) || (pkt[2] != 0x01) ||
+	    (pkt[3] != 0x10))
+		goto error;
+	if (aquarea_state_encode(pkt, AQ_HP_STATE, 1) ||
+	    aquarea_state_encode(pkt, AQ_FORCE_DHW, 0) ||
+	    aquarea_state_encode(pkt, AQ_FORCE_DHW, 1) ||
+	    aquarea_state_encode(pkt, AQ_OPERATING_MODE, 0x52) ||
+	    aquarea_state_encode(pkt, AQ_QUIET_MODE, 2) ||
+	    aquarea_state_encode(pkt, AQ_DHW_TARGET_TEMP, -5))
+		goto error;
+	if (aquarea_state_encode(pkt, AQ_OUTLET_TEMP, 1) == 0)
+		goto error;
+	/* Other bytes are left to zero (no change) */
+	for (i = 8; i < 260; i++)
+	{
+		if ((i != 42) && pkt[i])
+			goto error;
+	}
+	printf("byte 4: %.2X, byte 7: %.2X, byte 42: %.2X\n", pkt[4], pkt[7], pkt[42]);
+
+	pkt[0] = 0x71;
+	memset(&s, 0, sizeof(struct aquarea_state));
+	if (aquarea_state_decode(&s, pkt, 260))
+		goto error;
+	if ((s.value[AQ_HP_STATE] != 1) || (s.value[AQ_FORCE_DHW] != 1) ||
+	    (s.value[AQ_OPERATING_MODE] != 0x52) || (s.value[AQ_QUIET_MODE] != 2) ||
+	    (s.value[AQ_DHW_TARGET_TEMP] != -5))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_modbus.txt");
+	return(-1);
+}
+
+static int test_status(void)
+{
+	struct aquarea_state in, out;
+	uint8_t pkt[AQUAREA_STATUS_LEN];
+	int i, j;
+
+	printf(COLOR_BLUE " * Write : status packet round trip " COLOR_NONE);
+
+	log_start("/tmp/ut_log_modbus.txt");
+
+	/* Values that each encoding can store without rounding */
+	memset(&in, 0, sizeof(struct aquarea_state));
+	in.value[AQ_HP_STATE]        = 1;
+	in.value[AQ_PUMP_FLOW]       = 1850;
+	in.value[AQ_FORCE_DHW]       = 1;
+	in.value[AQ_OPERATING_MODE]  = 0x52;
+	in.value[AQ_INLET_TEMP]      = 31;
+	in.value[AQ_OUTLET_TEMP]     = 35;
+	in.value[AQ_TARGET_TEMP]     = 36;
+	in.value[AQ_COMPRESSOR_FREQ] = 45;
+	in.value[AQ_DHW_TARGET_TEMP] = 50;
+	in.value[AQ_DHW_TEMP]        = 48;
+	in.value[AQ_OUTSIDE_TEMP]    = -12;
+	in.value[AQ_Z1_WATER_TEMP]   = 34;
+	in.value[AQ_HEAT_POWER_PROD] = 4200;
+	in.value[AQ_HEAT_POWER_CONS] = 1000;
+	in.value[AQ_DHW_POWER_PROD]  = 200;
+	in.value[AQ_DHW_POWER_CONS]  = 0;
+	in.value[AQ_DEFROST]         = 1;
+	in.value[AQ_QUIET_MODE]      = 2;
+	in.value[AQ_ERROR]           = 0x4801;
+	in.value[AQ_Z1_HEAT_REQUEST] = -3;
+
+	memset(pkt, 0, sizeof(pkt));
+	pkt[0] = AQUAREA_QUERY;
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+		aquarea_state_pack(pkt, i, in.value[i]);
+	memset(&out, 0, sizeof(struct aquarea_state));
+	if (aquarea_state_decode(&out, pkt, sizeof(pkt)))
+		goto error;
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		if (out.value[i] != in.value[i])
+		{
+			printf("%s: %d, expected %d\n", aquarea_state_name(i),
+			       (int)out.value[i], (int)in.value[i]);
+			goto error;
+		}
+	}
+	if (out.seq != 1)
+		goto error;
+
+	/* Names are unique */
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		for (j = i + 1; j < AQ_FIELD_COUNT; j++)
+		{
+			if (strcmp(aquarea_state_name(i), aquarea_state_name(j)) == 0)
+				goto error;
+		}
+	}
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_modbus.txt");
+	return(-1);
+}
+
+/**
+ * @brief Send a write single register request
+ *
+ * @param addr  Address of the register
+ * @param value New value
+ * @return integer Zero on success, exception code, or -1 on bad response
+ */
+static int write_single(uint16_t addr, int16_t value)
+{
+	struct aquarea_state s;
+	uint8_t req[12];
+	uint8_t rsp[MODBUS_ADU_SIZE];
+	size_t used;
+	int r;
+
+	memset(&s, 0, sizeof(struct aquarea_state));
+	memcpy(req, "\x00\x01\x00\x00\x00\x06\x01\x06", 8);
+	req[8]  = addr >> 8;
+	req[9]  = addr & 0xFF;
+	req[10] = (uint16_t)value >> 8;
+	req[11] = value & 0xFF;
+
+	r = modbus_adu(&s, req, 12, rsp, &used);
+	if ((r == 12) && (memcmp(req, rsp, 12) == 0))
+		return(0);
+	if ((r == 9) && (rsp[7] == 0x86))
+		return(rsp[8]);
+	return(-1);
+}
+/* EOF */
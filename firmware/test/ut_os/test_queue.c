@@ -0,0 +1,250 @@
+/**
+ * @file  test_queue.c
+ * @brief Some tests to verify queues of the OS layer (POSIX backend)
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include "os.h"
+#include "log.h"
+
+#define THREAD_COUNT 100000
+
+/* Functions for each sub-test */
+static int  test_fifo(void);
+static int  test_timeout(void);
+static int  test_thread(void);
+static int  test_static(void);
+static void producer(void *arg);
+
+static os_queue_t queue;
+static os_mutex_t lock;
+static volatile int done;
+static volatile uint32_t shared;
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_queue(void)
+{
+	int result = 0;
+
+	/* Order of items, full and empty queue */
+	if (test_fifo())
+		result = -1;
+	/* Timeouts */
+	if (test_timeout())
+		result = -1;
+	/* Tasks exchange items */
+	if (test_thread())
+		result = -1;
+	/* Queue into static memory */
+	if (test_static())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_fifo(void)
+{
+	uint32_t v, n;
+	int i;
+
+	printf(COLOR_BLUE " * Queue : order, full and empty " COLOR_NONE);
+
+	log_start("/tmp/ut_log_os.txt");
+
+	queue = os_queue_create(4, sizeof(uint32_t));
+	if (queue == NULL)
+		goto error;
+	if ((os_queue_count(queue) != 0) || (os_queue_recv(queue, &v, 0) == 0))
+		goto error;
+
+	/* Many rounds, to use all positions of the ring */
+	for (i = 0; i < 10; i++)
+	{
+		for (v = 0; v < 4; v++)
+			if (os_queue_send(queue, &v, 0) != 0)
+				goto error;
+		v = 4;
+		if ((os_queue_send(queue, &v, 0) == 0) || (os_queue_count(queue) != 4))
+			goto error;
+		if ((os_queue_recv(queue, &v, 0) != 0) || (v != 0))
+			goto error;
+		v = 4;
+		if (os_queue_send(queue, &v, 0) != 0)
+			goto error;
+		for (n = 1; n <= 4; n++)
+		{
+			if ((os_queue_recv(queue, &v, 0) != 0) || (v != n))
+				goto error;
+		}
+		if (os_queue_count(queue) != 0)
+			goto error;
+	}
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_os.txt");
+	return(-1);
+}
+
+static int test_static(void)
+{
+	static struct os_queue_static qs, qs1;
+	static uint32_t storage[3], last;
+	os_queue_t q;
+	uint32_t v;
+
+	printf(COLOR_BLUE " * Queue : static storage, overwrite " COLOR_NONE);
+
+	log_start("/tmp/ut_log_os.txt");
+
+	q = os_queue_create_static(3, sizeof(uint32_t), &qs,
+	                           (uint8_t *)storage);
+	if (q == NULL)
+		goto error;
+	for (v = 1; v <= 3; v++)
+		if (os_queue_send(q, &v, 0) != 0)
+			goto error;
+	if (os_queue_send(q, &v, 0) == 0)
+		goto error;
+	/* Items are copied into the buffer given */
+	if ((storage[0] != 1) || (storage[1] != 2) || (storage[2] != 3))
+		goto error;
+	if ((os_queue_recv(q, &v, 0) != 0) || (v != 1) || (os_queue_count(q) != 2))
+		goto error;
+
+	/* Queue of one item, overwrite keeps only the last one */
+	q = os_queue_create_static(1, sizeof(uint32_t), &qs1, (uint8_t *)&last);
+	if (q == NULL)
+		goto error;
+	for (v = 1; v <= 3; v++)
+		os_queue_overwrite(q, &v);
+	if ((os_queue_count(q) != 1) || (os_queue_recv(q, &v, 0) != 0) || (v != 3))
+		goto error;
+	if (os_queue_recv(q, &v, 0) == 0)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_os.txt");
+	return(-1);
+}
+
+static int test_timeout(void)
+{
+	uint32_t t0, t1, v;
+
+	printf(COLOR_BLUE " * Queue : timeouts " COLOR_NONE);
+
+	log_start("/tmp/ut_log_os.txt");
+
+	t0 = os_time_ms();
+	if (os_queue_recv(queue, &v, 50) == 0)
+		goto error;
+	t1 = os_time_ms();
+	printf("recv timeout %u ms\n", t1 - t0);
+	if (((t1 - t0) < 50) || ((t1 - t0) > 500))
+		goto error;
+
+	os_delay(20);
+	if ((os_time_ms() - t1) < 20)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_os.txt");
+	return(-1);
+}
+
+static int test_thread(void)
+{
+	uint32_t v, expected = 0;
+
+	printf(COLOR_BLUE " * Queue : tasks and mutex " COLOR_NONE);
+
+	log_start("/tmp/ut_log_os.txt");
+
+	lock = os_mutex_create();
+	done = 0;
+	shared = 0;
+	if ((lock == NULL) || os_task_create(producer, "producer", 2048, NULL,
+	                                     OS_PRIO_IDLE + 1, OS_CORE_ANY))
+		goto error;
+
+	/* Items are received in order, blocking sends never lose one */
+	while (expected < THREAD_COUNT)
+	{
+		if (os_queue_recv(queue, &v, 1000) != 0)
+			goto error;
+		if (v != expected)
+			goto error;
+		expected++;
+		os_mutex_lock(lock);
+		shared++;
+		os_mutex_unlock(lock);
+	}
+	while ( ! done)
+		os_delay(1);
+	printf("%u items, shared counter %u\n", expected, shared);
+	if (shared != (2 * THREAD_COUNT))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_os.txt");
+	return(-1);
+}
+
+/**
+ * @brief Producer task, send numbered items
+ *
+ */
+static void producer(void *arg)
+{
+	uint32_t v;
+
+	for (v = 0; v < THREAD_COUNT; v++)
+	{
+		os_queue_send(queue, &v, OS_FOREVER);
+		os_mutex_lock(lock);
+		shared++;
+		os_mutex_unlock(lock);
+	}
+	done = 1;
+	os_task_exit();
+}
+/* EOF */
@@ -0,0 +1,200 @@
+/**
+ * @file  test_task.c
+ * @brief Some tests to verify task statistics and the monitor
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "monitor.h"
+#include "os.h"
+#include "log.h"
+
+/* Functions for each sub-test */
+static int  test_stats(void);
+static int  test_load(void);
+static void busy(void *arg);
+static void sleepy(void *arg);
+static const struct os_task_stat *find(const struct os_task_stat *st, int n,
+                                       const char *name);
+
+static volatile int busy_stop;
+static volatile int busy_done;
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_task(void)
+{
+	int result = 0;
+
+	/* Name, priority, core and CPU time of tasks */
+	if (test_stats())
+		result = -1;
+	/* Load computed by the monitor */
+	if (test_load())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_stats(void)
+{
+	struct os_task_stat st[8];
+	const struct os_task_stat *t;
+	int n;
+
+	printf(COLOR_BLUE " * Task : statistics " COLOR_NONE);
+
+	log_start("/tmp/ut_log_os.txt");
+
+	busy_stop = 0;
+	busy_done = 0;
+	if (os_task_create(busy, "busy", 2048, NULL, OS_PRIO_IDLE + 3, 1))
+		goto error;
+	if (os_task_create(sleepy, "sleepy", 2048, NULL, OS_PRIO_IDLE + 1, OS_CORE_ANY))
+		goto error;
+	os_delay(300);
+
+	n = os_task_stats(st, 8);
+	t = find(st, n, "busy");
+	if ((t == NULL) || (t->prio != 3) || (t->core != 1))
+		goto error;
+	printf("busy: %u us\n", (unsigned int)t->runtime);
+	if (t->runtime < 100000)
+		goto error;
+	t = find(st, n, "sleepy");
+	if ((t == NULL) || (t->prio != 1) || (t->core != OS_CORE_ANY))
+		goto error;
+	printf("sleepy: %u us\n", (unsigned int)t->runtime);
+	if (t->runtime > 50000)
+		goto error;
+
+	/* A terminated task is removed */
+	busy_stop = 1;
+	while ( ! busy_done)
+		os_delay(10);
+	os_delay(50);
+	n = os_task_stats(st, 8);
+	if ((find(st, n, "busy") != NULL) || (find(st, n, "sleepy") == NULL))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_os.txt");
+	return(-1);
+}
+
+static int test_load(void)
+{
+	struct monitor_task tab[MONITOR_TASK_MAX];
+	struct os_task_stat st[3];
+	int count;
+
+	printf(COLOR_BLUE " * Task : monitor load " COLOR_NONE);
+
+	log_start("/tmp/ut_log_os.txt");
+
+	memset(st, 0, sizeof(st));
+	strcpy(st[0].name, "aquarea");
+	st[0].core = 1;
+	st[0].runtime = 1000;
+	strcpy(st[1].name, "IDLE");
+	st[1].core = 0;
+	st[1].runtime = 0xFFFFF000; /* Counter about to wrap */
+	strcpy(st[2].name, "IDLE");
+	st[2].core = 1;
+	st[2].runtime = 5000;
+
+	/* First measure, no load known */
+	count = monitor_update(tab, 0, st, 3, 10000000);
+	if ((count != 3) || tab[0].load || tab[1].load || tab[2].load)
+		goto error;
+
+	/* 10 seconds later : 1.2%, 75% (wrapped), 98.8% */
+	st[0].runtime += 120000;
+	st[1].runtime += 7500000;
+	st[2].runtime += 9880000;
+	count = monitor_update(tab, count, st, 3, 10000000);
+	if ((count != 3) || (tab[0].load != 12) || (tab[1].load != 750) ||
+	    (tab[2].load != 988))
+		goto error;
+
+	/* A task removed, a new one (same name on another core) */
+	st[0] = st[2];
+	st[0].runtime += 10000000;
+	strcpy(st[1].name, "aquarea");
+	st[1].core = 0;
+	st[1].runtime = 7;
+	count = monitor_update(tab, count, st, 2, 10000000);
+	if ((count != 2) || (tab[0].load != 1000) || (tab[1].load != 0) ||
+	    strcmp(tab[0].name, "IDLE") || (tab[1].core != 0))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_os.txt");
+	return(-1);
+}
+
+/**
+ * @brief Task that uses the CPU until stopped
+ *
+ */
+static void busy(void *arg)
+{
+	while ( ! busy_stop)
+		;
+	busy_done = 1;
+	os_task_exit();
+}
+
+/**
+ * @brief Task that always waits
+ *
+ */
+static void sleepy(void *arg)
+{
+	while(1)
+		os_delay(1000);
+}
+
+/**
+ * @brief Search a task by name
+ *
+ */
+static const struct os_task_stat *find(const struct os_task_stat *st, int n,
+                                       const char *name)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		if (strcmp(st[i].name, name) == 0)
+			return(&st[i]);
+	}
+	return(NULL);
+}
+/* EOF */
@@ -0,0 +1,451 @@
+/**
+ * @file  test_render.c
+ * @brief Some tests to verify rendering of Prometheus text format
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include "prom.h"
+#include "log.h"
+
+/* Functions for each sub-test */
+static int test_content(void);
+static int test_nostate(void);
+static int test_overflow(void);
+static int test_tasks(void);
+static int test_alarms(void);
+static int test_mem(void);
+static int check_syntax(const char *text);
+static void make_input(void);
+
+extern int alloc_count;
+
+/* Histogram bounds, normally defined into aquarea_ll.c */
+const uint16_t aquarea_ll_lat_bounds[AQUAREA_LL_LAT_BUCKETS - 1] =
+	{ 250, 300, 400, 500, 750, 1000, 2000 };
+const uint16_t aquarea_ll_gap_bounds[AQUAREA_LL_GAP_BUCKETS - 1] =
+	{ 20, 50, 100, 200, 500, 1000, 5000 };
+
+static struct aquarea_state    state;
+static struct aquarea_ll_stats ll;
+static char buffer[PROM_BUFFER_SIZE + 16];
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_render(void)
+{
+	int result = 0;
+
+	/* All values and counters */
+	if (test_content())
+		result = -1;
+	/* No frame received yet */
+	if (test_nostate())
+		result = -1;
+	/* Buffer too small */
+	if (test_overflow())
+		result = -1;
+	/* Measures of tasks */
+	if (test_tasks())
+		result = -1;
+	/* State of alarm rules */
+	if (test_alarms())
+		result = -1;
+	/* Memory usage */
+	if (test_mem())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_content(void)
+{
+	static const char *expect[] = {
+		"aquarea_last_frame_timestamp_seconds 1640995200\n",
+		"# TYPE aquarea_inlet_temp gauge\naquarea_inlet_temp 31\n",
+		"aquarea_outside_temp -7\n",
+		"# TYPE aquarea_energy_prod_wh_total counter\naquarea_energy_prod_wh_total 12345\n",
+		"# TYPE aquarea_ll_rx_frames_total counter\naquarea_ll_rx_frames_total 1000\n",
+		"aquarea_ll_rx_checksum_errors_total 3\n",
+		"aquarea_ll_rx_resync_total 2\n",
+		"aquarea_ll_tx_frames_total 1004\n",
+		"# TYPE aquarea_ll_rx_latency_seconds histogram\n",
+		"aquarea_ll_rx_latency_seconds_bucket{le=\"0.250\"} 10\n",
+		"aquarea_ll_rx_latency_seconds_bucket{le=\"0.300\"} 910\n",
+		"aquarea_ll_rx_latency_seconds_bucket{le=\"2.000\"} 998\n",
+		"aquarea_ll_rx_latency_seconds_bucket{le=\"+Inf\"} 1000\n",
+		"aquarea_ll_rx_latency_seconds_sum 281.500\n",
+		"aquarea_ll_rx_latency_seconds_count 1000\n",
+		"# TYPE aquarea_ll_rx_bytes_total counter\naquarea_ll_rx_bytes_total 203000\n",
+		"aquarea_ll_tx_busy_seconds_total 127.206\n",
+		"aquarea_ll_load_ratio 0.094\n",
+		"aquarea_ll_gap_seconds_bucket{le=\"0.050\"} 1000\n",
+		"aquarea_ll_gap_seconds_bucket{le=\"+Inf\"} 2003\n",
+		"aquarea_ll_gap_seconds_sum 4420.000\n",
+		NULL
+	};
+	int i, len, allocs;
+
+	printf(COLOR_BLUE " * Render : values and counters " COLOR_NONE);
+
+	log_start("/tmp/ut_log_prom.txt");
+
+	make_input();
+	allocs = alloc_count;
+	len = prom_render(buffer, PROM_BUFFER_SIZE, &state, &ll);
+	if (alloc_count != allocs)
+	{
+		printf("%d allocations during render\n", alloc_count - allocs);
+		goto error;
+	}
+	printf("%d bytes rendered\n", len);
+	if ((len <= 0) || (len != strlen(buffer)))
+		goto error;
+	for (i = 0; expect[i]; i++)
+	{
+		if (strstr(buffer, expect[i]) == NULL)
+		{
+			printf("Missing: %s", expect[i]);
+			goto error;
+		}
+	}
+	if (check_syntax(buffer))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_prom.txt");
+	return(-1);
+}
+
+static int test_nostate(void)
+{
+	int len;
+
+	printf(COLOR_BLUE " * Render : no state received " COLOR_NONE);
+
+	log_start("/tmp/ut_log_prom.txt");
+
+	make_input();
+	state.seq = 0;
+	len = prom_render(buffer, PROM_BUFFER_SIZE, &state, &ll);
+	if (len <= 0)
+		goto error;
+	if (strstr(buffer, "aquarea_inlet_temp") ||
+	    strstr(buffer, "aquarea_last_frame") ||
+	    (strstr(buffer, "aquarea_ll_rx_frames_total 1000\n") == NULL))
+		goto error;
+	if (check_syntax(buffer))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_prom.txt");
+	return(-1);
+}
+
+static int test_overflow(void)
+{
+	int i, len, size;
+
+	printf(COLOR_BLUE " * Render : buffer too small " COLOR_NONE);
+
+	log_start("/tmp/ut_log_prom.txt");
+
+	make_input();
+	len = prom_render(buffer, PROM_BUFFER_SIZE, &state, &ll);
+	if (len <= 0)
+		goto error;
+
+	for (size = 1; size <= (len + 1); size++)
+	{
+		memset(buffer, 0x55, sizeof(buffer));
+		i = prom_render(buffer, size, &state, &ll);
+		/* Result must be complete, or an error */
+		if ((size <= len) && (i != -1))
+			goto error;
+		if ((size == (len + 1)) && (i != len))
+			goto error;
+		/* Nothing written after the end of buffer */
+		for (i = size; i < sizeof(buffer); i++)
+		{
+			if (buffer[i] != 0x55)
+			{
+				printf("Buffer overflow with size %d\n", size);
+				goto error;
+			}
+		}
+	}
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_prom.txt");
+	return(-1);
+}
+
+static int test_tasks(void)
+{
+	static const char *expect =
+		"# TYPE aquarea_task_cpu_ratio gauge\n"
+		"aquarea_task_cpu_ratio{task=\"aquarea\",core=\"1\"} 0.012\n"
+		"aquarea_task_cpu_ratio{task=\"tiT\",core=\"any\"} 1.000\n"
+		"# TYPE aquarea_task_stack_free_bytes gauge\n"
+		"aquarea_task_stack_free_bytes{task=\"aquarea\",core=\"1\"} 1840\n"
+		"aquarea_task_stack_free_bytes{task=\"tiT\",core=\"any\"} 920\n";
+	struct monitor_task tasks[2];
+	int len;
+
+	printf(COLOR_BLUE " * Render : tasks " COLOR_NONE);
+
+	log_start("/tmp/ut_log_prom.txt");
+
+	/* Nothing measured yet */
+	if (prom_render_tasks(buffer, PROM_BUFFER_SIZE, tasks, 0) != 0)
+		goto error;
+
+	memset(tasks, 0, sizeof(tasks));
+	strcpy(tasks[0].name, "aquarea");
+	tasks[0].core = 1;
+	tasks[0].load = 12;
+	tasks[0].stack_free = 1840;
+	strcpy(tasks[1].name, "tiT");
+	tasks[1].core = OS_CORE_ANY;
+	tasks[1].load = 1000;
+	tasks[1].stack_free = 920;
+
+	len = prom_render_tasks(buffer, PROM_BUFFER_SIZE, tasks, 2);
+	if ((len != strlen(expect)) || memcmp(buffer, expect, len))
+		goto error;
+	buffer[len] = 0;
+	if (check_syntax(buffer))
+		goto error;
+	/* Buffer too small */
+	if (prom_render_tasks(buffer, len, tasks, 2) != -1)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_prom.txt");
+	return(-1);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+static int test_alarms(void)
+{
+	static const char *expect =
+		"# TYPE aquarea_alarm gauge\n"
+		"aquarea_alarm{rule=\"flow_low\",field=\"pump_flow\"} 0\n"
+		"aquarea_alarm{rule=\"outlet_high\",field=\"outlet_temp\"} 1\n"
+		"aquarea_alarm{rule=\"error\",field=\"error\"} 0\n";
+	static struct rules rules;
+	int len;
+
+	printf(COLOR_BLUE " * Render : alarms " COLOR_NONE);
+
+	log_start("/tmp/ut_log_prom.txt");
+
+	/* No rules */
+	rules_init(&rules, NULL);
+	if (prom_render_alarms(buffer, PROM_BUFFER_SIZE, &rules) != 0)
+		goto error;
+
+	if (rules_load(&rules, RULES_DEFAULT) != 3)
+		goto error;
+	rules.active = 2;
+	len = prom_render_alarms(buffer, PROM_BUFFER_SIZE, &rules);
+	if ((len != strlen(expect)) || memcmp(buffer, expect, len))
+		goto error;
+	buffer[len] = 0;
+	if (check_syntax(buffer))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_prom.txt");
+	return(-1);
+}
+
+static int test_mem(void)
+{
+	static const char *expect =
+		"# TYPE aquarea_heap_free_bytes gauge\n"
+		"aquarea_heap_free_bytes 120000\n"
+		"# TYPE aquarea_heap_min_free_bytes gauge\n"
+		"aquarea_heap_min_free_bytes 98000\n"
+		"# TYPE aquarea_heap_sealed_allocs_total counter\n"
+		"aquarea_heap_sealed_allocs_total 0\n"
+		"# TYPE aquarea_static_bytes gauge\n"
+		"aquarea_static_bytes{subsystem=\"ll\"} 280\n"
+		"aquarea_static_bytes{subsystem=\"state\"} 5200\n"
+		"# TYPE aquarea_static_budget_bytes gauge\n"
+		"aquarea_static_budget_bytes{subsystem=\"ll\"} 1024\n"
+		"aquarea_static_budget_bytes{subsystem=\"state\"} 6144\n";
+	struct mem_stats st;
+	int len;
+
+	printf(COLOR_BLUE " * Render : memory " COLOR_NONE);
+
+	log_start("/tmp/ut_log_prom.txt");
+
+	/* Host : no heap counters, no region */
+	memset(&st, 0, sizeof(struct mem_stats));
+	len = prom_render_mem(buffer, PROM_BUFFER_SIZE, &st);
+	if ((len <= 0) || strstr(buffer, "heap_free"))
+		goto error;
+
+	st.heap_valid    = 1;
+	st.heap_free     = 120000;
+	st.heap_min_free = 98000;
+	st.count = 2;
+	st.region[0].name = "ll";
+	st.region[0].used = 280;
+	st.region[0].budget = 1024;
+	st.region[1].name = "state";
+	st.region[1].used = 5200;
+	st.region[1].budget = 6144;
+	len = prom_render_mem(buffer, PROM_BUFFER_SIZE, &st);
+	if ((len != strlen(expect)) || memcmp(buffer, expect, len))
+		goto error;
+	buffer[len] = 0;
+	if (check_syntax(buffer))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_prom.txt");
+	return(-1);
+}
+
+/**
+ * @brief Verify that each line is a comment or a "name{labels} value" sample
+ *
+ * @param text Pointer to the rendered text
+ * @return integer Zero is returned on success, -1 on error
+ */
+static int check_syntax(const char *text)
+{
+	const char *p = text;
+
+	while (*p)
+	{
+		if (strncmp(p, "# TYPE ", 7) == 0)
+		{
+			p = strchr(p, '\n');
+			if (p == NULL)
+				return(-1);
+			p++;
+			continue;
+		}
+		if ( ! isalpha((unsigned char)*p))
+			goto error;
+		while (isalnum((unsigned char)*p) || (*p == '_'))
+			p++;
+		if (*p == '{')
+		{
+			p = strchr(p, '}');
+			if (p == NULL)
+				goto error;
+			p++;
+		}
+		if (*p++ != ' ')
+			goto error;
+		if (*p == '-')
+			p++;
+		if ( ! isdigit((unsigned char)*p))
+			goto error;
+		while (isdigit((unsigned char)*p) || (*p == '.'))
+			p++;
+		if (*p++ != '\n')
+			goto error;
+	}
+	return(0);
+
+error:
+	printf("Syntax error at: %.40s\n", p);
+	return(-1);
+}
+
+/**
+ * @brief Make a state and link counters with known values
+ *
+ */
+static void make_input(void)
+{
+	memset(&state, 0, sizeof(state));
+	state.seq  = 42;
+	state.time = 1640995200;
+	state.value[AQ_INLET_TEMP]   = 31;
+	state.value[AQ_OUTSIDE_TEMP] = -7;
+	state.value[AQ_ENERGY_PROD]  = 12345;
+
+	memset(&ll, 0, sizeof(ll));
+	ll.rx_ok     = 1000;
+	ll.rx_cksum  = 3;
+	ll.rx_resync = 2;
+	ll.tx        = 1004;
+	ll.lat_bucket[0] = 10;
+	ll.lat_bucket[1] = 900;
+	ll.lat_bucket[2] = 80;
+	ll.lat_bucket[6] = 8;
+	ll.lat_bucket[7] = 2;
+	ll.lat_count = 1000;
+	ll.lat_sum   = 281500;
+	ll.rx_bytes  = 203000;
+	ll.tx_bytes  = 111000;
+	ll.rx_busy   = 232638;
+	ll.tx_busy   = 127206;
+	ll.load      = 94;
+	ll.gap_bucket[1] = 1000;
+	ll.gap_bucket[7] = 1003;
+	ll.gap_count = 2003;
+	ll.gap_sum   = 4420000;
+}
+/* EOF */
@@ -0,0 +1,264 @@
+/**
+ * @file  test_eval.c
+ * @brief Some tests to verify the evaluation of rules
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "log.h"
+#include "rules.h"
+
+#define TEST_TIME_BASE 1640995200
+
+/* Functions for each sub-test */
+static int test_changes(void);
+static int test_hyst(void);
+static int test_hold(void);
+static int update(uint32_t time, int field, int32_t value);
+static void event(struct rules *r, const struct rule *rule,
+                  int32_t value, uint32_t time);
+
+static struct rules rules;
+static struct aquarea_state state;
+static int event_count;
+static int event_active;
+static uint32_t event_time;
+static uint32_t wall = TEST_TIME_BASE; /* Wall clock at start of test */
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_eval(void)
+{
+	int result = 0;
+
+	/* Cost depends on changes, not on rule count */
+	if (test_changes())
+		result = -1;
+	/* Alarm cleared only after hysteresis */
+	if (test_hyst())
+		result = -1;
+	/* Alarm raised only after hold time */
+	if (test_hold())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_changes(void)
+{
+	char text[RULES_LINE];
+	int i, n;
+
+	printf(COLOR_BLUE " * Eval : changed fields only " COLOR_NONE);
+
+	log_start("/tmp/ut_log_rules.txt");
+
+	/* Two rules per field, on the first 16 fields */
+	rules_init(&rules, event);
+	for (i = 0; i < RULES_MAX; i++)
+	{
+		snprintf(text, RULES_LINE, "r%d %s > 1000", i,
+		         aquarea_state_name(i / 2));
+		if (rules_load(&rules, text) != 1)
+			goto error;
+	}
+	memset(&state, 0, sizeof(struct aquarea_state));
+	event_count = 0;
+
+	/* First state, all rules */
+	if (update(0, 0, 0) != RULES_MAX)
+		goto error;
+	/* Nothing changed, nothing evaluated */
+	for (i = 1; i < 1000; i++)
+	{
+		if (update(i * 5, 0, 0) != 0)
+			goto error;
+	}
+	/* One field, only its rules */
+	for (i = 0; i < 1000; i++)
+	{
+		n = update(5000 + (i * 5), (i % 16), i + 1);
+		if (n != 2)
+			goto error;
+	}
+	/* A field without rules */
+	if (update(10000, AQ_COP_1H, 42) != 0)
+		goto error;
+	if (event_count != 0)
+		goto error;
+
+	log_end();
+	printf("(%u evals for %u states) ", rules.evals, rules.updates);
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_rules.txt");
+	return(-1);
+}
+
+static int test_hyst(void)
+{
+	/* Outlet temperature, then value each state and expected alarm */
+	const int32_t value[]  = { 50, 56, 55, 54, 53, 55, 58, 40 };
+	const int     active[] = {  0,  1,  1,  1,  0,  0,  1,  0 };
+	const int     events[] = {  0,  1,  1,  1,  2,  2,  3,  4 };
+	int i;
+
+	printf(COLOR_BLUE " * Eval : hysteresis " COLOR_NONE);
+
+	log_start("/tmp/ut_log_rules.txt");
+
+	rules_init(&rules, event);
+	if (rules_load(&rules, "outlet_high outlet_temp > 55 hyst 2") != 1)
+		goto error;
+	memset(&state, 0, sizeof(struct aquarea_state));
+	event_count = 0;
+
+	for (i = 0; i < (sizeof(value) / sizeof(value[0])); i++)
+	{
+		update(i * 5, AQ_OUTLET_TEMP, value[i]);
+		if ((rules.rule[0].active != active[i]) ||
+		    (rules.active != active[i]) || (event_count != events[i]))
+		{
+			printf("State %d : active %d, %d events\n", i,
+			       rules.rule[0].active, event_count);
+			goto error;
+		}
+		if (event_count && (event_active != rules.rule[0].active))
+			goto error;
+	}
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_rules.txt");
+	return(-1);
+}
+
+static int test_hold(void)
+{
+	printf(COLOR_BLUE " * Eval : hold time " COLOR_NONE);
+
+	log_start("/tmp/ut_log_rules.txt");
+
+	rules_init(&rules, event);
+	if (rules_load(&rules, RULES_DEFAULT) != 3)
+		goto error;
+	memset(&state, 0, sizeof(struct aquarea_state));
+	event_count = 0;
+	state.value[AQ_PUMP_FLOW] = 2000;
+	update(0, AQ_OUTLET_TEMP, 30);
+
+	/* Flow too low, but not long enough */
+	update(5, AQ_PUMP_FLOW, 900);
+	if ((rules.pending != 1) || rules.active || event_count)
+		goto error;
+	/* Value does not change, pending rule is evaluated anyway */
+	if (update(30, AQ_PUMP_FLOW, 900) != 1)
+		goto error;
+	if ((rules.pending != 1) || rules.active || event_count)
+		goto error;
+	update(35, AQ_PUMP_FLOW, 900);
+	if (rules.pending || (rules.active != 1) || (event_count != 1))
+		goto error;
+	/* Raised : no more evaluation without change */
+	if (update(40, AQ_PUMP_FLOW, 900) != 0)
+		goto error;
+	/* Cleared above 1000 + 100 */
+	update(45, AQ_PUMP_FLOW, 1050);
+	update(50, AQ_PUMP_FLOW, 1100);
+	if (rules.active || (event_count != 2) || event_active)
+		goto error;
+
+	/* A short glitch does not raise the alarm */
+	update(100, AQ_PUMP_FLOW, 500);
+	update(120, AQ_PUMP_FLOW, 1500);
+	update(200, AQ_PUMP_FLOW, 1500);
+	if (rules.pending || rules.active || (event_count != 2))
+		goto error;
+
+	/* Error code, raised immediately */
+	update(205, AQ_ERROR, 0x0116);
+	if ((rules.active != 4) || (event_count != 3))
+		goto error;
+
+	/* Clock set while a rule is pending (boot, then SNTP) */
+	wall = 0;
+	update(300, AQ_PUMP_FLOW, 900);
+	wall = TEST_TIME_BASE;
+	update(310, AQ_PUMP_FLOW, 900);
+	if ((rules.pending != 1) || (event_count != 3))
+		goto error;
+	/* Then moved backward */
+	wall = TEST_TIME_BASE - 3600;
+	update(320, AQ_PUMP_FLOW, 900);
+	if ((rules.pending != 1) || (event_count != 3))
+		goto error;
+	/* Raised after the hold time, event has the wall clock time */
+	update(330, AQ_PUMP_FLOW, 900);
+	if ((rules.active != 5) || (event_count != 4) ||
+	    (event_time != (wall + 330)))
+		goto error;
+	wall = TEST_TIME_BASE;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_rules.txt");
+	return(-1);
+}
+
+/**
+ * @brief Modify one field of the state, and evaluate rules
+ *
+ * @param time  Time since start of test (sec.)
+ * @param field Identifier of the field to modify
+ * @param value New value of the field
+ * @return integer Number of rules evaluated
+ */
+static int update(uint32_t time, int field, int32_t value)
+{
+	state.seq++;
+	state.time = wall + time;
+	state.value[field] = value;
+	return(rules_update(&rules, &state, time));
+}
+
+/**
+ * @brief Alarm handler, count events
+ *
+ */
+static void event(struct rules *r, const struct rule *rule,
+                  int32_t value, uint32_t time)
+{
+	printf("Alarm %s %d (value %d)\n", rule->name, rule->active, (int)value);
+	event_count++;
+	event_active = rule->active;
+	event_time = time;
+}
+/* EOF */
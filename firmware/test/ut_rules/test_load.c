@@ -0,0 +1,165 @@
+/**
+ * @file  test_load.c
+ * @brief Some tests to verify the compilation of rules
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "log.h"
+#include "rules.h"
+
+/* Functions for each sub-test */
+static int test_syntax(void);
+static int test_index(void);
+
+static struct rules rules;
+
+/* Invalid definitions, the error is always on second line */
+static const char *invalid[] =
+{
+	"a error != 0\nb unknown_field > 1",
+	"a error != 0\nb inlet_temp => 1",
+	"a error != 0\nb inlet_temp >",
+	"a error != 0\nb inlet_temp > 1x",
+	"a error != 0\nb inlet_temp > 1 hyst",
+	"a error != 0\nb inlet_temp > 1 delay 5",
+	"a error != 0\nb inlet_temp > 1 hold -",
+	"a error != 0\nname_is_too_long inlet_temp > 1",
+	NULL
+};
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_load(void)
+{
+	int result = 0;
+
+	/* Rules syntax, errors */
+	if (test_syntax())
+		result = -1;
+	/* Rules linked by field */
+	if (test_index())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_syntax(void)
+{
+	const struct rule *rule;
+	int i;
+
+	printf(COLOR_BLUE " * Load : syntax " COLOR_NONE);
+
+	log_start("/tmp/ut_log_rules.txt");
+
+	/* Default rules of the firmware */
+	rules_init(&rules, NULL);
+	if (rules_load(&rules, RULES_DEFAULT) != 3)
+		goto error;
+	rule = &rules.rule[0];
+	if (strcmp(rule->name, "flow_low") || (rule->field != AQ_PUMP_FLOW) ||
+	    (rule->op != RULES_LT) || (rule->value != 1000) ||
+	    (rule->hyst != 100) || (rule->hold != 30))
+		goto error;
+	rule = &rules.rule[2];
+	if (strcmp(rule->name, "error") || (rule->field != AQ_ERROR) ||
+	    (rule->op != RULES_NE) || rule->value || rule->hyst || rule->hold)
+		goto error;
+
+	/* Comments, empty lines and separators */
+	if (rules_load(&rules, "# Comment\n\n a inlet_temp <= -5 # cold;"
+	                       "b outlet_temp >= 0x30 hold 5 hyst 1\r\n") != 2)
+		goto error;
+	if ((rules.count != 5) || (rules.rule[3].value != -5) ||
+	    (rules.rule[4].value != 0x30) || (rules.rule[4].hold != 5))
+		goto error;
+
+	/* Errors, nothing loaded */
+	for (i = 0; invalid[i]; i++)
+	{
+		if (rules_load(&rules, invalid[i]) != -2)
+		{
+			printf("Rule %d accepted\n", i);
+			goto error;
+		}
+		if (rules.count != 5)
+			goto error;
+	}
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_rules.txt");
+	return(-1);
+}
+
+static int test_index(void)
+{
+	char text[RULES_LINE];
+	int  count[AQ_FIELD_COUNT];
+	int  i, n, prev;
+
+	printf(COLOR_BLUE " * Load : field index " COLOR_NONE);
+
+	log_start("/tmp/ut_log_rules.txt");
+
+	/* Maximum number of rules, spread over some fields */
+	rules_init(&rules, NULL);
+	for (i = 0; i < RULES_MAX; i++)
+	{
+		snprintf(text, RULES_LINE, "r%d %s > %d", i,
+		         aquarea_state_name((i * 7) % AQ_FIELD_COUNT), i);
+		if (rules_load(&rules, text) != 1)
+			goto error;
+	}
+	if (rules_load(&rules, "full error != 0") != -1)
+		goto error;
+
+	/* Each rule into the list of its field, in definition order */
+	memset(count, 0, sizeof(count));
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+	{
+		prev = -1;
+		for (n = rules.first[i]; n >= 0; n = rules.rule[n].next)
+		{
+			if ((rules.rule[n].field != i) || (n <= prev))
+				goto error;
+			prev = n;
+			count[i]++;
+		}
+	}
+	for (i = 0, n = 0; i < AQ_FIELD_COUNT; i++)
+		n += count[i];
+	if (n != RULES_MAX)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_rules.txt");
+	return(-1);
+}
+/* EOF */
@@ -0,0 +1,207 @@
+/**
+ * @file  test_bench.c
+ * @brief Benchmark of the snapshot cache, and test with concurrent readers
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "snapshot.h"
+#include "log.h"
+
+#define READERS 3
+
+/* Functions for each sub-test */
+static int   test_cost(void);
+static int   test_concurrent(void);
+static void *reader(void *arg);
+static double now(void);
+
+static atomic_int bench_stop;
+static long       bench_reads[READERS];
+static long       bench_errors;
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_bench(void)
+{
+	int result = 0;
+
+	/* Serialization cost, and reads served by the cache */
+	if (test_cost())
+		result = -1;
+	/* Readers never see a snapshot being written */
+	if (test_concurrent())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_cost(void)
+{
+	const struct snapshot *snap;
+	struct aquarea_state s;
+	volatile size_t total = 0;
+	double t0, t1;
+	long i, count;
+	int j;
+
+	printf(COLOR_BLUE " * Bench : serialize and read " COLOR_NONE);
+
+	snapshot_init();
+	memset(&s, 0, sizeof(s));
+
+	/* Each frame is different, so serialized */
+	count = 200000;
+	t0 = now();
+	for (i = 0; i < count; i++)
+	{
+		s.seq = i;
+		for (j = 0; j < AQ_FIELD_COUNT; j++)
+			s.value[j] = (int32_t)(i + j);
+		if (snapshot_update(&s) != 1)
+			goto error;
+	}
+	t1 = now();
+	printf("\n   serialize (JSON%s) : %.0f ns per frame\n",
+	       SNAPSHOT_CBOR ? " + CBOR" : "", ((t1 - t0) * 1e9) / count);
+
+	/* Reads from cache : no formatting, only a reference */
+	count = 20000000;
+	t0 = now();
+	for (i = 0; i < count; i++)
+	{
+		snap = snapshot_get();
+		total += snap->json_len;
+		snapshot_put(snap);
+	}
+	t1 = now();
+	printf("   read from cache      : %.1f M reads per second\n",
+	       (count / (t1 - t0)) / 1e6);
+
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	return(-1);
+}
+
+static int test_concurrent(void)
+{
+	pthread_t th[READERS];
+	struct aquarea_state s;
+	long i, updates = 0, busy = 0, reads = 0;
+	int j;
+
+	printf(COLOR_BLUE " * Bench : concurrent readers " COLOR_NONE);
+
+	snapshot_init();
+	atomic_store(&bench_stop, 0);
+	bench_errors = 0;
+	for (j = 0; j < READERS; j++)
+		pthread_create(&th[j], NULL, reader, &bench_reads[j]);
+
+	memset(&s, 0, sizeof(s));
+	for (i = 1; i < 300000; i++)
+	{
+		/* All values of a state are equals to the sequence number */
+		s.seq = i;
+		for (j = 0; j < AQ_FIELD_COUNT; j++)
+			s.value[j] = i;
+		j = snapshot_update(&s);
+		if (j == 1)
+			updates++;
+		else if (j == -1)
+			busy++;
+	}
+	atomic_store(&bench_stop, 1);
+	for (j = 0; j < READERS; j++)
+	{
+		pthread_join(th[j], NULL);
+		reads += bench_reads[j];
+	}
+	printf("\n   %ld updates, %ld skipped (busy), %ld reads, %ld errors\n",
+	       updates, busy, reads, bench_errors);
+	if (bench_errors || (updates == 0) || (reads == 0))
+		goto error;
+
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	return(-1);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Reader thread, verify that all values of a snapshot are consistent
+ *
+ * @param arg Pointer to a counter of reads
+ */
+static void *reader(void *arg)
+{
+	const struct snapshot *snap;
+	const char *p;
+	long *reads = arg;
+	long seq;
+
+	*reads = 0;
+	while ( ! atomic_load(&bench_stop))
+	{
+		snap = snapshot_get();
+		if (snap == NULL)
+			continue;
+		/* Each value (after "time") must be the sequence number */
+		p = strstr(snap->json, "\"time\":");
+		p = strchr(p, ',');
+		while (p && (p < (snap->json + snap->json_len)))
+		{
+			p = strchr(p, ':');
+			seq = strtol(p + 1, (char **)&p, 10);
+			if (seq != snap->seq)
+			{
+				__atomic_add_fetch(&bench_errors, 1, __ATOMIC_RELAXED);
+				break;
+			}
+			p = strchr(p, ',');
+		}
+		snapshot_put(snap);
+		(*reads)++;
+	}
+	return(NULL);
+}
+
+/**
+ * @brief Get a monotonic time
+ *
+ * @return double Time in seconds
+ */
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec + (ts.tv_nsec / 1e9));
+}
+/* EOF */
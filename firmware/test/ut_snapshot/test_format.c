@@ -0,0 +1,286 @@
+/**
+ * @file  test_format.c
+ * @brief Some tests to verify snapshot content and update rules
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "snapshot.h"
+#include "log.h"
+
+/* Functions for each sub-test */
+static int test_json(void);
+static int test_cbor(void);
+static int test_update(void);
+static void make_state(struct aquarea_state *s, int n);
+static int  cbor_get(const uint8_t **p, uint8_t *major, uint32_t *v);
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_format(void)
+{
+	int result = 0;
+
+	/* Content of JSON snapshot */
+	if (test_json())
+		result = -1;
+	/* Content of CBOR snapshot */
+	if (test_cbor())
+		result = -1;
+	/* Update only on change, never overwrite a used snapshot */
+	if (test_update())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_json(void)
+{
+	const struct snapshot *snap;
+	struct aquarea_state s;
+	char ref[SNAPSHOT_JSON_SIZE];
+	size_t len;
+	int i;
+
+	printf(COLOR_BLUE " * Snapshot : JSON content " COLOR_NONE);
+
+	log_start("/tmp/ut_log_snapshot.txt");
+
+	snapshot_init();
+	if (snapshot_get() != NULL)
+		goto error;
+
+	make_state(&s, 7);
+	if (snapshot_update(&s) != 1)
+		goto error;
+
+	len = sprintf(ref, "{\"seq\":7,\"time\":1640995235");
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+		len += sprintf(ref + len, ",\"%s\":%d", aquarea_state_name(i), s.value[i]);
+	len += sprintf(ref + len, "}");
+
+	snap = snapshot_get();
+	if (snap == NULL)
+		goto error;
+	printf("%d bytes: %.40s...\n", (int)snap->json_len, snap->json);
+	if ((snap->json_len != len) || memcmp(snap->json, ref, len))
+		goto error;
+	snapshot_put(snap);
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_snapshot.txt");
+	return(-1);
+}
+
+static int test_cbor(void)
+{
+#if SNAPSHOT_CBOR
+	const struct snapshot *snap;
+	struct aquarea_state s;
+	const uint8_t *p;
+	uint8_t  major;
+	uint32_t v;
+	int32_t  value;
+	int i;
+
+	printf(COLOR_BLUE " * Snapshot : CBOR content " COLOR_NONE);
+
+	log_start("/tmp/ut_log_snapshot.txt");
+
+	snapshot_init();
+	make_state(&s, 70000);
+	snapshot_update(&s);
+	snap = snapshot_get();
+	printf("%d bytes\n", (int)snap->cbor_len);
+
+	p = snap->cbor;
+	if (cbor_get(&p, &major, &v) || (major != 5) || (v != (2 + AQ_FIELD_COUNT)))
+		goto error;
+	for (i = -2; i < AQ_FIELD_COUNT; i++)
+	{
+		/* Key */
+		if (cbor_get(&p, &major, &v) || (major != 3))
+			goto error;
+		if (i == -2)
+		{
+			if ((v != 3) || memcmp(p, "seq", 3))
+				goto error;
+		}
+		else if (i == -1)
+		{
+			if ((v != 4) || memcmp(p, "time", 4))
+				goto error;
+		}
+		else if ((v != strlen(aquarea_state_name(i))) ||
+		         memcmp(p, aquarea_state_name(i), v))
+			goto error;
+		p += v;
+		/* Value */
+		if (cbor_get(&p, &major, &v))
+			goto error;
+		if (major == 0)
+			value = (int32_t)v;
+		else if (major == 1)
+			value = -1 - (int32_t)v;
+		else
+			goto error;
+		if ((i == -2) && (value != s.seq))
+			goto error;
+		if ((i == -1) && (value != s.time))
+			goto error;
+		if ((i >= 0) && (value != s.value[i]))
+			goto error;
+	}
+	if (p != (snap->cbor + snap->cbor_len))
+		goto error;
+	snapshot_put(snap);
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_snapshot.txt");
+	return(-1);
+#else
+	return(0);
+#endif
+}
+
+static int test_update(void)
+{
+	const struct snapshot *a, *b;
+	struct aquarea_state s;
+
+	printf(COLOR_BLUE " * Snapshot : update rules " COLOR_NONE);
+
+	log_start("/tmp/ut_log_snapshot.txt");
+
+	snapshot_init();
+	make_state(&s, 1);
+	if (snapshot_update(&s) != 1)
+		goto error;
+	/* Same values, new frame : nothing to do */
+	s.seq++;
+	s.time += 5;
+	if (snapshot_update(&s) != 0)
+		goto error;
+
+	/* Keep the current snapshot, a new one is made into the other buffer */
+	a = snapshot_get();
+	make_state(&s, 2);
+	if (snapshot_update(&s) != 1)
+		goto error;
+	b = snapshot_get();
+	if ((b == a) || (b->seq != 2) || (a->seq != 1))
+		goto error;
+	snapshot_put(b);
+	/* The only free buffer is used by a reader : skip */
+	make_state(&s, 3);
+	if (snapshot_update(&s) != -1)
+		goto error;
+	if ((a->seq != 1) || (strstr(a->json, "\"seq\":1,") == NULL))
+		goto error;
+	snapshot_put(a);
+	/* Reader has finished, retry with next frame */
+	make_state(&s, 4);
+	if (snapshot_update(&s) != 1)
+		goto error;
+	a = snapshot_get();
+	if (a->seq != 4)
+		goto error;
+	snapshot_put(a);
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_snapshot.txt");
+	return(-1);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --                          Internal functions                          -- */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Make a state where all values depends on a number
+ *
+ * @param s Pointer to the state to fill
+ * @param n Number used to compute values
+ */
+static void make_state(struct aquarea_state *s, int n)
+{
+	int i;
+
+	s->seq  = n;
+	s->time = 1640995200 + (n * 5);
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+		s->value[i] = (i & 1) ? (n * (i + 1)) : -(n + i);
+}
+
+/**
+ * @brief Read the head of a CBOR item
+ *
+ * @param p     Pointer to the read pointer (updated)
+ * @param major Pointer to a variable where major type is stored
+ * @param v     Pointer to a variable where argument is stored
+ * @return integer Zero is returned on success, -1 if not supported
+ */
+static int cbor_get(const uint8_t **p, uint8_t *major, uint32_t *v)
+{
+	const uint8_t *c = *p;
+	uint8_t info;
+
+	*major = c[0] >> 5;
+	info   = c[0] & 0x1F;
+	if (info < 24)
+	{
+		*v = info;
+		*p += 1;
+	}
+	else if (info == 24)
+	{
+		*v = c[1];
+		*p += 2;
+	}
+	else if (info == 25)
+	{
+		*v = (c[1] << 8) | c[2];
+		*p += 3;
+	}
+	else if (info == 26)
+	{
+		*v = ((uint32_t)c[1] << 24) | (c[2] << 16) | (c[3] << 8) | c[4];
+		*p += 5;
+	}
+	else
+		return(-1);
+	return(0);
+}
+/* EOF */
@@ -0,0 +1,101 @@
+/**
+ * @file  main.c
+ * @brief Entry point of the unit-test for the UDP stream records
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aquarea_state.h"
+#include "log.h"
+
+#define TEST_TIME_BASE 1640995200
+
+/* Declare functions for each group of tests */
+int  test_codec(void);
+int  test_socket(void);
+
+static void usage(char *appname);
+
+/**
+ * @brief Entry point of this unit-test
+ *
+ * @param argc Number or command line arguments
+ * @param argv Array of string with command line arguments
+ * @return integer Zero is returned on success, -1 for error
+ */
+int main(int argc, char **argv)
+{
+	int test_num;
+	int result = 0;
+
+	if (argc < 2)
+	{
+		usage(argv[0]);
+		return(-1);
+	}
+
+	log_init();
+
+	test_num = atoi(argv[1]);
+
+	if ((test_num == 1) || (test_num == 0))
+	{
+		if (test_codec() != 0)
+			result = -1;
+	}
+	if ((test_num == 2) || (test_num == 0))
+	{
+		if (test_socket() != 0)
+			result = -1;
+	}
+
+	return(result);
+}
+
+/**
+ * @brief Make a sample state, values evolve slowly with some jitter
+ *
+ * @param state Pointer to a state structure to fill
+ * @param n     Index of the sample (one sample every 5 seconds)
+ */
+void test_sample(struct aquarea_state *state, int n)
+{
+	int i;
+
+	memset(state, 0, sizeof(struct aquarea_state));
+	state->seq  = n;
+	state->time = TEST_TIME_BASE + (n * 5);
+	for (i = 0; i < AQ_FIELD_COUNT; i++)
+		state->value[i] = ((n / (i + 3)) % 7) - 3;
+	state->value[AQ_HP_STATE]       = 1;
+	state->value[AQ_OUTSIDE_TEMP]   = -5 + ((n / 60) % 12) + (n & 1);
+	state->value[AQ_PUMP_FLOW]      = 1850 + ((n * 7) % 40);
+	state->value[AQ_HEAT_POWER_PROD] = ((n / 50) % 30) * 200;
+	state->value[AQ_ENERGY_PROD]    = 2000000 + (n * 3);
+	state->value[AQ_ERROR]          = ((n % 500) > 480) ? 0x4801 : 0;
+}
+
+/**
+ * @brief Print an help message about command line arguments
+ *
+ */
+static void usage(char *appname)
+{
+	printf("Usage %s <test_num>\n", appname);
+	printf("  where test_num can be:\n");
+	printf("    0: Run all tests\n");
+	printf("    1: Test records encoding (round trip, malformed records)\n");
+	printf("    2: Test loss and reorder on a local UDP socket\n");
+}
+/* EOF */
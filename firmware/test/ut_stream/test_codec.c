@@ -0,0 +1,228 @@
+/**
+ * @file  test_codec.c
+ * @brief Some tests to verify encoding and decoding of stream records
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "log.h"
+#include "stream_codec.h"
+
+#define TEST_COUNT 10000
+
+/* Functions for each sub-test */
+static int test_round(void);
+static int test_malformed(void);
+static int test_restart(void);
+
+extern void test_sample(struct aquarea_state *state, int n);
+
+static struct stream_enc enc;
+static struct stream_dec dec;
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_codec(void)
+{
+	int result = 0;
+
+	/* Decoded states are the encoded ones */
+	if (test_round())
+		result = -1;
+	/* Truncated, unknown version, unknown fields */
+	if (test_malformed())
+		result = -1;
+	/* Encoder restarted (reboot of the sender) */
+	if (test_restart())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_round(void)
+{
+	struct aquarea_state in, out;
+	uint8_t rec[STREAM_REC_MAX];
+	size_t len, total = 0, key = 0;
+	int n;
+
+	printf(COLOR_BLUE " * Codec : round trip " COLOR_NONE);
+
+	log_start("/tmp/ut_log_stream.txt");
+
+	stream_enc_init(&enc);
+	stream_dec_init(&dec);
+	for (n = 0; n < TEST_COUNT; n++)
+	{
+		test_sample(&in, n);
+		/* Extreme values */
+		if (n == 100)
+		{
+			in.value[AQ_COP]   = INT32_MIN;
+			in.value[AQ_COP_1M] = INT32_MAX;
+		}
+		len = stream_encode(&enc, &in, rec);
+		if (len > STREAM_REC_MAX)
+			goto error;
+		if ((n % STREAM_KEY_PERIOD) == 0)
+		{
+			if ((rec[0] & STREAM_FLAG_KEY) == 0)
+				goto error;
+			key += len;
+		}
+		total += len;
+		if (stream_decode(&dec, rec, len, &out) != 1)
+			goto error;
+		if ((out.seq != n) || (out.time != in.time) ||
+		    memcmp(out.value, in.value, sizeof(in.value)))
+		{
+			printf("Record %d differs\n", n);
+			goto error;
+		}
+	}
+	if ((dec.records != TEST_COUNT) || dec.lost || dec.late || dec.invalid)
+		goto error;
+
+	log_end();
+	printf("(%u bytes/record, key %u) ", (unsigned int)(total / TEST_COUNT),
+	       (unsigned int)(key / ((TEST_COUNT + STREAM_KEY_PERIOD - 1) / STREAM_KEY_PERIOD)));
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_stream.txt");
+	return(-1);
+}
+
+static int test_malformed(void)
+{
+	/* Key record 0 (time 10) then record 1 with a field of a newer firmware */
+	const uint8_t key[]  = { 0x11, 0x00, 0x0A, AQ_INLET_TEMP, 0x3C };
+	const uint8_t next[] = { 0x10, 0x01, 0x0F, 0x7F, 0x02, AQ_INLET_TEMP, 0x01 };
+	struct aquarea_state in, out;
+	uint8_t rec[STREAM_REC_MAX];
+	size_t len, i;
+
+	printf(COLOR_BLUE " * Codec : malformed records " COLOR_NONE);
+
+	log_start("/tmp/ut_log_stream.txt");
+
+	stream_dec_init(&dec);
+	if ((stream_decode(&dec, key, sizeof(key), &out) != 1) ||
+	    (out.time != 10) || (out.value[AQ_INLET_TEMP] != 30))
+		goto error;
+	if ((stream_decode(&dec, next, sizeof(next), &out) != 1) ||
+	    (out.time != 15) || (out.value[AQ_INLET_TEMP] != 29))
+		goto error;
+
+	/* Each truncation of a full record, then a wrong version */
+	stream_enc_init(&enc);
+	test_sample(&in, 1);
+	len = stream_encode(&enc, &in, rec);
+	for (i = 0; i < len; i++)
+	{
+		stream_dec_init(&dec);
+		if (stream_decode(&dec, rec, i, &out) == 1)
+		{
+			/* Only valid when cut between two fields */
+			if (memcmp(out.value, in.value, sizeof(in.value)) == 0)
+				goto error;
+		}
+	}
+	rec[0] = (STREAM_VERSION + 1) << 4;
+	if ((stream_decode(&dec, rec, len, &out) != -1) || (dec.synced))
+		goto error;
+	/* Varint longer than 32 bits */
+	memset(rec, 0xFF, sizeof(rec));
+	rec[0] = (STREAM_VERSION << 4);
+	if (stream_decode(&dec, rec, 12, &out) != -1)
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_stream.txt");
+	return(-1);
+}
+
+static int test_restart(void)
+{
+	struct aquarea_state in, out;
+	uint8_t rec[STREAM_REC_MAX], late[STREAM_REC_MAX];
+	size_t len, late_len = 0;
+	int n, r, pos, at[2] = { 1000, 5 };
+
+	printf(COLOR_BLUE " * Codec : sender restarted " COLOR_NONE);
+
+	log_start("/tmp/ut_log_stream.txt");
+
+	/* Restart with a sequence far behind, then only a few records behind */
+	stream_enc_init(&enc);
+	stream_dec_init(&dec);
+	for (n = 0, pos = 0; n < 2000; n++, pos++)
+	{
+		if ((n == at[0]) || (n == (at[0] + at[1])))
+		{
+			stream_enc_init(&enc);
+			pos = 0;
+		}
+		test_sample(&in, n);
+		len = stream_encode(&enc, &in, rec);
+		r = stream_decode(&dec, rec, len, &out);
+		if ((r != 1) || (out.seq != pos) ||
+		    memcmp(out.value, in.value, sizeof(in.value)))
+		{
+			printf("Record %d not decoded\n", n);
+			goto error;
+		}
+	}
+	if ((dec.restarts != 2) || dec.late || dec.lost || dec.skipped)
+		goto error;
+
+	/* A late key record is not a restart */
+	stream_enc_init(&enc);
+	stream_dec_init(&dec);
+	for (n = 0; n < 30; n++)
+	{
+		test_sample(&in, n);
+		len = stream_encode(&enc, &in, (n == 24) ? late : rec);
+		if (n == 24)
+			late_len = len;
+		else
+			stream_decode(&dec, rec, len, &out);
+	}
+	if ((stream_decode(&dec, late, late_len, &out) != 0) ||
+	    (dec.late != 1) || (dec.restarts != 0))
+		goto error;
+
+	log_end();
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_stream.txt");
+	return(-1);
+}
+/* EOF */
@@ -0,0 +1,175 @@
+/**
+ * @file  test_socket.c
+ * @brief Some tests to verify the decoder with a lossy UDP link
+ *
+ * @author Saint-Genest Gwenael <gwen@agilack.fr>
+ * @copyright Agilack (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "log.h"
+#include "stream_codec.h"
+
+#define TEST_COUNT 240
+
+/* Functions for each sub-test */
+static int test_loss(void);
+
+extern void test_sample(struct aquarea_state *state, int n);
+
+static struct stream_enc enc;
+static struct stream_dec dec;
+static uint8_t rec[TEST_COUNT][STREAM_REC_MAX];
+static size_t  rec_len[TEST_COUNT];
+
+/* Order of records on the link : lost (20, 50, 51, 130), swapped (70-71,
+ * 160-161) and duplicated (100) */
+static int order[TEST_COUNT];
+static int order_count;
+
+/**
+ * @brief Entry point for this group of tests
+ *
+ */
+int test_socket(void)
+{
+	int result = 0;
+
+	/* Lost, late and duplicated records */
+	if (test_loss())
+		result = -1;
+
+	printf("\n");
+
+	return(result);
+}
+
+static int test_loss(void)
+{
+	struct aquarea_state in, out;
+	struct sockaddr_in addr;
+	struct timeval tv;
+	socklen_t alen;
+	uint8_t buf[STREAM_REC_MAX + 1];
+	ssize_t len;
+	int rx = -1, tx = -1;
+	int i, n, run, run_max;
+
+	printf(COLOR_BLUE " * Socket : loss and reorder " COLOR_NONE);
+
+	log_start("/tmp/ut_log_stream.txt");
+
+	/* Encode all records, then make the link order */
+	stream_enc_init(&enc);
+	for (n = 0; n < TEST_COUNT; n++)
+	{
+		test_sample(&in, n);
+		rec_len[n] = stream_encode(&enc, &in, rec[n]);
+	}
+	order_count = 0;
+	for (n = 0; n < TEST_COUNT; n++)
+	{
+		if ((n == 20) || (n == 50) || (n == 51) || (n == 130))
+			continue;
+		if ((n == 70) || (n == 160))
+		{
+			order[order_count++] = n + 1;
+			order[order_count++] = n;
+			n++;
+			continue;
+		}
+		order[order_count++] = n;
+		if (n == 100)
+			order[order_count++] = n;
+	}
+
+	/* Receiver on a local port, sender */
+	rx = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	tx = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if ((rx < 0) || (tx < 0))
+		goto error;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = 0;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	alen = sizeof(addr);
+	if ((bind(rx, (struct sockaddr *)&addr, sizeof(addr)) != 0) ||
+	    (getsockname(rx, (struct sockaddr *)&addr, &alen) != 0))
+		goto error;
+	tv.tv_sec  = 1;
+	tv.tv_usec = 0;
+	setsockopt(rx, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	for (i = 0; i < order_count; i++)
+	{
+		n = order[i];
+		if (sendto(tx, rec[n], rec_len[n], 0, (struct sockaddr *)&addr,
+		           sizeof(addr)) != rec_len[n])
+			goto error;
+	}
+
+	stream_dec_init(&dec);
+	run = run_max = 0;
+	for (i = 0; i < order_count; i++)
+	{
+		len = recv(rx, buf, sizeof(buf), 0);
+		if (len <= 0)
+			goto error;
+		switch (stream_decode(&dec, buf, len, &out))
+		{
+			case 1:
+				test_sample(&in, out.seq);
+				if ((out.time != in.time) ||
+				    memcmp(out.value, in.value, sizeof(in.value)))
+				{
+					printf("Record %u differs\n", (unsigned int)out.seq);
+					goto error;
+				}
+				run = 0;
+				break;
+			case 0:
+				run++;
+				if (run > run_max)
+					run_max = run;
+				break;
+			default:
+				goto error;
+		}
+	}
+	printf("%u decoded, %u lost, %u late, %u skipped\n", dec.records,
+	       dec.lost, dec.late, dec.skipped);
+	/* Decoder waits the next key record after each loss */
+	if ((dec.lost != 4) || (dec.late != 3) || (dec.skipped != 20) ||
+	    (dec.records != 214) || (run_max >= STREAM_KEY_PERIOD))
+		goto error;
+
+	close(rx);
+	close(tx);
+	log_end();
+	printf("(%u of %u decoded) ", dec.records, TEST_COUNT);
+	printf("[" COLOR_GREEN " OK " COLOR_NONE "]\n");
+	return(0);
+
+error:
+	if (rx >= 0)
+		close(rx);
+	if (tx >= 0)
+		close(tx);
+	log_end();
+	printf("[" COLOR_RED "FAIL" COLOR_NONE "]\n");
+	log_dump("/tmp/ut_log_stream.txt");
+	return(-1);
+}
+/* EOF */